@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+/* gcc pairs the malloc in operator new with the free in operator delete and
+ * warns about a mismatch that is not one, since both are replaced here */
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+/* counts every global operator new in the binary that includes this header,
+ * and the bytes asked for. include it from exactly one translation unit */
+static size_t alloc_count = 0;
+static size_t alloc_bytes = 0;
+
+void* operator new(size_t size) {
+    alloc_count++;
+    alloc_bytes += size;
+    void* p = std::malloc(size == 0 ? 1 : size);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+
+void operator delete(void* p, size_t) noexcept { std::free(p); }
@@ -0,0 +1,68 @@
+#include "../src/closure_eval.hh"
+#include "../src/eval.hh"
+#include "../src/lexer.hh"
+#include "../src/object.hh"
+#include "../src/parser.hh"
+#include "../src/resolver.hh"
+#include "alloc_count.hh"
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+/* a balanced tree of integer infix and prefix expressions of the given depth */
+static void integer_tree(std::string& out, int depth, int& n) {
+    static const char* opers[] = {" + ", " - ", " * ", " - "};
+    if (depth == 0) {
+        out.append(std::to_string(++n % 9 + 1));
+        return;
+    }
+    out.append(depth % 3 == 0 ? "-(" : "(");
+    integer_tree(out, depth - 1, n);
+    out.append(opers[depth % 4]);
+    integer_tree(out, depth - 1, n);
+    out.push_back(')');
+}
+
+int main(int argc, char** argv) {
+    int depth = argc > 1 ? std::atoi(argv[1]) : 12;
+    int iterations = argc > 2 ? std::atoi(argv[2]) : 2000;
+    int n = 0;
+    std::string input;
+    integer_tree(input, depth, n);
+
+    Lexer l(input);
+    Parser p(l);
+    Program program = p.parse();
+    auto env = std::make_shared<Environment>();
+    resolve(program, *env);
+    Object res = eval(program, env);
+
+    size_t allocs = alloc_count;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        res = eval(program, env);
+    }
+    auto end = std::chrono::steady_clock::now();
+    allocs = alloc_count - allocs;
+
+    double ns =
+        std::chrono::duration<double, std::nano>(end - start).count() /
+        iterations;
+    std::printf("eval: %d leaves, result %s\n", n, res.inspect().c_str());
+    std::printf("eval: %.0f ns/eval, %.2f allocations/eval\n", ns,
+                (double)allocs / iterations);
+
+    /* the same tree compiled to callables once, up front */
+    ClosureProgram compiled = compile_closures(program);
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        res = eval(compiled, env);
+    }
+    end = std::chrono::steady_clock::now();
+    double closure_ns =
+        std::chrono::duration<double, std::nano>(end - start).count() /
+        iterations;
+    std::printf("closures: result %s, %.0f ns/eval, %.2fx eval\n",
+                res.inspect().c_str(), closure_ns, ns / closure_ns);
+    return 0;
+}
@@ -0,0 +1,173 @@
+#include "../src/flat_ast.hh"
+#include "../src/lexer.hh"
+#include "../src/parser.hh"
+#include "alloc_count.hh"
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+static std::string make_source(size_t bytes) {
+    std::string out;
+    size_t i = 0;
+    while (out.size() < bytes) {
+        std::string n = std::to_string(i);
+        out.append("let f" + n + " = fn(a, b) { if (a < b) { a + b * " + n +
+                   " } else { f" + n + "(b, -a - 1) } };\n");
+        out.append("let x" + n + " = f" + n + "(" + n + ", (1 + 2) * 3);\n");
+        i++;
+    }
+    return out;
+}
+
+static size_t count_tree(const Expression& exp);
+
+static size_t count_tree(const std::vector<Statement>& stmts) {
+    size_t n = 0;
+    for (auto& stmt : stmts) {
+        n++;
+        switch (stmt.type) {
+        case Statement::Type::Let:
+            n += count_tree(std::get<LetStatement>(stmt.data).value);
+            break;
+        case Statement::Type::Ret:
+            n += count_tree(std::get<ReturnStatement>(stmt.data).value);
+            break;
+        case Statement::Type::Expression:
+            n += count_tree(std::get<ExpressionStatement>(stmt.data).exp);
+            break;
+        default:
+            break;
+        }
+    }
+    return n;
+}
+
+static size_t count_tree(const Expression& exp) {
+    switch (exp.type) {
+    case Expression::Type::Prefix:
+        return 1 + count_tree(*std::get<PrefixExpression>(exp.data).right);
+    case Expression::Type::Infix: {
+        auto& infix = std::get<InfixExpression>(exp.data);
+        return 1 + count_tree(*infix.left) + count_tree(*infix.right);
+    }
+    case Expression::Type::If: {
+        auto& ife = std::get<IfExpression>(exp.data);
+        size_t n = 1 + count_tree(*ife.condition) +
+                   count_tree(ife.consequence.stmts);
+        if (ife.alternative.has_value()) {
+            n += count_tree(ife.alternative->stmts);
+        }
+        return n;
+    }
+    case Expression::Type::Function:
+        return 1 + count_tree(std::get<FunctionLiteral*>(exp.data)->body.stmts);
+    case Expression::Type::Call: {
+        auto& call = std::get<CallExpression>(exp.data);
+        size_t n = 1 + count_tree(*call.function);
+        for (auto& arg : call.arguments) {
+            n += count_tree(arg);
+        }
+        return n;
+    }
+    case Expression::Type::Inv:
+        return 0;
+    default:
+        return 1;
+    }
+}
+
+static size_t count_flat(const FlatAst& ast, NodeIndex node) {
+    if (node == FLAT_AST_NONE) {
+        return 0;
+    }
+    size_t i, n = 1;
+    switch (ast.kinds[node]) {
+    case FlatAst::Kind::Prefix:
+    case FlatAst::Kind::Return:
+    case FlatAst::Kind::Expression:
+        return 1 + count_flat(ast, ast.lhs[node]);
+    case FlatAst::Kind::Let:
+        return 1 + count_flat(ast, ast.rhs[node]);
+    case FlatAst::Kind::Infix:
+        return 1 + count_flat(ast, ast.lhs[node]) +
+               count_flat(ast, ast.rhs[node]);
+    case FlatAst::Kind::If: {
+        const uint32_t* blocks = ast.list_items(ast.rhs[node]);
+        return 1 + count_flat(ast, ast.lhs[node]) +
+               count_flat(ast, blocks[0]) + count_flat(ast, blocks[1]);
+    }
+    case FlatAst::Kind::Function:
+        return 1 + count_flat(ast, ast.rhs[node]);
+    case FlatAst::Kind::Call: {
+        size_t len = ast.list_size(ast.rhs[node]);
+        const uint32_t* args = ast.list_items(ast.rhs[node]);
+        n += count_flat(ast, ast.lhs[node]);
+        for (i = 0; i < len; ++i) {
+            n += count_flat(ast, args[i]);
+        }
+        return n;
+    }
+    case FlatAst::Kind::Block: {
+        /* blocks are not nodes in the tree form */
+        size_t len = ast.list_size(ast.lhs[node]);
+        const uint32_t* stmts = ast.list_items(ast.lhs[node]);
+        n = 0;
+        for (i = 0; i < len; ++i) {
+            n += count_flat(ast, stmts[i]);
+        }
+        return n;
+    }
+    default:
+        return 1;
+    }
+}
+
+template <typename F> static double time_ms(F f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+int main(int argc, char** argv) {
+    size_t mb = argc > 1 ? std::atoi(argv[1]) : 8;
+    std::string input = make_source(mb << 20);
+
+    Program program;
+    size_t bytes = alloc_bytes;
+    double tree_parse = time_ms([&] {
+        Lexer l(input);
+        Parser p(l);
+        program = p.parse();
+    });
+    size_t tree_bytes = alloc_bytes - bytes;
+
+    FlatAst ast;
+    bytes = alloc_bytes;
+    double flat_parse = time_ms([&] {
+        Lexer l(input);
+        Parser p(l);
+        ast = p.parse_flat();
+    });
+    size_t flat_bytes = alloc_bytes - bytes;
+
+    size_t tree_nodes = 0, flat_nodes = 0;
+    double tree_walk =
+        time_ms([&] { tree_nodes = count_tree(program.statements); });
+    double flat_walk = time_ms([&] {
+        for (auto stmt : ast.statements) {
+            flat_nodes += count_flat(ast, stmt);
+        }
+    });
+
+    std::printf("input: %zu bytes, %zu nodes (%zu flat)\n", input.size(),
+                tree_nodes, flat_nodes);
+    std::printf("tree: parse %.1f ms, walk %.2f ms, %.1f bytes/node "
+                "allocated\n",
+                tree_parse, tree_walk, (double)tree_bytes / tree_nodes);
+    std::printf("flat: parse %.1f ms, walk %.2f ms, %.1f bytes/node "
+                "allocated, %.1f bytes/node resident\n",
+                flat_parse, flat_walk, (double)flat_bytes / flat_nodes,
+                (double)ast.bytes() / ast.size());
+    return 0;
+}
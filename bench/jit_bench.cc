@@ -0,0 +1,44 @@
+#include "../src/eval.hh"
+#include "../src/jit.hh"
+#include "../src/lexer.hh"
+#include "../src/object.hh"
+#include "../src/parser.hh"
+#include "../src/resolver.hh"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+/* eval with the jit off and on, each run on a freshly parsed program so the
+ * jit starts cold and compiles on the first hot call */
+static double run_ms(const std::string& input, bool jit, Object& res) {
+    jit_enable(jit);
+    Lexer l(input);
+    Parser p(l);
+    Program program = p.parse();
+    auto env = std::make_shared<Environment>();
+    resolve(program, *env);
+    auto start = std::chrono::steady_clock::now();
+    res = eval(program, env);
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+int main(int argc, char** argv) {
+    int n = argc > 1 ? std::atoi(argv[1]) : 27;
+    if (!jit_enable(true)) {
+        std::fprintf(stderr, "no jit on this platform\n");
+        return 1;
+    }
+    std::string input = "let fib = fn(n) { if (n < 2) { n } else {"
+                        " fib(n - 1) + fib(n - 2) } }; fib(" +
+                        std::to_string(n) + ")";
+    Object interpreted, compiled;
+    double eval_ms = run_ms(input, false, interpreted);
+    double jit_ms = run_ms(input, true, compiled);
+    std::printf("fib(%d) = %s / %s\n", n, interpreted.inspect().c_str(),
+                compiled.inspect().c_str());
+    std::printf("eval %.1f ms, jit %.1f ms, %.1fx\n", eval_ms, jit_ms,
+                eval_ms / jit_ms);
+    return 0;
+}
@@ -0,0 +1,80 @@
+#include "../src/lexer.hh"
+#include "../src/scan.hh"
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+/* short names and single spaces, the way people write */
+static std::string make_source(size_t bytes) {
+    std::string out;
+    size_t i = 0;
+    while (out.size() < bytes) {
+        std::string n = std::to_string(i * 7919);
+        out.append("let fibonacci_" + n + " = fn(n, acc) {\n"
+                   "    if (n < 2) { return acc; }\n"
+                   "    let next = fibonacci_" + n + "(n - 1, acc * " + n +
+                   ");\n"
+                   "    if (next != " + n + ") { next } else { !true }\n"
+                   "};\n");
+        i++;
+    }
+    return out;
+}
+
+/* deep indentation and long names, the way generators write */
+static std::string make_generated_source(size_t bytes) {
+    std::string out;
+    size_t i = 0;
+    while (out.size() < bytes) {
+        std::string n = std::to_string(i * 7919);
+        std::string indent((i % 12 + 1) * 4, ' ');
+        out.append(indent + "let generated_module_binding_value_" + n +
+                   " = generated_module_helper_function_argument_" + n +
+                   " + 1234567890123;\n");
+        i++;
+    }
+    return out;
+}
+
+static void run(const char* name, const std::string& input, int iterations) {
+    size_t tokens = 0;
+    int64_t sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        Lexer l(input);
+        Token tok;
+        while ((tok = l.next_token()).type != Token::Type::Eof) {
+            tokens++;
+            sum += (int64_t)tok.type;
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    double s = std::chrono::duration<double>(end - start).count();
+    std::printf("%-10s %8.0f MB/s %8.1f ns/token (checksum %lld)\n", name,
+                (double)input.size() * iterations / s / (1 << 20),
+                s * 1e9 / tokens, (long long)sum);
+}
+
+int main(int argc, char** argv) {
+    size_t mb = argc > 1 ? std::atoi(argv[1]) : 64;
+    int iterations = argc > 2 ? std::atoi(argv[2]) : 5;
+    std::string written = make_source(mb << 20);
+    std::string generated = make_generated_source(mb << 20);
+    const struct {
+        ScanImpl impl;
+        const char* name;
+    } impls[] = {
+        {ScanImpl::Scalar, "scalar"},
+        {ScanImpl::Sse2, "sse2"},
+        {ScanImpl::Avx2, "avx2"},
+    };
+    for (auto& impl : impls) {
+        if (!scan_use(impl.impl)) {
+            continue;
+        }
+        std::printf("%s:\n", impl.name);
+        run("written", written, iterations);
+        run("generated", generated, iterations);
+    }
+    return 0;
+}
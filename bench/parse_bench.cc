@@ -0,0 +1,139 @@
+#include "../src/lexer.hh"
+#include "../src/parser.hh"
+#include "../src/token_buffer.hh"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+/* blocks nested depth deep, alternating if blocks and function bodies */
+static std::string nested(int depth) {
+    std::string out;
+    int i;
+    for (i = 0; i < depth; ++i) {
+        out.append(i % 2 ? "if (x < 1) { let x = x + 1; "
+                         : "fn(x) { let y = x; ");
+    }
+    out.append("x");
+    for (i = 0; i < depth; ++i) {
+        out.append(" }");
+    }
+    return out;
+}
+
+/* count copies of a flat statement list */
+static std::string repeated(int count) {
+    std::string out;
+    int i;
+    for (i = 0; i < count; ++i) {
+        out.append("let a = fn(x, y) { if (x < y) { x } else { y } };\n");
+    }
+    return out;
+}
+
+static double parse_ns(const std::string& input, int iterations) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        Lexer l(input);
+        Parser p(l);
+        p.set_max_depth(SIZE_MAX);
+        Program program = p.parse();
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() /
+           iterations;
+}
+
+/* a library of count functions with bodies of a few statements each */
+static std::string library(int count) {
+    std::string out;
+    int i;
+    for (i = 0; i < count; ++i) {
+        out.append("let f = fn(a, b) { let c = a * b + 1; if (c > a) { "
+                   "return c - b; } let d = fn(x) { x + c }; d(a) };\n");
+    }
+    return out;
+}
+
+/* ns per parse and arena bytes, parsing input from a token buffer with
+ * function bodies parsed up front or skipped */
+static void library_parse(const TokenBuffer& tokens, bool lazy,
+                          int iterations, double& ns, size_t& bytes) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        Parser p(tokens);
+        p.set_lazy(lazy);
+        Program program = p.parse();
+        bytes = program.arena->bytes_allocated();
+    }
+    auto end = std::chrono::steady_clock::now();
+    ns = std::chrono::duration<double, std::nano>(end - start).count() /
+         iterations;
+}
+
+/* ns per byte to lex input into a token buffer, and to parse from that
+ * buffer once it is built */
+static void buffered_ns(const std::string& input, int iterations,
+                        double& lex, double& parse) {
+    lex = 0;
+    parse = 0;
+    for (int i = 0; i < iterations; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        TokenBuffer tokens(input);
+        auto lexed = std::chrono::steady_clock::now();
+        Parser p(tokens);
+        p.set_max_depth(SIZE_MAX);
+        Program program = p.parse();
+        auto end = std::chrono::steady_clock::now();
+        lex += std::chrono::duration<double, std::nano>(lexed - start).count();
+        parse += std::chrono::duration<double, std::nano>(end - lexed).count();
+    }
+    lex /= (double)iterations * input.size();
+    parse /= (double)iterations * input.size();
+}
+
+/* parse time should grow linearly with both nesting depth and input size,
+ * so ns/byte stays flat down each column */
+int main(int argc, char** argv) {
+    int iterations = argc > 1 ? std::atoi(argv[1]) : 20;
+    int n;
+    std::printf("%8s %12s %12s %10s\n", "depth", "bytes", "ns/parse",
+                "ns/byte");
+    for (n = 64; n <= 2048; n *= 2) {
+        std::string input = nested(n);
+        double ns = parse_ns(input, iterations);
+        std::printf("%8d %12zu %12.0f %10.2f\n", n, input.size(), ns,
+                    ns / input.size());
+    }
+    std::printf("\n%8s %12s %12s %10s\n", "stmts", "bytes", "ns/parse",
+                "ns/byte");
+    for (n = 1024; n <= 65536; n *= 4) {
+        std::string input = repeated(n);
+        double ns = parse_ns(input, iterations);
+        std::printf("%8d %12zu %12.0f %10.2f\n", n, input.size(), ns,
+                    ns / input.size());
+    }
+    std::printf("\n%8s %12s %12s %12s %12s\n", "stmts", "bytes", "streamed",
+                "buffer lex", "buffer parse");
+    for (n = 1024; n <= 65536; n *= 4) {
+        std::string input = repeated(n);
+        double streamed = parse_ns(input, iterations) / input.size();
+        double lex, parse;
+        buffered_ns(input, iterations, lex, parse);
+        std::printf("%8d %12zu %12.2f %12.2f %12.2f\n", n, input.size(),
+                    streamed, lex, parse);
+    }
+    std::printf("\n%8s %12s %12s %12s %12s\n", "fns", "eager ns",
+                "lazy ns", "eager bytes", "lazy bytes");
+    for (n = 1024; n <= 16384; n *= 4) {
+        std::string input = library(n);
+        TokenBuffer tokens(input);
+        double eager_ns, lazy_ns;
+        size_t eager_bytes, lazy_bytes;
+        library_parse(tokens, false, iterations, eager_ns, eager_bytes);
+        library_parse(tokens, true, iterations, lazy_ns, lazy_bytes);
+        std::printf("%8d %12.0f %12.0f %12zu %12zu\n", n, eager_ns, lazy_ns,
+                    eager_bytes, lazy_bytes);
+    }
+    return 0;
+}
@@ -0,0 +1,51 @@
+#include "../src/lexer.hh"
+#include "../src/parser.hh"
+#include "../src/token_pipe.hh"
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+static std::string make_source(size_t bytes) {
+    std::string out;
+    size_t i = 0;
+    while (out.size() < bytes) {
+        std::string n = std::to_string(i);
+        out.append("let f" + n + " = fn(a, b) { if (a < b) { a + b * " + n +
+                   " } else { f" + n + "(b, -a - 1) } };\n");
+        i++;
+    }
+    return out;
+}
+
+template <typename F> static double time_ms(F f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+/* front end wall time with the lexer running inline in the parser's thread
+ * against running ahead of it on a token pipe. parses into the flat layout
+ * so the tree for a large input fits in memory */
+int main(int argc, char** argv) {
+    size_t mb = argc > 1 ? std::atoi(argv[1]) : 100;
+    std::string input = make_source(mb << 20);
+    size_t nodes = 0;
+    std::printf("%zu bytes, %u hardware threads\n", input.size(),
+                std::thread::hardware_concurrency());
+    double inline_ms = time_ms([&] {
+        Lexer l(input);
+        Parser p(l);
+        nodes = p.parse_flat().size();
+    });
+    std::printf("%10s %10.1f ms %8zu nodes\n", "inline", inline_ms, nodes);
+    double piped_ms = time_ms([&] {
+        TokenPipe pipe(input);
+        Parser p(pipe);
+        nodes = p.parse_flat().size();
+    });
+    std::printf("%10s %10.1f ms %8zu nodes %6.2fx\n", "pipelined", piped_ms,
+                nodes, inline_ms / piped_ms);
+    return 0;
+}
@@ -0,0 +1,75 @@
+#include "../src/compiler.hh"
+#include "../src/eval.hh"
+#include "../src/lexer.hh"
+#include "../src/object.hh"
+#include "../src/parser.hh"
+#include "../src/reg_vm.hh"
+#include "../src/resolver.hh"
+#include "../src/vm.hh"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+/* integer heavy recursion: calls, comparisons and arithmetic on locals */
+static const char* programs[] = {
+    "let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + fib(n - 2) } };"
+    "fib(%d)",
+    "let sum = fn(n, acc) { if (n == 0) { acc } else { let sq = n * n;"
+    " sum(n - 1, acc + sq / 2 - n) } };"
+    "let loop = fn(i, acc) { if (i == 0) { acc } else {"
+    " loop(i - 1, acc + sum(%d, 0)) } }; loop(200, 0)",
+};
+
+template <typename F> static double time_ms(int iterations, F f) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        f();
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count() /
+           iterations;
+}
+
+/* runs each program on the evaluator, the stack vm and the register vm.
+ * compiling is left out of the vm times, as resolving is out of eval's */
+int main(int argc, char** argv) {
+    int n = argc > 1 ? std::atoi(argv[1]) : 22;
+    int iterations = argc > 2 ? std::atoi(argv[2]) : 5;
+    std::printf("%-6s %12s %12s %12s %8s %8s\n", "prog", "eval ms", "vm ms",
+                "reg vm ms", "vs eval", "vs vm");
+    for (size_t i = 0; i < sizeof programs / sizeof programs[0]; ++i) {
+        char buf[512];
+        std::snprintf(buf, sizeof buf, programs[i], n);
+        std::string input = buf;
+        Lexer l(input);
+        Parser p(l);
+        Program program = p.parse();
+        auto env = std::make_shared<Environment>();
+        resolve(program, *env);
+        Compiler c;
+        c.compile(program);
+        RegCompiler rc;
+        rc.compile(program);
+        Object res, vm_res, reg_res;
+        double eval_ms =
+            time_ms(iterations, [&] { res = eval(program, env); });
+        double vm_ms = time_ms(iterations, [&] {
+            VM vm(c.bytecode());
+            vm_res = vm.run();
+        });
+        double reg_ms = time_ms(iterations, [&] {
+            RegVM vm(rc.bytecode());
+            reg_res = vm.run();
+        });
+        if (res != vm_res || res != reg_res) {
+            std::fprintf(stderr, "results differ: %s %s %s\n",
+                         res.inspect().c_str(), vm_res.inspect().c_str(),
+                         reg_res.inspect().c_str());
+            return 1;
+        }
+        std::printf("%-6zu %12.2f %12.2f %12.2f %7.2fx %7.2fx\n", i, eval_ms,
+                    vm_ms, reg_ms, eval_ms / reg_ms, vm_ms / reg_ms);
+    }
+    return 0;
+}
@@ -0,0 +1,84 @@
+#include "../src/ast_cache.hh"
+#include "../src/lexer.hh"
+#include "../src/parser.hh"
+#include "../src/source.hh"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+
+/* a library of count functions, like a script that defines many helpers
+ * before doing a little work with them */
+static std::string library(int count) {
+    std::string out;
+    int i;
+    for (i = 0; i < count; ++i) {
+        out.append("let f = fn(a, b) { let c = a * b + 1; if (c > a) { "
+                   "return c - b; } let d = fn(x) { x + c }; d(a) };\n");
+    }
+    out.append("f(1, 2)\n");
+    return out;
+}
+
+template <typename F> static double time_us(int iterations, F f) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        f();
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(end - start).count() /
+           iterations;
+}
+
+/* the time from a script on disk to a program ready to resolve, parsing the
+ * script against loading its cached parse. both map the script, since a
+ * cache is only used once the script's hash shows it is current */
+int main(int argc, char** argv) {
+    int iterations = argc > 1 ? std::atoi(argv[1]) : 20;
+    char dir[] = "/tmp/monkey_startup_XXXXXX";
+    if (mkdtemp(dir) == nullptr) {
+        std::perror("mkdtemp");
+        return 1;
+    }
+    std::string script = std::string(dir) + "/script.mk";
+    std::printf("%8s %10s %10s %12s %12s %8s\n", "fns", "src bytes",
+                "ast bytes", "parse us", "cache us", "speedup");
+    for (int n = 256; n <= 65536; n *= 4) {
+        std::string err, text = library(n);
+        if (!write_ast_cache(script, text, err)) {
+            std::fprintf(stderr, "%s\n", err.c_str());
+            return 1;
+        }
+        auto source = Source::map_file(script, err);
+        SourceStamp stamp = source_stamp(*source);
+        Lexer l(*source);
+        Parser p(l);
+        std::string data = encode_ast(p.parse_flat(), stamp);
+        std::string cache = ast_cache_path(dir, stamp.hash);
+        if (!write_ast_cache(cache, data, err)) {
+            std::fprintf(stderr, "%s\n", err.c_str());
+            return 1;
+        }
+        double parse_us = time_us(iterations, [&] {
+            auto source = Source::map_file(script, err);
+            Lexer l(*source);
+            Parser p(l);
+            Program program = p.parse();
+        });
+        double cache_us = time_us(iterations, [&] {
+            auto source = Source::map_file(script, err);
+            Program program;
+            if (!load_ast_cache(cache, source_stamp(*source), program, err)) {
+                std::fprintf(stderr, "%s\n", err.c_str());
+                std::exit(1);
+            }
+        });
+        std::printf("%8d %10zu %10zu %12.0f %12.0f %7.2fx\n", n, text.size(),
+                    data.size(), parse_us, cache_us, parse_us / cache_us);
+        unlink(cache.c_str());
+    }
+    unlink(script.c_str());
+    rmdir(dir);
+    return 0;
+}
@@ -0,0 +1,42 @@
+#include "../src/thread_pool.hh"
+#include "../src/tokenize.hh"
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+static std::string make_source(size_t bytes) {
+    std::string out;
+    size_t i = 0;
+    while (out.size() < bytes) {
+        std::string n = std::to_string(i);
+        out.append("let f" + n + " = fn(a, b) { if (a < b) { a + b * " + n +
+                   " } else { f" + n + "(b, -a - 1) } };\n");
+        i++;
+    }
+    return out;
+}
+
+template <typename F> static double time_ms(F f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+int main(int argc, char** argv) {
+    size_t mb = argc > 1 ? std::atoi(argv[1]) : 64;
+    std::string input = make_source(mb << 20);
+    size_t tokens = 0;
+    double base = time_ms([&] { tokens = tokenize(input).size(); });
+    std::printf("%zu bytes, %zu tokens, %u hardware threads\n", input.size(),
+                tokens, std::thread::hardware_concurrency());
+    std::printf("%8s %10.1f ms\n", "serial", base);
+    for (size_t n = 1; n <= 16; n *= 2) {
+        ThreadPool pool(n);
+        double ms =
+            time_ms([&] { tokens = tokenize_parallel(input, pool).size(); });
+        std::printf("%5zu thr %10.1f ms %6.2fx\n", n, ms, base / ms);
+    }
+    return 0;
+}
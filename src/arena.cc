@@ -0,0 +1,69 @@
+#include "arena.hh"
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+Arena::Arena()
+    : cur(nullptr), end(nullptr), next_block_size(ARENA_MIN_BLOCK_SIZE),
+      allocated(0), destructors(nullptr) {}
+
+Arena::~Arena() { reset(); }
+
+void* Arena::allocate(size_t size, size_t align) {
+    uintptr_t p = ((uintptr_t)cur + align - 1) & ~(uintptr_t)(align - 1);
+    if (cur == nullptr || p + size > (uintptr_t)end) {
+        /* blocks double in size so small trees stay small */
+        size_t block_size = size + align > next_block_size ? size + align
+                                                            : next_block_size;
+        if (next_block_size < ARENA_MAX_BLOCK_SIZE) {
+            next_block_size *= 2;
+        }
+        char* block = (char*)std::malloc(block_size);
+        if (block == nullptr) {
+            throw std::bad_alloc();
+        }
+        blocks.push_back(block);
+        cur = block;
+        end = block + block_size;
+        p = ((uintptr_t)cur + align - 1) & ~(uintptr_t)(align - 1);
+    }
+    cur = (char*)(p + size);
+    allocated += size;
+    return (void*)p;
+}
+
+std::string_view Arena::copy(std::string_view s) {
+    char* mem = (char*)allocate(s.size(), 1);
+    std::memcpy(mem, s.data(), s.size());
+    return std::string_view(mem, s.size());
+}
+
+void Arena::adopt(std::shared_ptr<Arena> other) {
+    if (other.get() != this) {
+        adopted.push_back(std::move(other));
+    }
+}
+
+void Arena::reset() {
+    while (destructors != nullptr) {
+        Destructor* d = destructors;
+        destructors = d->next;
+        d->fn(d->obj);
+    }
+    for (auto block : blocks) {
+        std::free(block);
+    }
+    blocks.clear();
+    adopted.clear();
+    cur = nullptr;
+    end = nullptr;
+    next_block_size = ARENA_MIN_BLOCK_SIZE;
+    allocated = 0;
+}
+
+size_t Arena::bytes_allocated() { return allocated; }
+
+void Arena::add_destructor(void* obj, void (*fn)(void*)) {
+    void* mem = allocate(sizeof(Destructor), alignof(Destructor));
+    destructors = new (mem) Destructor{obj, fn, destructors};
+}
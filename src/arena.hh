@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#define ARENA_MIN_BLOCK_SIZE 1024
+#define ARENA_MAX_BLOCK_SIZE (64 * 1024)
+
+/* a bump allocator. objects made in an arena live until the arena is reset
+ * or destroyed, at which point every destructor runs, newest first, and the
+ * memory is released a block at a time */
+class Arena : public std::enable_shared_from_this<Arena> {
+  public:
+    Arena();
+    ~Arena();
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    template <typename T, typename... Args> T* make(Args&&... args) {
+        void* mem = allocate(sizeof(T), alignof(T));
+        T* obj = new (mem) T(std::forward<Args>(args)...);
+        if constexpr (!std::is_trivially_destructible_v<T>) {
+            add_destructor(obj, [](void* p) { static_cast<T*>(p)->~T(); });
+        }
+        return obj;
+    }
+
+    void* allocate(size_t size, size_t align);
+    /* a copy of s that lives as long as the arena */
+    std::string_view copy(std::string_view s);
+    /* keeps other alive until this arena is reset or destroyed, so objects
+     * made in other live at least as long as ones made here */
+    void adopt(std::shared_ptr<Arena> other);
+    void reset();
+    size_t bytes_allocated();
+
+  private:
+    struct Destructor {
+        void* obj;
+        void (*fn)(void*);
+        Destructor* next;
+    };
+    std::vector<char*> blocks;
+    std::vector<std::shared_ptr<Arena>> adopted;
+    char* cur;
+    char* end;
+    size_t next_block_size;
+    size_t allocated;
+    Destructor* destructors;
+    void add_destructor(void* obj, void (*fn)(void*));
+};
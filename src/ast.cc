@@ -4,67 +4,80 @@
 
 Statement::Statement() : type(Statement::Type::Inv), data(std::monostate()) {}
 
-LetStatement::LetStatement(Token tok, Identifier name, Expression& value)
-    : tok(tok), name(name), value(value) {}
+LetStatement::LetStatement(Token tok, Identifier name, Expression value)
+    : tok(tok), name(std::move(name)), value(std::move(value)) {}
 
-ReturnStatement::ReturnStatement(Token tok, Expression& value)
-    : tok(tok), value(value) {}
+ReturnStatement::ReturnStatement(Token tok, Expression value)
+    : tok(tok), value(std::move(value)) {}
 
 ExpressionStatement::ExpressionStatement(Token tok, Expression e)
-    : tok(tok), exp(e) {}
+    : tok(tok), exp(std::move(e)) {}
 
 Expression::Expression() : type(Expression::Type::Inv) {}
 
 Expression::Expression(Expression::Type type, ExpressionVariant data)
-    : type(type), data(data) {}
+    : type(type), data(std::move(data)) {}
 
-Identifier::Identifier(Token tok, std::shared_ptr<std::string> value)
-    : tok(tok), value(value) {}
+Identifier::Identifier(Token tok, SymbolId symbol)
+    : tok(tok), symbol(symbol), value(symbol_name(symbol)), depth(-1),
+      slot(-1) {}
 
-IntegerLiteral::IntegerLiteral(Token tok, int64_t value)
-    : tok(tok), value(value) {}
+IntegerLiteral::IntegerLiteral(Token tok, int64_t value,
+                               std::string_view literal)
+    : tok(tok), value(value), literal(literal) {}
 
 BooleanLiteral::BooleanLiteral(Token tok, bool value)
     : tok(tok), value(value) {}
 
 PrefixExpression::PrefixExpression(Token tok, PrefixExpression::Operator oper,
-                                   Expression& right)
-    : tok(tok), oper(oper), right(std::make_shared<Expression>(right)) {}
+                                   Expression* right)
+    : tok(tok), oper(oper), right(right) {}
 
 InfixExpression::InfixExpression(Token tok, InfixExpression::Operator oper,
-                                 Expression& left, Expression& right)
-    : tok(tok), oper(oper), left(std::make_shared<Expression>(left)),
-      right(std::make_shared<Expression>(right)) {}
+                                 Expression* left, Expression* right)
+    : tok(tok), oper(oper), left(left), right(right) {}
 
 BlockStatement::BlockStatement()
     : tok(Token()), stmts(std::vector<Statement>()) {}
 
-BlockStatement::BlockStatement(Token tok, std::vector<Statement>& stmts)
-    : tok(tok), stmts(stmts) {}
-
-IfExpression::IfExpression(Token tok, Expression& condition,
-                           BlockStatement& consequence,
-                           std::optional<BlockStatement>& alternative)
-    : tok(tok), condition(std::make_shared<Expression>(condition)),
-      consequence(consequence), alternative(alternative) {}
-
-FunctionLiteral::FunctionLiteral(Token tok, std::vector<Identifier>& params,
-                                 BlockStatement& body)
-    : tok(tok), params(params), body(body) {}
+BlockStatement::BlockStatement(Token tok, std::vector<Statement> stmts)
+    : tok(tok), stmts(std::move(stmts)) {}
+
+IfExpression::IfExpression(Token tok, Expression* condition,
+                           BlockStatement consequence,
+                           std::optional<BlockStatement> alternative)
+    : tok(tok), condition(condition), consequence(std::move(consequence)),
+      alternative(std::move(alternative)) {}
+
+LazyBody::LazyBody(const TokenBuffer* tokens, size_t begin, size_t end,
+                   std::string_view text)
+    : tokens(tokens), begin(begin), end(end), text(text), parsed(false),
+      resolved(false) {}
+
+FunctionLiteral::FunctionLiteral(Token tok, std::vector<Identifier> params,
+                                 BlockStatement body, Arena* arena,
+                                 LazyBody* lazy)
+    : tok(tok), params(std::move(params)), body(std::move(body)),
+      num_slots(this->params.size()), arena(arena), lazy(lazy),
+      code(nullptr), calls(0), jit(nullptr) {}
+
+bool FunctionLiteral::body_parsed() const {
+    return lazy == nullptr || lazy->parsed.load(std::memory_order_acquire);
+}
 
-CallExpression::CallExpression(Token tok, Expression& function,
-                               std::vector<Expression>& arguments)
-    : tok(tok), function(std::make_shared<Expression>(function)),
-      arguments(arguments) {}
+CallExpression::CallExpression(Token tok, Expression* function,
+                               std::vector<Expression> arguments)
+    : tok(tok), function(function), arguments(std::move(arguments)),
+      tail(false) {}
 
-const char* Program::token_literal() {
-    if (statements.size() < 0) {
-        return nullptr;
+std::string_view Program::token_literal() const {
+    if (statements.empty()) {
+        return "";
     }
     return statements[0].token_literal();
 }
 
-const char* Statement::token_literal() {
+std::string_view Statement::token_literal() const {
     switch (type) {
     case Type::Let:
         return std::get<LetStatement>(data).token_literal();
@@ -79,11 +92,15 @@ const char* Statement::token_literal() {
     return "";
 }
 
-const char* LetStatement::token_literal() { return tok.get_literal(); }
+std::string_view LetStatement::token_literal() const {
+    return token_type_literal(tok.type);
+}
 
-const char* ReturnStatement::token_literal() { return tok.get_literal(); }
+std::string_view ReturnStatement::token_literal() const {
+    return token_type_literal(tok.type);
+}
 
-const char* Expression::token_literal() {
+std::string_view Expression::token_literal() const {
     switch (type) {
     case Type::Identifier:
         return std::get<Identifier>(data).token_literal();
@@ -98,7 +115,7 @@ const char* Expression::token_literal() {
     case Type::If:
         return std::get<IfExpression>(data).token_literal();
     case Type::Function:
-        return std::get<FunctionLiteral>(data).token_literal();
+        return std::get<FunctionLiteral*>(data)->token_literal();
     case Type::Call:
         return std::get<CallExpression>(data).token_literal();
     default:
@@ -107,27 +124,45 @@ const char* Expression::token_literal() {
     return "";
 }
 
-const char* ExpressionStatement::token_literal() { return tok.get_literal(); }
+std::string_view ExpressionStatement::token_literal() const {
+    return token_type_literal(tok.type);
+}
 
-const char* Identifier::token_literal() { return tok.get_literal(); }
+std::string_view Identifier::token_literal() const { return value; }
 
-const char* IntegerLiteral::token_literal() { return tok.get_literal(); }
+std::string_view IntegerLiteral::token_literal() const {
+    return literal;
+}
 
-const char* BooleanLiteral::token_literal() { return tok.get_literal(); }
+std::string_view BooleanLiteral::token_literal() const {
+    return token_type_literal(tok.type);
+}
 
-const char* PrefixExpression::token_literal() { return tok.get_literal(); }
+std::string_view PrefixExpression::token_literal() const {
+    return token_type_literal(tok.type);
+}
 
-const char* InfixExpression::token_literal() { return tok.get_literal(); }
+std::string_view InfixExpression::token_literal() const {
+    return token_type_literal(tok.type);
+}
 
-const char* BlockStatement::token_literal() { return tok.get_literal(); }
+std::string_view BlockStatement::token_literal() const {
+    return token_type_literal(tok.type);
+}
 
-const char* IfExpression::token_literal() { return tok.get_literal(); }
+std::string_view IfExpression::token_literal() const {
+    return token_type_literal(tok.type);
+}
 
-const char* FunctionLiteral::token_literal() { return tok.get_literal(); }
+std::string_view FunctionLiteral::token_literal() const {
+    return token_type_literal(tok.type);
+}
 
-const char* CallExpression::token_literal() { return tok.get_literal(); }
+std::string_view CallExpression::token_literal() const {
+    return token_type_literal(tok.type);
+}
 
-std::string Program::string() {
+std::string Program::string() const {
     std::string res;
     for (auto& stmt : statements) {
         res.append(stmt.string());
@@ -135,7 +170,7 @@ std::string Program::string() {
     return res;
 }
 
-std::string Statement::string() {
+std::string Statement::string() const {
     switch (type) {
     case Type::Let:
         return std::get<LetStatement>(data).string();
@@ -150,9 +185,10 @@ std::string Statement::string() {
     return "";
 }
 
-std::string LetStatement::string() {
+std::string LetStatement::string() const {
     std::string res;
     res.append(token_literal());
+    res.push_back(' ');
     res.append(name.string());
     res.append(" = ");
     if (value.type != Expression::Type::Inv) {
@@ -162,7 +198,7 @@ std::string LetStatement::string() {
     return res;
 }
 
-std::string ReturnStatement::string() {
+std::string ReturnStatement::string() const {
     std::string res;
     res.append(token_literal());
     res.append(" ");
@@ -173,14 +209,14 @@ std::string ReturnStatement::string() {
     return res;
 }
 
-std::string ExpressionStatement::string() {
+std::string ExpressionStatement::string() const {
     if (exp.type == Expression::Type::Inv) {
         return "";
     }
     return exp.string();
 }
 
-std::string Expression::string() {
+std::string Expression::string() const {
     switch (type) {
     case Type::Identifier:
         return std::get<Identifier>(data).string();
@@ -195,7 +231,7 @@ std::string Expression::string() {
     case Type::If:
         return std::get<IfExpression>(data).string();
     case Type::Function:
-        return std::get<FunctionLiteral>(data).string();
+        return std::get<FunctionLiteral*>(data)->string();
     case Type::Call:
         return std::get<CallExpression>(data).string();
     default:
@@ -203,13 +239,15 @@ std::string Expression::string() {
     }
 }
 
-std::string Identifier::string() { return *value; }
+std::string Identifier::string() const { return std::string(value); }
 
-std::string IntegerLiteral::string() { return token_literal(); }
+std::string IntegerLiteral::string() const { return std::string(literal); }
 
-std::string BooleanLiteral::string() { return token_literal(); }
+std::string BooleanLiteral::string() const {
+    return value ? "true" : "false";
+}
 
-std::string PrefixExpression::string() {
+std::string PrefixExpression::string() const {
     std::string res;
     res.push_back('(');
     res.append(prefix_oper_to_string(oper));
@@ -218,7 +256,7 @@ std::string PrefixExpression::string() {
     return res;
 }
 
-std::string InfixExpression::string() {
+std::string InfixExpression::string() const {
     std::string res;
     res.push_back('(');
     res.append(left->string());
@@ -230,7 +268,7 @@ std::string InfixExpression::string() {
     return res;
 }
 
-std::string BlockStatement::string() {
+std::string BlockStatement::string() const {
     std::string res;
     for (auto& stmt : stmts) {
         res.append(stmt.string());
@@ -238,7 +276,7 @@ std::string BlockStatement::string() {
     return res;
 }
 
-std::string IfExpression::string() {
+std::string IfExpression::string() const {
     std::string res;
     res.append("if");
     res.append(condition->string());
@@ -251,23 +289,24 @@ std::string IfExpression::string() {
     return res;
 }
 
-std::string FunctionLiteral::string() {
+std::string FunctionLiteral::string() const {
     std::string res;
     size_t i, len = params.size();
     res.append(token_literal());
-    res.push_back(')');
+    res.push_back('(');
     for (i = 0; i < len; ++i) {
         res.append(params[i].string());
         if (i != len - 1) {
             res.append(", ");
         }
     }
-    res.push_back(')');
-    res.append(body.string());
+    res.append(") ");
+    /* a body not parsed yet prints as its source */
+    res.append(body_parsed() ? body.string() : std::string(lazy->text));
     return res;
 }
 
-std::string CallExpression::string() {
+std::string CallExpression::string() const {
     std::string res;
     size_t i, len = arguments.size();
     res.append(function->string());
@@ -1,41 +1,60 @@
 #pragma once
 
+#include "arena.hh"
+#include "intern.hh"
 #include "token.hh"
+#include <atomic>
 #include <cstdint>
 #include <memory>
 #include <optional>
 #include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
 #include <variant>
 #include <vector>
 
+/* nodes own their children, so they move but never copy. a copy of a block
+ * would copy every statement under it */
 class Node {
   public:
-    virtual const char* token_literal() = 0;
-    virtual std::string string() = 0;
+    Node() = default;
+    Node(const Node&) = delete;
+    Node& operator=(const Node&) = delete;
+    Node(Node&&) = default;
+    Node& operator=(Node&&) = default;
+    virtual std::string_view token_literal() const = 0;
+    virtual std::string string() const = 0;
 };
 
 struct Identifier : Node {
     Token tok; /* the Ident token */
-    std::shared_ptr<std::string> value;
-    Identifier(Token tok, std::shared_ptr<std::string> value);
-    const char* token_literal() override;
-    std::string string() override;
+    SymbolId symbol;
+    std::string_view value; /* the interned text of symbol */
+    /* lexical address set by the resolver: the number of function scopes
+     * out from the use and the slot in that scope, -1 if unbound */
+    int depth;
+    int slot;
+    Identifier(Token tok, SymbolId symbol);
+    std::string_view token_literal() const override;
+    std::string string() const override;
 };
 
 struct IntegerLiteral : Node {
     Token tok; /* the Int token */
     int64_t value;
-    IntegerLiteral(Token tok, int64_t value);
-    const char* token_literal() override;
-    std::string string() override;
+    std::string_view literal; /* the digits, copied into the arena */
+    IntegerLiteral(Token tok, int64_t value, std::string_view literal);
+    std::string_view token_literal() const override;
+    std::string string() const override;
 };
 
 struct BooleanLiteral : Node {
     Token tok;
     bool value;
     BooleanLiteral(Token tok, bool value);
-    const char* token_literal() override;
-    std::string string() override;
+    std::string_view token_literal() const override;
+    std::string string() const override;
 };
 
 struct PrefixExpression : Node {
@@ -44,11 +63,11 @@ struct PrefixExpression : Node {
         Bang,
         Minus,
     } oper;
-    std::shared_ptr<struct Expression> right;
+    struct Expression* right;
     PrefixExpression(Token tok, PrefixExpression::Operator oper,
-                     struct Expression& right);
-    const char* token_literal() override;
-    std::string string() override;
+                     struct Expression* right);
+    std::string_view token_literal() const override;
+    std::string string() const override;
 };
 
 struct InfixExpression : Node {
@@ -63,57 +82,96 @@ struct InfixExpression : Node {
         Eq,
         NotEq,
     } oper;
-    std::shared_ptr<Expression> left;
-    std::shared_ptr<Expression> right;
-    InfixExpression(Token tok, Operator oper, Expression& left,
-                    Expression& right);
-    const char* token_literal() override;
-    std::string string() override;
+    Expression* left;
+    Expression* right;
+    InfixExpression(Token tok, Operator oper, Expression* left,
+                    Expression* right);
+    std::string_view token_literal() const override;
+    std::string string() const override;
 };
 
 struct BlockStatement : Node {
     Token tok; /* the { token */
     std::vector<struct Statement> stmts;
     BlockStatement();
-    BlockStatement(Token tok, std::vector<struct Statement>& stmts);
-    const char* token_literal() override;
-    std::string string() override;
+    BlockStatement(Token tok, std::vector<struct Statement> stmts);
+    std::string_view token_literal() const override;
+    std::string string() const override;
 };
 
 struct IfExpression : Node {
     Token tok; /* if token */
-    std::shared_ptr<Expression> condition;
+    Expression* condition;
     BlockStatement consequence;
     std::optional<BlockStatement> alternative;
-    IfExpression(Token tok, Expression& condition, BlockStatement& consequence,
-                 std::optional<BlockStatement>& alternative);
-    const char* token_literal() override;
-    std::string string() override;
+    IfExpression(Token tok, Expression* condition, BlockStatement consequence,
+                 std::optional<BlockStatement> alternative);
+    std::string_view token_literal() const override;
+    std::string string() const override;
+};
+
+struct TokenBuffer;
+
+/* a function body skipped by a lazy parser. it is parsed from tokens[begin,
+ * end) the first time it is needed, and resolved the first time it is
+ * called against the local scopes the resolver saw around the literal */
+struct LazyBody {
+    const TokenBuffer* tokens;
+    size_t begin;          /* the { */
+    size_t end;            /* one past the } */
+    std::string_view text; /* the body's source, braces included */
+    std::atomic<bool> parsed;
+    std::atomic<bool> resolved;
+    std::vector<std::string> errors; /* from parsing the body */
+    std::vector<std::unordered_map<SymbolId, size_t>> scopes;
+    LazyBody(const TokenBuffer* tokens, size_t begin, size_t end,
+             std::string_view text);
 };
 
 struct FunctionLiteral : Node {
     Token tok; /* the fn token */
     std::vector<Identifier> params;
-    BlockStatement body;
-    FunctionLiteral(Token tok, std::vector<Identifier>& params,
-                    BlockStatement& body);
-    const char* token_literal() override;
-    std::string string() override;
+    BlockStatement body; /* empty until a lazy body is parsed */
+    size_t num_slots;    /* params and lets, set by the resolver */
+    Arena* arena;        /* the arena that owns this literal */
+    LazyBody* lazy;      /* null unless the body was skipped */
+    /* the body as compiled by compile_closures, shared by every program
+     * compiled from this literal. code is set once, to the FunctionCode
+     * that code_owner keeps alive */
+    mutable std::atomic<struct FunctionCode*> code;
+    mutable std::shared_ptr<struct FunctionCode> code_owner;
+    /* calls counted until the jit has looked at the literal, and the native
+     * code it made, which jit_owner keeps alive */
+    mutable std::atomic<uint32_t> calls;
+    mutable std::atomic<struct JitCode*> jit;
+    mutable std::shared_ptr<struct JitCode> jit_owner;
+    FunctionLiteral(Token tok, std::vector<Identifier> params,
+                    BlockStatement body, Arena* arena,
+                    LazyBody* lazy = nullptr);
+    bool body_parsed() const;
+    std::string_view token_literal() const override;
+    std::string string() const override;
 };
 
 struct CallExpression : Node {
     Token tok;
-    std::shared_ptr<struct Expression> function;
+    struct Expression* function;
     std::vector<struct Expression> arguments;
-    CallExpression(Token tok, struct Expression& function,
-                   std::vector<struct Expression>& arguments);
-    const char* token_literal() override;
-    std::string string() override;
-};
-
+    /* set by the resolver when the call is the last thing the function
+     * making it does, so the call's result is the function's result */
+    bool tail;
+    CallExpression(Token tok, struct Expression* function,
+                   std::vector<struct Expression> arguments);
+    std::string_view token_literal() const override;
+    std::string string() const override;
+};
+
+/* function literals live in the program's arena like the rest of the tree.
+ * Function objects made from them share ownership of that arena, so they can
+ * outlive the Program they were evaluated from */
 typedef std::variant<std::monostate, Identifier, BooleanLiteral, IntegerLiteral,
                      PrefixExpression, InfixExpression, IfExpression,
-                     FunctionLiteral, CallExpression>
+                     FunctionLiteral*, CallExpression>
     ExpressionVariant;
 
 struct Expression : Node {
@@ -131,33 +189,33 @@ struct Expression : Node {
     ExpressionVariant data;
     Expression();
     Expression(Expression::Type type, ExpressionVariant data);
-    const char* token_literal() override;
-    std::string string() override;
+    std::string_view token_literal() const override;
+    std::string string() const override;
 };
 
 struct LetStatement : Node {
     Token tok; /* the Let token */
     Identifier name;
     Expression value;
-    LetStatement(Token tok, Identifier name, Expression& value);
-    const char* token_literal() override;
-    std::string string() override;
+    LetStatement(Token tok, Identifier name, Expression value);
+    std::string_view token_literal() const override;
+    std::string string() const override;
 };
 
 struct ReturnStatement : Node {
     Token tok; /* the Return token */
     Expression value;
-    ReturnStatement(Token tok, Expression& value);
-    const char* token_literal() override;
-    std::string string() override;
+    ReturnStatement(Token tok, Expression value);
+    std::string_view token_literal() const override;
+    std::string string() const override;
 };
 
 struct ExpressionStatement : Node {
     Token tok; /* first token of expression */
     Expression exp;
     ExpressionStatement(Token tok, Expression e);
-    const char* token_literal() override;
-    std::string string() override;
+    std::string_view token_literal() const override;
+    std::string string() const override;
 };
 
 struct Statement : Node {
@@ -171,14 +229,17 @@ struct Statement : Node {
                  ExpressionStatement>
         data;
     Statement();
-    const char* token_literal() override;
-    std::string string() override;
+    std::string_view token_literal() const override;
+    std::string string() const override;
 };
 
+/* every node below the top level statements is allocated in arena, and child
+ * nodes are plain pointers into it, so the whole tree is freed at once */
 struct Program : Node {
     std::vector<Statement> statements;
-    const char* token_literal() override;
-    std::string string() override;
+    std::shared_ptr<Arena> arena;
+    std::string_view token_literal() const override;
+    std::string string() const override;
 };
 
 const char* prefix_oper_to_string(PrefixExpression::Operator oper);
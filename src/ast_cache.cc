@@ -0,0 +1,674 @@
+#include "ast_cache.hh"
+#include "source.hh"
+#include "util.hh"
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <vector>
+
+#define AST_CACHE_MAGIC "MONKAST"
+#define AST_CACHE_BYTE_ORDER 0x01020304
+
+struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t hash;
+    uint64_t size;
+    int64_t mtime;
+    uint32_t num_nodes;
+    uint32_t num_extra;
+    uint32_t num_integers;
+    uint32_t num_names;
+    uint32_t name_bytes;
+    uint32_t num_statements;
+};
+
+static_assert(sizeof(CacheHeader) == 64, "the header is part of the format");
+
+/* the sections of a cache, read in place. a buffer holding a cache need not
+ * be aligned, so values are copied out rather than dereferenced */
+struct CacheView {
+    CacheHeader h;
+    const char* integers;
+    const char* lhs;
+    const char* rhs;
+    const char* extra;
+    const char* statements;
+    const char* name_offsets;
+    const char* kinds;
+    const char* opers;
+    const char* names;
+
+    uint32_t u32(const char* section, size_t i) const {
+        uint32_t res;
+        std::memcpy(&res, section + i * sizeof(res), sizeof(res));
+        return res;
+    }
+    int64_t integer(size_t i) const {
+        int64_t res;
+        std::memcpy(&res, integers + i * sizeof(res), sizeof(res));
+        return res;
+    }
+    std::string_view name(size_t i) const {
+        uint32_t from = u32(name_offsets, i);
+        return std::string_view(names + from, u32(name_offsets, i + 1) - from);
+    }
+};
+
+uint64_t source_hash(std::string_view text) {
+    uint64_t res = 0xcbf29ce484222325ull ^ text.size();
+    size_t i = 0;
+    /* fnv-1a over words, folding the high half back in since a multiply
+     * only carries upwards */
+    for (; i + 8 <= text.size(); i += 8) {
+        uint64_t word;
+        std::memcpy(&word, text.data() + i, sizeof(word));
+        res = (res ^ word) * 0x100000001b3ull;
+        res ^= res >> 32;
+    }
+    for (; i < text.size(); ++i) {
+        res = (res ^ (uint8_t)text[i]) * 0x100000001b3ull;
+    }
+    return res;
+}
+
+SourceStamp source_stamp(const Source& source) {
+    std::string_view text = source.text();
+    return SourceStamp{source_hash(text), text.size(), source.mtime()};
+}
+
+template <typename T>
+static void append(std::string& out, const std::vector<T>& xs) {
+    out.append((const char*)xs.data(), xs.size() * sizeof(T));
+}
+
+static uint64_t cache_size(const CacheHeader& h) {
+    return sizeof(CacheHeader) + (uint64_t)h.num_integers * 8 +
+           ((uint64_t)h.num_nodes * 2 + h.num_extra + h.num_statements +
+            h.num_names + 1) *
+               4 +
+           (uint64_t)h.num_nodes * 2 + h.name_bytes;
+}
+
+std::string encode_ast(const FlatAst& ast, const SourceStamp& stamp) {
+    CacheHeader h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, AST_CACHE_MAGIC, sizeof(h.magic));
+    h.version = AST_CACHE_VERSION;
+    h.byte_order = AST_CACHE_BYTE_ORDER;
+    h.hash = stamp.hash;
+    h.size = stamp.size;
+    h.mtime = stamp.mtime;
+    h.num_nodes = ast.size();
+    h.num_extra = ast.extra.size();
+    h.num_integers = ast.integers.size();
+    h.num_names = ast.names.size();
+    h.num_statements = ast.statements.size();
+    std::vector<uint32_t> name_offsets;
+    name_offsets.reserve(ast.names.size() + 1);
+    for (auto& name : ast.names) {
+        name_offsets.push_back(h.name_bytes);
+        h.name_bytes += name.size();
+    }
+    name_offsets.push_back(h.name_bytes);
+
+    std::string out;
+    out.reserve(cache_size(h));
+    out.append((const char*)&h, sizeof(h));
+    append(out, ast.integers);
+    append(out, ast.lhs);
+    append(out, ast.rhs);
+    append(out, ast.extra);
+    append(out, ast.statements);
+    append(out, name_offsets);
+    append(out, ast.kinds);
+    append(out, ast.opers);
+    for (auto& name : ast.names) {
+        out.append(name);
+    }
+    return out;
+}
+
+SourceStamp ast_cache_stamp(std::string_view data) {
+    CacheHeader h;
+    if (data.size() < sizeof(h)) {
+        return SourceStamp{0, 0, 0};
+    }
+    std::memcpy(&h, data.data(), sizeof(h));
+    if (std::memcmp(h.magic, AST_CACHE_MAGIC, sizeof(h.magic)) != 0) {
+        return SourceStamp{0, 0, 0};
+    }
+    return SourceStamp{h.hash, h.size, h.mtime};
+}
+
+static const Token::Type prefix_tokens[] = {
+    Token::Type::Bang,
+    Token::Type::Minus,
+};
+
+static const Token::Type infix_tokens[] = {
+    Token::Type::Plus, Token::Type::Minus, Token::Type::Asterisk,
+    Token::Type::Slash, Token::Type::Lt,   Token::Type::Gt,
+    Token::Type::Eq,   Token::Type::NotEq,
+};
+
+/* only the type of a rebuilt node's token is known. nothing reads the span
+ * of a token once a program is parsed */
+static Token token(Token::Type type) {
+    Token tok;
+    std::memset(&tok, 0, sizeof(tok));
+    tok.type = type;
+    return tok;
+}
+
+/* checks a cache, then builds a program from it. nodes are built in index
+ * order, which puts every child before its parent, so nothing recurses and
+ * a deep tree needs no more stack than a shallow one */
+class AstLoader {
+  public:
+    AstLoader(const CacheView& v);
+    bool check(std::string& err);
+    Program build();
+
+  private:
+    enum class Category : uint8_t {
+        Expression,
+        Block,
+        Statement,
+    };
+    /* how a node's parent holds it. an expression held by pointer is made
+     * in the arena as soon as it is built, and anything held by value waits
+     * in a side table until its parent moves it out */
+    enum class Use : uint8_t {
+        None,
+        Pointer,
+        Value,
+    };
+    const CacheView& v;
+    std::shared_ptr<Arena> arena;
+    std::vector<Use> uses;
+    /* the most nodes on a path down from each, counted as the parser does */
+    std::vector<uint32_t> heights;
+    std::vector<uint32_t> slots; /* of built nodes in their side table */
+    std::vector<SymbolId> symbols;
+    std::vector<Expression*> pointers;
+    std::vector<Expression> values;
+    std::vector<BlockStatement> blocks;
+    std::vector<Statement> stmts;
+    FlatAst::Kind kind(uint32_t node) const;
+    Category category(uint32_t node) const;
+    bool list(uint32_t list, uint32_t& len) const;
+    bool child(uint32_t parent, uint32_t node, Category want, Use use);
+    bool check_node(uint32_t node);
+    /* each builds node in place, in what its parent will hold */
+    void expression(uint32_t node, Expression& exp);
+    void block(uint32_t node, BlockStatement& block);
+    void statement(uint32_t node, Statement& stmt);
+    Token::Type first_token(uint32_t node) const;
+};
+
+AstLoader::AstLoader(const CacheView& v)
+    : v(v), arena(std::make_shared<Arena>()) {}
+
+FlatAst::Kind AstLoader::kind(uint32_t node) const {
+    return (FlatAst::Kind)v.kinds[node];
+}
+
+AstLoader::Category AstLoader::category(uint32_t node) const {
+    FlatAst::Kind k = kind(node);
+    if (k <= FlatAst::Kind::Call) {
+        return Category::Expression;
+    }
+    return k == FlatAst::Kind::Block ? Category::Block : Category::Statement;
+}
+
+bool AstLoader::list(uint32_t list, uint32_t& len) const {
+    if (list >= v.h.num_extra) {
+        return false;
+    }
+    len = v.u32(v.extra, list);
+    return len < v.h.num_extra - list;
+}
+
+/* a child comes before its parent, is of the kind its parent expects, and
+ * belongs to no other parent, which makes the nodes a tree */
+bool AstLoader::child(uint32_t parent, uint32_t node, Category want,
+                      Use use) {
+    if (node >= parent || category(node) != want || uses[node] != Use::None) {
+        return false;
+    }
+    uses[node] = use;
+    if (parent < v.h.num_nodes) {
+        /* a statement is as tall as what it holds */
+        uint32_t height =
+            heights[node] + (category(parent) != Category::Statement);
+        heights[parent] = std::max(heights[parent], height);
+    }
+    return true;
+}
+
+bool AstLoader::check_node(uint32_t node) {
+    uint8_t oper = v.opers[node];
+    uint32_t lhs = v.u32(v.lhs, node), rhs = v.u32(v.rhs, node);
+    uint32_t i, len;
+    if ((uint8_t)v.kinds[node] > (uint8_t)FlatAst::Kind::Expression) {
+        return false;
+    }
+    switch (kind(node)) {
+    case FlatAst::Kind::Identifier:
+        return lhs < v.h.num_names;
+    case FlatAst::Kind::Integer:
+        return lhs < v.h.num_integers;
+    case FlatAst::Kind::Boolean:
+        return lhs <= 1;
+    case FlatAst::Kind::Prefix:
+        return oper < sizeof(prefix_tokens) / sizeof(prefix_tokens[0]) &&
+               child(node, lhs, Category::Expression, Use::Pointer);
+    case FlatAst::Kind::Infix:
+        return oper < sizeof(infix_tokens) / sizeof(infix_tokens[0]) &&
+               child(node, lhs, Category::Expression, Use::Pointer) &&
+               child(node, rhs, Category::Expression, Use::Pointer);
+    case FlatAst::Kind::If: {
+        if (!child(node, lhs, Category::Expression, Use::Pointer) ||
+            !list(rhs, len) || len != 2) {
+            return false;
+        }
+        uint32_t alternative = v.u32(v.extra, rhs + 2);
+        return child(node, v.u32(v.extra, rhs + 1), Category::Block,
+                     Use::Value) &&
+               (alternative == FLAT_AST_NONE ||
+                child(node, alternative, Category::Block, Use::Value));
+    }
+    case FlatAst::Kind::Function:
+        if (!list(lhs, len)) {
+            return false;
+        }
+        for (i = 0; i < len; ++i) {
+            if (v.u32(v.extra, lhs + 1 + i) >= v.h.num_names) {
+                return false;
+            }
+        }
+        return child(node, rhs, Category::Block, Use::Value);
+    case FlatAst::Kind::Call:
+        if (!child(node, lhs, Category::Expression, Use::Pointer) ||
+            !list(rhs, len)) {
+            return false;
+        }
+        for (i = 0; i < len; ++i) {
+            if (!child(node, v.u32(v.extra, rhs + 1 + i),
+                       Category::Expression, Use::Value)) {
+                return false;
+            }
+        }
+        return true;
+    case FlatAst::Kind::Block:
+        if (!list(lhs, len)) {
+            return false;
+        }
+        for (i = 0; i < len; ++i) {
+            if (!child(node, v.u32(v.extra, lhs + 1 + i), Category::Statement,
+                       Use::Value)) {
+                return false;
+            }
+        }
+        return true;
+    case FlatAst::Kind::Let:
+        return lhs < v.h.num_names &&
+               child(node, rhs, Category::Expression, Use::Value);
+    case FlatAst::Kind::Return:
+    case FlatAst::Kind::Expression:
+        return child(node, lhs, Category::Expression, Use::Value);
+    }
+    unreachable;
+    return false;
+}
+
+bool AstLoader::check(std::string& err) {
+    uint32_t i, n = v.h.num_nodes;
+    for (i = 0; i < v.h.num_names; ++i) {
+        if (v.u32(v.name_offsets, i) > v.u32(v.name_offsets, i + 1)) {
+            err = "ast cache: bad name table";
+            return false;
+        }
+    }
+    if (v.u32(v.name_offsets, v.h.num_names) != v.h.name_bytes) {
+        err = "ast cache: bad name table";
+        return false;
+    }
+    uses.assign(n, Use::None);
+    heights.assign(n, 0);
+    for (i = 0; i < n; ++i) {
+        if (!check_node(i)) {
+            err = "ast cache: bad node " + std::to_string(i);
+            return false;
+        }
+        heights[i] = std::max(heights[i], 1u);
+        /* the tree is built without recursing, but is then walked by code
+         * that does */
+        if (heights[i] > PARSER_MAX_DEPTH) {
+            err = "ast cache: nested deeper than " +
+                  std::to_string(PARSER_MAX_DEPTH);
+            return false;
+        }
+    }
+    /* the top level statements hang off a root past the last node */
+    for (i = 0; i < v.h.num_statements; ++i) {
+        if (!child(n, v.u32(v.statements, i), Category::Statement,
+                   Use::Value)) {
+            err = "ast cache: bad statement " + std::to_string(i);
+            return false;
+        }
+    }
+    return true;
+}
+
+Program AstLoader::build() {
+    uint32_t i, n = v.h.num_nodes;
+    size_t num_pointers = 0, num_values = 0, num_blocks = 0, num_stmts = 0;
+    for (i = 0; i < n; ++i) {
+        if (uses[i] == Use::Pointer) {
+            num_pointers++;
+        } else if (uses[i] == Use::Value) {
+            Category c = category(i);
+            num_values += c == Category::Expression;
+            num_blocks += c == Category::Block;
+            num_stmts += c == Category::Statement;
+        }
+    }
+    pointers.reserve(num_pointers);
+    values.reserve(num_values);
+    blocks.reserve(num_blocks);
+    stmts.reserve(num_stmts);
+    symbols.reserve(v.h.num_names);
+    for (i = 0; i < v.h.num_names; ++i) {
+        symbols.push_back(intern(v.name(i)));
+    }
+
+    slots.assign(n, 0);
+    for (i = 0; i < n; ++i) {
+        /* a node no parent uses is dropped */
+        if (uses[i] == Use::None) {
+            continue;
+        }
+        switch (category(i)) {
+        case Category::Expression:
+            if (uses[i] == Use::Pointer) {
+                slots[i] = pointers.size();
+                pointers.push_back(arena->make<Expression>());
+                expression(i, *pointers.back());
+            } else {
+                slots[i] = values.size();
+                expression(i, values.emplace_back());
+            }
+            break;
+        case Category::Block:
+            slots[i] = blocks.size();
+            block(i, blocks.emplace_back());
+            break;
+        case Category::Statement:
+            slots[i] = stmts.size();
+            statement(i, stmts.emplace_back());
+            break;
+        }
+    }
+
+    Program program;
+    program.statements.reserve(v.h.num_statements);
+    for (i = 0; i < v.h.num_statements; ++i) {
+        program.statements.push_back(
+            std::move(stmts[slots[v.u32(v.statements, i)]]));
+    }
+    program.arena = arena;
+    return program;
+}
+
+void AstLoader::expression(uint32_t node, Expression& exp) {
+    uint8_t oper = v.opers[node];
+    uint32_t lhs = v.u32(v.lhs, node), rhs = v.u32(v.rhs, node);
+    uint32_t i, len;
+    switch (kind(node)) {
+    case FlatAst::Kind::Identifier:
+        exp.type = Expression::Type::Identifier;
+        exp.data.emplace<Identifier>(token(Token::Type::Ident), symbols[lhs]);
+        break;
+    case FlatAst::Kind::Integer: {
+        int64_t value = v.integer(lhs);
+        char digits[24];
+        auto res = std::to_chars(digits, digits + sizeof(digits), value);
+        Token tok = token(Token::Type::Int);
+        tok.value = value;
+        exp.type = Expression::Type::Integer;
+        exp.data.emplace<IntegerLiteral>(
+            tok, value,
+            arena->copy(std::string_view(digits, res.ptr - digits)));
+    } break;
+    case FlatAst::Kind::Boolean:
+        exp.type = Expression::Type::Boolean;
+        exp.data.emplace<BooleanLiteral>(
+            token(lhs ? Token::Type::True : Token::Type::False), lhs);
+        break;
+    case FlatAst::Kind::Prefix:
+        exp.type = Expression::Type::Prefix;
+        exp.data.emplace<PrefixExpression>(token(prefix_tokens[oper]),
+                                           (PrefixExpression::Operator)oper,
+                                           pointers[slots[lhs]]);
+        break;
+    case FlatAst::Kind::Infix:
+        exp.type = Expression::Type::Infix;
+        exp.data.emplace<InfixExpression>(
+            token(infix_tokens[oper]), (InfixExpression::Operator)oper,
+            pointers[slots[lhs]], pointers[slots[rhs]]);
+        break;
+    case FlatAst::Kind::If: {
+        uint32_t alternative = v.u32(v.extra, rhs + 2);
+        std::optional<BlockStatement> alt;
+        if (alternative != FLAT_AST_NONE) {
+            alt = std::move(blocks[slots[alternative]]);
+        }
+        exp.type = Expression::Type::If;
+        exp.data.emplace<IfExpression>(
+            token(Token::Type::If), pointers[slots[lhs]],
+            std::move(blocks[slots[v.u32(v.extra, rhs + 1)]]),
+            std::move(alt));
+    } break;
+    case FlatAst::Kind::Function: {
+        len = v.u32(v.extra, lhs);
+        std::vector<Identifier> params;
+        params.reserve(len);
+        for (i = 0; i < len; ++i) {
+            params.emplace_back(token(Token::Type::Ident),
+                                symbols[v.u32(v.extra, lhs + 1 + i)]);
+        }
+        exp.type = Expression::Type::Function;
+        exp.data.emplace<FunctionLiteral*>(arena->make<FunctionLiteral>(
+            token(Token::Type::Function), std::move(params),
+            std::move(blocks[slots[rhs]]), arena.get()));
+    } break;
+    case FlatAst::Kind::Call: {
+        len = v.u32(v.extra, rhs);
+        std::vector<Expression> args;
+        args.reserve(len);
+        for (i = 0; i < len; ++i) {
+            args.push_back(
+                std::move(values[slots[v.u32(v.extra, rhs + 1 + i)]]));
+        }
+        exp.type = Expression::Type::Call;
+        exp.data.emplace<CallExpression>(token(Token::Type::LParen),
+                                         pointers[slots[lhs]],
+                                         std::move(args));
+    } break;
+    default:
+        unreachable;
+        break;
+    }
+}
+
+void AstLoader::block(uint32_t node, BlockStatement& block) {
+    uint32_t list = v.u32(v.lhs, node);
+    uint32_t i, len = v.u32(v.extra, list);
+    block.tok = token(Token::Type::LSquirly);
+    block.stmts.reserve(len);
+    for (i = 0; i < len; ++i) {
+        block.stmts.push_back(
+            std::move(stmts[slots[v.u32(v.extra, list + 1 + i)]]));
+    }
+}
+
+void AstLoader::statement(uint32_t node, Statement& stmt) {
+    uint32_t lhs = v.u32(v.lhs, node), rhs = v.u32(v.rhs, node);
+    switch (kind(node)) {
+    case FlatAst::Kind::Let:
+        stmt.type = Statement::Type::Let;
+        stmt.data.emplace<LetStatement>(
+            token(Token::Type::Let),
+            Identifier(token(Token::Type::Ident), symbols[lhs]),
+            std::move(values[slots[rhs]]));
+        break;
+    case FlatAst::Kind::Return:
+        stmt.type = Statement::Type::Ret;
+        stmt.data.emplace<ReturnStatement>(token(Token::Type::Return),
+                                           std::move(values[slots[lhs]]));
+        break;
+    case FlatAst::Kind::Expression:
+        stmt.type = Statement::Type::Expression;
+        stmt.data.emplace<ExpressionStatement>(
+            token(first_token(lhs)), std::move(values[slots[lhs]]));
+        break;
+    default:
+        unreachable;
+        break;
+    }
+}
+
+/* the first token of an expression, as far as the cache still knows it. the
+ * parentheses around a grouped expression are not kept */
+Token::Type AstLoader::first_token(uint32_t node) const {
+    while (kind(node) == FlatAst::Kind::Infix ||
+           kind(node) == FlatAst::Kind::Call) {
+        node = v.u32(v.lhs, node);
+    }
+    switch (kind(node)) {
+    case FlatAst::Kind::Identifier:
+        return Token::Type::Ident;
+    case FlatAst::Kind::Integer:
+        return Token::Type::Int;
+    case FlatAst::Kind::Boolean:
+        return v.u32(v.lhs, node) ? Token::Type::True : Token::Type::False;
+    case FlatAst::Kind::Prefix:
+        return prefix_tokens[(uint8_t)v.opers[node]];
+    case FlatAst::Kind::If:
+        return Token::Type::If;
+    case FlatAst::Kind::Function:
+        return Token::Type::Function;
+    default:
+        break;
+    }
+    return Token::Type::Illegal;
+}
+
+bool decode_ast(std::string_view data, const SourceStamp& stamp,
+                Program& program, std::string& err) {
+    CacheView v;
+    if (data.size() < sizeof(v.h)) {
+        err = "ast cache: truncated";
+        return false;
+    }
+    std::memcpy(&v.h, data.data(), sizeof(v.h));
+    if (std::memcmp(v.h.magic, AST_CACHE_MAGIC, sizeof(v.h.magic)) != 0) {
+        err = "ast cache: not a cache";
+        return false;
+    }
+    if (v.h.version != AST_CACHE_VERSION ||
+        v.h.byte_order != AST_CACHE_BYTE_ORDER) {
+        err = "ast cache: written by an incompatible version";
+        return false;
+    }
+    if (v.h.hash != stamp.hash || v.h.size != stamp.size ||
+        v.h.mtime != stamp.mtime) {
+        err = "ast cache: stale";
+        return false;
+    }
+    if (cache_size(v.h) != data.size()) {
+        err = "ast cache: truncated";
+        return false;
+    }
+    const char* p = data.data() + sizeof(v.h);
+    v.integers = p;
+    p += (size_t)v.h.num_integers * 8;
+    v.lhs = p;
+    p += (size_t)v.h.num_nodes * 4;
+    v.rhs = p;
+    p += (size_t)v.h.num_nodes * 4;
+    v.extra = p;
+    p += (size_t)v.h.num_extra * 4;
+    v.statements = p;
+    p += (size_t)v.h.num_statements * 4;
+    v.name_offsets = p;
+    p += ((size_t)v.h.num_names + 1) * 4;
+    v.kinds = p;
+    p += v.h.num_nodes;
+    v.opers = p;
+    p += v.h.num_nodes;
+    v.names = p;
+
+    AstLoader loader(v);
+    if (!loader.check(err)) {
+        return false;
+    }
+    program = loader.build();
+    return true;
+}
+
+std::string ast_cache_path(const std::string& dir, uint64_t hash) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.ast",
+                  (unsigned long long)hash);
+    return dir + "/" + name;
+}
+
+bool write_ast_cache(const std::string& path, std::string_view data,
+                     std::string& err) {
+    std::string tmp = path + ".tmp" + std::to_string(getpid());
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        err = tmp + ": " + std::strerror(errno);
+        return false;
+    }
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t n = write(fd, data.data() + done, data.size() - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            err = tmp + ": " + std::strerror(errno);
+            close(fd);
+            unlink(tmp.c_str());
+            return false;
+        }
+        done += n;
+    }
+    if (close(fd) < 0 || rename(tmp.c_str(), path.c_str()) < 0) {
+        err = path + ": " + std::strerror(errno);
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool load_ast_cache(const std::string& path, const SourceStamp& stamp,
+                    Program& program, std::string& err) {
+    std::unique_ptr<Source> src = Source::map_file(path, err);
+    if (src == nullptr) {
+        return false;
+    }
+    if (!decode_ast(src->text(), stamp, program, err)) {
+        err = path + ": " + err;
+        return false;
+    }
+    return true;
+}
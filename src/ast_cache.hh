@@ -0,0 +1,70 @@
+#pragma once
+
+#include "ast.hh"
+#include "flat_ast.hh"
+#include "parser.hh"
+#include "source.hh"
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#define AST_CACHE_VERSION 2
+
+/* a parsed program saved to disk, so a script that has not changed is not
+ * lexed and parsed again. the file is the flat ast's arrays laid end to end
+ * behind a header:
+ *
+ *   header     magic, version, byte order, source stamp, section counts
+ *   integers   int64 per integer literal
+ *   lhs, rhs   uint32 per node
+ *   extra      uint32 per list entry
+ *   statements uint32 per top level statement
+ *   names      uint32 offsets, one more than there are names
+ *   kinds      uint8 per node
+ *   opers      uint8 per node
+ *   name bytes the text of every name, back to back
+ *
+ * every reference is an index or an offset, never an address, so the file is
+ * read in place from a mapping wherever it lands. a cache is only valid for
+ * the source whose stamp it holds, in the byte order of the machine that
+ * wrote it */
+
+/* what a cache is checked against to tell it was saved from a source. a
+ * hash alone could match another text, so the text's length and the time
+ * its file was last modified must match too */
+struct SourceStamp {
+    uint64_t hash;
+    uint64_t size;
+    int64_t mtime; /* nanoseconds since the epoch, 0 if not from a file */
+};
+
+/* a 64 bit hash of a script's text, used to key and check caches */
+uint64_t source_hash(std::string_view text);
+
+/* the stamp of source's text */
+SourceStamp source_stamp(const Source& source);
+
+/* serializes a flat ast parsed from a source with the given stamp */
+std::string encode_ast(const FlatAst& ast, const SourceStamp& stamp);
+
+/* rebuilds the program saved in data, which must have been encoded from a
+ * source with the given stamp. data is checked before anything is built, so
+ * a truncated, stale or corrupt cache sets err and returns false */
+bool decode_ast(std::string_view data, const SourceStamp& stamp,
+                Program& program, std::string& err);
+
+/* the stamp of the source a cache was written for, all 0 if data is not a
+ * cache */
+SourceStamp ast_cache_stamp(std::string_view data);
+
+/* the file a cache for a source with the given hash lives in under dir */
+std::string ast_cache_path(const std::string& dir, uint64_t hash);
+
+/* writes data to path, replacing any file there all at once so a reader
+ * never sees half a cache */
+bool write_ast_cache(const std::string& path, std::string_view data,
+                     std::string& err);
+
+/* maps the cache at path and decodes it, as decode_ast */
+bool load_ast_cache(const std::string& path, const SourceStamp& stamp,
+                    Program& program, std::string& err);
@@ -0,0 +1,539 @@
+#include "closure_eval.hh"
+#include "jit.hh"
+#include "resolver.hh"
+#include "util.hh"
+#include <mutex>
+
+static const Object null_obj(Object::Type::Null, std::monostate());
+static const Object true_obj(Object::Type::Bool, true);
+static const Object false_obj(Object::Type::Bool, false);
+
+static std::mutex code_mu;
+
+/* the compiled body of a function literal. a lazily parsed body is parsed,
+ * resolved and compiled the first time it is called */
+struct FunctionCode {
+    ClosureCode body;
+    std::once_flag loaded;
+    std::string error; /* from parsing a lazy body */
+};
+
+/* the operands of an infix node. each yields a pointer to its value, which
+ * is in tmp when it has to be computed */
+struct CodeOperand {
+    ClosureCode code;
+    const Object* operator()(const std::shared_ptr<Environment>& env,
+                             Object& tmp) const {
+        tmp = code(env);
+        return &tmp;
+    }
+};
+
+struct LocalOperand {
+    int slot;
+    std::string_view name;
+    const Object* operator()(const std::shared_ptr<Environment>& env,
+                             Object& tmp) const {
+        const Object& obj = env->slots[slot];
+        if (obj.type == Object::Type::Null) {
+            tmp = Object(Object::Type::Error,
+                         "identifier not found: " + std::string(name));
+            return &tmp;
+        }
+        return &obj;
+    }
+};
+
+struct IntOperand {
+    Object value;
+    const Object* operator()(const std::shared_ptr<Environment>&,
+                             Object&) const {
+        return &value;
+    }
+};
+
+static ClosureCode compile_block(const std::vector<Statement>& stmts);
+static ClosureCode compile_statement(const Statement& stmt);
+static ClosureCode compile_expression(const Expression& exp);
+static ClosureCode compile_prefix(const PrefixExpression& pe);
+static ClosureCode compile_infix(const InfixExpression& infix);
+template <InfixExpression::Operator O>
+static ClosureCode compile_infix_as(const InfixExpression& infix);
+static ClosureCode compile_if(const IfExpression& ife);
+static ClosureCode compile_identifier(const Identifier& ident);
+static ClosureCode compile_function(const FunctionLiteral& fn);
+static ClosureCode compile_call(const CallExpression& call);
+static FunctionCode* function_code(const FunctionLiteral& fn);
+static Object apply_function(const Function& fn,
+                             const std::vector<ClosureCode>& args,
+                             const std::shared_ptr<Environment>& env);
+static Object generic_infix(InfixExpression::Operator oper, Object left,
+                            Object right);
+static inline Object unwrap_return(Object obj);
+static inline Object native_bool_to_bool_obj(bool input);
+static bool is_truthy(const Object& obj);
+static inline bool is_local(const Expression& exp);
+static inline IntOperand int_operand(const Expression& exp);
+static inline LocalOperand local_operand(const Expression& exp);
+
+ClosureProgram compile_closures(const Program& program) {
+    return ClosureProgram{compile_block(program.statements)};
+}
+
+Object eval(const ClosureProgram& program,
+            const std::shared_ptr<Environment>& env) {
+    return unwrap_return(program.code(env));
+}
+
+/* runs stmts in turn, stopping at a return or an error. a block of one
+ * statement is just that statement */
+static ClosureCode compile_block(const std::vector<Statement>& stmts) {
+    std::vector<ClosureCode> code;
+    code.reserve(stmts.size());
+    for (auto& stmt : stmts) {
+        code.push_back(compile_statement(stmt));
+    }
+    if (code.size() == 1) {
+        return std::move(code[0]);
+    }
+    return [code = std::move(code)](const std::shared_ptr<Environment>& env) {
+        Object res;
+        for (auto& stmt : code) {
+            res = stmt(env);
+            if (res.type == Object::Type::Return ||
+                res.type == Object::Type::Error) {
+                return res;
+            }
+        }
+        return res;
+    };
+}
+
+static ClosureCode compile_statement(const Statement& stmt) {
+    switch (stmt.type) {
+    case Statement::Type::Let: {
+        const LetStatement& let = std::get<LetStatement>(stmt.data);
+        int slot = let.name.slot;
+        ClosureCode value = compile_expression(let.value);
+        return [slot, value = std::move(value)](
+                   const std::shared_ptr<Environment>& env) {
+            Object val = value(env);
+            if (val.type == Object::Type::Error) {
+                return val;
+            }
+            env->set(slot, std::move(val));
+            return null_obj;
+        };
+    }
+    case Statement::Type::Ret: {
+        ClosureCode value =
+            compile_expression(std::get<ReturnStatement>(stmt.data).value);
+        return [value = std::move(value)](
+                   const std::shared_ptr<Environment>& env) {
+            return Object(Object::Type::Return,
+                          std::make_shared<Object>(value(env)));
+        };
+    }
+    case Statement::Type::Expression:
+        return compile_expression(std::get<ExpressionStatement>(stmt.data).exp);
+    default:
+        break;
+    }
+    return [](const std::shared_ptr<Environment>&) { return null_obj; };
+}
+
+static ClosureCode compile_expression(const Expression& exp) {
+    switch (exp.type) {
+    case Expression::Type::Integer: {
+        Object value(Object::Type::Int,
+                     std::get<IntegerLiteral>(exp.data).value);
+        return [value](const std::shared_ptr<Environment>&) { return value; };
+    }
+    case Expression::Type::Boolean: {
+        Object value =
+            native_bool_to_bool_obj(std::get<BooleanLiteral>(exp.data).value);
+        return [value](const std::shared_ptr<Environment>&) { return value; };
+    }
+    case Expression::Type::Prefix:
+        return compile_prefix(std::get<PrefixExpression>(exp.data));
+    case Expression::Type::Infix:
+        return compile_infix(std::get<InfixExpression>(exp.data));
+    case Expression::Type::If:
+        return compile_if(std::get<IfExpression>(exp.data));
+    case Expression::Type::Identifier:
+        return compile_identifier(std::get<Identifier>(exp.data));
+    case Expression::Type::Function:
+        return compile_function(*std::get<FunctionLiteral*>(exp.data));
+    case Expression::Type::Call:
+        return compile_call(std::get<CallExpression>(exp.data));
+    default:
+        break;
+    }
+    return [](const std::shared_ptr<Environment>&) { return null_obj; };
+}
+
+static ClosureCode compile_prefix(const PrefixExpression& pe) {
+    ClosureCode right = compile_expression(*pe.right);
+    if (pe.oper == PrefixExpression::Operator::Minus) {
+        return [right = std::move(right)](
+                   const std::shared_ptr<Environment>& env) {
+            Object obj = right(env);
+            if (obj.type == Object::Type::Error) {
+                return obj;
+            }
+            if (obj.type != Object::Type::Int) {
+                return Object(Object::Type::Error,
+                              string_format("unknown operator: -%s",
+                                            obj.type_to_string()));
+            }
+            return Object(Object::Type::Int, -std::get<int64_t>(obj.value));
+        };
+    }
+    return [right = std::move(right)](
+               const std::shared_ptr<Environment>& env) {
+        Object obj = right(env);
+        switch (obj.type) {
+        case Object::Type::Error:
+            return obj;
+        case Object::Type::Null:
+            return true_obj;
+        case Object::Type::Bool:
+            return native_bool_to_bool_obj(!std::get<bool>(obj.value));
+        default:
+            break;
+        }
+        return false_obj;
+    };
+}
+
+template <InfixExpression::Operator O>
+static inline Object int_infix(int64_t left, int64_t right) {
+    if constexpr (O == InfixExpression::Operator::Plus) {
+        return Object(Object::Type::Int, left + right);
+    } else if constexpr (O == InfixExpression::Operator::Minus) {
+        return Object(Object::Type::Int, left - right);
+    } else if constexpr (O == InfixExpression::Operator::Asterisk) {
+        return Object(Object::Type::Int, left * right);
+    } else if constexpr (O == InfixExpression::Operator::Slash) {
+        return Object(Object::Type::Int, left / right);
+    } else if constexpr (O == InfixExpression::Operator::Lt) {
+        return native_bool_to_bool_obj(left < right);
+    } else if constexpr (O == InfixExpression::Operator::Gt) {
+        return native_bool_to_bool_obj(left > right);
+    } else if constexpr (O == InfixExpression::Operator::Eq) {
+        return native_bool_to_bool_obj(left == right);
+    } else {
+        return native_bool_to_bool_obj(left != right);
+    }
+}
+
+/* an infix node with its operator and operand kinds fixed. two integers
+ * are combined directly, anything else takes eval's general rules */
+template <InfixExpression::Operator O, typename L, typename R>
+static ClosureCode infix_code(L left, R right) {
+    return [left = std::move(left), right = std::move(right)](
+               const std::shared_ptr<Environment>& env) {
+        Object ltmp, rtmp;
+        const Object* l = left(env, ltmp);
+        if (l->type == Object::Type::Error) {
+            return *l;
+        }
+        const Object* r = right(env, rtmp);
+        if (r->type == Object::Type::Error) {
+            return *r;
+        }
+        if (l->type == Object::Type::Int && r->type == Object::Type::Int) {
+            return int_infix<O>(*std::get_if<int64_t>(&l->value),
+                                *std::get_if<int64_t>(&r->value));
+        }
+        return generic_infix(O, *l, *r);
+    };
+}
+
+static ClosureCode compile_infix(const InfixExpression& infix) {
+    switch (infix.oper) {
+    case InfixExpression::Operator::Plus:
+        return compile_infix_as<InfixExpression::Operator::Plus>(infix);
+    case InfixExpression::Operator::Minus:
+        return compile_infix_as<InfixExpression::Operator::Minus>(infix);
+    case InfixExpression::Operator::Asterisk:
+        return compile_infix_as<InfixExpression::Operator::Asterisk>(infix);
+    case InfixExpression::Operator::Slash:
+        return compile_infix_as<InfixExpression::Operator::Slash>(infix);
+    case InfixExpression::Operator::Lt:
+        return compile_infix_as<InfixExpression::Operator::Lt>(infix);
+    case InfixExpression::Operator::Gt:
+        return compile_infix_as<InfixExpression::Operator::Gt>(infix);
+    case InfixExpression::Operator::Eq:
+        return compile_infix_as<InfixExpression::Operator::Eq>(infix);
+    case InfixExpression::Operator::NotEq:
+        return compile_infix_as<InfixExpression::Operator::NotEq>(infix);
+    }
+    unreachable;
+    return nullptr;
+}
+
+template <InfixExpression::Operator O, typename L>
+static ClosureCode infix_code_with(L left, const Expression& right) {
+    if (right.type == Expression::Type::Integer) {
+        return infix_code<O>(std::move(left), int_operand(right));
+    }
+    if (is_local(right)) {
+        return infix_code<O>(std::move(left), local_operand(right));
+    }
+    return infix_code<O>(std::move(left),
+                         CodeOperand{compile_expression(right)});
+}
+
+/* locals are read in place and integer literals are kept as Objects. a
+ * local on the left is only read in place when nothing on the right can
+ * rebind it */
+template <InfixExpression::Operator O>
+static ClosureCode compile_infix_as(const InfixExpression& infix) {
+    const Expression& left = *infix.left;
+    const Expression& right = *infix.right;
+    if (left.type == Expression::Type::Integer) {
+        return infix_code_with<O>(int_operand(left), right);
+    }
+    if (is_local(left) && (right.type == Expression::Type::Integer ||
+                           is_local(right))) {
+        return infix_code_with<O>(local_operand(left), right);
+    }
+    return infix_code_with<O>(CodeOperand{compile_expression(left)}, right);
+}
+
+static ClosureCode compile_if(const IfExpression& ife) {
+    ClosureCode cond = compile_expression(*ife.condition);
+    ClosureCode consequence = compile_block(ife.consequence.stmts);
+    ClosureCode alternative;
+    if (ife.alternative.has_value()) {
+        alternative = compile_block(ife.alternative->stmts);
+    }
+    return [cond = std::move(cond), consequence = std::move(consequence),
+            alternative = std::move(alternative)](
+               const std::shared_ptr<Environment>& env) {
+        Object obj = cond(env);
+        if (obj.type == Object::Type::Error) {
+            return obj;
+        }
+        if (is_truthy(obj)) {
+            return consequence(env);
+        }
+        if (alternative) {
+            return alternative(env);
+        }
+        return null_obj;
+    };
+}
+
+/* the walk out to the binding's scope is fixed, so the usual depths get a
+ * node each */
+static ClosureCode compile_identifier(const Identifier& ident) {
+    int depth = ident.depth, slot = ident.slot;
+    std::string_view name = ident.value;
+    if (slot < 0) {
+        return [name](const std::shared_ptr<Environment>&) {
+            return Object(Object::Type::Error,
+                          "identifier not found: " + std::string(name));
+        };
+    }
+    if (depth == 0) {
+        return [slot, name](const std::shared_ptr<Environment>& env) {
+            Object tmp;
+            return *LocalOperand{slot, name}(env, tmp);
+        };
+    }
+    if (depth == 1) {
+        return [slot, name](const std::shared_ptr<Environment>& env) {
+            Object tmp;
+            return *LocalOperand{slot, name}(env->outer, tmp);
+        };
+    }
+    return [depth, slot, name](const std::shared_ptr<Environment>& env) {
+        Object& obj = env->get(depth, slot);
+        if (obj.type == Object::Type::Null) {
+            return Object(Object::Type::Error,
+                          "identifier not found: " + std::string(name));
+        }
+        return obj;
+    };
+}
+
+static ClosureCode compile_function(const FunctionLiteral& fn) {
+    function_code(fn);
+    const FunctionLiteral* literal = &fn;
+    return [literal](const std::shared_ptr<Environment>& env) {
+        /* the Function shares ownership of the arena holding its literal */
+        std::shared_ptr<const FunctionLiteral> shared(
+            literal->arena->shared_from_this(), literal);
+        return Object(Object::Type::Function, Function(std::move(shared), env));
+    };
+}
+
+static ClosureCode compile_call(const CallExpression& call) {
+    ClosureCode function = compile_expression(*call.function);
+    std::vector<ClosureCode> args;
+    args.reserve(call.arguments.size());
+    for (auto& arg : call.arguments) {
+        args.push_back(compile_expression(arg));
+    }
+    return [function = std::move(function), args = std::move(args)](
+               const std::shared_ptr<Environment>& env) {
+        Object fn = function(env);
+        if (fn.type == Object::Type::Error) {
+            return fn;
+        }
+        if (fn.type != Object::Type::Function) {
+            for (auto& arg : args) {
+                Object obj = arg(env);
+                if (obj.type == Object::Type::Error) {
+                    return obj;
+                }
+            }
+            return Object(
+                Object::Type::Error,
+                string_format("not a function: %s", fn.type_to_string()));
+        }
+        return apply_function(std::get<Function>(fn.value), args, env);
+    };
+}
+
+/* the code of a literal is made once and kept on the literal, so functions
+ * eval made can be called here too */
+static FunctionCode* function_code(const FunctionLiteral& fn) {
+    FunctionCode* code = fn.code.load(std::memory_order_acquire);
+    if (code != nullptr) {
+        return code;
+    }
+    std::shared_ptr<FunctionCode> fresh = std::make_shared<FunctionCode>();
+    if (fn.lazy == nullptr) {
+        fresh->body = compile_block(fn.body.stmts);
+    }
+    std::lock_guard<std::mutex> lock(code_mu);
+    code = fn.code.load(std::memory_order_relaxed);
+    if (code == nullptr) {
+        code = fresh.get();
+        fn.code_owner = std::move(fresh);
+        fn.code.store(code, std::memory_order_release);
+    }
+    return code;
+}
+
+static Object apply_function(const Function& fn,
+                             const std::vector<ClosureCode>& args,
+                             const std::shared_ptr<Environment>& env) {
+    if (stack_exhausted()) {
+        return Object(Object::Type::Error, "stack overflow");
+    }
+    const FunctionLiteral& literal = *fn.literal;
+    FunctionCode* code = function_code(literal);
+    if (literal.lazy != nullptr) {
+        std::call_once(code->loaded, [&] {
+            Environment* globals = fn.env.get();
+            while (globals->outer != nullptr) {
+                globals = globals->outer.get();
+            }
+            const std::vector<std::string>& errors =
+                resolve_body(literal, *globals);
+            if (!errors.empty()) {
+                code->error = errors[0];
+                return;
+            }
+            code->body = compile_block(literal.body.stmts);
+        });
+        if (!code->error.empty()) {
+            return Object(Object::Type::Error, code->error);
+        }
+    }
+    std::shared_ptr<Environment> frame =
+        std::make_shared<Environment>(fn.env, literal.num_slots);
+    const std::vector<Identifier>& params = literal.params;
+    size_t i, len = args.size(), num_params = params.size();
+    for (i = 0; i < len; ++i) {
+        Object arg = args[i](env);
+        if (arg.type == Object::Type::Error) {
+            return arg;
+        }
+        if (i < num_params) {
+            frame->set(params[i].slot, std::move(arg));
+        }
+    }
+    if (len != num_params) {
+        return Object(Object::Type::Error,
+                      string_format("wrong number of arguments: want=%zu, "
+                                    "got=%zu",
+                                    num_params, len));
+    }
+    Object res;
+    if (jit_call(*fn.literal, *frame, res)) {
+        return res;
+    }
+    return unwrap_return(code->body(frame));
+}
+
+static Object generic_infix(InfixExpression::Operator oper, Object left,
+                            Object right) {
+    if (left.type != right.type) {
+        return Object(
+            Object::Type::Error,
+            string_format("type mismatch: %s %s %s", left.type_to_string(),
+                          infix_oper_to_string(oper), right.type_to_string()));
+    }
+    if (oper == InfixExpression::Operator::Eq) {
+        return native_bool_to_bool_obj(left == right);
+    }
+    if (oper == InfixExpression::Operator::NotEq) {
+        return native_bool_to_bool_obj(left != right);
+    }
+    return Object(
+        Object::Type::Error,
+        string_format("unknown operator: %s %s %s", left.type_to_string(),
+                      infix_oper_to_string(oper), right.type_to_string()));
+}
+
+static inline Object unwrap_return(Object obj) {
+    if (obj.type == Object::Type::Return) {
+        return *std::get<std::shared_ptr<Object>>(obj.value);
+    }
+    return obj;
+}
+
+static inline Object native_bool_to_bool_obj(bool input) {
+    if (input) {
+        return true_obj;
+    }
+    return false_obj;
+}
+
+static bool is_truthy(const Object& obj) {
+    switch (obj.type) {
+    case Object::Type::Null:
+        return false;
+    case Object::Type::Int:
+        return true;
+    case Object::Type::Bool:
+        return std::get<bool>(obj.value);
+    default:
+        break;
+    }
+    return false;
+}
+
+/* a name bound in the scope of the node using it */
+static inline bool is_local(const Expression& exp) {
+    if (exp.type != Expression::Type::Identifier) {
+        return false;
+    }
+    const Identifier& ident = std::get<Identifier>(exp.data);
+    return ident.depth == 0 && ident.slot >= 0;
+}
+
+static inline IntOperand int_operand(const Expression& exp) {
+    return IntOperand{
+        Object(Object::Type::Int, std::get<IntegerLiteral>(exp.data).value)};
+}
+
+static inline LocalOperand local_operand(const Expression& exp) {
+    const Identifier& ident = std::get<Identifier>(exp.data);
+    return LocalOperand{ident.slot, ident.value};
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "ast.hh"
+#include "object.hh"
+#include <functional>
+#include <memory>
+
+/* runs one node of a compiled program in the environment of the call it is
+ * part of */
+typedef std::function<Object(const std::shared_ptr<Environment>& env)>
+    ClosureCode;
+
+/* a resolved program compiled to a tree of callables, one per node, each
+ * specialized to the kind of its node and of its operands. the switches and
+ * variant lookups eval does each time it visits a node are done once, when
+ * compiling */
+struct ClosureProgram {
+    ClosureCode code;
+};
+
+/* compiles a resolved program. the result shares the program's function
+ * literals, so it may be run after the Program is gone */
+ClosureProgram compile_closures(const Program& program);
+
+/* runs a compiled program as eval runs the Program it was compiled from */
+Object eval(const ClosureProgram& program,
+            const std::shared_ptr<Environment>& env);
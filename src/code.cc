@@ -0,0 +1,95 @@
+#include "code.hh"
+#include "util.hh"
+
+const Definition definitions[] = {
+    {"OpConstant", {2, 0}, 1},
+    {"OpAdd", {0, 0}, 0},
+    {"OpSub", {0, 0}, 0},
+    {"OpMul", {0, 0}, 0},
+    {"OpDiv", {0, 0}, 0},
+    {"OpTrue", {0, 0}, 0},
+    {"OpFalse", {0, 0}, 0},
+    {"OpNull", {0, 0}, 0},
+    {"OpEqual", {0, 0}, 0},
+    {"OpNotEqual", {0, 0}, 0},
+    {"OpLessThan", {0, 0}, 0},
+    {"OpGreaterThan", {0, 0}, 0},
+    {"OpMinus", {0, 0}, 0},
+    {"OpBang", {0, 0}, 0},
+    {"OpJumpNotTruthy", {2, 0}, 1},
+    {"OpJump", {2, 0}, 1},
+    {"OpGetGlobal", {2, 0}, 1},
+    {"OpSetGlobal", {2, 0}, 1},
+    {"OpGetLocal", {1, 2}, 2},
+    {"OpSetLocal", {1, 0}, 1},
+    {"OpCaptureLocal", {1, 0}, 1},
+    {"OpGetFree", {1, 0}, 1},
+    {"OpGetCell", {1, 2}, 2},
+    {"OpGetFreeCell", {1, 2}, 2},
+    {"OpSetCell", {1, 0}, 1},
+    {"OpMakeCell", {1, 0}, 1},
+    {"OpCurrentClosure", {0, 0}, 0},
+    {"OpClosure", {2, 1}, 2},
+    {"OpCall", {1, 0}, 1},
+    {"OpReturnValue", {0, 0}, 0},
+    {"OpReturn", {0, 0}, 0},
+    {"OpPop", {0, 0}, 0},
+};
+
+const Definition& lookup_definition(Opcode op) {
+    return definitions[(size_t)op];
+}
+
+size_t make_instruction(Instructions& ins, Opcode op, int operand,
+                        int operand2) {
+    const Definition& def = lookup_definition(op);
+    size_t pos = ins.size();
+    int operands[2] = {operand, operand2};
+    size_t i;
+    ins.push_back((uint8_t)op);
+    for (i = 0; i < def.num_operands; ++i) {
+        switch (def.operand_widths[i]) {
+        case 2:
+            ins.push_back((uint8_t)((operands[i] >> 8) & 0xff));
+            ins.push_back((uint8_t)(operands[i] & 0xff));
+            break;
+        case 1:
+            ins.push_back((uint8_t)(operands[i] & 0xff));
+            break;
+        default:
+            unreachable;
+            break;
+        }
+    }
+    return pos;
+}
+
+size_t instruction_width(Opcode op) {
+    const Definition& def = lookup_definition(op);
+    size_t i, width = 1;
+    for (i = 0; i < def.num_operands; ++i) {
+        width += def.operand_widths[i];
+    }
+    return width;
+}
+
+std::string instructions_string(const Instructions& ins) {
+    std::string res;
+    size_t i = 0, j;
+    while (i < ins.size()) {
+        Opcode op = (Opcode)ins[i];
+        const Definition& def = lookup_definition(op);
+        size_t offset = 1;
+        res.append(string_format("%04zu %s", i, def.name));
+        for (j = 0; j < def.num_operands; ++j) {
+            int operand = def.operand_widths[j] == 2
+                              ? read_uint16(&ins[i + offset])
+                              : read_uint8(&ins[i + offset]);
+            res.append(string_format(" %d", operand));
+            offset += def.operand_widths[j];
+        }
+        res.push_back('\n');
+        i += offset;
+    }
+    return res;
+}
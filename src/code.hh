@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+typedef std::vector<uint8_t> Instructions;
+
+enum class Opcode : uint8_t {
+    Constant,
+    Add,
+    Sub,
+    Mul,
+    Div,
+    True,
+    False,
+    Null,
+    Equal,
+    NotEqual,
+    LessThan,
+    GreaterThan,
+    Minus,
+    Bang,
+    JumpNotTruthy,
+    Jump,
+    GetGlobal,
+    SetGlobal,
+    /* the value of a local, or an error naming local_names[operand 2] if it
+     * is unbound */
+    GetLocal,
+    SetLocal,
+    /* the local as it is, bound or not, for a closure to capture */
+    CaptureLocal,
+    GetFree,
+    /* the value in the cell of a local or free variable, or an error naming
+     * local_names[operand 2] if it is unbound */
+    GetCell,
+    GetFreeCell,
+    /* binds a local kept in a cell */
+    SetCell,
+    /* puts the value of a local in a new cell */
+    MakeCell,
+    CurrentClosure,
+    Closure,
+    Call,
+    ReturnValue,
+    Return,
+    Pop,
+};
+
+struct Definition {
+    const char* name;
+    /* width in bytes of each operand, at most two operands */
+    uint8_t operand_widths[2];
+    uint8_t num_operands;
+};
+
+const Definition& lookup_definition(Opcode op);
+
+/* encodes op and its operands, appending them to ins */
+size_t make_instruction(Instructions& ins, Opcode op, int operand = 0,
+                        int operand2 = 0);
+
+/* total width in bytes of op including its operands */
+size_t instruction_width(Opcode op);
+
+std::string instructions_string(const Instructions& ins);
+
+static inline uint16_t read_uint16(const uint8_t* ins) {
+    return (uint16_t)(ins[0] << 8) | ins[1];
+}
+
+static inline uint8_t read_uint8(const uint8_t* ins) { return ins[0]; }
@@ -0,0 +1,403 @@
+#include "compiler.hh"
+#include "parser.hh"
+#include "resolver.hh"
+#include "util.hh"
+
+Compiler::Compiler()
+    : symbols(std::make_shared<SymbolTable>()),
+      scopes(std::vector<CompilationScope>(1)) {}
+
+void Compiler::compile(const Program& program) {
+    /* top level bindings are visible to every function in the program, even
+     * ones defined before the binding, so give them their slots up front */
+    for (auto& stmt : program.statements) {
+        if (stmt.type == Statement::Type::Let) {
+            const LetStatement& let = std::get<LetStatement>(stmt.data);
+            define_global(let.name.symbol);
+        }
+    }
+    compile_statements(program.statements);
+    /* a let has no value, so a program ending in one has none either */
+    if (!program.statements.empty() &&
+        program.statements.back().type == Statement::Type::Let) {
+        emit(Opcode::Null);
+        emit(Opcode::Pop);
+    }
+}
+
+Bytecode Compiler::bytecode() {
+    Bytecode bc;
+    bc.instructions = current_instructions();
+    bc.constants = constants;
+    bc.global_names = global_names;
+    bc.local_names = local_names;
+    return bc;
+}
+
+std::vector<std::string>& Compiler::get_errors() { return errors; }
+
+void Compiler::compile_statements(const std::vector<Statement>& stmts) {
+    for (auto& stmt : stmts) {
+        compile_statement(stmt);
+    }
+}
+
+void Compiler::compile_statement(const Statement& stmt) {
+    switch (stmt.type) {
+    case Statement::Type::Let: {
+        const LetStatement& let = std::get<LetStatement>(stmt.data);
+        SymbolId name = let.name.symbol;
+        Symbol sym;
+        if (let.value.type == Expression::Type::Function) {
+            sym = define_let(name);
+            compile_function(*std::get<FunctionLiteral*>(let.value.data),
+                             &name);
+        } else {
+            /* the value sees the binding the let shadows, if any */
+            compile_expression(let.value);
+            sym = define_let(name);
+        }
+        if (sym.scope == Symbol::Scope::Global) {
+            emit(Opcode::SetGlobal, sym.index);
+        } else if (sym.cell) {
+            emit(Opcode::SetCell, sym.index);
+        } else {
+            emit(Opcode::SetLocal, sym.index);
+        }
+    } break;
+    case Statement::Type::Ret:
+        compile_expression(std::get<ReturnStatement>(stmt.data).value);
+        emit(Opcode::ReturnValue);
+        break;
+    case Statement::Type::Expression:
+        compile_expression(std::get<ExpressionStatement>(stmt.data).exp);
+        emit(Opcode::Pop);
+        break;
+    default:
+        break;
+    }
+}
+
+void Compiler::compile_expression(const Expression& exp) {
+    switch (exp.type) {
+    case Expression::Type::Integer: {
+        const IntegerLiteral& integer = std::get<IntegerLiteral>(exp.data);
+        emit(Opcode::Constant,
+             add_constant(Object(Object::Type::Int, integer.value)));
+    } break;
+    case Expression::Type::Boolean:
+        emit(std::get<BooleanLiteral>(exp.data).value ? Opcode::True
+                                                      : Opcode::False);
+        break;
+    case Expression::Type::Prefix: {
+        const PrefixExpression& pe = std::get<PrefixExpression>(exp.data);
+        compile_expression(*pe.right);
+        switch (pe.oper) {
+        case PrefixExpression::Operator::Bang:
+            emit(Opcode::Bang);
+            break;
+        case PrefixExpression::Operator::Minus:
+            emit(Opcode::Minus);
+            break;
+        }
+    } break;
+    case Expression::Type::Infix:
+        compile_infix(std::get<InfixExpression>(exp.data));
+        break;
+    case Expression::Type::If:
+        compile_if(std::get<IfExpression>(exp.data));
+        break;
+    case Expression::Type::Identifier:
+        compile_identifier(std::get<Identifier>(exp.data));
+        break;
+    case Expression::Type::Function:
+        compile_function(*std::get<FunctionLiteral*>(exp.data), nullptr);
+        break;
+    case Expression::Type::Call:
+        compile_call(std::get<CallExpression>(exp.data));
+        break;
+    default:
+        emit(Opcode::Null);
+        break;
+    }
+}
+
+void Compiler::compile_infix(const InfixExpression& infix) {
+    compile_expression(*infix.left);
+    compile_expression(*infix.right);
+    switch (infix.oper) {
+    case InfixExpression::Operator::Plus:
+        emit(Opcode::Add);
+        break;
+    case InfixExpression::Operator::Minus:
+        emit(Opcode::Sub);
+        break;
+    case InfixExpression::Operator::Asterisk:
+        emit(Opcode::Mul);
+        break;
+    case InfixExpression::Operator::Slash:
+        emit(Opcode::Div);
+        break;
+    case InfixExpression::Operator::Lt:
+        emit(Opcode::LessThan);
+        break;
+    case InfixExpression::Operator::Gt:
+        emit(Opcode::GreaterThan);
+        break;
+    case InfixExpression::Operator::Eq:
+        emit(Opcode::Equal);
+        break;
+    case InfixExpression::Operator::NotEq:
+        emit(Opcode::NotEqual);
+        break;
+    }
+}
+
+void Compiler::compile_if(const IfExpression& ife) {
+    compile_expression(*ife.condition);
+    size_t jump_not_truthy = emit(Opcode::JumpNotTruthy, 9999);
+    compile_block(ife.consequence);
+    size_t jump = emit(Opcode::Jump, 9999);
+    change_operand(jump_not_truthy, current_instructions().size());
+    if (ife.alternative.has_value()) {
+        compile_block(*ife.alternative);
+    } else {
+        emit(Opcode::Null);
+    }
+    change_operand(jump, current_instructions().size());
+}
+
+void Compiler::compile_block(const BlockStatement& block) {
+    size_t start = current_instructions().size();
+    compile_statements(block.stmts);
+    if (current_instructions().size() != start &&
+        last_instruction_is(Opcode::Pop)) {
+        /* the block's value is the value of its last expression */
+        remove_last_pop();
+    } else if (current_instructions().size() == start ||
+               !last_instruction_is(Opcode::ReturnValue)) {
+        emit(Opcode::Null);
+    }
+}
+
+void Compiler::compile_function(const FunctionLiteral& fn,
+                                const SymbolId* name) {
+    enter_scope();
+    if (name != nullptr) {
+        symbols->define_function_name(*name);
+    }
+    if (fn.lazy != nullptr) {
+        const std::vector<std::string>& errs = Parser::load_body(fn);
+        errors.insert(errors.end(), errs.begin(), errs.end());
+    }
+    LetBindings lets = let_bindings(fn);
+    for (auto& param : fn.params) {
+        symbols->define(param.symbol, lets.captured.count(param.symbol) != 0);
+    }
+    /* the lets a closure in the body may use are bound from the start */
+    for (SymbolId let : lets.early) {
+        symbols->define(let, true);
+    }
+    for (size_t idx : symbols->reserve_cells(lets.captured)) {
+        emit(Opcode::MakeCell, idx);
+    }
+    scopes.back().captured = std::move(lets.captured);
+    compile_statements(fn.body.stmts);
+    if (last_instruction_is(Opcode::Pop)) {
+        replace_last_pop_with_return();
+    }
+    if (!last_instruction_is(Opcode::ReturnValue)) {
+        emit(Opcode::Return);
+    }
+    std::vector<Symbol> free_symbols = symbols->get_free_symbols();
+    size_t num_locals = symbols->num_definitions();
+    Instructions ins = leave_scope();
+    for (auto& sym : free_symbols) {
+        load_symbol(sym);
+    }
+    auto compiled = std::make_shared<const CompiledFunction>(
+        std::move(ins), num_locals, fn.params.size());
+    size_t idx = add_constant(Object(Object::Type::CompiledFunction, compiled));
+    emit(Opcode::Closure, idx, free_symbols.size());
+}
+
+void Compiler::compile_call(const CallExpression& call) {
+    compile_expression(*call.function);
+    for (auto& arg : call.arguments) {
+        compile_expression(arg);
+    }
+    emit(Opcode::Call, call.arguments.size());
+}
+
+void Compiler::compile_identifier(const Identifier& ident) {
+    std::optional<Symbol> sym = symbols->resolve(ident.symbol);
+    if (!sym.has_value()) {
+        errors.push_back("identifier not found: " + std::string(ident.value));
+        return;
+    }
+    if (sym->cell) {
+        emit(sym->scope == Symbol::Scope::Local ? Opcode::GetCell
+                                                : Opcode::GetFreeCell,
+             sym->index, local_name(ident.symbol));
+    } else if (sym->scope == Symbol::Scope::Local) {
+        emit(Opcode::GetLocal, sym->index, local_name(ident.symbol));
+    } else {
+        load_symbol(*sym);
+    }
+}
+
+void Compiler::define_global(SymbolId name) {
+    if (symbols->resolve(name).has_value()) {
+        return;
+    }
+    Symbol sym = symbols->define(name);
+    global_names.resize(sym.index + 1);
+    global_names[sym.index] = symbol_name(name);
+}
+
+/* the symbol a let binds name to */
+Symbol Compiler::define_let(SymbolId name) {
+    if (scopes.size() == 1) {
+        define_global(name);
+        return *symbols->resolve(name);
+    }
+    return symbols->define(name, scopes.back().captured.count(name) != 0);
+}
+
+/* pushes what sym's slot holds, which for a binding kept in a cell is the
+ * cell itself */
+void Compiler::load_symbol(Symbol sym) {
+    switch (sym.scope) {
+    case Symbol::Scope::Global:
+        emit(Opcode::GetGlobal, sym.index);
+        break;
+    case Symbol::Scope::Local:
+        emit(Opcode::CaptureLocal, sym.index);
+        break;
+    case Symbol::Scope::Free:
+        emit(Opcode::GetFree, sym.index);
+        break;
+    case Symbol::Scope::Function:
+        emit(Opcode::CurrentClosure);
+        break;
+    }
+}
+
+/* the index of name in local_names */
+size_t Compiler::local_name(SymbolId name) {
+    auto it = local_name_index.find(name);
+    if (it != local_name_index.end()) {
+        return it->second;
+    }
+    local_names.push_back(std::string(symbol_name(name)));
+    local_name_index[name] = local_names.size() - 1;
+    return local_names.size() - 1;
+}
+
+size_t Compiler::add_constant(Object obj) {
+    constants.push_back(std::move(obj));
+    return constants.size() - 1;
+}
+
+/* what it means when operand i of op does not fit its width */
+static const char* operand_error(Opcode op, size_t i) {
+    switch (op) {
+    case Opcode::Constant:
+        return "too many constants";
+    case Opcode::JumpNotTruthy:
+    case Opcode::Jump:
+        return "function too long to jump across";
+    case Opcode::GetGlobal:
+    case Opcode::SetGlobal:
+        return "too many globals";
+    case Opcode::SetLocal:
+    case Opcode::CaptureLocal:
+    case Opcode::SetCell:
+    case Opcode::MakeCell:
+        return "too many locals";
+    case Opcode::GetFree:
+        return "too many free variables";
+    case Opcode::GetLocal:
+    case Opcode::GetCell:
+        return i == 0 ? "too many locals" : "too many local names";
+    case Opcode::GetFreeCell:
+        return i == 0 ? "too many free variables" : "too many local names";
+    case Opcode::Closure:
+        return i == 0 ? "too many constants" : "too many free variables";
+    case Opcode::Call:
+        return "too many arguments";
+    default:
+        return "operand out of range";
+    }
+}
+
+/* records an error for each operand of op too wide for the instruction,
+ * which would otherwise be truncated */
+void Compiler::check_operands(Opcode op, int operand, int operand2) {
+    const Definition& def = lookup_definition(op);
+    int operands[2] = {operand, operand2};
+    size_t i;
+    for (i = 0; i < def.num_operands; ++i) {
+        long max = (1L << (8 * def.operand_widths[i])) - 1;
+        if (operands[i] < 0 || operands[i] > max) {
+            const char* err = operand_error(op, i);
+            if (errors.empty() || errors.back() != err) {
+                errors.push_back(err);
+            }
+        }
+    }
+}
+
+size_t Compiler::emit(Opcode op, int operand, int operand2) {
+    check_operands(op, operand, operand2);
+    CompilationScope& scope = scopes.back();
+    size_t pos = make_instruction(scope.instructions, op, operand, operand2);
+    scope.previous = scope.last;
+    scope.last = {op, pos};
+    return pos;
+}
+
+bool Compiler::last_instruction_is(Opcode op) {
+    CompilationScope& scope = scopes.back();
+    if (scope.instructions.empty()) {
+        return false;
+    }
+    return scope.last.op == op;
+}
+
+void Compiler::remove_last_pop() {
+    CompilationScope& scope = scopes.back();
+    scope.instructions.resize(scope.last.pos);
+    scope.last = scope.previous;
+}
+
+void Compiler::replace_last_pop_with_return() {
+    CompilationScope& scope = scopes.back();
+    scope.instructions[scope.last.pos] = (uint8_t)Opcode::ReturnValue;
+    scope.last.op = Opcode::ReturnValue;
+}
+
+void Compiler::change_operand(size_t pos, int operand) {
+    Instructions& ins = current_instructions();
+    Opcode op = (Opcode)ins[pos];
+    check_operands(op, operand);
+    Instructions replacement;
+    make_instruction(replacement, op, operand);
+    std::copy(replacement.begin(), replacement.end(), ins.begin() + pos);
+}
+
+Instructions& Compiler::current_instructions() {
+    return scopes.back().instructions;
+}
+
+void Compiler::enter_scope() {
+    scopes.push_back(CompilationScope());
+    symbols = std::make_shared<SymbolTable>(symbols);
+}
+
+Instructions Compiler::leave_scope() {
+    Instructions ins = std::move(scopes.back().instructions);
+    scopes.pop_back();
+    symbols = symbols->get_outer();
+    return ins;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "ast.hh"
+#include "code.hh"
+#include "object.hh"
+#include "symbol_table.hh"
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+struct Bytecode {
+    Instructions instructions;
+    std::vector<Object> constants;
+    /* names of the global slots, used to report unbound globals */
+    std::vector<std::string> global_names;
+    /* names of the locals, used the same way */
+    std::vector<std::string> local_names;
+};
+
+class Compiler {
+  public:
+    Compiler();
+    void compile(const Program& program);
+    Bytecode bytecode();
+    std::vector<std::string>& get_errors();
+
+  private:
+    struct EmittedInstruction {
+        Opcode op;
+        size_t pos;
+    };
+    struct CompilationScope {
+        Instructions instructions;
+        EmittedInstruction last;
+        EmittedInstruction previous;
+        /* the lets of the function kept in cells */
+        std::unordered_set<SymbolId> captured;
+    };
+    std::vector<Object> constants;
+    std::vector<std::string> global_names;
+    std::vector<std::string> local_names;
+    std::unordered_map<SymbolId, size_t> local_name_index;
+    std::shared_ptr<SymbolTable> symbols;
+    std::vector<CompilationScope> scopes;
+    std::vector<std::string> errors;
+    void compile_statements(const std::vector<Statement>& stmts);
+    void compile_statement(const Statement& stmt);
+    void compile_expression(const Expression& exp);
+    void compile_infix(const InfixExpression& infix);
+    void compile_if(const IfExpression& ife);
+    void compile_block(const BlockStatement& block);
+    void compile_function(const FunctionLiteral& fn, const SymbolId* name);
+    void compile_call(const CallExpression& call);
+    void compile_identifier(const Identifier& ident);
+    void define_global(SymbolId name);
+    Symbol define_let(SymbolId name);
+    void load_symbol(Symbol sym);
+    size_t local_name(SymbolId name);
+    size_t add_constant(Object obj);
+    void check_operands(Opcode op, int operand, int operand2 = 0);
+    size_t emit(Opcode op, int operand = 0, int operand2 = 0);
+    bool last_instruction_is(Opcode op);
+    void remove_last_pop();
+    void replace_last_pop_with_return();
+    void change_operand(size_t pos, int operand);
+    Instructions& current_instructions();
+    void enter_scope();
+    Instructions leave_scope();
+};
@@ -0,0 +1,674 @@
+#include "emit_c.hh"
+#include "object.hh"
+#include "resolver.hh"
+#include <memory>
+#include <vector>
+
+/* every emitted file starts with this. mk_program is emitted after it */
+static const char* runtime = R"(#include <inttypes.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+enum { MK_NULL, MK_INT, MK_BOOL, MK_ERROR, MK_FUNCTION };
+
+typedef struct mk_env mk_env;
+typedef struct mk_literal mk_literal;
+
+typedef struct {
+    int type;
+    union {
+        int64_t i;
+        int b;
+        const char* err;
+        struct {
+            const mk_literal* lit;
+            mk_env* env;
+        } fn;
+    } u;
+} mk_value;
+
+/* a function literal: its code and how the interpreter inspects it */
+struct mk_literal {
+    mk_value (*code)(mk_env* env, const mk_value* args, int argc);
+    const char* text;
+};
+
+struct mk_env {
+    mk_env* outer;
+    mk_value slots[];
+};
+
+#define mk_null ((mk_value){MK_NULL, {0}})
+static mk_env* mk_globals;
+
+/* calls stop with a stack overflow once they are this far below main, as
+ * eval's do */
+#define MK_STACK_BYTES (4 * 1024 * 1024)
+static uintptr_t mk_stack_base;
+
+static inline mk_value mk_int(int64_t i) {
+    mk_value v;
+    v.type = MK_INT;
+    v.u.i = i;
+    return v;
+}
+
+static inline mk_value mk_bool(int b) {
+    mk_value v;
+    v.type = MK_BOOL;
+    v.u.b = b;
+    return v;
+}
+
+static inline mk_value mk_function(const mk_literal* lit, mk_env* env) {
+    mk_value v;
+    v.type = MK_FUNCTION;
+    v.u.fn.lit = lit;
+    v.u.fn.env = env;
+    return v;
+}
+
+static mk_value mk_error(const char* fmt, ...) {
+    mk_value v;
+    va_list ap;
+    char* err;
+    int n;
+    va_start(ap, fmt);
+    n = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+    err = malloc(n + 1);
+    if (err == NULL) {
+        abort();
+    }
+    va_start(ap, fmt);
+    vsnprintf(err, n + 1, fmt, ap);
+    va_end(ap);
+    v.type = MK_ERROR;
+    v.u.err = err;
+    return v;
+}
+
+static inline mk_value mk_not_found(const char* name) {
+    return mk_error("identifier not found: %s", name);
+}
+
+/* slots start out null */
+static mk_env* mk_env_new(mk_env* outer, size_t size) {
+    mk_env* env = calloc(1, sizeof(mk_env) + size * sizeof(mk_value));
+    if (env == NULL) {
+        abort();
+    }
+    env->outer = outer;
+    return env;
+}
+
+static const char* mk_type(mk_value v) {
+    switch (v.type) {
+    case MK_INT:
+        return "INTEGER";
+    case MK_BOOL:
+        return "BOOLEAN";
+    case MK_ERROR:
+        return "ERROR";
+    case MK_FUNCTION:
+        return "FUNCTION";
+    }
+    return "NULL";
+}
+
+static inline int mk_truthy(mk_value v) {
+    return v.type == MK_INT || (v.type == MK_BOOL && v.u.b);
+}
+
+static inline mk_value mk_bang(mk_value v) {
+    return mk_bool(v.type == MK_NULL || (v.type == MK_BOOL && !v.u.b));
+}
+
+static inline mk_value mk_minus(mk_value v) {
+    if (v.type != MK_INT) {
+        return mk_error("unknown operator: -%s", mk_type(v));
+    }
+    return mk_int((int64_t)(0 - (uint64_t)v.u.i));
+}
+
+/* op applied to operands that are not both integers */
+static mk_value mk_infix(const char* op, mk_value l, mk_value r) {
+    int eq;
+    if (l.type != r.type) {
+        return mk_error("type mismatch: %s %s %s", mk_type(l), op,
+                        mk_type(r));
+    }
+    if (op[0] == '=' || op[0] == '!') {
+        if (l.type == MK_FUNCTION) {
+            return mk_bool(0);
+        }
+        eq = l.type == MK_NULL || l.u.b == r.u.b;
+        return mk_bool(op[0] == '=' ? eq : !eq);
+    }
+    return mk_error("unknown operator: %s %s %s", mk_type(l), op, mk_type(r));
+}
+
+#define MK_INFIX(name, op, result)                                            \
+    static inline mk_value name(mk_value l, mk_value r) {                    \
+        if (l.type == MK_INT && r.type == MK_INT) {                           \
+            return result;                                                    \
+        }                                                                     \
+        return mk_infix(op, l, r);                                            \
+    }
+
+MK_INFIX(mk_add, "+", mk_int((int64_t)((uint64_t)l.u.i + (uint64_t)r.u.i)))
+MK_INFIX(mk_sub, "-", mk_int((int64_t)((uint64_t)l.u.i - (uint64_t)r.u.i)))
+MK_INFIX(mk_mul, "*", mk_int((int64_t)((uint64_t)l.u.i * (uint64_t)r.u.i)))
+MK_INFIX(mk_div, "/", mk_int(l.u.i / r.u.i))
+MK_INFIX(mk_lt, "<", mk_bool(l.u.i < r.u.i))
+MK_INFIX(mk_gt, ">", mk_bool(l.u.i > r.u.i))
+MK_INFIX(mk_eq, "==", mk_bool(l.u.i == r.u.i))
+MK_INFIX(mk_ne, "!=", mk_bool(l.u.i != r.u.i))
+
+/* the callee checks the number of arguments */
+static inline mk_value mk_call(mk_value f, const mk_value* args, int argc) {
+    char here;
+    if (f.type != MK_FUNCTION) {
+        return mk_error("not a function: %s", mk_type(f));
+    }
+    if (mk_stack_base - (uintptr_t)&here > MK_STACK_BYTES) {
+        return mk_error("stack overflow");
+    }
+    return f.u.fn.lit->code(f.u.fn.env, args, argc);
+}
+
+static mk_value mk_program(void);
+
+int main(void) {
+    char base;
+    mk_value v;
+    mk_stack_base = (uintptr_t)&base;
+    v = mk_program();
+    switch (v.type) {
+    case MK_INT:
+        printf("%" PRId64 "\n", v.u.i);
+        break;
+    case MK_BOOL:
+        puts(v.u.b ? "true" : "false");
+        break;
+    case MK_ERROR:
+        fprintf(stderr, "Error: %s\n", v.u.err);
+        return 1;
+    case MK_FUNCTION:
+        puts(v.u.fn.lit->text);
+        break;
+    }
+    return 0;
+}
+)";
+
+/* where the bindings of the code being emitted live */
+enum class Frame {
+    Globals, /* the top level, in mk_globals */
+    Locals,  /* a function that makes no closures, in C variables */
+    Heap,    /* a function whose frame closures may capture */
+};
+
+static bool makes_closures(const std::vector<Statement>& stmts);
+
+static bool makes_closures(const Expression& exp) {
+    switch (exp.type) {
+    case Expression::Type::Prefix:
+        return makes_closures(*std::get<PrefixExpression>(exp.data).right);
+    case Expression::Type::Infix: {
+        const InfixExpression& infix = std::get<InfixExpression>(exp.data);
+        return makes_closures(*infix.left) || makes_closures(*infix.right);
+    }
+    case Expression::Type::If: {
+        const IfExpression& ife = std::get<IfExpression>(exp.data);
+        return makes_closures(*ife.condition) ||
+               makes_closures(ife.consequence.stmts) ||
+               (ife.alternative.has_value() &&
+                makes_closures(ife.alternative->stmts));
+    }
+    case Expression::Type::Function:
+        return true;
+    case Expression::Type::Call: {
+        const CallExpression& call = std::get<CallExpression>(exp.data);
+        if (makes_closures(*call.function)) {
+            return true;
+        }
+        for (auto& arg : call.arguments) {
+            if (makes_closures(arg)) {
+                return true;
+            }
+        }
+        return false;
+    }
+    default:
+        break;
+    }
+    return false;
+}
+
+static bool makes_closures(const std::vector<Statement>& stmts) {
+    for (auto& stmt : stmts) {
+        switch (stmt.type) {
+        case Statement::Type::Let:
+            if (makes_closures(std::get<LetStatement>(stmt.data).value)) {
+                return true;
+            }
+            break;
+        case Statement::Type::Ret:
+            if (makes_closures(std::get<ReturnStatement>(stmt.data).value)) {
+                return true;
+            }
+            break;
+        case Statement::Type::Expression:
+            if (makes_closures(std::get<ExpressionStatement>(stmt.data).exp)) {
+                return true;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    return false;
+}
+
+/* s as a C string literal */
+static std::string c_string(std::string_view s) {
+    std::string res = "\"";
+    for (char ch : s) {
+        unsigned char c = ch;
+        if (c == '"' || c == '\\') {
+            res.push_back('\\');
+            res.push_back(ch);
+        } else if (c == '\n') {
+            res.append("\\n");
+        } else if (c < 0x20 || c >= 0x7f) {
+            /* octal, since a hex escape would run into a following digit */
+            res.push_back('\\');
+            res.push_back('0' + (c >> 6));
+            res.push_back('0' + ((c >> 3) & 7));
+            res.push_back('0' + (c & 7));
+        } else {
+            res.push_back(ch);
+        }
+    }
+    res.push_back('"');
+    return res;
+}
+
+/* emits C statements computing each expression into a fresh variable,
+ * followed by a check that returns any error it holds. an expression's
+ * value is therefore never an error once computed */
+class CEmitter {
+  public:
+    CEmitter(Environment& globals);
+    bool emit(const Program& program, std::string& out);
+    std::string err;
+
+  private:
+    Environment& globals;
+    std::string decls;     /* prototypes and literals */
+    std::string functions; /* the bodies of function literals */
+    std::string* code;     /* where statements are being emitted */
+    Frame frame;
+    int indent;
+    size_t num_literals;
+    size_t num_temps;
+    std::string self;   /* the mk_litN of the function being emitted */
+    size_t self_params; /* and its number of params */
+    bool loops;         /* whether it has a tail call turned into a loop */
+    void line(const std::string& s);
+    std::string temp();
+    std::string binding(int depth, int slot);
+    void check(const std::string& value);
+    bool gen_block(const std::vector<Statement>& stmts, std::string& value);
+    bool gen_statement(const Statement& stmt, std::string& value);
+    bool gen_expression(const Expression& exp, std::string& value);
+    bool gen_if(const IfExpression& ife, std::string& value);
+    bool gen_call(const CallExpression& call, std::string& value);
+    bool gen_function(const FunctionLiteral& fn, std::string& value);
+};
+
+CEmitter::CEmitter(Environment& globals)
+    : globals(globals), code(nullptr), frame(Frame::Globals), indent(0),
+      num_literals(0), num_temps(0), self_params(0), loops(false) {}
+
+bool CEmitter::emit(const Program& program, std::string& out) {
+    std::string body, value;
+    code = &body;
+    indent = 1;
+    line("mk_globals = mk_env_new(NULL, " +
+         std::to_string(globals.slots.size()) + ");");
+    if (!gen_block(program.statements, value)) {
+        return false;
+    }
+    line("return " + value + ";");
+    out.append(runtime);
+    out.append("\n");
+    out.append(decls);
+    out.append(functions);
+    out.append("static mk_value mk_program(void) {\n");
+    out.append(body);
+    out.append("}\n");
+    return true;
+}
+
+void CEmitter::line(const std::string& s) {
+    code->append(4 * indent, ' ');
+    code->append(s);
+    code->push_back('\n');
+}
+
+std::string CEmitter::temp() { return "t" + std::to_string(num_temps++); }
+
+/* the C lvalue of the binding at (depth, slot) */
+std::string CEmitter::binding(int depth, int slot) {
+    std::string s = std::to_string(slot);
+    switch (frame) {
+    case Frame::Globals:
+        return "mk_globals->slots[" + s + "]";
+    case Frame::Locals:
+        if (depth == 0) {
+            return "s" + s;
+        }
+        break;
+    case Frame::Heap:
+        if (depth == 0) {
+            return "frame->slots[" + s + "]";
+        }
+        break;
+    }
+    std::string env = "env";
+    while (--depth > 0) {
+        env.append("->outer");
+    }
+    return env + "->slots[" + s + "]";
+}
+
+void CEmitter::check(const std::string& value) {
+    line("if (" + value + ".type == MK_ERROR) {");
+    line("    return " + value + ";");
+    line("}");
+}
+
+/* value is that of the last statement, null after a let */
+bool CEmitter::gen_block(const std::vector<Statement>& stmts,
+                         std::string& value) {
+    value = "mk_null";
+    for (auto& stmt : stmts) {
+        if (!gen_statement(stmt, value)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CEmitter::gen_statement(const Statement& stmt, std::string& value) {
+    switch (stmt.type) {
+    case Statement::Type::Let: {
+        const LetStatement& let = std::get<LetStatement>(stmt.data);
+        if (!gen_expression(let.value, value)) {
+            return false;
+        }
+        line(binding(0, let.name.slot) + " = " + value + ";");
+        value = "mk_null";
+        return true;
+    }
+    case Statement::Type::Ret:
+        if (!gen_expression(std::get<ReturnStatement>(stmt.data).value,
+                            value)) {
+            return false;
+        }
+        line("return " + value + ";");
+        value = "mk_null";
+        return true;
+    case Statement::Type::Expression:
+        return gen_expression(std::get<ExpressionStatement>(stmt.data).exp,
+                              value);
+    default:
+        break;
+    }
+    value = "mk_null";
+    return true;
+}
+
+bool CEmitter::gen_expression(const Expression& exp, std::string& value) {
+    switch (exp.type) {
+    case Expression::Type::Integer:
+        value = "mk_int(INT64_C(" +
+                std::to_string(std::get<IntegerLiteral>(exp.data).value) +
+                "))";
+        return true;
+    case Expression::Type::Boolean:
+        value = std::get<BooleanLiteral>(exp.data).value ? "mk_bool(1)"
+                                                         : "mk_bool(0)";
+        return true;
+    case Expression::Type::Identifier: {
+        const Identifier& ident = std::get<Identifier>(exp.data);
+        std::string name = c_string(ident.value);
+        if (ident.slot < 0) {
+            line("return mk_not_found(" + name + ");");
+            value = "mk_null";
+            return true;
+        }
+        value = temp();
+        line("mk_value " + value + " = " +
+             binding(ident.depth, ident.slot) + ";");
+        line("if (" + value + ".type == MK_NULL) {");
+        line("    return mk_not_found(" + name + ");");
+        line("}");
+        return true;
+    }
+    case Expression::Type::Prefix: {
+        const PrefixExpression& pe = std::get<PrefixExpression>(exp.data);
+        std::string right;
+        if (!gen_expression(*pe.right, right)) {
+            return false;
+        }
+        value = temp();
+        if (pe.oper == PrefixExpression::Operator::Bang) {
+            line("mk_value " + value + " = mk_bang(" + right + ");");
+            return true;
+        }
+        line("mk_value " + value + " = mk_minus(" + right + ");");
+        check(value);
+        return true;
+    }
+    case Expression::Type::Infix: {
+        static const char* names[] = {"mk_add", "mk_sub", "mk_mul", "mk_div",
+                                      "mk_lt",  "mk_gt",  "mk_eq",  "mk_ne"};
+        const InfixExpression& infix = std::get<InfixExpression>(exp.data);
+        std::string left, right;
+        if (!gen_expression(*infix.left, left) ||
+            !gen_expression(*infix.right, right)) {
+            return false;
+        }
+        value = temp();
+        line("mk_value " + value + " = " + names[(int)infix.oper] + "(" +
+             left + ", " + right + ");");
+        check(value);
+        return true;
+    }
+    case Expression::Type::If:
+        return gen_if(std::get<IfExpression>(exp.data), value);
+    case Expression::Type::Function:
+        return gen_function(*std::get<FunctionLiteral*>(exp.data), value);
+    case Expression::Type::Call:
+        return gen_call(std::get<CallExpression>(exp.data), value);
+    default:
+        break;
+    }
+    value = "mk_null";
+    return true;
+}
+
+bool CEmitter::gen_if(const IfExpression& ife, std::string& value) {
+    std::string cond, branch;
+    if (!gen_expression(*ife.condition, cond)) {
+        return false;
+    }
+    value = temp();
+    line("mk_value " + value + " = mk_null;");
+    line("if (mk_truthy(" + cond + ")) {");
+    indent++;
+    if (!gen_block(ife.consequence.stmts, branch)) {
+        return false;
+    }
+    line(value + " = " + branch + ";");
+    indent--;
+    if (ife.alternative.has_value()) {
+        line("} else {");
+        indent++;
+        if (!gen_block(ife.alternative->stmts, branch)) {
+            return false;
+        }
+        line(value + " = " + branch + ";");
+        indent--;
+    }
+    line("}");
+    return true;
+}
+
+bool CEmitter::gen_call(const CallExpression& call, std::string& value) {
+    std::string fn, args;
+    std::vector<std::string> vals;
+    if (!gen_expression(*call.function, fn)) {
+        return false;
+    }
+    for (auto& arg : call.arguments) {
+        std::string v;
+        if (!gen_expression(arg, v)) {
+            return false;
+        }
+        args.append(args.empty() ? v : ", " + v);
+        vals.push_back(v);
+    }
+    if (call.tail && !self.empty() && vals.size() == self_params) {
+        /* a tail call to the function itself starts it over with the new
+         * arguments rather than nesting a call */
+        line("if (" + fn + ".type == MK_FUNCTION && " + fn +
+             ".u.fn.lit == &" + self + ") {");
+        size_t i, len = vals.size();
+        for (i = 0; i < len; ++i) {
+            line("    mk_args[" + std::to_string(i) + "] = " + vals[i] + ";");
+        }
+        line("    env = " + fn + ".u.fn.env;");
+        line("    args = mk_args;");
+        line("    goto mk_tail;");
+        line("}");
+        loops = true;
+    }
+    std::string argv = "NULL";
+    if (!args.empty()) {
+        argv = temp();
+        line("mk_value " + argv + "[] = {" + args + "};");
+    }
+    value = temp();
+    line("mk_value " + value + " = mk_call(" + fn + ", " + argv + ", " +
+         std::to_string(call.arguments.size()) + ");");
+    check(value);
+    return true;
+}
+
+/* the literal becomes a C function mk_fnN, called with the environment the
+ * closure captured and the arguments of the call */
+bool CEmitter::gen_function(const FunctionLiteral& fn, std::string& value) {
+    if (fn.lazy != nullptr) {
+        const std::vector<std::string>& errors = resolve_body(fn, globals);
+        if (!errors.empty()) {
+            err = errors[0];
+            return false;
+        }
+    }
+    std::string id = std::to_string(num_literals++);
+    std::string text = "fn(";
+    size_t i, len = fn.params.size();
+    for (i = 0; i < len; ++i) {
+        text.append(i == 0 ? "" : ", ");
+        text.append(fn.params[i].string());
+    }
+    text.append(") {\n" + fn.body.string() + "\n}");
+    decls.append("static mk_value mk_fn" + id +
+                 "(mk_env* env, const mk_value* args, int argc);\n");
+    decls.append("static const mk_literal mk_lit" + id + " = {mk_fn" + id +
+                 ", " + c_string(text) + "};\n");
+    value = "mk_function(&mk_lit" + id + ", " +
+            (frame == Frame::Heap ? "frame" : "mk_globals") + ")";
+
+    std::string body, result;
+    std::string* outer_code = code;
+    Frame outer_frame = frame;
+    int outer_indent = indent;
+    std::string outer_self = self;
+    size_t outer_self_params = self_params;
+    bool outer_loops = loops;
+    Frame fn_frame =
+        makes_closures(fn.body.stmts) ? Frame::Heap : Frame::Locals;
+    code = &body;
+    frame = fn_frame;
+    indent = 1;
+    self = "mk_lit" + id;
+    self_params = len;
+    loops = false;
+    line("if (argc != " + std::to_string(len) + ") {");
+    line("    return mk_error(\"wrong number of arguments: want=" +
+         std::to_string(len) + ", got=%d\", argc);");
+    line("}");
+    if (frame == Frame::Heap) {
+        line("frame = mk_env_new(env, " + std::to_string(fn.num_slots) +
+             ");");
+    } else {
+        for (i = 0; i < fn.num_slots; ++i) {
+            line("s" + std::to_string(i) + " = mk_null;");
+        }
+    }
+    for (i = 0; i < len; ++i) {
+        line(binding(0, fn.params[i].slot) + " = args[" + std::to_string(i) +
+             "];");
+    }
+    bool ok = gen_block(fn.body.stmts, result);
+    line("return " + result + ";");
+    bool looped = loops;
+    code = outer_code;
+    frame = outer_frame;
+    indent = outer_indent;
+    self = outer_self;
+    self_params = outer_self_params;
+    loops = outer_loops;
+    if (!ok) {
+        return false;
+    }
+    /* the locals are declared ahead of the label a tail call jumps to */
+    std::string vars;
+    if (fn_frame == Frame::Heap) {
+        vars.append("    mk_env* frame;\n");
+    } else {
+        for (i = 0; i < fn.num_slots; ++i) {
+            vars.append("    mk_value s" + std::to_string(i) + ";\n");
+        }
+    }
+    if (looped) {
+        /* the arguments of a tail call outlive the block computing them */
+        vars.append("    mk_value mk_args[" + std::to_string(len ? len : 1) +
+                    "];\n");
+        vars.append("mk_tail:\n");
+    }
+    functions.append("static mk_value mk_fn" + id +
+                     "(mk_env* env, const mk_value* args, int argc) {\n");
+    functions.append(vars);
+    functions.append(body);
+    functions.append("}\n\n");
+    return true;
+}
+
+bool emit_c(Program& program, std::string& out, std::string& err) {
+    std::shared_ptr<Environment> env = std::make_shared<Environment>();
+    resolve(program, *env);
+    CEmitter e(*env);
+    if (!e.emit(program, out)) {
+        err = e.err;
+        return false;
+    }
+    return true;
+}
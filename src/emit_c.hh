@@ -0,0 +1,21 @@
+#pragma once
+
+#include "ast.hh"
+#include <string>
+
+/* translates a parsed program into a self-contained C file, runtime
+ * included, that builds with any C99 compiler into a binary doing what
+ * `monkey SCRIPT` does: the value of the program is printed to stdout, or
+ * an error to stderr with exit status 1.
+ *
+ * values are tagged unions passed by value, functions are closures over
+ * heap frames and errors are values returned up to main, so the binary
+ * reports the same results and errors as eval. a function that makes no
+ * closures keeps its locals in C variables, and a tail call to itself
+ * becomes a jump back to its start. other calls stop with a stack overflow
+ * error once deep enough, as eval's do. frames that closures may capture
+ * are never freed, which only matters to long running scripts.
+ *
+ * resolves program itself, and parses any lazy function bodies. returns
+ * false and sets err when a body does not parse */
+bool emit_c(Program& program, std::string& out, std::string& err);
@@ -1,15 +1,21 @@
 #include "ast.hh"
+#include "jit.hh"
 #include "object.hh"
+#include "resolver.hh"
+#include "util.hh"
 
 const Object null_obj(Object::Type::Null, std::monostate());
 const Object true_obj(Object::Type::Bool, true);
 const Object false_obj(Object::Type::Bool, false);
 
-static Object eval_statements(std::vector<Statement>& statements,
-                              std::shared_ptr<Environment> env);
-static Object eval_statement(Statement& stmt, std::shared_ptr<Environment> env);
-static Object eval_return(ReturnStatement& ret, std::shared_ptr<Environment> env);
-static Object eval_expression(Expression& exp, std::shared_ptr<Environment> env);
+static Object eval_statements(const std::vector<Statement>& statements,
+                              const std::shared_ptr<Environment>& env);
+static Object eval_statement(const Statement& stmt,
+                             const std::shared_ptr<Environment>& env);
+static Object eval_return(const ReturnStatement& ret,
+                          const std::shared_ptr<Environment>& env);
+static Object eval_expression(const Expression& exp,
+                              const std::shared_ptr<Environment>& env);
 static Object eval_prefix(PrefixExpression::Operator oper, Object& right);
 static Object eval_bang(Object& right);
 static Object eval_minus(Object& right);
@@ -17,31 +23,39 @@ static Object eval_infix(InfixExpression::Operator oper, Object& left,
                          Object& right);
 static Object eval_integer_infix(InfixExpression::Operator oper, int64_t left,
                                  int64_t right);
-static Object eval_if(IfExpression& ife, std::shared_ptr<Environment> env);
-static Object eval_block(BlockStatement& bs, std::shared_ptr<Environment> env);
-static Object eval_identifier(Identifier& ident, std::shared_ptr<Environment> env);
-static Object eval_function(FunctionLiteral& fn, std::shared_ptr<Environment> env);
-static inline Object eval_integer(IntegerLiteral& integer);
-static inline Object eval_boolean(BooleanLiteral& boolean);
+static Object eval_if(const IfExpression& ife,
+                      const std::shared_ptr<Environment>& env);
+static Object eval_block(const BlockStatement& bs,
+                         const std::shared_ptr<Environment>& env);
+static Object eval_identifier(const Identifier& ident,
+                              const std::shared_ptr<Environment>& env);
+static Object eval_function(const FunctionLiteral& fn,
+                            const std::shared_ptr<Environment>& env);
+static inline Object eval_integer(const IntegerLiteral& integer);
+static inline Object eval_boolean(const BooleanLiteral& boolean);
 static inline Object native_bool_to_bool_obj(bool input);
-std::vector<Object> eval_expressions(std::vector<Expression>& exps,
-                                     std::shared_ptr<Environment> env);
-static Object apply_function(Function& fn, std::vector<Object>& args);
-static Environment extend_function_env(Function& fn, std::vector<Object>& args);
+std::vector<Object> eval_expressions(const std::vector<Expression>& exps,
+                                     const std::shared_ptr<Environment>& env);
+static Object apply_function(const Function& fn,
+                             const std::vector<Expression>& args,
+                             const std::shared_ptr<Environment>& env);
+static Object tail_call(const Function& fn,
+                        const std::vector<Expression>& args,
+                        const std::shared_ptr<Environment>& env);
+static Object run_tail_calls(Object& tail);
+static Object load_function(const Function& fn);
+static Object wrong_arity(size_t want, size_t got);
 static Object unwrap_return(Object& obj);
 
 static bool is_truthy(Object& obj);
 static inline bool is_error(Object& obj);
 
-template <typename... Args>
-std::string string_format(const std::string& format, Args... args);
-
-Object eval(Program& program, std::shared_ptr<Environment> env) {
+Object eval(const Program& program, const std::shared_ptr<Environment>& env) {
     return eval_statements(program.statements, env);
 }
 
-static Object eval_statements(std::vector<Statement>& statements,
-                              std::shared_ptr<Environment> env) {
+static Object eval_statements(const std::vector<Statement>& statements,
+                              const std::shared_ptr<Environment>& env) {
     Object obj;
     for (auto& stmt : statements) {
         obj = eval_statement(stmt, env);
@@ -55,15 +69,16 @@ static Object eval_statements(std::vector<Statement>& statements,
     return obj;
 }
 
-static Object eval_statement(Statement& stmt, std::shared_ptr<Environment> env) {
+static Object eval_statement(const Statement& stmt,
+                             const std::shared_ptr<Environment>& env) {
     switch (stmt.type) {
     case Statement::Type::Let: {
-        LetStatement let = std::get<LetStatement>(stmt.data);
+        const LetStatement& let = std::get<LetStatement>(stmt.data);
         Object val = eval_expression(let.value, env);
         if (is_error(val)) {
             return val;
         }
-        env->set(std::move(*let.name.value), std::move(val));
+        env->set(let.name.slot, std::move(val));
     } break;
     case Statement::Type::Ret:
         return eval_return(std::get<ReturnStatement>(stmt.data), env);
@@ -76,19 +91,21 @@ static Object eval_statement(Statement& stmt, std::shared_ptr<Environment> env)
     return null_obj;
 }
 
-static Object eval_return(ReturnStatement& ret, std::shared_ptr<Environment> env) {
+static Object eval_return(const ReturnStatement& ret,
+                          const std::shared_ptr<Environment>& env) {
     Object val = eval_expression(ret.value, env);
     return Object(Object::Type::Return, std::make_shared<Object>(val));
 }
 
-static Object eval_expression(Expression& exp, std::shared_ptr<Environment> env) {
+static Object eval_expression(const Expression& exp,
+                              const std::shared_ptr<Environment>& env) {
     switch (exp.type) {
     case Expression::Type::Integer:
         return eval_integer(std::get<IntegerLiteral>(exp.data));
     case Expression::Type::Boolean:
         return eval_boolean(std::get<BooleanLiteral>(exp.data));
     case Expression::Type::Prefix: {
-        PrefixExpression pe = std::get<PrefixExpression>(exp.data);
+        const PrefixExpression& pe = std::get<PrefixExpression>(exp.data);
         Object right = eval_expression(*pe.right, env);
         if (is_error(right)) {
             return right;
@@ -96,7 +113,7 @@ static Object eval_expression(Expression& exp, std::shared_ptr<Environment> env)
         return eval_prefix(pe.oper, right);
     };
     case Expression::Type::Infix: {
-        InfixExpression infix = std::get<InfixExpression>(exp.data);
+        const InfixExpression& infix = std::get<InfixExpression>(exp.data);
         Object left = eval_expression(*infix.left, env);
         if (is_error(left)) {
             return left;
@@ -112,23 +129,28 @@ static Object eval_expression(Expression& exp, std::shared_ptr<Environment> env)
     case Expression::Type::Identifier:
         return eval_identifier(std::get<Identifier>(exp.data), env);
     case Expression::Type::Function:
-        return eval_function(std::get<FunctionLiteral>(exp.data), env);
+        return eval_function(*std::get<FunctionLiteral*>(exp.data), env);
     case Expression::Type::Call: {
-        CallExpression call = std::get<CallExpression>(exp.data);
+        const CallExpression& call = std::get<CallExpression>(exp.data);
         Object fn = eval_expression(*call.function, env);
         if (is_error(fn)) {
             return fn;
         }
-        std::vector<Object> args = eval_expressions(call.arguments, env);
-        if (args.size() == 1 && is_error(args[0])) {
-            return args[0];
-        }
         if (fn.type != Object::Type::Function) {
+            std::vector<Object> args = eval_expressions(call.arguments, env);
+            if (args.size() == 1 && is_error(args[0])) {
+                return args[0];
+            }
             return Object(
                 Object::Type::Error,
                 string_format("not a function: %s", fn.type_to_string()));
         }
-        return apply_function(std::get<Function>(fn.value), args);
+        if (call.tail) {
+            return tail_call(std::get<Function>(fn.value), call.arguments,
+                             env);
+        }
+        return apply_function(std::get<Function>(fn.value), call.arguments,
+                              env);
     }
     default:
         break;
@@ -226,7 +248,8 @@ static Object eval_integer_infix(InfixExpression::Operator oper, int64_t left,
     return null_obj;
 }
 
-static Object eval_if(IfExpression& ife, std::shared_ptr<Environment> env) {
+static Object eval_if(const IfExpression& ife,
+                      const std::shared_ptr<Environment>& env) {
     Object cond = eval_expression(*ife.condition, env);
     if (is_error(cond)) {
         return cond;
@@ -240,7 +263,8 @@ static Object eval_if(IfExpression& ife, std::shared_ptr<Environment> env) {
     }
 }
 
-static Object eval_block(BlockStatement& bs, std::shared_ptr<Environment> env) {
+static Object eval_block(const BlockStatement& bs,
+                         const std::shared_ptr<Environment>& env) {
     Object res;
     for (auto& stmt : bs.stmts) {
         res = eval_statement(stmt, env);
@@ -254,22 +278,30 @@ static Object eval_block(BlockStatement& bs, std::shared_ptr<Environment> env) {
     return res;
 }
 
-static Object eval_identifier(Identifier& ident, std::shared_ptr<Environment> env) {
-    Object obj = env->get(*ident.value);
+static Object eval_identifier(const Identifier& ident,
+                              const std::shared_ptr<Environment>& env) {
+    if (ident.slot < 0) {
+        return Object(Object::Type::Error,
+                      "identifier not found: " + std::string(ident.value));
+    }
+    Object& obj = env->get(ident.depth, ident.slot);
     if (obj.type == Object::Type::Null) {
         return Object(Object::Type::Error,
-                      "identifier not found: " + *ident.value);
+                      "identifier not found: " + std::string(ident.value));
     }
     return obj;
 }
 
-static Object eval_function(FunctionLiteral& fn, std::shared_ptr<Environment> env) {
-    Function func(std::move(fn.params), std::move(fn.body), env);
-    return Object(Object::Type::Function, func);
+static Object eval_function(const FunctionLiteral& fn,
+                            const std::shared_ptr<Environment>& env) {
+    /* the Function shares ownership of the arena holding its literal */
+    std::shared_ptr<const FunctionLiteral> literal(
+        fn.arena->shared_from_this(), &fn);
+    return Object(Object::Type::Function, Function(std::move(literal), env));
 }
 
-std::vector<Object> eval_expressions(std::vector<Expression>& exps,
-                                     std::shared_ptr<Environment> env) {
+std::vector<Object> eval_expressions(const std::vector<Expression>& exps,
+                                     const std::shared_ptr<Environment>& env) {
     std::vector<Object> res;
     for (auto& e : exps) {
         Object obj = eval_expression(e, env);
@@ -283,20 +315,128 @@ std::vector<Object> eval_expressions(std::vector<Expression>& exps,
     return res;
 }
 
-static Object apply_function(Function& fn, std::vector<Object>& args) {
-    std::shared_ptr<Environment> extended_env = std::make_shared<Environment>(extend_function_env(fn, args));
-    Object evaluated = eval_block(fn.body, extended_env);
-    return unwrap_return(evaluated);
+/* resolves the body of a lazily parsed function before its first call */
+static Object load_function(const Function& fn) {
+    if (fn.literal->lazy != nullptr) {
+        Environment* globals = fn.env.get();
+        while (globals->outer != nullptr) {
+            globals = globals->outer.get();
+        }
+        const std::vector<std::string>& errors =
+            resolve_body(*fn.literal, *globals);
+        if (!errors.empty()) {
+            return Object(Object::Type::Error, errors[0]);
+        }
+    }
+    return null_obj;
+}
+
+/* the call's frame only links to the closure's environment, so setting it
+ * up costs the callee's slots no matter how much the enclosing scopes hold.
+ * arguments are evaluated straight into their parameter slots. a call in
+ * tail position gives back a TailCall for run_tail_calls to make here, so a
+ * chain of tail calls takes constant stack */
+static Object apply_function(const Function& fn,
+                             const std::vector<Expression>& args,
+                             const std::shared_ptr<Environment>& env) {
+    if (stack_exhausted()) {
+        return Object(Object::Type::Error, "stack overflow");
+    }
+    Object loaded = load_function(fn);
+    if (is_error(loaded)) {
+        return loaded;
+    }
+    std::shared_ptr<Environment> frame =
+        std::make_shared<Environment>(fn.env, fn.literal->num_slots);
+    const std::vector<Identifier>& params = fn.parameters();
+    size_t i, len = args.size(), num_params = params.size();
+    for (i = 0; i < len; ++i) {
+        Object arg = eval_expression(args[i], env);
+        if (is_error(arg)) {
+            return arg;
+        }
+        if (i < num_params) {
+            frame->set(params[i].slot, std::move(arg));
+        }
+    }
+    if (len != num_params) {
+        return wrong_arity(num_params, len);
+    }
+    Object res;
+    if (jit_call(*fn.literal, *frame, res)) {
+        return res;
+    }
+    Object evaluated = eval_block(fn.body(), frame);
+    res = unwrap_return(evaluated);
+    if (res.type == Object::Type::TailCall) {
+        /* drops every hold on the frame, so the tail call can reuse it */
+        evaluated = Object();
+        frame.reset();
+        return run_tail_calls(res);
+    }
+    return res;
+}
+
+/* runs tail calls until one returns something else. tail keeps the
+ * literal of the callee alive while it runs */
+static Object run_tail_calls(Object& tail) {
+    for (;;) {
+        Function& callee = std::get<Function>(tail.value);
+        std::shared_ptr<Environment> frame = std::move(callee.env);
+        Object res;
+        if (jit_call(*callee.literal, *frame, res)) {
+            return res;
+        }
+        Object evaluated = eval_block(callee.body(), frame);
+        res = unwrap_return(evaluated);
+        if (res.type != Object::Type::TailCall) {
+            return res;
+        }
+        frame.reset();
+        tail = std::move(res);
+    }
 }
 
-static Environment extend_function_env(Function& fn,
-                                       std::vector<Object>& args) {
-    Environment env = Environment(*fn.env);
-    size_t i, len = fn.parameters.size();
+/* sets up a call in tail position without making it. the frame the call is
+ * made from, env, is reused when the callee's frame would have the same
+ * size and outer scope, and no closure holds on to env. the arguments are
+ * evaluated before any slot is cleared, since they may read them */
+static Object tail_call(const Function& fn,
+                        const std::vector<Expression>& args,
+                        const std::shared_ptr<Environment>& env) {
+    Object loaded = load_function(fn);
+    if (is_error(loaded)) {
+        return loaded;
+    }
+    std::vector<Object> vals = eval_expressions(args, env);
+    if (vals.size() == 1 && is_error(vals[0])) {
+        return vals[0];
+    }
+    const std::vector<Identifier>& params = fn.parameters();
+    if (vals.size() != params.size()) {
+        return wrong_arity(params.size(), vals.size());
+    }
+    std::shared_ptr<Environment> frame;
+    if (env.use_count() == 1 && env->outer == fn.env &&
+        env->slots.size() == fn.literal->num_slots) {
+        frame = env;
+        for (auto& slot : frame->slots) {
+            slot = Object();
+        }
+    } else {
+        frame = std::make_shared<Environment>(fn.env, fn.literal->num_slots);
+    }
+    size_t i, len = params.size();
     for (i = 0; i < len; ++i) {
-        env.set(*fn.parameters[i].value, args[i]);
+        frame->set(params[i].slot, std::move(vals[i]));
     }
-    return env;
+    return Object(Object::Type::TailCall, Function(fn.literal, frame));
+}
+
+static Object wrong_arity(size_t want, size_t got) {
+    return Object(Object::Type::Error,
+                  string_format("wrong number of arguments: want=%zu, got=%zu",
+                                want, got));
 }
 
 static Object unwrap_return(Object& obj) {
@@ -306,11 +446,11 @@ static Object unwrap_return(Object& obj) {
     return obj;
 }
 
-static inline Object eval_integer(IntegerLiteral& integer) {
+static inline Object eval_integer(const IntegerLiteral& integer) {
     return Object(Object::Type::Int, integer.value);
 }
 
-static inline Object eval_boolean(BooleanLiteral& boolean) {
+static inline Object eval_boolean(const BooleanLiteral& boolean) {
     return native_bool_to_bool_obj(boolean.value);
 }
 
@@ -338,17 +478,3 @@ static bool is_truthy(Object& obj) {
 static inline bool is_error(Object& obj) {
     return obj.type == Object::Type::Error;
 }
-
-template <typename... Args>
-std::string string_format(const std::string& format, Args... args) {
-    int size_s = std::snprintf(nullptr, 0, format.c_str(), args...) +
-                 1; // Extra space for '\0'
-    if (size_s <= 0) {
-        throw std::runtime_error("Error during formatting.");
-    }
-    auto size = static_cast<size_t>(size_s);
-    std::unique_ptr<char[]> buf(new char[size]);
-    std::snprintf(buf.get(), size, format.c_str(), args...);
-    return std::string(buf.get(),
-                       buf.get() + size - 1); // We don't want the '\0' inside
-}
@@ -3,4 +3,8 @@
 #include "object.hh"
 #include "ast.hh"
 
-Object eval(Program& program, std::shared_ptr<Environment> env);
+/* evaluates a resolved program. the program is only read, so one Program can
+ * be evaluated any number of times, and from several threads at once as long
+ * as each uses its own environment. as on the vms, a call must pass exactly
+ * as many arguments as the function has params */
+Object eval(const Program& program, const std::shared_ptr<Environment>& env);
@@ -0,0 +1,206 @@
+#include "flat_ast.hh"
+#include "util.hh"
+#include <algorithm>
+
+NodeIndex FlatAst::add(Kind kind, uint32_t lhs, uint32_t rhs, uint8_t oper) {
+    NodeIndex node = kinds.size();
+    kinds.push_back(kind);
+    opers.push_back(oper);
+    this->lhs.push_back(lhs);
+    this->rhs.push_back(rhs);
+    return node;
+}
+
+uint32_t FlatAst::add_list(const std::vector<uint32_t>& items) {
+    uint32_t list = extra.size();
+    extra.push_back(items.size());
+    extra.insert(extra.end(), items.begin(), items.end());
+    return list;
+}
+
+size_t FlatAst::list_size(uint32_t list) const { return extra[list]; }
+
+const uint32_t* FlatAst::list_items(uint32_t list) const {
+    return &extra[list + 1];
+}
+
+size_t FlatAst::size() const { return kinds.size(); }
+
+size_t FlatAst::bytes() const {
+    size_t res = kinds.capacity() * sizeof(Kind) +
+                 opers.capacity() * sizeof(uint8_t) +
+                 lhs.capacity() * sizeof(uint32_t) +
+                 rhs.capacity() * sizeof(uint32_t) +
+                 extra.capacity() * sizeof(uint32_t) +
+                 integers.capacity() * sizeof(int64_t) +
+                 names.capacity() * sizeof(std::string) +
+                 statements.capacity() * sizeof(NodeIndex);
+    for (auto& name : names) {
+        if (name.capacity() > sizeof(std::string)) {
+            res += name.capacity();
+        }
+    }
+    return res;
+}
+
+/* children are added before their parents, so one pass in order sees every
+ * child's height before its parent needs it */
+void FlatAst::heights(std::vector<uint32_t>& heights) const {
+    size_t node = heights.size();
+    heights.resize(kinds.size());
+    for (; node < kinds.size(); ++node) {
+        uint32_t height = 0;
+        auto under = [&](uint32_t child) {
+            if (child != FLAT_AST_NONE && heights[child] > height) {
+                height = heights[child];
+            }
+        };
+        const uint32_t* items;
+        size_t i, len;
+        switch (kinds[node]) {
+        case Kind::Identifier:
+        case Kind::Integer:
+        case Kind::Boolean:
+            break;
+        case Kind::Prefix:
+        case Kind::Return:
+        case Kind::Expression:
+            under(lhs[node]);
+            break;
+        case Kind::Infix:
+            under(lhs[node]);
+            under(rhs[node]);
+            break;
+        case Kind::If:
+            under(lhs[node]);
+            under(list_items(rhs[node])[0]);
+            under(list_items(rhs[node])[1]);
+            break;
+        case Kind::Function:
+        case Kind::Let:
+            under(rhs[node]);
+            break;
+        case Kind::Call:
+            under(lhs[node]);
+            items = list_items(rhs[node]);
+            for (i = 0, len = list_size(rhs[node]); i < len; ++i) {
+                under(items[i]);
+            }
+            break;
+        case Kind::Block:
+            items = list_items(lhs[node]);
+            for (i = 0, len = list_size(lhs[node]); i < len; ++i) {
+                under(items[i]);
+            }
+            break;
+        }
+        bool statement = kinds[node] == Kind::Let ||
+                         kinds[node] == Kind::Return ||
+                         kinds[node] == Kind::Expression;
+        heights[node] = statement ? std::max(height, 1u) : height + 1;
+    }
+}
+
+std::string FlatAst::string() const {
+    std::string res;
+    for (auto stmt : statements) {
+        res.append(string(stmt));
+    }
+    return res;
+}
+
+std::string FlatAst::string(NodeIndex node) const {
+    if (node == FLAT_AST_NONE) {
+        return "";
+    }
+    std::string res;
+    switch (kinds[node]) {
+    case Kind::Identifier:
+        return names[lhs[node]];
+    case Kind::Integer:
+        return std::to_string(integers[lhs[node]]);
+    case Kind::Boolean:
+        return lhs[node] ? "true" : "false";
+    case Kind::Prefix:
+        res.push_back('(');
+        res.append(
+            prefix_oper_to_string((PrefixExpression::Operator)opers[node]));
+        res.append(string(lhs[node]));
+        res.push_back(')');
+        return res;
+    case Kind::Infix:
+        res.push_back('(');
+        res.append(string(lhs[node]));
+        res.push_back(' ');
+        res.append(
+            infix_oper_to_string((InfixExpression::Operator)opers[node]));
+        res.push_back(' ');
+        res.append(string(rhs[node]));
+        res.push_back(')');
+        return res;
+    case Kind::If: {
+        const uint32_t* blocks = list_items(rhs[node]);
+        res.append("if");
+        res.append(string(lhs[node]));
+        res.push_back(' ');
+        res.append(string(blocks[0]));
+        if (blocks[1] != FLAT_AST_NONE) {
+            res.append("else ");
+            res.append(string(blocks[1]));
+        }
+        return res;
+    }
+    case Kind::Function: {
+        size_t i, len = list_size(lhs[node]);
+        const uint32_t* params = list_items(lhs[node]);
+        res.append("fn(");
+        for (i = 0; i < len; ++i) {
+            res.append(names[params[i]]);
+            if (i != len - 1) {
+                res.append(", ");
+            }
+        }
+        res.append(") ");
+        res.append(string(rhs[node]));
+        return res;
+    }
+    case Kind::Call: {
+        size_t i, len = list_size(rhs[node]);
+        const uint32_t* args = list_items(rhs[node]);
+        res.append(string(lhs[node]));
+        res.push_back('(');
+        for (i = 0; i < len; ++i) {
+            res.append(string(args[i]));
+            if (i != len - 1) {
+                res.append(", ");
+            }
+        }
+        res.push_back(')');
+        return res;
+    }
+    case Kind::Block: {
+        size_t i, len = list_size(lhs[node]);
+        const uint32_t* stmts = list_items(lhs[node]);
+        for (i = 0; i < len; ++i) {
+            res.append(string(stmts[i]));
+        }
+        return res;
+    }
+    case Kind::Let:
+        res.append("let ");
+        res.append(names[lhs[node]]);
+        res.append(" = ");
+        res.append(string(rhs[node]));
+        res.push_back(';');
+        return res;
+    case Kind::Return:
+        res.append("return ");
+        res.append(string(lhs[node]));
+        res.push_back(';');
+        return res;
+    case Kind::Expression:
+        return string(lhs[node]);
+    }
+    unreachable;
+    return "";
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "ast.hh"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+typedef uint32_t NodeIndex;
+
+#define FLAT_AST_NONE UINT32_MAX
+
+/* an index based, struct of arrays form of the ast. node i is described by
+ * kinds[i], opers[i], lhs[i] and rhs[i]; children are 32 bit indices into the
+ * same arrays and literals live in side tables, so a node costs 10 bytes and
+ * a walk over the tree touches a handful of contiguous arrays.
+ *
+ *   kind        oper       lhs                rhs
+ *   Identifier             names index
+ *   Integer                integers index
+ *   Boolean                0 or 1
+ *   Prefix      operator   right
+ *   Infix       operator   left               right
+ *   If                     condition          extra: consequence, alternative
+ *   Function               extra: params      body block
+ *   Call                   function           extra: arguments
+ *   Block                  extra: statements
+ *   Let                    names index        value
+ *   Return                 value
+ *   Expression             expression
+ *
+ * "extra: xs" is an offset into extra holding a count followed by that many
+ * entries. an alternative of FLAT_AST_NONE means there is no else block, and
+ * a child of FLAT_AST_NONE is an expression that failed to parse */
+struct FlatAst {
+    enum class Kind : uint8_t {
+        Identifier,
+        Integer,
+        Boolean,
+        Prefix,
+        Infix,
+        If,
+        Function,
+        Call,
+        Block,
+        Let,
+        Return,
+        Expression,
+    };
+    std::vector<Kind> kinds;
+    std::vector<uint8_t> opers;
+    std::vector<uint32_t> lhs;
+    std::vector<uint32_t> rhs;
+    std::vector<uint32_t> extra;
+    std::vector<int64_t> integers;
+    std::vector<std::string> names;
+    std::vector<NodeIndex> statements; /* the top level statements */
+
+    NodeIndex add(Kind kind, uint32_t lhs, uint32_t rhs = 0, uint8_t oper = 0);
+    uint32_t add_list(const std::vector<uint32_t>& items);
+    size_t list_size(uint32_t list) const;
+    const uint32_t* list_items(uint32_t list) const;
+    size_t size() const;
+    size_t bytes() const;
+    /* extends heights to cover every node, with the most nodes on a path
+     * down from each. a statement counts as the height of what it holds,
+     * as in the tree parser */
+    void heights(std::vector<uint32_t>& heights) const;
+    std::string string() const;
+    std::string string(NodeIndex node) const;
+};
@@ -0,0 +1,44 @@
+#include "intern.hh"
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+
+struct Interner {
+    std::shared_mutex mu;
+    /* a deque never moves its elements, so the views into it stay valid */
+    std::deque<std::string> names;
+    std::unordered_map<std::string_view, SymbolId> ids;
+};
+
+static Interner& interner() {
+    static Interner in;
+    return in;
+}
+
+SymbolId intern(std::string_view name) {
+    Interner& in = interner();
+    {
+        std::shared_lock<std::shared_mutex> lock(in.mu);
+        auto it = in.ids.find(name);
+        if (it != in.ids.end()) {
+            return it->second;
+        }
+    }
+    std::unique_lock<std::shared_mutex> lock(in.mu);
+    auto it = in.ids.find(name);
+    if (it != in.ids.end()) {
+        return it->second;
+    }
+    SymbolId id = in.names.size();
+    in.names.emplace_back(name);
+    in.ids.emplace(in.names.back(), id);
+    return id;
+}
+
+std::string_view symbol_name(SymbolId id) {
+    Interner& in = interner();
+    std::shared_lock<std::shared_mutex> lock(in.mu);
+    return in.names[id];
+}
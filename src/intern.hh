@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+typedef uint32_t SymbolId;
+
+/* identifier text is interned once per process into a dense id, so names are
+ * compared and hashed as integers. interning is thread safe, and the text
+ * of an interned name lives until the process exits */
+SymbolId intern(std::string_view name);
+std::string_view symbol_name(SymbolId id);
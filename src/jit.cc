@@ -0,0 +1,589 @@
+#include "jit.hh"
+#include <atomic>
+#include <cstring>
+#include <initializer_list>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) && defined(__linux__) &&                              \
+    (defined(__GNUC__) || defined(__clang__))
+#define JIT_X86 1
+#include <pthread.h>
+#include <sys/mman.h>
+#endif
+
+/* what native code needs from the call that entered it. the offsets of the
+ * fields are used by the generated code */
+struct JitContext {
+    void* saved_sp;    /* rsp at entry, restored to unwind an overflow */
+    void* stack_limit; /* the lowest rsp a body may start at */
+    int64_t overflowed;
+};
+
+/* the native code of a literal, made the first time the literal is hot.
+ * entry is null when the body cannot be compiled */
+struct JitCode {
+    void* mem;
+    size_t size;
+    int64_t (*entry)(const int64_t* args, JitContext* ctx);
+    bool returns_bool;
+    /* the (depth, slot) addresses the body calls itself through, which must
+     * still hold a Function of the literal when the code is run */
+    std::vector<std::pair<int, int>> self_calls;
+    JitCode();
+    ~JitCode();
+};
+
+JitCode::JitCode()
+    : mem(nullptr), size(0), entry(nullptr), returns_bool(false) {}
+
+#ifdef JIT_X86
+
+static std::atomic<bool> enabled(true);
+static std::mutex jit_mu;
+
+JitCode::~JitCode() {
+    if (mem != nullptr) {
+        munmap(mem, size);
+    }
+}
+
+enum class JitType {
+    None,
+    Int,
+    Bool,
+};
+
+/* appends x86-64 machine code to a buffer */
+class Assembler {
+  public:
+    std::vector<uint8_t> code;
+    void bytes(std::initializer_list<uint8_t> bs) {
+        code.insert(code.end(), bs.begin(), bs.end());
+    }
+    void imm32(int32_t value) { raw(&value, sizeof value); }
+    void imm64(int64_t value) { raw(&value, sizeof value); }
+    /* emits op followed by a rel32 to be patched, returning where the
+     * rel32 is */
+    size_t jump(std::initializer_list<uint8_t> op) {
+        bytes(op);
+        size_t at = code.size();
+        imm32(0);
+        return at;
+    }
+    void patch(size_t at, size_t target) {
+        int32_t rel = (int32_t)((int64_t)target - (int64_t)(at + 4));
+        std::memcpy(&code[at], &rel, sizeof rel);
+    }
+
+  private:
+    void raw(const void* p, size_t n) {
+        const uint8_t* b = (const uint8_t*)p;
+        code.insert(code.end(), b, b + n);
+    }
+};
+
+/* compiles one literal, assuming every param is an integer and the body
+ * returns ret. values are computed into rax, with temporaries pushed on
+ * the stack and locals at rbp - 8 * (slot + 1). r12 holds the JitContext */
+class JitCompiler {
+  public:
+    JitCompiler(const FunctionLiteral& fn, Environment& frame, JitType ret);
+    bool compile();
+    Assembler as;
+    std::vector<std::pair<int, int>> self_calls;
+
+  private:
+    const FunctionLiteral& fn;
+    Environment& frame; /* of the call that made the literal hot */
+    JitType ret;
+    std::vector<JitType> slots; /* None until assigned */
+    std::vector<size_t> body_calls;
+    size_t loop; /* where the body starts once its params are set */
+    bool gen_block(const BlockStatement& block, bool value, JitType& type,
+                   bool top);
+    bool gen_statement(const Statement& stmt, bool top);
+    bool gen_expression(const Expression& exp, JitType& type);
+    bool gen_infix(const InfixExpression& infix, JitType& type);
+    bool gen_if(const IfExpression& ife, bool value, JitType& type);
+    bool gen_call(const CallExpression& call, JitType& type);
+    bool local(const Expression& exp, int32_t& offset);
+    void gen_return();
+};
+
+static inline int32_t slot_offset(int slot) { return -8 * (slot + 1); }
+
+JitCompiler::JitCompiler(const FunctionLiteral& fn, Environment& frame,
+                         JitType ret)
+    : fn(fn), frame(frame), ret(ret), slots(fn.num_slots, JitType::None),
+      loop(0) {}
+
+bool JitCompiler::compile() {
+    size_t i, n = fn.params.size();
+    if (n > JIT_MAX_PARAMS) {
+        return false;
+    }
+    /* entry(args, ctx): saves the registers it uses and calls the body */
+    as.bytes({0x55});             /* push rbp */
+    as.bytes({0x41, 0x54});       /* push r12 */
+    as.bytes({0x49, 0x89, 0xf4}); /* mov r12, rsi */
+    as.bytes({0x49, 0x89, 0x24, 0x24}); /* mov [r12], rsp */
+    body_calls.push_back(as.jump({0xe8}));
+    as.bytes({0x41, 0x5c, 0x5d, 0xc3}); /* pop r12; pop rbp; ret */
+    /* a body out of stack unwinds every native frame at once */
+    size_t overflow = as.code.size();
+    as.bytes({0x49, 0x8b, 0x24, 0x24}); /* mov rsp, [r12] */
+    as.bytes({0x49, 0xc7, 0x44, 0x24, 0x10}); /* mov qword [r12 + 16], */
+    as.imm32(1);
+    as.bytes({0x41, 0x5c, 0x5d, 0xc3}); /* pop r12; pop rbp; ret */
+
+    /* body(args): args[n - 1 - i] is param i */
+    size_t body = as.code.size();
+    as.bytes({0x55});                         /* push rbp */
+    as.bytes({0x48, 0x89, 0xe5});             /* mov rbp, rsp */
+    as.bytes({0x49, 0x3b, 0x64, 0x24, 0x08}); /* cmp rsp, [r12 + 8] */
+    as.patch(as.jump({0x0f, 0x82}), overflow); /* jb overflow */
+    as.bytes({0x48, 0x81, 0xec});             /* sub rsp, */
+    as.imm32(8 * fn.num_slots);
+    for (i = 0; i < n; ++i) {
+        int slot = fn.params[i].slot;
+        if (slot < 0 || (size_t)slot >= slots.size() ||
+            slots[slot] != JitType::None) {
+            return false;
+        }
+        slots[slot] = JitType::Int;
+        as.bytes({0x48, 0x8b, 0x87}); /* mov rax, [rdi + disp] */
+        as.imm32(8 * (n - 1 - i));
+        as.bytes({0x48, 0x89, 0x85}); /* mov [rbp + disp], rax */
+        as.imm32(slot_offset(slot));
+    }
+    loop = as.code.size();
+    JitType type;
+    if (!gen_block(fn.body, true, type, true) || type != ret) {
+        return false;
+    }
+    gen_return();
+    for (size_t at : body_calls) {
+        as.patch(at, body);
+    }
+    return true;
+}
+
+/* a block's value is that of its last statement. lets are only allowed in
+ * the function's own block, where they are sure to have run before any
+ * later statement */
+bool JitCompiler::gen_block(const BlockStatement& block, bool value,
+                            JitType& type, bool top) {
+    size_t i, len = block.stmts.size();
+    if (len == 0) {
+        return !value;
+    }
+    for (i = 0; i < len - 1; ++i) {
+        if (!gen_statement(block.stmts[i], top)) {
+            return false;
+        }
+    }
+    const Statement& last = block.stmts[len - 1];
+    if (!value) {
+        return gen_statement(last, top);
+    }
+    switch (last.type) {
+    case Statement::Type::Ret:
+        type = ret;
+        return gen_statement(last, top);
+    case Statement::Type::Expression: {
+        const Expression& exp = std::get<ExpressionStatement>(last.data).exp;
+        return gen_expression(exp, type);
+    }
+    default:
+        break;
+    }
+    return false;
+}
+
+bool JitCompiler::gen_statement(const Statement& stmt, bool top) {
+    JitType type;
+    switch (stmt.type) {
+    case Statement::Type::Let: {
+        const LetStatement& let = std::get<LetStatement>(stmt.data);
+        int slot = let.name.slot;
+        if (!top || !gen_expression(let.value, type)) {
+            return false;
+        }
+        if (slots[slot] != JitType::None && slots[slot] != type) {
+            return false;
+        }
+        slots[slot] = type;
+        as.bytes({0x48, 0x89, 0x85}); /* mov [rbp + disp], rax */
+        as.imm32(slot_offset(slot));
+        return true;
+    }
+    case Statement::Type::Ret:
+        if (!gen_expression(std::get<ReturnStatement>(stmt.data).value,
+                            type) ||
+            type != ret) {
+            return false;
+        }
+        gen_return();
+        return true;
+    case Statement::Type::Expression: {
+        const Expression& exp = std::get<ExpressionStatement>(stmt.data).exp;
+        if (exp.type == Expression::Type::If) {
+            return gen_if(std::get<IfExpression>(exp.data), false, type);
+        }
+        return gen_expression(exp, type);
+    }
+    default:
+        break;
+    }
+    return false;
+}
+
+bool JitCompiler::gen_expression(const Expression& exp, JitType& type) {
+    switch (exp.type) {
+    case Expression::Type::Integer:
+        as.bytes({0x48, 0xb8}); /* mov rax, imm64 */
+        as.imm64(std::get<IntegerLiteral>(exp.data).value);
+        type = JitType::Int;
+        return true;
+    case Expression::Type::Boolean:
+        as.bytes({0xb8}); /* mov eax, imm32 */
+        as.imm32(std::get<BooleanLiteral>(exp.data).value);
+        type = JitType::Bool;
+        return true;
+    case Expression::Type::Identifier: {
+        int32_t offset;
+        if (!local(exp, offset)) {
+            return false;
+        }
+        as.bytes({0x48, 0x8b, 0x85}); /* mov rax, [rbp + disp] */
+        as.imm32(offset);
+        type = slots[std::get<Identifier>(exp.data).slot];
+        return true;
+    }
+    case Expression::Type::Prefix: {
+        const PrefixExpression& pe = std::get<PrefixExpression>(exp.data);
+        if (!gen_expression(*pe.right, type)) {
+            return false;
+        }
+        if (pe.oper == PrefixExpression::Operator::Minus) {
+            as.bytes({0x48, 0xf7, 0xd8}); /* neg rax */
+            return type == JitType::Int;
+        }
+        if (type == JitType::Int) {
+            as.bytes({0x31, 0xc0}); /* xor eax, eax */
+        } else {
+            as.bytes({0x83, 0xf0, 0x01}); /* xor eax, 1 */
+        }
+        type = JitType::Bool;
+        return true;
+    }
+    case Expression::Type::Infix:
+        return gen_infix(std::get<InfixExpression>(exp.data), type);
+    case Expression::Type::If:
+        return gen_if(std::get<IfExpression>(exp.data), true, type);
+    case Expression::Type::Call:
+        return gen_call(std::get<CallExpression>(exp.data), type);
+    default:
+        break;
+    }
+    return false;
+}
+
+/* left ends up in rax and right in rcx. a literal or local on the right is
+ * loaded straight into rcx */
+bool JitCompiler::gen_infix(const InfixExpression& infix, JitType& type) {
+    JitType left, right;
+    int32_t offset;
+    if (!gen_expression(*infix.left, left)) {
+        return false;
+    }
+    const Expression& rexp = *infix.right;
+    if (rexp.type == Expression::Type::Integer &&
+        std::get<IntegerLiteral>(rexp.data).value >= INT32_MIN &&
+        std::get<IntegerLiteral>(rexp.data).value <= INT32_MAX) {
+        as.bytes({0x48, 0xc7, 0xc1}); /* mov rcx, imm32 */
+        as.imm32(std::get<IntegerLiteral>(rexp.data).value);
+        right = JitType::Int;
+    } else if (local(rexp, offset)) {
+        as.bytes({0x48, 0x8b, 0x8d}); /* mov rcx, [rbp + disp] */
+        as.imm32(offset);
+        right = slots[std::get<Identifier>(rexp.data).slot];
+    } else {
+        as.bytes({0x50}); /* push rax */
+        if (!gen_expression(rexp, right)) {
+            return false;
+        }
+        as.bytes({0x48, 0x89, 0xc1}); /* mov rcx, rax */
+        as.bytes({0x58});             /* pop rax */
+    }
+    /* mismatched or non-integer operands are errors for eval to report */
+    if (left != right) {
+        return false;
+    }
+    type = JitType::Int;
+    switch (infix.oper) {
+    case InfixExpression::Operator::Plus:
+        as.bytes({0x48, 0x01, 0xc8}); /* add rax, rcx */
+        return left == JitType::Int;
+    case InfixExpression::Operator::Minus:
+        as.bytes({0x48, 0x29, 0xc8}); /* sub rax, rcx */
+        return left == JitType::Int;
+    case InfixExpression::Operator::Asterisk:
+        as.bytes({0x48, 0x0f, 0xaf, 0xc1}); /* imul rax, rcx */
+        return left == JitType::Int;
+    case InfixExpression::Operator::Slash:
+        as.bytes({0x48, 0x99});       /* cqo */
+        as.bytes({0x48, 0xf7, 0xf9}); /* idiv rcx */
+        return left == JitType::Int;
+    default:
+        break;
+    }
+    type = JitType::Bool;
+    as.bytes({0x48, 0x39, 0xc8}); /* cmp rax, rcx */
+    switch (infix.oper) {
+    case InfixExpression::Operator::Lt:
+        as.bytes({0x0f, 0x9c, 0xc0}); /* setl al */
+        break;
+    case InfixExpression::Operator::Gt:
+        as.bytes({0x0f, 0x9f, 0xc0}); /* setg al */
+        break;
+    case InfixExpression::Operator::Eq:
+        as.bytes({0x0f, 0x94, 0xc0}); /* sete al */
+        break;
+    default:
+        as.bytes({0x0f, 0x95, 0xc0}); /* setne al */
+        break;
+    }
+    as.bytes({0x0f, 0xb6, 0xc0}); /* movzx eax, al */
+    return left == JitType::Int ||
+           infix.oper == InfixExpression::Operator::Eq ||
+           infix.oper == InfixExpression::Operator::NotEq;
+}
+
+/* an integer condition is always truthy, so only its consequence runs. an
+ * if used as a value needs both branches to give the same type */
+bool JitCompiler::gen_if(const IfExpression& ife, bool value, JitType& type) {
+    JitType cond, alt;
+    if (!gen_expression(*ife.condition, cond)) {
+        return false;
+    }
+    if (cond == JitType::Int) {
+        return gen_block(ife.consequence, value, type, false);
+    }
+    as.bytes({0x48, 0x85, 0xc0}); /* test rax, rax */
+    size_t to_alt = as.jump({0x0f, 0x84});
+    if (!gen_block(ife.consequence, value, type, false)) {
+        return false;
+    }
+    size_t to_end = as.jump({0xe9});
+    as.patch(to_alt, as.code.size());
+    if (ife.alternative.has_value()) {
+        if (!gen_block(*ife.alternative, value, alt, false)) {
+            return false;
+        }
+    } else if (value) {
+        return false;
+    }
+    as.patch(to_end, as.code.size());
+    return !value || type == alt;
+}
+
+/* only calls the function makes to itself are compiled. they pass the
+ * arguments on the stack, as entry does. a call in tail position instead
+ * sets the params and jumps back to the start of the body */
+bool JitCompiler::gen_call(const CallExpression& call, JitType& type) {
+    const Expression& callee = *call.function;
+    if (callee.type != Expression::Type::Identifier ||
+        call.arguments.size() != fn.params.size()) {
+        return false;
+    }
+    const Identifier& ident = std::get<Identifier>(callee.data);
+    if (ident.depth < 1 || ident.slot < 0) {
+        return false;
+    }
+    Object& binding = frame.get(ident.depth, ident.slot);
+    if (binding.type != Object::Type::Function ||
+        std::get<Function>(binding.value).literal.get() != &fn) {
+        return false;
+    }
+    std::pair<int, int> addr(ident.depth, ident.slot);
+    bool known = false;
+    for (auto& a : self_calls) {
+        known = known || a == addr;
+    }
+    if (!known) {
+        self_calls.push_back(addr);
+    }
+    for (auto& arg : call.arguments) {
+        JitType arg_type;
+        if (!gen_expression(arg, arg_type) || arg_type != JitType::Int) {
+            return false;
+        }
+        as.bytes({0x50}); /* push rax */
+    }
+    type = ret;
+    if (call.tail) {
+        size_t i;
+        for (i = call.arguments.size(); i-- > 0;) {
+            as.bytes({0x58});             /* pop rax */
+            as.bytes({0x48, 0x89, 0x85}); /* mov [rbp + disp], rax */
+            as.imm32(slot_offset(fn.params[i].slot));
+        }
+        as.patch(as.jump({0xe9}), loop);
+        return true;
+    }
+    as.bytes({0x48, 0x89, 0xe7}); /* mov rdi, rsp */
+    body_calls.push_back(as.jump({0xe8}));
+    as.bytes({0x48, 0x81, 0xc4}); /* add rsp, */
+    as.imm32(8 * call.arguments.size());
+    return true;
+}
+
+/* the frame offset of a local that has been assigned */
+bool JitCompiler::local(const Expression& exp, int32_t& offset) {
+    if (exp.type != Expression::Type::Identifier) {
+        return false;
+    }
+    const Identifier& ident = std::get<Identifier>(exp.data);
+    if (ident.depth != 0 || ident.slot < 0 ||
+        slots[ident.slot] == JitType::None) {
+        return false;
+    }
+    offset = slot_offset(ident.slot);
+    return true;
+}
+
+void JitCompiler::gen_return() {
+    as.bytes({0x48, 0x89, 0xec}); /* mov rsp, rbp */
+    as.bytes({0x5d, 0xc3});       /* pop rbp; ret */
+}
+
+/* copies the code into an executable mapping, never writable and
+ * executable at once */
+static bool install(JitCode& code, const std::vector<uint8_t>& bytes) {
+    size_t size = bytes.size();
+    void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        return false;
+    }
+    std::memcpy(mem, bytes.data(), size);
+    if (mprotect(mem, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(mem, size);
+        return false;
+    }
+    code.mem = mem;
+    code.size = size;
+    code.entry = (int64_t(*)(const int64_t*, JitContext*))mem;
+    return true;
+}
+
+static JitCode* compile_literal(const FunctionLiteral& literal,
+                                Environment& frame) {
+    std::lock_guard<std::mutex> lock(jit_mu);
+    JitCode* code = literal.jit.load(std::memory_order_relaxed);
+    if (code != nullptr) {
+        return code;
+    }
+    std::shared_ptr<JitCode> fresh = std::make_shared<JitCode>();
+    for (JitType ret : {JitType::Int, JitType::Bool}) {
+        JitCompiler c(literal, frame, ret);
+        if (c.compile() && install(*fresh, c.as.code)) {
+            fresh->returns_bool = ret == JitType::Bool;
+            fresh->self_calls = std::move(c.self_calls);
+            break;
+        }
+    }
+    code = fresh.get();
+    literal.jit_owner = std::move(fresh);
+    literal.jit.store(code, std::memory_order_release);
+    return code;
+}
+
+static void* thread_stack_limit() {
+    static thread_local void* limit = nullptr;
+    if (limit == nullptr) {
+        pthread_attr_t attr;
+        void* addr;
+        size_t size;
+        if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+            pthread_attr_getstack(&attr, &addr, &size);
+            pthread_attr_destroy(&attr);
+            limit = (char*)addr + JIT_STACK_MARGIN;
+        } else {
+            limit = (char*)__builtin_frame_address(0) - 16 * JIT_STACK_MARGIN;
+        }
+    }
+    return limit;
+}
+
+bool jit_call(const FunctionLiteral& literal, Environment& frame,
+              Object& res) {
+    if (!enabled.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    JitCode* code = literal.jit.load(std::memory_order_acquire);
+    if (code == nullptr) {
+        if (literal.calls.fetch_add(1, std::memory_order_relaxed) + 1 <
+            JIT_HOT_CALLS) {
+            return false;
+        }
+        code = compile_literal(literal, frame);
+    }
+    if (code->entry == nullptr) {
+        return false;
+    }
+    /* guards: the code assumes integer params and that it calls itself */
+    size_t i, n = literal.params.size();
+    int64_t args[JIT_MAX_PARAMS];
+    for (i = 0; i < n; ++i) {
+        const Object& arg = frame.slots[literal.params[i].slot];
+        if (arg.type != Object::Type::Int) {
+            return false;
+        }
+        args[n - 1 - i] = std::get<int64_t>(arg.value);
+    }
+    for (auto& addr : code->self_calls) {
+        Object& binding = frame.get(addr.first, addr.second);
+        if (binding.type != Object::Type::Function ||
+            std::get<Function>(binding.value).literal.get() != &literal) {
+            return false;
+        }
+    }
+    JitContext ctx = {nullptr, thread_stack_limit(), 0};
+    int64_t value = code->entry(args, &ctx);
+    if (ctx.overflowed) {
+        res = Object(Object::Type::Error, "stack overflow");
+    } else if (code->returns_bool) {
+        res = Object(Object::Type::Bool, value != 0);
+    } else {
+        res = Object(Object::Type::Int, value);
+    }
+    return true;
+}
+
+bool jit_enable(bool enable) {
+    enabled.store(enable, std::memory_order_relaxed);
+    return true;
+}
+
+bool jit_enabled() { return enabled.load(std::memory_order_relaxed); }
+
+#else
+
+JitCode::~JitCode() {}
+
+bool jit_call(const FunctionLiteral&, Environment&, Object&) { return false; }
+
+bool jit_enable(bool enable) { return !enable; }
+
+bool jit_enabled() { return false; }
+
+#endif
+
+bool jit_compiled(const FunctionLiteral& fn) {
+    JitCode* code = fn.jit.load(std::memory_order_acquire);
+    return code != nullptr && code->entry != nullptr;
+}
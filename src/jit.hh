@@ -0,0 +1,35 @@
+#pragma once
+
+#include "ast.hh"
+#include "object.hh"
+
+#define JIT_HOT_CALLS 50
+#define JIT_MAX_PARAMS 16
+/* native code stops with a stack overflow this close to the end of the
+ * thread's stack. that is far deeper than the interpreter's
+ * INTERP_STACK_BYTES or the vms' VM_MAX_FRAMES, so once a function is hot
+ * it can finish recursion the other backends stop as a stack overflow */
+#define JIT_STACK_MARGIN (64 * 1024)
+
+/* a baseline jit for functions that only compute with integers and
+ * booleans. once a function has been called JIT_HOT_CALLS times its body is
+ * compiled to x86-64 code, which then runs every call whose arguments are
+ * all integers. the body may use its params, lets, integer and boolean
+ * literals, prefix and infix operators, if, return and calls to the
+ * function itself. anything else, or an argument that is not an integer,
+ * leaves the call to the interpreter.
+ *
+ * only supported on x86-64 linux. elsewhere jit_call always declines */
+
+/* runs a call to fn natively if it can. frame is the call's frame, holding
+ * its arguments in their param slots. returns false, leaving res alone,
+ * when the call has to be interpreted */
+bool jit_call(const FunctionLiteral& fn, Environment& frame, Object& res);
+
+/* whether the body of fn has been compiled to native code */
+bool jit_compiled(const FunctionLiteral& fn);
+
+bool jit_enabled();
+/* turns the jit on or off for every thread. returns false and changes
+ * nothing when turning it on where it is not supported */
+bool jit_enable(bool enable);
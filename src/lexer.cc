@@ -1,128 +1,154 @@
 #include "lexer.hh"
+#include "scan.hh"
 #include "token.hh"
-#include "util.hh"
-#include <memory>
 
-Lexer::Lexer(const std::string& input) : input(input), pos(0), ch(0) {
-    read_char();
+enum class CharClass : uint8_t {
+    Other,
+    End,
+    Space,
+    Letter,
+    Digit,
+    Punct,
+};
+
+struct CharTables {
+    CharClass cls[256];
+    Token::Type punct[256]; /* the token a Punct character starts */
+};
+
+static constexpr CharTables make_char_tables() {
+    CharTables t{};
+    int c = 0;
+    for (c = 0; c < 256; ++c) {
+        t.cls[c] = CharClass::Other;
+        t.punct[c] = Token::Type::Illegal;
+    }
+    t.cls[0] = CharClass::End;
+    t.cls[(uint8_t)' '] = CharClass::Space;
+    t.cls[(uint8_t)'\t'] = CharClass::Space;
+    t.cls[(uint8_t)'\n'] = CharClass::Space;
+    t.cls[(uint8_t)'\r'] = CharClass::Space;
+    for (c = 'a'; c <= 'z'; ++c) {
+        t.cls[c] = CharClass::Letter;
+    }
+    for (c = 'A'; c <= 'Z'; ++c) {
+        t.cls[c] = CharClass::Letter;
+    }
+    t.cls[(uint8_t)'_'] = CharClass::Letter;
+    for (c = '0'; c <= '9'; ++c) {
+        t.cls[c] = CharClass::Digit;
+    }
+    const struct {
+        char ch;
+        Token::Type type;
+    } puncts[] = {
+        {'=', Token::Type::Assign},   {'+', Token::Type::Plus},
+        {';', Token::Type::Semicolon}, {',', Token::Type::Comma},
+        {'(', Token::Type::LParen},   {')', Token::Type::RParen},
+        {'{', Token::Type::LSquirly}, {'}', Token::Type::RSquirly},
+        {'!', Token::Type::Bang},     {'-', Token::Type::Minus},
+        {'/', Token::Type::Slash},    {'*', Token::Type::Asterisk},
+        {'<', Token::Type::Lt},       {'>', Token::Type::Gt},
+    };
+    for (auto& p : puncts) {
+        t.cls[(uint8_t)p.ch] = CharClass::Punct;
+        t.punct[(uint8_t)p.ch] = p.type;
+    }
+    return t;
+}
+
+static constexpr CharTables tables = make_char_tables();
+
+static inline CharClass char_class(char ch) {
+    return tables.cls[(uint8_t)ch];
+}
+
+/* most runs are short, so the first few bytes of one are checked here and
+ * only a run that is still going is handed to the scanner */
+#define SHORT_RUN 8
+
+template <size_t (*scan)(const char*, size_t, size_t)>
+static inline size_t skip_run(const char* s, size_t pos, size_t len,
+                              CharClass cls) {
+    size_t end = pos + SHORT_RUN < len ? pos + SHORT_RUN : len;
+    while (pos < end) {
+        if (char_class(s[pos]) != cls) {
+            return pos;
+        }
+        pos++;
+    }
+    return scan(s, pos, len);
 }
 
+Lexer::Lexer(const std::string& input)
+    : input(input), pos(0), end(input.size()) {}
+
+Lexer::Lexer(const Source& source)
+    : input(source.text()), pos(0), end(input.size()) {}
+
+Lexer::Lexer(std::string_view input, size_t begin, size_t end)
+    : input(input), pos(begin), end(end) {}
+
+/* one table lookup classifies the first character of a token. the runs of
+ * whitespace, identifiers and integers are found by the scanners, which look
+ * at many bytes at once, and integers are decoded as they are lexed so the
+ * parser never reads their digits again */
 Token Lexer::next_token() {
+    const char* s = input.data();
+    size_t len = end;
+    pos = skip_run<scan_spaces>(s, pos, len, CharClass::Space);
     Token tok;
-    skip_whitespace();
-    switch (ch) {
-    case '=':
-        if (peek_char() == '=') {
-            read_char();
-            tok.type = Token::Type::Eq;
-        } else {
-            tok.type = Token::Type::Assign;
+    tok.offset = pos;
+    tok.length = 1;
+    tok.value = 0;
+    if (pos >= len) {
+        tok.type = Token::Type::Eof;
+        tok.offset = len;
+        tok.length = 0;
+        return tok;
+    }
+    char ch = s[pos];
+    switch (char_class(ch)) {
+    case CharClass::Letter: {
+        size_t start = pos;
+        pos = skip_run<scan_letters>(s, pos + 1, len, CharClass::Letter);
+        tok.length = pos - start;
+        tok.type = lookup_ident(std::string_view(s + start, tok.length));
+    } break;
+    case CharClass::Digit: {
+        size_t start = pos;
+        pos = skip_run<scan_digits>(s, pos + 1, len, CharClass::Digit);
+        /* unsigned, so an out of range literal wraps instead of overflowing */
+        uint64_t value = 0;
+        for (size_t i = start; i < pos; ++i) {
+            value = value * 10 + (uint64_t)(s[i] - '0');
         }
-        break;
-    case '+':
-        tok.type = Token::Type::Plus;
-        break;
-    case ';':
-        tok.type = Token::Type::Semicolon;
-        break;
-    case ',':
-        tok.type = Token::Type::Comma;
-        break;
-    case '(':
-        tok.type = Token::Type::LParen;
-        break;
-    case ')':
-        tok.type = Token::Type::RParen;
-        break;
-    case '{':
-        tok.type = Token::Type::LSquirly;
-        break;
-    case '}':
-        tok.type = Token::Type::RSquirly;
-        break;
-    case '!':
-        if (peek_char() == '=') {
-            tok.type = Token::Type::NotEq;
-            read_char();
-        } else {
-            tok.type = Token::Type::Bang;
+        tok.length = pos - start;
+        tok.type = Token::Type::Int;
+        tok.value = (int64_t)value;
+    } break;
+    case CharClass::Punct:
+        tok.type = tables.punct[(uint8_t)ch];
+        if ((ch == '=' || ch == '!') && pos + 1 < len && s[pos + 1] == '=') {
+            tok.type = ch == '=' ? Token::Type::Eq : Token::Type::NotEq;
+            tok.length = 2;
         }
+        pos += tok.length;
         break;
-    case '-':
-        tok.type = Token::Type::Minus;
-        break;
-    case '/':
-        tok.type = Token::Type::Slash;
-        break;
-    case '*':
-        tok.type = Token::Type::Asterisk;
-        break;
-    case '<':
-        tok.type = Token::Type::Lt;
-        break;
-    case '>':
-        tok.type = Token::Type::Gt;
-        break;
-    case 0:
+    case CharClass::End:
+        /* a nul byte ends the input */
         tok.type = Token::Type::Eof;
+        tok.offset = len;
+        tok.length = 0;
         break;
     default:
-        if (is_letter(ch)) {
-            std::string literal = read_ident();
-            Token::Type type = lookup_ident(literal);
-            if (type == Token::Type::Ident) {
-                tok.literal = std::make_shared<std::string>(literal);
-            }
-            tok.type = type;
-            return tok;
-        } else if (is_digit(ch)) {
-            tok.type = Token::Type::Int;
-            tok.literal = std::make_shared<std::string>(read_int());
-            return tok;
-        }
         tok.type = Token::Type::Illegal;
+        pos++;
         break;
     }
-    read_char();
     return tok;
 }
 
-char Lexer::peek_char() {
-    if (pos >= input.size()) {
-        return 0;
-    }
-    return input[pos];
-}
+std::string_view Lexer::source() const { return input; }
 
-std::string Lexer::read_ident() {
-    std::string res;
-    while (is_letter(ch)) {
-        res.push_back(ch);
-        read_char();
-    }
-    return res;
-}
-
-std::string Lexer::read_int() {
-    std::string res;
-    while (is_digit(ch)) {
-        res.push_back(ch);
-        read_char();
-    }
-    return res;
-}
-
-void Lexer::skip_whitespace() {
-    while (ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r') {
-        read_char();
-    }
-}
-
-void Lexer::read_char() {
-    if (pos >= input.size()) {
-        ch = 0;
-    } else {
-        ch = input[pos];
-    }
-    pos++;
-}
+size_t Lexer::position() const { return pos; }
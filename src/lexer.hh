@@ -1,20 +1,23 @@
 #pragma once
 
+#include "source.hh"
 #include "token.hh"
 #include <string>
+#include <string_view>
 
+/* tokens are spans into input, which must outlive them */
 class Lexer {
   public:
     Lexer(const std::string& input);
+    Lexer(const Source& source);
+    /* lexes input[begin, end), with offsets still relative to input */
+    Lexer(std::string_view input, size_t begin, size_t end);
     Token next_token();
+    std::string_view source() const;
+    size_t position() const;
 
   private:
-    const std::string& input;
+    std::string_view input;
     size_t pos;
-    char ch;
-    void read_char();
-    void skip_whitespace();
-    char peek_char();
-    std::string read_ident();
-    std::string read_int();
+    size_t end;
 };
@@ -1,7 +1,215 @@
+#include "ast_cache.hh"
+#include "compiler.hh"
+#include "emit_c.hh"
+#include "eval.hh"
+#include "lexer.hh"
+#include "parser.hh"
+#include "resolver.hh"
+#include "source.hh"
+#include "vm.hh"
+#include <cerrno>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
 
-int main(void) {
-    std::cout << "hello world"
-              << "\n";
+static const char* usage =
+    "usage: monkey [--vm] [--cache DIR] [--emit-ast FILE] [--load-ast FILE] "
+    "[--emit-c FILE] [SCRIPT]\n"
+    "  --vm             run on the bytecode vm instead of the evaluator\n"
+    "  --cache DIR      reuse the parse of SCRIPT saved in DIR, saving it\n"
+    "                   there first if it is missing or stale\n"
+    "  --emit-ast FILE  save the parse of SCRIPT to FILE and exit\n"
+    "  --load-ast FILE  run the parse saved in FILE. with a SCRIPT, FILE\n"
+    "                   must have been saved from it\n"
+    "  --emit-c FILE    translate the program to a standalone C file and\n"
+    "                   exit. `cc FILE` builds a binary that runs it\n";
+
+struct Options {
+    bool vm = false;
+    std::string cache_dir;
+    std::string emit_ast;
+    std::string load_ast;
+    std::string emit_c;
+    std::string script;
+};
+
+static bool parse_args(int argc, char** argv, Options& opts) {
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        std::string* value = nullptr;
+        if (std::strcmp(arg, "--vm") == 0) {
+            opts.vm = true;
+            continue;
+        } else if (std::strcmp(arg, "--cache") == 0) {
+            value = &opts.cache_dir;
+        } else if (std::strcmp(arg, "--emit-ast") == 0) {
+            value = &opts.emit_ast;
+        } else if (std::strcmp(arg, "--load-ast") == 0) {
+            value = &opts.load_ast;
+        } else if (std::strcmp(arg, "--emit-c") == 0) {
+            value = &opts.emit_c;
+        } else if (arg[0] == '-' || !opts.script.empty()) {
+            return false;
+        } else {
+            opts.script = arg;
+            continue;
+        }
+        if (++i == argc) {
+            return false;
+        }
+        *value = argv[i];
+    }
+    if (opts.load_ast.empty() && opts.script.empty()) {
+        return false;
+    }
+    return opts.emit_ast.empty() || !opts.script.empty();
+}
+
+static int report(const std::vector<std::string>& errors) {
+    for (auto& err : errors) {
+        std::cerr << err << "\n";
+    }
+    return 1;
+}
+
+/* parses source into the flat form and encodes it as a cache */
+static bool encode_source(const Source& source, std::string& data,
+                          std::vector<std::string>& errors) {
+    Lexer l(source);
+    Parser p(l);
+    FlatAst ast = p.parse_flat();
+    if (!p.get_errors().empty()) {
+        errors = p.get_errors();
+        return false;
+    }
+    data = encode_ast(ast, source_stamp(source));
+    return true;
+}
+
+/* the program in the script or cache named by opts, reading the script's
+ * parse from a cache when one is current */
+static bool load_program(const Options& opts, Program& program,
+                         std::vector<std::string>& errors) {
+    std::string err;
+    std::unique_ptr<Source> source;
+    SourceStamp stamp = {0, 0, 0};
+    if (!opts.script.empty()) {
+        source = Source::map_file(opts.script, err);
+        if (source == nullptr) {
+            errors.push_back(err);
+            return false;
+        }
+    }
+    if (!opts.load_ast.empty()) {
+        if (source != nullptr) {
+            stamp = source_stamp(*source);
+        } else {
+            std::unique_ptr<Source> cache =
+                Source::map_file(opts.load_ast, err);
+            if (cache == nullptr) {
+                errors.push_back(err);
+                return false;
+            }
+            stamp = ast_cache_stamp(cache->text());
+        }
+        if (!load_ast_cache(opts.load_ast, stamp, program, err)) {
+            errors.push_back(err);
+            return false;
+        }
+        return true;
+    }
+    if (opts.cache_dir.empty()) {
+        Lexer l(*source);
+        Parser p(l);
+        program = p.parse();
+        errors = p.get_errors();
+        return errors.empty();
+    }
+    stamp = source_stamp(*source);
+    std::string path = ast_cache_path(opts.cache_dir, stamp.hash);
+    if (load_ast_cache(path, stamp, program, err)) {
+        return true;
+    }
+    std::string data;
+    if (!encode_source(*source, data, errors)) {
+        return false;
+    }
+    if (!decode_ast(data, stamp, program, err)) {
+        errors.push_back(err);
+        return false;
+    }
+    /* only a cache that loads is saved, and one that cannot be saved only
+     * costs the next run a parse */
+    if (!write_ast_cache(path, data, err)) {
+        std::cerr << "monkey: " << err << "\n";
+    }
+    return true;
+}
+
+static Object run(Program& program, bool vm) {
+    if (!vm) {
+        std::shared_ptr<Environment> env = std::make_shared<Environment>();
+        resolve(program, *env);
+        return eval(program, env);
+    }
+    Compiler c;
+    c.compile(program);
+    if (!c.get_errors().empty()) {
+        return Object(Object::Type::Error, c.get_errors()[0]);
+    }
+    VM machine(c.bytecode());
+    return machine.run();
+}
+
+static int write_c(Program& program, const std::string& path) {
+    std::string out, err;
+    if (!emit_c(program, out, err)) {
+        return report({err});
+    }
+    std::ofstream file(path, std::ios::binary);
+    if (!(file << out) || !file.flush()) {
+        return report({path + ": " + std::strerror(errno)});
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    Options opts;
+    if (!parse_args(argc, argv, opts)) {
+        std::cerr << usage;
+        return 2;
+    }
+    std::vector<std::string> errors;
+    if (!opts.emit_ast.empty()) {
+        std::string err, data;
+        std::unique_ptr<Source> source = Source::map_file(opts.script, err);
+        if (source == nullptr) {
+            return report({err});
+        }
+        if (!encode_source(*source, data, errors)) {
+            return report(errors);
+        }
+        if (!write_ast_cache(opts.emit_ast, data, err)) {
+            return report({err});
+        }
+        return 0;
+    }
+    Program program;
+    if (!load_program(opts, program, errors)) {
+        return report(errors);
+    }
+    if (!opts.emit_c.empty()) {
+        return write_c(program, opts.emit_c);
+    }
+    Object res = run(program, opts.vm);
+    if (res.type == Object::Type::Error) {
+        return report({res.inspect()});
+    }
+    if (res.type != Object::Type::Null) {
+        std::cout << res.inspect() << "\n";
+    }
     return 0;
 }
@@ -6,9 +6,24 @@ Object::Object() : type(Object::Type::Null), value(std::monostate()) {}
 Object::Object(Object::Type type, ObjectValue value)
     : type(type), value(std::move(value)) {}
 
-Function::Function(std::vector<Identifier> parameters, BlockStatement body,
+Function::Function(std::shared_ptr<const FunctionLiteral> literal,
                    std::shared_ptr<Environment> env)
-    : parameters(std::move(parameters)), body(std::move(body)), env(env) {}
+    : literal(std::move(literal)), env(std::move(env)) {}
+
+const std::vector<Identifier>& Function::parameters() const {
+    return literal->params;
+}
+
+const BlockStatement& Function::body() const { return literal->body; }
+
+CompiledFunction::CompiledFunction(Instructions instructions, size_t num_locals,
+                                   size_t num_params)
+    : instructions(std::move(instructions)), num_locals(num_locals),
+      num_params(num_params) {}
+
+Closure::Closure(std::shared_ptr<const CompiledFunction> fn,
+                 std::vector<Object> free)
+    : fn(std::move(fn)), free(std::move(free)) {}
 
 std::string Object::inspect() {
     switch (type) {
@@ -27,20 +42,39 @@ std::string Object::inspect() {
         return "Error: " + std::get<std::string>(value);
     case Type::Function: {
         std::string res;
-        auto fn = std::get<Function>(value);
-        size_t i, len = fn.parameters.size();
+        const Function& fn = std::get<Function>(value);
+        const std::vector<Identifier>& params = fn.parameters();
+        size_t i, len = params.size();
         res.append("fn(");
         for (i = 0; i < len; ++i) {
-            res.append(fn.parameters[i].string());
+            res.append(params[i].string());
             if (i != len - 1) {
                 res.append(", ");
             }
         }
+        if (!fn.literal->body_parsed()) {
+            res.append(") ");
+            res.append(fn.literal->lazy->text);
+            return res;
+        }
         res.append(") {\n");
-        res.append(fn.body.string());
+        res.append(fn.body().string());
         res.append("\n}");
         return res;
     }
+    case Type::CompiledFunction:
+        return string_format(
+            "CompiledFunction[%p]",
+            (void*)std::get<std::shared_ptr<const CompiledFunction>>(value)
+                .get());
+    case Type::Closure:
+        return string_format(
+            "Closure[%p]",
+            (void*)std::get<std::shared_ptr<Closure>>(value).get());
+    case Type::TailCall:
+        return "TailCall";
+    case Type::Cell:
+        return "Cell";
     }
     unreachable;
     return "";
@@ -60,6 +94,14 @@ const char* Object::type_to_string() {
         return "RETURN";
     case Type::Function:
         return "FUNCTION";
+    case Type::CompiledFunction:
+        return "COMPILED_FUNCTION";
+    case Type::Closure:
+        return "CLOSURE";
+    case Type::TailCall:
+        return "TAIL_CALL";
+    case Type::Cell:
+        return "CELL";
     }
     return "";
 }
@@ -81,6 +123,10 @@ bool Object::operator==(Object& right) {
         return std::get<std::string>(value) ==
                std::get<std::string>(right.value);
     case Type::Function:
+    case Type::CompiledFunction:
+    case Type::Closure:
+    case Type::TailCall:
+    case Type::Cell:
         return false;
     }
     return false;
@@ -103,27 +149,57 @@ bool Object::operator!=(Object& right) {
         return std::get<std::string>(value) !=
                std::get<std::string>(right.value);
     case Type::Function:
+    case Type::CompiledFunction:
+    case Type::Closure:
+    case Type::TailCall:
+    case Type::Cell:
         return false;
     }
     return true;
 }
 
-Environment::Environment()
-    : store(std::unordered_map<std::string, Object>()), outer({}) {}
+Environment::Environment() : outer(nullptr) {}
 
-Environment::Environment(std::shared_ptr<Environment> outer)
-    : store(std::unordered_map<std::string, Object>()), outer(outer) {}
+Environment::Environment(std::shared_ptr<Environment> outer, size_t size)
+    : slots(std::vector<Object>(size)), outer(std::move(outer)) {}
 
-Object& Environment::get(std::string& name) {
-    Object& obj = store[name];
-    if (obj.type == Object::Type::Null) {
-        if (outer.has_value()) {
-            return (**outer).get(name);
+/* moves out the references env holds to frames nothing else keeps alive */
+static void take_dying(Environment& env,
+                       std::vector<std::shared_ptr<Environment>>& dying) {
+    if (env.outer.use_count() == 1) {
+        dying.push_back(std::move(env.outer));
+    }
+    for (auto& slot : env.slots) {
+        Function* fn = std::get_if<Function>(&slot.value);
+        if (fn != nullptr && fn->env.use_count() == 1) {
+            dying.push_back(std::move(fn->env));
         }
     }
-    return obj;
 }
 
-void Environment::set(std::string name, Object value) {
-    store[std::move(name)] = std::move(value);
+/* a frame can hold the only reference to another through outer or through a
+ * closure in one of its slots, and a loop of tail calls that each capture
+ * their frame builds such a chain as long as the loop. the frames this one
+ * alone keeps alive are torn down here one at a time, rather than each from
+ * inside the destructor of the one before it */
+Environment::~Environment() {
+    std::vector<std::shared_ptr<Environment>> dying;
+    take_dying(*this, dying);
+    while (!dying.empty()) {
+        std::shared_ptr<Environment> env = std::move(dying.back());
+        dying.pop_back();
+        take_dying(*env, dying);
+    }
+}
+
+Object& Environment::get(int depth, int slot) {
+    Environment* env = this;
+    while (depth-- > 0) {
+        env = env->outer.get();
+    }
+    return env->slots[slot];
+}
+
+void Environment::set(int slot, Object value) {
+    slots[slot] = std::move(value);
 }
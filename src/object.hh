@@ -1,6 +1,7 @@
 #pragma once
 
 #include "ast.hh"
+#include "code.hh"
 #include <cstdint>
 #include <memory>
 #include <string>
@@ -9,15 +10,34 @@
 #include <vector>
 
 struct Function {
-    std::vector<Identifier> parameters;
-    BlockStatement body;
+    /* shared with the AST, so evaluating a function literal copies nothing */
+    std::shared_ptr<const FunctionLiteral> literal;
     std::shared_ptr<struct Environment> env;
-    Function(std::vector<Identifier> parameters, BlockStatement body,
+    Function(std::shared_ptr<const FunctionLiteral> literal,
              std::shared_ptr<struct Environment> env);
+    const std::vector<Identifier>& parameters() const;
+    const BlockStatement& body() const;
+};
+
+struct CompiledFunction {
+    Instructions instructions;
+    size_t num_locals;
+    size_t num_params;
+    CompiledFunction(Instructions instructions, size_t num_locals,
+                     size_t num_params);
+};
+
+struct Closure {
+    std::shared_ptr<const CompiledFunction> fn;
+    std::vector<struct Object> free;
+    Closure(std::shared_ptr<const CompiledFunction> fn,
+            std::vector<struct Object> free);
 };
 
 typedef std::variant<std::monostate, int64_t, bool, std::string,
-                     std::shared_ptr<struct Object>, struct Function>
+                     std::shared_ptr<struct Object>, struct Function,
+                     std::shared_ptr<const CompiledFunction>,
+                     std::shared_ptr<Closure>>
     ObjectValue;
 
 struct Object {
@@ -28,6 +48,16 @@ struct Object {
         Error,
         Return,
         Function,
+        CompiledFunction,
+        Closure,
+        /* a call in tail position, left for the caller's apply_function to
+         * run. its value is a Function whose env is the callee's frame,
+         * arguments bound */
+        TailCall,
+        /* a binding the vms share between a frame and the closures made in
+         * it. its value is a shared_ptr<Object> holding the bound value, or
+         * Null until the binding is made */
+        Cell,
     } type;
     ObjectValue value;
     Object();
@@ -38,11 +68,15 @@ struct Object {
     bool operator!=(Object& right);
 };
 
+/* a scope of bindings addressed by the slots the resolver assigns. names is
+ * only used in the top level scope, where it maps each global to its slot */
 struct Environment {
-    std::unordered_map<std::string, Object> store;
-    std::optional<std::shared_ptr<struct Environment>> outer;
+    std::vector<Object> slots;
+    std::shared_ptr<struct Environment> outer;
+    std::unordered_map<SymbolId, size_t> names;
     Environment();
-    Environment(std::shared_ptr<struct Environment> outer);
-    Object& get(std::string& name);
-    void set(std::string name, Object value);
+    Environment(std::shared_ptr<struct Environment> outer, size_t size);
+    ~Environment();
+    Object& get(int depth, int slot);
+    void set(int slot, Object value);
 };
@@ -0,0 +1,94 @@
+#include "parse_parallel.hh"
+#include "parser.hh"
+#include <future>
+
+struct Chunk {
+    size_t begin;
+    size_t end;
+    Program program;
+    std::vector<std::string> errors;
+};
+
+static Program parse_serial(const TokenBuffer& tokens,
+                            std::vector<std::string>& errors) {
+    Parser p(tokens);
+    Program program = p.parse();
+    errors = std::move(p.get_errors());
+    return program;
+}
+
+Program parse_parallel(const TokenBuffer& tokens, ThreadPool& pool,
+                       std::vector<std::string>& errors, size_t min_chunk) {
+    size_t len = tokens.size() - 1; /* without the Eof */
+    size_t chunk_size = len / pool.size();
+    if (chunk_size < min_chunk) {
+        chunk_size = min_chunk;
+    }
+    if (chunk_size >= len) {
+        return parse_serial(tokens, errors);
+    }
+
+    std::vector<Chunk> chunks;
+    size_t begin = 0, i;
+    int depth = 0;
+    for (i = 0; i < len; ++i) {
+        switch (tokens.types[i]) {
+        case Token::Type::LParen:
+        case Token::Type::LSquirly:
+            depth++;
+            break;
+        case Token::Type::RParen:
+        case Token::Type::RSquirly:
+            depth--;
+            break;
+        case Token::Type::Semicolon:
+            if (depth == 0 && i + 1 - begin >= chunk_size) {
+                chunks.push_back(Chunk{begin, i + 1, {}, {}});
+                begin = i + 1;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    if (begin < len || chunks.empty()) {
+        chunks.push_back(Chunk{begin, len, {}, {}});
+    }
+    if (chunks.size() == 1) {
+        return parse_serial(tokens, errors);
+    }
+
+    std::vector<std::future<void>> done;
+    done.reserve(chunks.size());
+    for (auto& chunk : chunks) {
+        Chunk* c = &chunk;
+        done.push_back(pool.submit([&tokens, c] {
+            Parser p(tokens, c->begin, c->end);
+            c->program = p.parse();
+            c->errors = std::move(p.get_errors());
+        }));
+    }
+    for (auto& d : done) {
+        d.get();
+    }
+
+    size_t total = 0;
+    for (auto& chunk : chunks) {
+        if (!chunk.errors.empty()) {
+            return parse_serial(tokens, errors);
+        }
+        total += chunk.program.statements.size();
+    }
+
+    Program program = std::move(chunks[0].program);
+    program.statements.reserve(total);
+    for (i = 1; i < chunks.size(); ++i) {
+        Program& part = chunks[i].program;
+        program.arena->adopt(part.arena);
+        for (auto& stmt : part.statements) {
+            program.statements.push_back(std::move(stmt));
+        }
+    }
+    errors.clear();
+    return program;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "ast.hh"
+#include "thread_pool.hh"
+#include "token_buffer.hh"
+#include <string>
+#include <vector>
+
+#define PARSE_MIN_CHUNK (16 * 1024)
+
+/* the same program and errors as Parser(tokens).parse(), parsed in chunks on
+ * pool. in a program that parses cleanly, a semicolon outside any parens or
+ * braces ends a top level statement, so the tokens are cut after such
+ * semicolons into chunks of at least min_chunk tokens, each chunk is parsed
+ * on its own and the statements are joined in order, with the program's
+ * arena adopting the arena of each chunk. if any chunk has errors the whole
+ * program is parsed again serially, so errors match the serial parser */
+Program parse_parallel(const TokenBuffer& tokens, ThreadPool& pool,
+                       std::vector<std::string>& errors,
+                       size_t min_chunk = PARSE_MIN_CHUNK);
@@ -1,19 +1,50 @@
 #include "parser.hh"
 #include "ast.hh"
+#include "flat_ast.hh"
 #include "util.hh"
+#include <algorithm>
+#include <mutex>
 #include <vector>
 
-Parser::Parser(Lexer& l) : l(l) {
+Parser::Parser(Lexer& l)
+    : l(&l), tokens(nullptr), pipe(nullptr), index(0), end(0),
+      arena(std::make_shared<Arena>()), max_depth(PARSER_MAX_DEPTH),
+      too_deep(false), lazy(false), flat(nullptr), flat_depth(0),
+      statement_height(0) {
+    next_token();
+    next_token();
+}
+
+Parser::Parser(const TokenBuffer& tokens)
+    : Parser(tokens, 0, tokens.size() - 1) {}
+
+Parser::Parser(const TokenBuffer& tokens, size_t begin, size_t end)
+    : l(nullptr), tokens(&tokens), pipe(nullptr), index(begin), end(end),
+      arena(std::make_shared<Arena>()), max_depth(PARSER_MAX_DEPTH),
+      too_deep(false), lazy(false), flat(nullptr), flat_depth(0),
+      statement_height(0) {
+    /* past end the buffer gives its final Eof */
+    cur = tokens.get(index < end ? index : SIZE_MAX);
+    index++;
+    peek = tokens.get(index < end ? index : SIZE_MAX);
+}
+
+Parser::Parser(TokenPipe& pipe)
+    : l(nullptr), tokens(nullptr), pipe(&pipe), index(0), end(0),
+      arena(std::make_shared<Arena>()), max_depth(PARSER_MAX_DEPTH),
+      too_deep(false), lazy(false), flat(nullptr), flat_depth(0),
+      statement_height(0) {
     next_token();
     next_token();
 }
 
 Program Parser::parse() {
     Program program;
+    program.arena = arena;
     while (cur.type != Token::Type::Eof) {
         Statement stmt = parse_statement();
         if (stmt.type != Statement::Type::Inv) {
-            program.statements.push_back(stmt);
+            program.statements.push_back(std::move(stmt));
         }
         next_token();
     }
@@ -22,326 +53,780 @@ Program Parser::parse() {
 
 std::vector<std::string>& Parser::get_errors() { return errors; }
 
+void Parser::set_max_depth(size_t depth) { max_depth = depth; }
+
+void Parser::set_lazy(bool lazy) { this->lazy = lazy && tokens != nullptr; }
+
+/* bodies are parsed into the arena of their program, which is not safe to
+ * share, so loads take turns. each body is only ever loaded once */
+static std::mutex load_mu;
+
+const std::vector<std::string>& Parser::load_body(const FunctionLiteral& fn) {
+    LazyBody* body = fn.lazy;
+    if (body->parsed.load(std::memory_order_acquire)) {
+        return body->errors;
+    }
+    std::lock_guard<std::mutex> lock(load_mu);
+    if (!body->parsed.load(std::memory_order_relaxed)) {
+        Parser p(*body->tokens, body->begin, body->end);
+        p.arena = fn.arena->shared_from_this();
+        p.lazy = true;
+        /* the literal is only const to the code running it; it was made in
+         * the arena like every other node */
+        const_cast<FunctionLiteral&>(fn).body = p.parse_body();
+        body->errors = std::move(p.errors);
+        body->parsed.store(true, std::memory_order_release);
+    }
+    return body->errors;
+}
+
 Statement Parser::parse_statement() {
-    Statement stmt;
+    start_statement();
+    run();
+    return std::move(statement);
+}
+
+/* parses the block starting at cur */
+BlockStatement Parser::parse_body() {
+    frames.push_back(frame(Frame::Kind::BlockOpen, Precedence::Lowest));
+    run();
+    if (blocks.empty()) {
+        return BlockStatement();
+    }
+    BlockStatement block = std::move(blocks.back());
+    blocks.pop_back();
+    block_heights.pop_back();
+    return block;
+}
+
+/* pushes the frames that parse the statement at cur. a let that is missing
+ * its name or = is left in statement as Inv straight away */
+void Parser::start_statement() {
     switch (cur.type) {
-    case Token::Type::Let:
-        stmt = parse_let_statement();
-        break;
+    case Token::Type::Let: {
+        Token let_tok = cur;
+        if (!expect_peek(Token::Type::Ident)) {
+            statement = Statement();
+            return;
+        }
+        Frame let = frame(Frame::Kind::Let, Precedence::Lowest, let_tok);
+        let.name = cur;
+        let.symbol = intern(text(cur));
+        if (!expect_peek(Token::Type::Assign)) {
+            statement = Statement();
+            return;
+        }
+        next_token();
+        frames.push_back(let);
+    } break;
     case Token::Type::Return:
-        stmt = parse_return_statement();
+        frames.push_back(frame(Frame::Kind::Return, Precedence::Lowest, cur));
+        next_token();
         break;
     default:
-        stmt = parse_expression_statement();
+        frames.push_back(
+            frame(Frame::Kind::ExpressionStatement, Precedence::Lowest, cur));
         break;
     }
-    return stmt;
-}
-
-Statement Parser::parse_let_statement() {
-    Statement stmt;
-    Token let_tok = cur;
-    if (!expect_peek(Token::Type::Ident)) {
-        return stmt;
-    }
-    Identifier name(cur, std::get<std::shared_ptr<std::string>>(cur.literal));
-    if (!expect_peek(Token::Type::Assign)) {
-        return stmt;
-    }
-    next_token();
-    Expression value = parse_expression(Precedence::Lowest);
-    stmt.type = Statement::Type::Let;
-    stmt.data = LetStatement(let_tok, name, value);
-    if (peek_tok_is(Token::Type::Semicolon)) {
-        next_token();
-    }
-    return stmt;
+    frames.push_back(frame(Frame::Kind::Expression, Precedence::Lowest));
 }
 
-Statement Parser::parse_return_statement() {
-    Statement stmt;
-    Token ret_tok = cur;
-    next_token();
-    Expression value = parse_expression(Precedence::Lowest);
-    ReturnStatement ret_stmt(ret_tok, value);
-    if (peek_tok_is(Token::Type::Semicolon)) {
-        next_token();
-    }
-    stmt.type = Statement::Type::Ret;
-    stmt.data = ret_stmt;
-    return stmt;
+Parser::Frame Parser::frame(Frame::Kind kind, Precedence prec, Token tok) {
+    Frame f;
+    f.kind = kind;
+    f.prec = prec;
+    f.tok = tok;
+    return f;
 }
 
-Statement Parser::parse_expression_statement() {
-    Statement stmt;
-    stmt.type = Statement::Type::Expression;
-    stmt.data = ExpressionStatement(cur, parse_expression(Precedence::Lowest));
-    if (peek_tok_is(Token::Type::Semicolon)) {
-        next_token();
+/* a Pratt parser run on frames instead of the call stack. each frame below
+ * the top waits on the expression in values or the block in blocks made by
+ * the frames above it, then builds its node and pushes what comes next.
+ * the tree and errors are the same as a recursive descent would give.
+ * operators chain in a loop rather than in frames, so the height of the
+ * node last built is checked against max_depth too: whatever walks the tree
+ * recurses that deep */
+void Parser::run() {
+    while (!frames.empty()) {
+        if (frames.size() > max_depth ||
+            (!heights.empty() && heights.back() > max_depth)) {
+            nested_too_deep();
+            return;
+        }
+        Frame f = frames.back();
+        frames.pop_back();
+        switch (f.kind) {
+        case Frame::Kind::Expression:
+            start_expression(f.prec);
+            break;
+        case Frame::Kind::Operators:
+            parse_operator(f.prec);
+            break;
+        case Frame::Kind::Prefix: {
+            size_t height;
+            Expression* right = arena->make<Expression>(pop_value(height));
+            push_value(Expression(Expression::Type::Prefix,
+                                  PrefixExpression(
+                                      f.tok, (PrefixExpression::Operator)f.oper,
+                                      right)),
+                       height + 1);
+            frames.push_back(frame(Frame::Kind::Operators, f.prec));
+        } break;
+        case Frame::Kind::Infix: {
+            size_t rheight, lheight;
+            Expression* right = arena->make<Expression>(pop_value(rheight));
+            Expression* left = arena->make<Expression>(pop_value(lheight));
+            push_value(Expression(Expression::Type::Infix,
+                                  InfixExpression(
+                                      f.tok, (InfixExpression::Operator)f.oper,
+                                      left, right)),
+                       std::max(lheight, rheight) + 1);
+            frames.push_back(frame(Frame::Kind::Operators, f.prec));
+        } break;
+        case Frame::Kind::Group:
+            if (!expect_peek(Token::Type::RParen)) {
+                values.back() = Expression();
+            }
+            frames.push_back(frame(Frame::Kind::Operators, f.prec));
+            break;
+        case Frame::Kind::IfCondition:
+            if (!expect_peek(Token::Type::RParen) ||
+                !expect_peek(Token::Type::LSquirly)) {
+                values.back() = Expression();
+                frames.push_back(frame(Frame::Kind::Operators, f.prec));
+                break;
+            }
+            f.kind = Frame::Kind::IfConsequence;
+            frames.push_back(f);
+            frames.push_back(frame(Frame::Kind::BlockOpen, f.prec));
+            break;
+        case Frame::Kind::IfConsequence:
+            if (!peek_tok_is(Token::Type::Else)) {
+                finish_if(f, {}, 0);
+                break;
+            }
+            next_token();
+            if (!expect_peek(Token::Type::LSquirly)) {
+                blocks.pop_back();
+                block_heights.pop_back();
+                values.back() = Expression();
+                frames.push_back(frame(Frame::Kind::Operators, f.prec));
+                break;
+            }
+            f.kind = Frame::Kind::IfAlternative;
+            frames.push_back(f);
+            frames.push_back(frame(Frame::Kind::BlockOpen, f.prec));
+            break;
+        case Frame::Kind::IfAlternative: {
+            BlockStatement alternative = std::move(blocks.back());
+            blocks.pop_back();
+            size_t height = block_heights.back();
+            block_heights.pop_back();
+            finish_if(f, std::move(alternative), height);
+        } break;
+        case Frame::Kind::FunctionBody: {
+            BlockStatement body = std::move(blocks.back());
+            blocks.pop_back();
+            size_t height = block_heights.back();
+            block_heights.pop_back();
+            std::vector<Identifier> ps = std::move(params.back());
+            params.pop_back();
+            push_value(Expression(Expression::Type::Function,
+                                  arena->make<FunctionLiteral>(
+                                      f.tok, std::move(ps), std::move(body),
+                                      arena.get())),
+                       height + 1);
+            frames.push_back(frame(Frame::Kind::Operators, f.prec));
+        } break;
+        case Frame::Kind::CallArgument:
+            if (peek_tok_is(Token::Type::Comma)) {
+                next_token();
+                next_token();
+                frames.push_back(f);
+                frames.push_back(
+                    frame(Frame::Kind::Expression, Precedence::Lowest));
+                break;
+            }
+            finish_call(f, expect_peek(Token::Type::RParen));
+            break;
+        case Frame::Kind::BlockOpen:
+            blocks.emplace_back();
+            blocks.back().tok = cur;
+            block_heights.push_back(1);
+            next_token();
+            frames.push_back(frame(Frame::Kind::BlockLoop, f.prec));
+            break;
+        case Frame::Kind::BlockLoop:
+            if (cur_tok_is(Token::Type::RSquirly) ||
+                cur_tok_is(Token::Type::Eof)) {
+                break;
+            }
+            frames.push_back(frame(Frame::Kind::BlockStatement, f.prec));
+            start_statement();
+            break;
+        case Frame::Kind::BlockStatement:
+            if (statement.type != Statement::Type::Inv) {
+                blocks.back().stmts.push_back(std::move(statement));
+                block_heights.back() =
+                    std::max(block_heights.back(), statement_height + 1);
+            }
+            next_token();
+            frames.push_back(frame(Frame::Kind::BlockLoop, f.prec));
+            break;
+        case Frame::Kind::Let: {
+            Identifier name(f.name, f.symbol);
+            statement.type = Statement::Type::Let;
+            statement.data = LetStatement(f.tok, std::move(name),
+                                          pop_value(statement_height));
+            if (peek_tok_is(Token::Type::Semicolon)) {
+                next_token();
+            }
+        } break;
+        case Frame::Kind::Return:
+            statement.type = Statement::Type::Ret;
+            statement.data =
+                ReturnStatement(f.tok, pop_value(statement_height));
+            if (peek_tok_is(Token::Type::Semicolon)) {
+                next_token();
+            }
+            break;
+        case Frame::Kind::ExpressionStatement:
+            statement.type = Statement::Type::Expression;
+            statement.data =
+                ExpressionStatement(f.tok, pop_value(statement_height));
+            if (peek_tok_is(Token::Type::Semicolon)) {
+                next_token();
+            }
+            break;
+        }
     }
-    return stmt;
 }
 
-Expression Parser::parse_expression(Precedence precedence) {
-    Expression e;
+/* the prefix half of an expression of at least prec. a literal is pushed
+ * to values at once; anything with a sub expression or block pushes the
+ * frame that finishes it. every expression but a missing one then goes on
+ * to its infix operators */
+void Parser::start_expression(Precedence prec) {
     switch (cur.type) {
     case Token::Type::Ident:
-        e = parse_identifier();
+        push_value(parse_identifier(), 1);
         break;
     case Token::Type::Int:
-        e = parse_integer();
+        push_value(parse_integer(), 1);
         break;
     case Token::Type::True:
-        e = parse_boolean();
-        break;
     case Token::Type::False:
-        e = parse_boolean();
+        push_value(parse_boolean(), 1);
         break;
     case Token::Type::Bang:
-        e = parse_prefix();
-        break;
-    case Token::Type::Minus:
-        e = parse_prefix();
-        break;
+    case Token::Type::Minus: {
+        Frame prefix = frame(Frame::Kind::Prefix, prec, cur);
+        prefix.oper = (uint8_t)prefix_oper(cur.type);
+        frames.push_back(prefix);
+        next_token();
+        frames.push_back(frame(Frame::Kind::Expression, Precedence::Prefix));
+        return;
+    }
     case Token::Type::LParen:
-        e = parse_group();
-        break;
-    case Token::Type::If:
-        e = parse_if();
-        break;
-    case Token::Type::Function:
-        e = parse_function();
-        break;
+        next_token();
+        frames.push_back(frame(Frame::Kind::Group, prec));
+        frames.push_back(frame(Frame::Kind::Expression, Precedence::Lowest));
+        return;
+    case Token::Type::If: {
+        Token tok = cur;
+        if (!expect_peek(Token::Type::LParen)) {
+            push_value(Expression(), 1);
+            break;
+        }
+        next_token();
+        frames.push_back(frame(Frame::Kind::IfCondition, prec, tok));
+        frames.push_back(frame(Frame::Kind::Expression, Precedence::Lowest));
+        return;
+    }
+    case Token::Type::Function: {
+        Token tok = cur;
+        if (!expect_peek(Token::Type::LParen)) {
+            push_value(Expression(), 1);
+            break;
+        }
+        std::vector<Identifier> ps = parse_function_params();
+        if (!expect_peek(Token::Type::LSquirly)) {
+            push_value(Expression(), 1);
+            break;
+        }
+        if (lazy && skip_body(tok, ps)) {
+            break;
+        }
+        params.push_back(std::move(ps));
+        frames.push_back(frame(Frame::Kind::FunctionBody, prec, tok));
+        frames.push_back(frame(Frame::Kind::BlockOpen, prec));
+        return;
+    }
     default:
         no_prefix_parse_method(cur.type);
-        return e;
+        push_value(Expression(), 1);
+        return;
     }
+    frames.push_back(frame(Frame::Kind::Operators, prec));
+}
 
-    while (!peek_tok_is(Token::Type::Semicolon) &&
-           precedence < peek_precedence()) {
-        switch (peek.type) {
-        case Token::Type::Plus:
-        case Token::Type::Minus:
-        case Token::Type::Asterisk:
-        case Token::Type::Slash:
-        case Token::Type::Lt:
-        case Token::Type::Gt:
-        case Token::Type::Eq:
-        case Token::Type::NotEq:
-            next_token();
-            e = parse_infix(e);
-            break;
-        case Token::Type::LParen:
+/* applies the next infix operator or call to values.back(), if it binds
+ * tighter than prec */
+void Parser::parse_operator(Precedence prec) {
+    if (peek_tok_is(Token::Type::Semicolon) || prec >= peek_precedence()) {
+        return;
+    }
+    switch (peek.type) {
+    case Token::Type::Plus:
+    case Token::Type::Minus:
+    case Token::Type::Asterisk:
+    case Token::Type::Slash:
+    case Token::Type::Lt:
+    case Token::Type::Gt:
+    case Token::Type::Eq:
+    case Token::Type::NotEq: {
+        next_token();
+        Frame infix = frame(Frame::Kind::Infix, prec, cur);
+        infix.oper = (uint8_t)infix_oper(cur.type);
+        frames.push_back(infix);
+        Precedence right = cur_precedence();
+        next_token();
+        frames.push_back(frame(Frame::Kind::Expression, right));
+    } break;
+    case Token::Type::LParen: {
+        next_token();
+        Frame call = frame(Frame::Kind::CallArgument, prec, cur);
+        call.base = values.size();
+        if (peek_tok_is(Token::Type::RParen)) {
             next_token();
-            e = parse_call(e);
+            finish_call(call, true);
             break;
-        default:
-            return e;
         }
+        next_token();
+        frames.push_back(call);
+        frames.push_back(frame(Frame::Kind::Expression, Precedence::Lowest));
+    } break;
+    default:
+        break;
     }
+}
+
+/* the arguments are values[call.base, end) and the function is just below
+ * them. a call whose argument list did not close gets no arguments */
+void Parser::finish_call(const Frame& call, bool closed) {
+    std::vector<Expression> args;
+    size_t height = 0;
+    if (closed) {
+        args.reserve(values.size() - call.base);
+        for (size_t i = call.base; i < values.size(); ++i) {
+            args.push_back(std::move(values[i]));
+            height = std::max(height, heights[i]);
+        }
+    }
+    values.resize(call.base);
+    heights.resize(call.base);
+    size_t fheight;
+    Expression* function = arena->make<Expression>(pop_value(fheight));
+    push_value(Expression(Expression::Type::Call,
+                          CallExpression(call.tok, function, std::move(args))),
+               std::max(height, fheight) + 1);
+    frames.push_back(frame(Frame::Kind::Operators, call.prec));
+}
+
+/* alternative_height is the height of alternative, if there is one */
+void Parser::finish_if(const Frame& ife,
+                       std::optional<BlockStatement> alternative,
+                       size_t alternative_height) {
+    BlockStatement consequence = std::move(blocks.back());
+    blocks.pop_back();
+    size_t height = std::max(block_heights.back(), alternative_height);
+    block_heights.pop_back();
+    size_t cheight;
+    Expression* condition = arena->make<Expression>(pop_value(cheight));
+    push_value(Expression(Expression::Type::If,
+                          IfExpression(ife.tok, condition,
+                                       std::move(consequence),
+                                       std::move(alternative))),
+               std::max(height, cheight) + 1);
+    frames.push_back(frame(Frame::Kind::Operators, ife.prec));
+}
+
+void Parser::push_value(Expression e, size_t height) {
+    values.push_back(std::move(e));
+    heights.push_back(height);
+}
+
+/* pops the last value, setting height to its height */
+Expression Parser::pop_value(size_t& height) {
+    Expression e = std::move(values.back());
+    values.pop_back();
+    height = heights.back();
+    heights.pop_back();
     return e;
 }
 
 Expression Parser::parse_identifier() {
-    Identifier ident(cur, std::get<std::shared_ptr<std::string>>(cur.literal));
-    return Expression(Expression::Type::Identifier, ident);
+    Identifier ident(cur, intern(text(cur)));
+    return Expression(Expression::Type::Identifier, std::move(ident));
 }
 
 Expression Parser::parse_integer() {
-    int64_t value = 0;
-    auto str = *std::get<std::shared_ptr<std::string>>(cur.literal);
-    for (auto c : str) {
-        value = (value * 10) + (c - '0');
-    }
-    IntegerLiteral i(cur, value);
-    return Expression(Expression::Type::Integer, i);
+    IntegerLiteral i(cur, cur.value, arena->copy(text(cur)));
+    return Expression(Expression::Type::Integer, std::move(i));
 }
 
 Expression Parser::parse_boolean() {
     Token tok = cur;
     bool value = cur_tok_is(Token::Type::True);
-    BooleanLiteral b(tok, value);
-    return Expression(Expression::Type::Boolean, b);
+    return Expression(Expression::Type::Boolean,
+                      BooleanLiteral(std::move(tok), value));
 }
 
-Expression Parser::parse_prefix() {
-    Token tok = cur;
-    PrefixExpression::Operator oper;
-    switch (cur.type) {
-    case Token::Type::Bang:
-        oper = PrefixExpression::Operator::Bang;
-        break;
-    case Token::Type::Minus:
-        oper = PrefixExpression::Operator::Minus;
-        break;
-    default:
-        unreachable;
-        return Expression();
+/* with cur on the { of a function body, finds its } and pushes a literal
+ * whose body is left to be parsed later, moving cur to the }. a body whose
+ * braces never close is parsed now, so its errors are not deferred */
+bool Parser::skip_body(const Token& tok, std::vector<Identifier>& ps) {
+    size_t open = index - 1, close, depth = 0;
+    for (close = open; close < end; ++close) {
+        Token::Type type = tokens->types[close];
+        if (type == Token::Type::LSquirly) {
+            depth++;
+        } else if (type == Token::Type::RSquirly && --depth == 0) {
+            break;
+        }
+    }
+    if (close == end) {
+        return false;
+    }
+    size_t from = tokens->offsets[open];
+    size_t to = tokens->offsets[close] + tokens->lengths[close];
+    LazyBody* body = arena->make<LazyBody>(tokens, open, close + 1,
+                                           tokens->source.substr(from,
+                                                                 to - from));
+    push_value(Expression(Expression::Type::Function,
+                          arena->make<FunctionLiteral>(tok, std::move(ps),
+                                                       BlockStatement(),
+                                                       arena.get(), body)),
+               1);
+    cur = tokens->get(close);
+    index = close + 1;
+    peek = tokens->get(index < end ? index : SIZE_MAX);
+    return true;
+}
+
+std::vector<Identifier> Parser::parse_function_params() {
+    std::vector<Identifier> idents;
+    if (peek_tok_is(Token::Type::RParen)) {
+        next_token();
+        return idents;
     }
     next_token();
-    Expression right = parse_expression(Precedence::Prefix);
-    return Expression(Expression::Type::Prefix,
-                      PrefixExpression(tok, oper, right));
+    idents.emplace_back(cur, intern(text(cur)));
+
+    while (peek_tok_is(Token::Type::Comma)) {
+        next_token();
+        next_token();
+        idents.emplace_back(cur, intern(text(cur)));
+    }
+
+    if (!expect_peek(Token::Type::RParen)) {
+        return std::vector<Identifier>();
+    }
+    return idents;
 }
 
-Expression Parser::parse_infix(Expression& left) {
-    Token tok = cur;
-    InfixExpression::Operator oper;
+FlatAst Parser::parse_flat() {
+    FlatAst ast;
+    flat = &ast;
+    /* operators chain in a loop, so only a statement's height tells how
+     * deep whatever walks it will recurse */
+    std::vector<uint32_t> node_heights;
+    while (cur.type != Token::Type::Eof) {
+        NodeIndex stmt = flat_statement();
+        if (stmt != FLAT_AST_NONE) {
+            ast.heights(node_heights);
+            if (!too_deep && node_heights[stmt] > max_depth) {
+                nested_too_deep();
+            }
+            if (too_deep) {
+                break;
+            }
+            ast.statements.push_back(stmt);
+        }
+        next_token();
+    }
+    flat = nullptr;
+    flat_names.clear();
+    return ast;
+}
+
+NodeIndex Parser::flat_statement() {
     switch (cur.type) {
-    case Token::Type::Plus:
-        oper = InfixExpression::Operator::Plus;
-        break;
-    case Token::Type::Minus:
-        oper = InfixExpression::Operator::Minus;
+    case Token::Type::Let: {
+        if (!expect_peek(Token::Type::Ident)) {
+            return FLAT_AST_NONE;
+        }
+        uint32_t name = flat_name();
+        if (!expect_peek(Token::Type::Assign)) {
+            return FLAT_AST_NONE;
+        }
+        next_token();
+        NodeIndex value = flat_expression(Precedence::Lowest);
+        if (peek_tok_is(Token::Type::Semicolon)) {
+            next_token();
+        }
+        return flat->add(FlatAst::Kind::Let, name, value);
+    }
+    case Token::Type::Return: {
+        next_token();
+        NodeIndex value = flat_expression(Precedence::Lowest);
+        if (peek_tok_is(Token::Type::Semicolon)) {
+            next_token();
+        }
+        return flat->add(FlatAst::Kind::Return, value);
+    }
+    default:
         break;
-    case Token::Type::Asterisk:
-        oper = InfixExpression::Operator::Asterisk;
+    }
+    NodeIndex exp = flat_expression(Precedence::Lowest);
+    if (peek_tok_is(Token::Type::Semicolon)) {
+        next_token();
+    }
+    return flat->add(FlatAst::Kind::Expression, exp);
+}
+
+NodeIndex Parser::flat_expression(Precedence precedence) {
+    if (flat_depth == max_depth) {
+        nested_too_deep();
+        return FLAT_AST_NONE;
+    }
+    flat_depth++;
+    NodeIndex e = flat_operand(precedence);
+    flat_depth--;
+    return e;
+}
+
+NodeIndex Parser::flat_operand(Precedence precedence) {
+    NodeIndex e;
+    switch (cur.type) {
+    case Token::Type::Ident:
+        e = flat->add(FlatAst::Kind::Identifier, flat_name());
         break;
-    case Token::Type::Slash:
-        oper = InfixExpression::Operator::Slash;
+    case Token::Type::Int:
+        e = flat->add(FlatAst::Kind::Integer, flat->integers.size());
+        flat->integers.push_back(cur.value);
         break;
-    case Token::Type::Lt:
-        oper = InfixExpression::Operator::Lt;
+    case Token::Type::True:
+    case Token::Type::False:
+        e = flat->add(FlatAst::Kind::Boolean, cur_tok_is(Token::Type::True));
         break;
-    case Token::Type::Gt:
-        oper = InfixExpression::Operator::Gt;
+    case Token::Type::Bang:
+    case Token::Type::Minus: {
+        PrefixExpression::Operator oper = prefix_oper(cur.type);
+        next_token();
+        NodeIndex right = flat_expression(Precedence::Prefix);
+        e = flat->add(FlatAst::Kind::Prefix, right, 0, (uint8_t)oper);
+    } break;
+    case Token::Type::LParen:
+        next_token();
+        e = flat_expression(Precedence::Lowest);
+        if (!expect_peek(Token::Type::RParen)) {
+            e = FLAT_AST_NONE;
+        }
         break;
-    case Token::Type::Eq:
-        oper = InfixExpression::Operator::Eq;
+    case Token::Type::If:
+        e = flat_if();
         break;
-    case Token::Type::NotEq:
-        oper = InfixExpression::Operator::NotEq;
+    case Token::Type::Function:
+        e = flat_function();
         break;
     default:
-        unreachable;
-        return Expression();
+        no_prefix_parse_method(cur.type);
+        return FLAT_AST_NONE;
     }
 
-    Precedence precedence = cur_precedence();
-    next_token();
-    Expression right = parse_expression(precedence);
-    InfixExpression ie(tok, oper, left, right);
-    return Expression(Expression::Type::Infix, ie);
-}
-
-Expression Parser::parse_group() {
-    next_token();
-    Expression e = parse_expression(Precedence::Lowest);
-    if (!expect_peek(Token::Type::RParen)) {
-        return Expression();
+    while (!peek_tok_is(Token::Type::Semicolon) &&
+           precedence < peek_precedence()) {
+        switch (peek.type) {
+        case Token::Type::Plus:
+        case Token::Type::Minus:
+        case Token::Type::Asterisk:
+        case Token::Type::Slash:
+        case Token::Type::Lt:
+        case Token::Type::Gt:
+        case Token::Type::Eq:
+        case Token::Type::NotEq: {
+            next_token();
+            InfixExpression::Operator oper = infix_oper(cur.type);
+            Precedence prec = cur_precedence();
+            next_token();
+            NodeIndex right = flat_expression(prec);
+            e = flat->add(FlatAst::Kind::Infix, e, right, (uint8_t)oper);
+        } break;
+        case Token::Type::LParen: {
+            next_token();
+            std::vector<uint32_t> args = flat_call_args();
+            e = flat->add(FlatAst::Kind::Call, e, flat->add_list(args));
+        } break;
+        default:
+            return e;
+        }
     }
     return e;
 }
 
-Expression Parser::parse_if() {
-    Token tok = cur;
+NodeIndex Parser::flat_if() {
     if (!expect_peek(Token::Type::LParen)) {
-        return Expression();
+        return FLAT_AST_NONE;
     }
     next_token();
-    Expression condition = parse_expression(Precedence::Lowest);
+    NodeIndex condition = flat_expression(Precedence::Lowest);
     if (!expect_peek(Token::Type::RParen)) {
-        return Expression();
+        return FLAT_AST_NONE;
     }
     if (!expect_peek(Token::Type::LSquirly)) {
-        return Expression();
+        return FLAT_AST_NONE;
     }
-    BlockStatement consequence = parse_block();
-    std::optional<BlockStatement> alternative = {};
+    NodeIndex consequence = flat_block();
+    NodeIndex alternative = FLAT_AST_NONE;
     if (peek_tok_is(Token::Type::Else)) {
         next_token();
         if (!expect_peek(Token::Type::LSquirly)) {
-            return Expression();
+            return FLAT_AST_NONE;
         }
-        alternative = parse_block();
+        alternative = flat_block();
     }
-    IfExpression ife(tok, condition, consequence, alternative);
-    return Expression(Expression::Type::If, ife);
+    uint32_t blocks = flat->add_list({consequence, alternative});
+    return flat->add(FlatAst::Kind::If, condition, blocks);
 }
 
-Expression Parser::parse_function() {
-    Token tok = cur;
+NodeIndex Parser::flat_function() {
     if (!expect_peek(Token::Type::LParen)) {
-        return Expression();
+        return FLAT_AST_NONE;
+    }
+    std::vector<uint32_t> params;
+    if (peek_tok_is(Token::Type::RParen)) {
+        next_token();
+    } else {
+        next_token();
+        params.push_back(flat_name());
+        while (peek_tok_is(Token::Type::Comma)) {
+            next_token();
+            next_token();
+            params.push_back(flat_name());
+        }
+        if (!expect_peek(Token::Type::RParen)) {
+            params.clear();
+        }
     }
-    std::vector<Identifier> params = parse_function_params();
     if (!expect_peek(Token::Type::LSquirly)) {
-        return Expression();
+        return FLAT_AST_NONE;
     }
-    BlockStatement body = parse_block();
-    FunctionLiteral fn(cur, params, body);
-    return Expression(Expression::Type::Function, fn);
+    NodeIndex body = flat_block();
+    return flat->add(FlatAst::Kind::Function, flat->add_list(params), body);
 }
 
-Expression Parser::parse_call(Expression& function) {
-    Token tok = cur;
-    std::vector<Expression> args = parse_call_args();
-    CallExpression call(tok, function, args);
-    return Expression(Expression::Type::Call, call);
-}
-
-BlockStatement Parser::parse_block() {
-    BlockStatement block;
-    block.tok = cur;
+NodeIndex Parser::flat_block() {
+    std::vector<uint32_t> stmts;
     next_token();
-
     while (!cur_tok_is(Token::Type::RSquirly) &&
            !cur_tok_is(Token::Type::Eof)) {
-        Statement stmt = parse_statement();
-        if (stmt.type != Statement::Type::Inv) {
-            block.stmts.push_back(stmt);
+        NodeIndex stmt = flat_statement();
+        if (stmt != FLAT_AST_NONE) {
+            stmts.push_back(stmt);
         }
         next_token();
     }
-    return block;
+    return flat->add(FlatAst::Kind::Block, flat->add_list(stmts));
 }
 
-std::vector<Identifier> Parser::parse_function_params() {
-    std::vector<Identifier> idents;
+std::vector<uint32_t> Parser::flat_call_args() {
+    std::vector<uint32_t> args;
     if (peek_tok_is(Token::Type::RParen)) {
         next_token();
-        return idents;
+        return args;
     }
     next_token();
-    Identifier ident(cur, std::get<std::shared_ptr<std::string>>(cur.literal));
-    idents.push_back(ident);
-
+    args.push_back(flat_expression(Precedence::Lowest));
     while (peek_tok_is(Token::Type::Comma)) {
         next_token();
         next_token();
-        ident.tok = cur;
-        ident.value = std::get<std::shared_ptr<std::string>>(cur.literal);
-        idents.push_back(ident);
+        args.push_back(flat_expression(Precedence::Lowest));
     }
-
     if (!expect_peek(Token::Type::RParen)) {
-        return std::vector<Identifier>();
+        return std::vector<uint32_t>();
     }
-    return idents;
+    return args;
 }
 
-std::vector<Expression> Parser::parse_call_args() {
-    std::vector<Expression> args;
-    if (peek_tok_is(Token::Type::RParen)) {
-        next_token();
-        return args;
+/* identifiers are stored once per distinct name */
+uint32_t Parser::flat_name() {
+    std::string_view name = text(cur);
+    auto it = flat_names.find(name);
+    if (it != flat_names.end()) {
+        return it->second;
     }
-    next_token();
-    args.push_back(parse_expression(Precedence::Lowest));
-    while (peek_tok_is(Token::Type::Comma)) {
-        next_token();
-        next_token();
-        args.push_back(parse_expression(Precedence::Lowest));
+    uint32_t idx = flat->names.size();
+    flat->names.emplace_back(name);
+    flat_names.emplace(name, idx);
+    return idx;
+}
+
+PrefixExpression::Operator Parser::prefix_oper(Token::Type type) {
+    switch (type) {
+    case Token::Type::Bang:
+        return PrefixExpression::Operator::Bang;
+    case Token::Type::Minus:
+        return PrefixExpression::Operator::Minus;
+    default:
+        break;
     }
-    if (!expect_peek(Token::Type::RParen)) {
-        return std::vector<Expression>();
+    unreachable;
+    return PrefixExpression::Operator::Bang;
+}
+
+InfixExpression::Operator Parser::infix_oper(Token::Type type) {
+    switch (type) {
+    case Token::Type::Plus:
+        return InfixExpression::Operator::Plus;
+    case Token::Type::Minus:
+        return InfixExpression::Operator::Minus;
+    case Token::Type::Asterisk:
+        return InfixExpression::Operator::Asterisk;
+    case Token::Type::Slash:
+        return InfixExpression::Operator::Slash;
+    case Token::Type::Lt:
+        return InfixExpression::Operator::Lt;
+    case Token::Type::Gt:
+        return InfixExpression::Operator::Gt;
+    case Token::Type::Eq:
+        return InfixExpression::Operator::Eq;
+    case Token::Type::NotEq:
+        return InfixExpression::Operator::NotEq;
+    default:
+        break;
     }
-    return args;
+    unreachable;
+    return InfixExpression::Operator::Plus;
+}
+
+std::string_view Parser::text(const Token& tok) {
+    if (tokens != nullptr) {
+        return tok.get_literal(tokens->source);
+    }
+    return tok.get_literal(pipe != nullptr ? pipe->source() : l->source());
 }
 
 void Parser::next_token() {
     cur = peek;
-    peek = l.next_token();
+    if (tokens != nullptr) {
+        ++index;
+        peek = tokens->get(index < end ? index : SIZE_MAX);
+    } else if (pipe != nullptr) {
+        peek = pipe->next_token();
+    } else {
+        peek = l->next_token();
+    }
 }
 
 bool Parser::cur_tok_is(Token::Type type) { return cur.type == type; }
@@ -388,6 +873,9 @@ Precedence Parser::cur_precedence() { return precedence(cur.type); }
 Precedence Parser::peek_precedence() { return precedence(peek.type); }
 
 void Parser::peek_error(Token::Type type) {
+    if (too_deep) {
+        return;
+    }
     std::string err = "expected next token to be ";
     err.append(cur.token_type_string());
     err.append(", got ");
@@ -397,8 +885,30 @@ void Parser::peek_error(Token::Type type) {
 }
 
 void Parser::no_prefix_parse_method(Token::Type type) {
+    if (too_deep) {
+        return;
+    }
     std::string err = "no prefix parse function for ";
     err.append(token_type_to_string(type));
     err.append(" found");
     errors.push_back(err);
 }
+
+/* gives up on the rest of the input. the tree parser drops what it was
+ * building; the flat parser unwinds over the Eof it is left at, with any
+ * errors that causes kept quiet */
+void Parser::nested_too_deep() {
+    errors.push_back("expression nested deeper than " +
+                     std::to_string(max_depth));
+    too_deep = true;
+    frames.clear();
+    values.clear();
+    heights.clear();
+    blocks.clear();
+    block_heights.clear();
+    params.clear();
+    statement = Statement();
+    while (!cur_tok_is(Token::Type::Eof)) {
+        next_token();
+    }
+}
@@ -1,8 +1,16 @@
 #pragma once
 
 #include "ast.hh"
+#include "flat_ast.hh"
 #include "lexer.hh"
 #include "token.hh"
+#include "token_buffer.hh"
+#include "token_pipe.hh"
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 
 enum class Precedence {
     Lowest = 0,
@@ -14,34 +22,116 @@ enum class Precedence {
     Call = 6,        // myFunction(X)
 };
 
+/* the most expressions and blocks the parser will have open at once, and
+ * the tallest tree it will build, before giving up on the input */
+#define PARSER_MAX_DEPTH 4096
+
 class Parser {
   public:
     Parser(Lexer& l);
+    /* reads pre-lexed tokens by index instead of pulling them from a lexer.
+     * the buffer must outlive the parser */
+    Parser(const TokenBuffer& tokens);
+    /* parses tokens [begin, end) of the buffer as if Eof followed them */
+    Parser(const TokenBuffer& tokens, size_t begin, size_t end);
+    /* reads tokens lexed ahead on the pipe's own thread */
+    Parser(TokenPipe& pipe);
     Program parse();
+    /* parses into the flat, index based layout instead of a tree of nodes.
+     * a parser is used for one or the other, not both */
+    FlatAst parse_flat();
     std::vector<std::string>& get_errors();
+    void set_max_depth(size_t depth);
+    /* skip function bodies, only matching their braces, and leave them to be
+     * parsed when first used. only a parser reading a token buffer can be
+     * lazy, and the buffer and its source must then outlive the program */
+    void set_lazy(bool lazy);
+    /* parses fn's body if it was skipped and has not been parsed yet,
+     * returning the errors found in it. safe to call from many threads */
+    static const std::vector<std::string>& load_body(const FunctionLiteral& fn);
 
   private:
-    Lexer& l;
+    Lexer* l;
+    const TokenBuffer* tokens;
+    TokenPipe* pipe;
+    size_t index; /* of peek in tokens */
+    size_t end;
+    std::shared_ptr<Arena> arena;
+    size_t max_depth;
+    bool too_deep;
+    bool lazy;
     Token cur;
     Token peek;
     std::vector<std::string> errors;
+    FlatAst* flat;
+    std::unordered_map<std::string_view, uint32_t> flat_names;
+    size_t flat_depth;
+    /* a construct of the tree parser waiting on the expression or block
+     * being parsed above it on the frame stack */
+    struct Frame {
+        enum class Kind : uint8_t {
+            Expression,
+            Operators,
+            Prefix,
+            Infix,
+            Group,
+            IfCondition,
+            IfConsequence,
+            IfAlternative,
+            FunctionBody,
+            CallArgument,
+            BlockOpen,
+            BlockLoop,
+            BlockStatement,
+            Let,
+            Return,
+            ExpressionStatement,
+        } kind;
+        uint8_t oper;
+        Precedence prec;
+        Token tok;
+        Token name;      /* Let only */
+        SymbolId symbol; /* Let only */
+        size_t base;     /* CallArgument only: values index of the first */
+    };
+    std::vector<Frame> frames;
+    std::vector<Expression> values;
+    /* of each of values, blocks and statement: the most nodes on a path
+     * down from it */
+    std::vector<size_t> heights;
+    std::vector<BlockStatement> blocks;
+    std::vector<size_t> block_heights;
+    std::vector<std::vector<Identifier>> params;
+    Statement statement;
+    size_t statement_height;
     Statement parse_statement();
-    Statement parse_let_statement();
-    Statement parse_return_statement();
-    Statement parse_expression_statement();
-    Expression parse_expression(Precedence precedence);
+    BlockStatement parse_body();
+    void start_statement();
+    static Frame frame(Frame::Kind kind, Precedence prec, Token tok = Token());
+    void run();
+    void start_expression(Precedence prec);
+    void parse_operator(Precedence prec);
+    void finish_call(const Frame& call, bool closed);
+    void finish_if(const Frame& ife, std::optional<BlockStatement> alternative,
+                   size_t alternative_height);
+    void push_value(Expression e, size_t height);
+    Expression pop_value(size_t& height);
     Expression parse_identifier();
     Expression parse_integer();
     Expression parse_boolean();
-    Expression parse_prefix();
-    Expression parse_infix(Expression& left);
-    Expression parse_group();
-    Expression parse_if();
-    Expression parse_function();
-    Expression parse_call(Expression& function);
-    BlockStatement parse_block();
     std::vector<Identifier> parse_function_params();
-    std::vector<Expression> parse_call_args();
+    bool skip_body(const Token& tok, std::vector<Identifier>& ps);
+    NodeIndex flat_statement();
+    NodeIndex flat_expression(Precedence precedence);
+    NodeIndex flat_operand(Precedence precedence);
+    NodeIndex flat_if();
+    NodeIndex flat_function();
+    NodeIndex flat_block();
+    std::vector<uint32_t> flat_call_args();
+    uint32_t flat_name();
+    static PrefixExpression::Operator prefix_oper(Token::Type type);
+    static InfixExpression::Operator infix_oper(Token::Type type);
+    std::string_view text(const Token& tok);
     void next_token();
     bool cur_tok_is(Token::Type type);
     bool peek_tok_is(Token::Type type);
@@ -51,4 +141,5 @@ class Parser {
     Precedence peek_precedence();
     void peek_error(Token::Type type);
     void no_prefix_parse_method(Token::Type type);
+    void nested_too_deep();
 };
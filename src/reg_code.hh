@@ -0,0 +1,84 @@
+#pragma once
+
+#include "code.hh"
+#include <cstdint>
+#include <cstring>
+
+/* opcodes of the register machine. a function's registers hold its params,
+ * then its lets, then the temporaries of the expression being computed.
+ * operands a, b and c are register numbers unless noted, and bc is b and c
+ * read together as one 32 bit operand.
+ *
+ * the arithmetic and comparison ops are specialized for integers: when both
+ * operands are Int they work on the int64 values directly, and only
+ * otherwise fall back to the generic rules and their errors. the Imm forms
+ * take a 16 bit integer literal as c in place of a right hand register */
+enum class RegOp : uint8_t {
+    Move,           /* a = b */
+    LoadInt,        /* a = bc as a signed integer */
+    LoadConst,      /* a = constants[bc] */
+    LoadTrue,       /* a = true */
+    LoadFalse,      /* a = false */
+    LoadNull,       /* a = null */
+    Clear,          /* a, ..., a + b - 1 = null */
+    GetGlobal,      /* a = globals[b] */
+    SetGlobal,      /* globals[b] = a */
+    GetFree,        /* a = free[b] of the running closure */
+    Check,          /* an error naming local_names[c] if a is unbound */
+    /* a = the value in the cell in b, or an error naming local_names[c] if
+     * it is unbound */
+    GetCell,
+    GetFreeCell,    /* a = the value in the cell free[b], as GetCell */
+    SetCell,        /* the cell in a holds b */
+    MakeCell,       /* a = a new cell holding a */
+    CurrentClosure, /* a = the running closure */
+    Closure,        /* a = constants[b] closed over a, ..., a + c - 1 */
+    Call,           /* a = a(a + 1, ..., a + b) */
+    Return,         /* returns a */
+    Jump,           /* to instruction bc */
+    JumpFalsy,      /* to instruction bc unless a is truthy */
+    Neg,            /* a = -b */
+    Not,            /* a = !b */
+    /* a = b op c, in the order of InfixExpression::Operator */
+    AddInt,
+    SubInt,
+    MulInt,
+    DivInt,
+    LtInt,
+    GtInt,
+    EqInt,
+    NotEqInt,
+    /* a = b op c, where c is the literal */
+    AddIntImm,
+    SubIntImm,
+    MulIntImm,
+    DivIntImm,
+    LtIntImm,
+    GtIntImm,
+    EqIntImm,
+    NotEqIntImm,
+};
+
+struct RegInstruction {
+    RegOp op;
+    uint8_t unused;
+    uint16_t a;
+    uint16_t b;
+    uint16_t c;
+
+    uint32_t bc() const { return (uint32_t)b | (uint32_t)c << 16; }
+};
+
+static_assert(sizeof(RegInstruction) == 8, "instructions are 8 bytes");
+
+/* register code is kept in the same byte vectors as stack code, so compiled
+ * functions and closures carry either */
+static inline size_t reg_code_size(const Instructions& ins) {
+    return ins.size() / sizeof(RegInstruction);
+}
+
+static inline RegInstruction reg_fetch(const uint8_t* code, size_t pc) {
+    RegInstruction ins;
+    std::memcpy(&ins, code + pc * sizeof(ins), sizeof(ins));
+    return ins;
+}
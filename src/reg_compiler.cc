@@ -0,0 +1,520 @@
+#include "reg_compiler.hh"
+#include "parser.hh"
+#include "resolver.hh"
+#include "util.hh"
+
+static size_t count_lets(const std::vector<Statement>& stmts);
+
+RegCompiler::RegCompiler()
+    : symbols(std::make_shared<SymbolTable>()),
+      scopes(std::vector<CompilationScope>(1)) {}
+
+void RegCompiler::compile(const Program& program) {
+    for (auto& stmt : program.statements) {
+        if (stmt.type == Statement::Type::Let) {
+            const LetStatement& let = std::get<LetStatement>(stmt.data);
+            define_global(let.name.symbol);
+        }
+    }
+    /* register 0 of the top level holds the value of the last expression
+     * statement run, which is the value of the program */
+    alloc_register();
+    scopes.back().first_temp = 1;
+    compile_statements(program.statements);
+    /* a let has no value, so a program ending in one has none either */
+    if (!program.statements.empty() &&
+        program.statements.back().type == Statement::Type::Let) {
+        emit(RegOp::LoadNull, 0);
+    }
+    emit(RegOp::Return, 0);
+}
+
+RegBytecode RegCompiler::bytecode() {
+    RegBytecode bc;
+    bc.instructions = scopes.back().instructions;
+    bc.num_registers = scopes.back().max;
+    bc.constants = constants;
+    bc.global_names = global_names;
+    bc.local_names = local_names;
+    return bc;
+}
+
+std::vector<std::string>& RegCompiler::get_errors() { return errors; }
+
+void RegCompiler::compile_statements(const std::vector<Statement>& stmts) {
+    for (auto& stmt : stmts) {
+        compile_statement(stmt);
+    }
+}
+
+void RegCompiler::compile_statement(const Statement& stmt) {
+    size_t mark = scopes.back().next;
+    switch (stmt.type) {
+    case Statement::Type::Let: {
+        const LetStatement& let = std::get<LetStatement>(stmt.data);
+        SymbolId name = let.name.symbol;
+        Symbol sym;
+        uint16_t dst;
+        if (scopes.size() == 1) {
+            define_global(name);
+            sym = *symbols->resolve(name);
+            dst = alloc_register();
+        } else if (let.value.type != Expression::Type::Function &&
+                   symbols->binds(name)) {
+            /* the value sees the binding the let shadows, so it is computed
+             * before the local is defined */
+            uint16_t src = compile_operand(let.value);
+            sym = symbols->define(name,
+                                  scopes.back().captured.count(name) != 0);
+            if (sym.cell) {
+                emit(RegOp::SetCell, sym.index, src);
+            } else if (sym.index != src) {
+                emit(RegOp::Move, sym.index, src);
+            }
+            scopes.back().bound[sym.index] = true;
+            break;
+        } else {
+            /* a local lives in its own register for the whole call, or in
+             * the cell that register holds */
+            sym = symbols->define(name,
+                                  scopes.back().captured.count(name) != 0);
+            dst = sym.cell ? alloc_register() : sym.index;
+        }
+        if (let.value.type == Expression::Type::Function) {
+            compile_function(*std::get<FunctionLiteral*>(let.value.data),
+                             &name, dst);
+        } else {
+            compile_expression(let.value, dst);
+        }
+        if (sym.scope == Symbol::Scope::Global) {
+            emit(RegOp::SetGlobal, dst, global_index(sym));
+        } else if (sym.cell) {
+            emit(RegOp::SetCell, sym.index, dst);
+        } else {
+            scopes.back().bound[sym.index] = true;
+        }
+    } break;
+    case Statement::Type::Ret:
+        emit(RegOp::Return,
+             compile_operand(std::get<ReturnStatement>(stmt.data).value));
+        break;
+    case Statement::Type::Expression: {
+        const Expression& exp = std::get<ExpressionStatement>(stmt.data).exp;
+        compile_expression(exp, scopes.size() == 1 ? 0 : alloc_register());
+    } break;
+    default:
+        break;
+    }
+    scopes.back().next = mark;
+}
+
+/* a block's value is the value of its last statement when that is an
+ * expression, and null otherwise */
+void RegCompiler::compile_block(const BlockStatement& block, uint16_t dst) {
+    size_t i, len = block.stmts.size();
+    if (len == 0) {
+        emit(RegOp::LoadNull, dst);
+        return;
+    }
+    std::vector<bool> bound = scopes.back().bound;
+    for (i = 0; i < len - 1; ++i) {
+        compile_statement(block.stmts[i]);
+    }
+    const Statement& last = block.stmts[len - 1];
+    if (last.type == Statement::Type::Expression) {
+        compile_expression(std::get<ExpressionStatement>(last.data).exp, dst);
+    } else {
+        compile_statement(last);
+        if (last.type != Statement::Type::Ret) {
+            emit(RegOp::LoadNull, dst);
+        }
+    }
+    scopes.back().bound = std::move(bound);
+}
+
+void RegCompiler::compile_expression(const Expression& exp, uint16_t dst) {
+    size_t mark = scopes.back().next;
+    switch (exp.type) {
+    case Expression::Type::Integer: {
+        int64_t value = std::get<IntegerLiteral>(exp.data).value;
+        if (value >= INT32_MIN && value <= INT32_MAX) {
+            emit_wide(RegOp::LoadInt, dst, (uint32_t)(int32_t)value);
+        } else {
+            emit_wide(RegOp::LoadConst, dst,
+                      add_constant(Object(Object::Type::Int, value)));
+        }
+    } break;
+    case Expression::Type::Boolean:
+        emit(std::get<BooleanLiteral>(exp.data).value ? RegOp::LoadTrue
+                                                      : RegOp::LoadFalse,
+             dst);
+        break;
+    case Expression::Type::Prefix: {
+        const PrefixExpression& pe = std::get<PrefixExpression>(exp.data);
+        emit(pe.oper == PrefixExpression::Operator::Minus ? RegOp::Neg
+                                                          : RegOp::Not,
+             dst, compile_operand(*pe.right));
+    } break;
+    case Expression::Type::Infix:
+        compile_infix(std::get<InfixExpression>(exp.data), dst);
+        break;
+    case Expression::Type::If:
+        compile_if(std::get<IfExpression>(exp.data), dst);
+        break;
+    case Expression::Type::Identifier:
+        compile_identifier(std::get<Identifier>(exp.data), dst);
+        break;
+    case Expression::Type::Function:
+        compile_function(*std::get<FunctionLiteral*>(exp.data), nullptr, dst);
+        break;
+    case Expression::Type::Call:
+        compile_call(std::get<CallExpression>(exp.data), dst);
+        break;
+    default:
+        emit(RegOp::LoadNull, dst);
+        break;
+    }
+    scopes.back().next = mark;
+}
+
+/* the register holding the value of exp: a local's own register, or a new
+ * temporary the value is computed into */
+uint16_t RegCompiler::compile_operand(const Expression& exp) {
+    if (exp.type == Expression::Type::Identifier) {
+        const Identifier& ident = std::get<Identifier>(exp.data);
+        std::optional<Symbol> sym = symbols->resolve(ident.symbol);
+        if (sym.has_value() && sym->scope == Symbol::Scope::Local &&
+            !sym->cell) {
+            check_bound(*sym, ident.symbol);
+            return sym->index;
+        }
+    }
+    uint16_t reg = alloc_register();
+    compile_expression(exp, reg);
+    return reg;
+}
+
+/* a local on the left is only read in place when nothing on the right can
+ * rebind it, as a let in an if block there would */
+void RegCompiler::compile_infix(const InfixExpression& infix, uint16_t dst) {
+    uint8_t oper = (uint8_t)infix.oper;
+    Expression::Type right_type = infix.right->type;
+    uint16_t left;
+    if (right_type == Expression::Type::Integer ||
+        right_type == Expression::Type::Boolean ||
+        right_type == Expression::Type::Identifier) {
+        left = compile_operand(*infix.left);
+    } else {
+        left = alloc_register();
+        compile_expression(*infix.left, left);
+    }
+    if (infix.right->type == Expression::Type::Integer) {
+        int64_t value = std::get<IntegerLiteral>(infix.right->data).value;
+        if (value >= INT16_MIN && value <= INT16_MAX) {
+            emit((RegOp)((uint8_t)RegOp::AddIntImm + oper), dst, left,
+                 (uint16_t)(int16_t)value);
+            return;
+        }
+    }
+    uint16_t right = compile_operand(*infix.right);
+    emit((RegOp)((uint8_t)RegOp::AddInt + oper), dst, left, right);
+}
+
+void RegCompiler::compile_if(const IfExpression& ife, uint16_t dst) {
+    size_t mark = scopes.back().next;
+    uint16_t cond = compile_operand(*ife.condition);
+    scopes.back().next = mark;
+    size_t jump_falsy = emit_wide(RegOp::JumpFalsy, cond, 0);
+    compile_block(ife.consequence, dst);
+    size_t jump = emit_wide(RegOp::Jump, 0, 0);
+    patch_target(jump_falsy, reg_code_size(scopes.back().instructions));
+    if (ife.alternative.has_value()) {
+        compile_block(*ife.alternative, dst);
+    } else {
+        emit(RegOp::LoadNull, dst);
+    }
+    patch_target(jump, reg_code_size(scopes.back().instructions));
+}
+
+void RegCompiler::compile_function(const FunctionLiteral& fn,
+                                   const SymbolId* name, uint16_t dst) {
+    if (fn.lazy != nullptr) {
+        const std::vector<std::string>& errs = Parser::load_body(fn);
+        errors.insert(errors.end(), errs.begin(), errs.end());
+    }
+    size_t num_lets = count_lets(fn.body.stmts);
+    enter_scope(fn.params.size() + num_lets);
+    if (name != nullptr) {
+        symbols->define_function_name(*name);
+    }
+    LetBindings lets = let_bindings(fn);
+    for (auto& param : fn.params) {
+        Symbol sym = symbols->define(param.symbol,
+                                     lets.captured.count(param.symbol) != 0);
+        scopes.back().bound[sym.index] = true;
+    }
+    /* a let's register holds nothing until the let runs, not what an
+     * earlier call left there */
+    if (num_lets > 0) {
+        emit(RegOp::Clear, fn.params.size(), num_lets);
+    }
+    /* the lets a closure in the body may use are bound from the start */
+    for (SymbolId let : lets.early) {
+        symbols->define(let, true);
+    }
+    for (size_t idx : symbols->reserve_cells(lets.captured)) {
+        emit(RegOp::MakeCell, idx);
+    }
+    scopes.back().captured = std::move(lets.captured);
+    uint16_t res = alloc_register();
+    compile_block(fn.body, res);
+    emit(RegOp::Return, res);
+    std::vector<Symbol> free_symbols = symbols->get_free_symbols();
+    CompilationScope scope = leave_scope();
+
+    auto compiled = std::make_shared<const CompiledFunction>(
+        std::move(scope.instructions), scope.max, fn.params.size());
+    size_t idx = add_constant(Object(Object::Type::CompiledFunction, compiled));
+    if (idx > UINT16_MAX) {
+        errors.push_back("too many functions");
+    }
+    if (free_symbols.empty()) {
+        emit(RegOp::Closure, dst, idx, 0);
+        return;
+    }
+    /* the captured values go in consecutive registers, which the closure
+     * then replaces */
+    size_t mark = scopes.back().next;
+    uint16_t base = alloc_register();
+    load_symbol(free_symbols[0], base);
+    for (size_t i = 1; i < free_symbols.size(); ++i) {
+        load_symbol(free_symbols[i], alloc_register());
+    }
+    emit(RegOp::Closure, base, idx, free_symbols.size());
+    if (base != dst) {
+        emit(RegOp::Move, dst, base);
+    }
+    scopes.back().next = mark;
+}
+
+/* the callee's registers start just past the call's arguments, so its
+ * params are the argument registers themselves and nothing is copied */
+void RegCompiler::compile_call(const CallExpression& call, uint16_t dst) {
+    CompilationScope& scope = scopes.back();
+    size_t mark = scope.next;
+    uint16_t fn;
+    /* a temporary on top of the stack of registers can hold the function
+     * and then its result */
+    if (dst >= scope.first_temp && dst + 1u == scope.next) {
+        fn = dst;
+    } else {
+        fn = alloc_register();
+    }
+    compile_expression(*call.function, fn);
+    for (auto& arg : call.arguments) {
+        compile_expression(arg, alloc_register());
+    }
+    emit(RegOp::Call, fn, call.arguments.size());
+    if (fn != dst) {
+        emit(RegOp::Move, dst, fn);
+    }
+    scopes.back().next = mark;
+}
+
+void RegCompiler::compile_identifier(const Identifier& ident, uint16_t dst) {
+    std::optional<Symbol> sym = symbols->resolve(ident.symbol);
+    if (!sym.has_value()) {
+        errors.push_back("identifier not found: " + std::string(ident.value));
+        return;
+    }
+    if (sym->cell) {
+        emit(sym->scope == Symbol::Scope::Local ? RegOp::GetCell
+                                                : RegOp::GetFreeCell,
+             dst, sym->index, local_name(ident.symbol));
+        return;
+    }
+    if (sym->scope == Symbol::Scope::Local) {
+        check_bound(*sym, ident.symbol);
+    }
+    load_symbol(*sym, dst);
+}
+
+/* makes a read of local sym fail as unbound when its let may not have run:
+ * a let only binds for sure in the rest of the block it is in */
+void RegCompiler::check_bound(Symbol sym, SymbolId name) {
+    if (!scopes.back().bound[sym.index]) {
+        emit(RegOp::Check, sym.index, 0, local_name(name));
+    }
+}
+
+/* copies what sym's slot holds to dst, which for a binding kept in a cell
+ * is the cell itself */
+void RegCompiler::load_symbol(Symbol sym, uint16_t dst) {
+    switch (sym.scope) {
+    case Symbol::Scope::Global:
+        emit(RegOp::GetGlobal, dst, global_index(sym));
+        break;
+    case Symbol::Scope::Local:
+        if (sym.index != dst) {
+            emit(RegOp::Move, dst, sym.index);
+        }
+        break;
+    case Symbol::Scope::Free:
+        emit(RegOp::GetFree, dst, sym.index);
+        break;
+    case Symbol::Scope::Function:
+        emit(RegOp::CurrentClosure, dst);
+        break;
+    }
+}
+
+/* the b operand addressing global sym, which must fit 16 bits */
+uint16_t RegCompiler::global_index(Symbol sym) {
+    if (sym.index > UINT16_MAX) {
+        const char* err = "too many globals";
+        if (errors.empty() || errors.back() != err) {
+            errors.push_back(err);
+        }
+    }
+    return sym.index;
+}
+
+/* the c operand naming name in local_names, which must fit 16 bits */
+uint16_t RegCompiler::local_name(SymbolId name) {
+    auto it = local_name_index.find(name);
+    if (it != local_name_index.end()) {
+        return it->second;
+    }
+    if (local_names.size() > UINT16_MAX) {
+        const char* err = "too many local names";
+        if (errors.empty() || errors.back() != err) {
+            errors.push_back(err);
+        }
+    }
+    local_names.push_back(std::string(symbol_name(name)));
+    local_name_index[name] = local_names.size() - 1;
+    return local_names.size() - 1;
+}
+
+void RegCompiler::define_global(SymbolId name) {
+    if (symbols->resolve(name).has_value()) {
+        return;
+    }
+    Symbol sym = symbols->define(name);
+    global_names.resize(sym.index + 1);
+    global_names[sym.index] = symbol_name(name);
+}
+
+size_t RegCompiler::add_constant(Object obj) {
+    constants.push_back(std::move(obj));
+    return constants.size() - 1;
+}
+
+size_t RegCompiler::emit(RegOp op, uint16_t a, uint16_t b, uint16_t c) {
+    Instructions& ins = scopes.back().instructions;
+    RegInstruction instruction = {op, 0, a, b, c};
+    size_t pos = reg_code_size(ins);
+    ins.resize(ins.size() + sizeof(instruction));
+    std::memcpy(&ins[pos * sizeof(instruction)], &instruction,
+                sizeof(instruction));
+    return pos;
+}
+
+size_t RegCompiler::emit_wide(RegOp op, uint16_t a, uint32_t bc) {
+    return emit(op, a, bc & 0xffff, bc >> 16);
+}
+
+void RegCompiler::patch_target(size_t pos, size_t target) {
+    Instructions& ins = scopes.back().instructions;
+    RegInstruction instruction = reg_fetch(ins.data(), pos);
+    instruction.b = target & 0xffff;
+    instruction.c = target >> 16;
+    std::memcpy(&ins[pos * sizeof(instruction)], &instruction,
+                sizeof(instruction));
+}
+
+uint16_t RegCompiler::alloc_register() {
+    CompilationScope& scope = scopes.back();
+    if (scope.next == REG_MAX_REGISTERS) {
+        errors.push_back("too many registers");
+        return 0;
+    }
+    size_t reg = scope.next++;
+    if (scope.next > scope.max) {
+        scope.max = scope.next;
+    }
+    return reg;
+}
+
+/* params and lets take the first num_locals registers of a function */
+void RegCompiler::enter_scope(size_t num_locals) {
+    CompilationScope scope;
+    scope.next = num_locals;
+    scope.max = num_locals;
+    scope.first_temp = num_locals;
+    scope.bound.resize(num_locals);
+    scopes.push_back(std::move(scope));
+    symbols = std::make_shared<SymbolTable>(symbols);
+}
+
+RegCompiler::CompilationScope RegCompiler::leave_scope() {
+    CompilationScope scope = std::move(scopes.back());
+    scopes.pop_back();
+    symbols = symbols->get_outer();
+    return scope;
+}
+
+static size_t count_lets(const Expression& exp);
+
+/* an upper bound on the locals the lets in stmts define. if blocks share
+ * the scope they are in, function literals do not */
+static size_t count_lets(const std::vector<Statement>& stmts) {
+    size_t res = 0;
+    for (auto& stmt : stmts) {
+        switch (stmt.type) {
+        case Statement::Type::Let:
+            res += 1 + count_lets(std::get<LetStatement>(stmt.data).value);
+            break;
+        case Statement::Type::Ret:
+            res += count_lets(std::get<ReturnStatement>(stmt.data).value);
+            break;
+        case Statement::Type::Expression:
+            res += count_lets(std::get<ExpressionStatement>(stmt.data).exp);
+            break;
+        default:
+            break;
+        }
+    }
+    return res;
+}
+
+static size_t count_lets(const Expression& exp) {
+    switch (exp.type) {
+    case Expression::Type::Prefix:
+        return count_lets(*std::get<PrefixExpression>(exp.data).right);
+    case Expression::Type::Infix: {
+        const InfixExpression& infix = std::get<InfixExpression>(exp.data);
+        return count_lets(*infix.left) + count_lets(*infix.right);
+    }
+    case Expression::Type::If: {
+        const IfExpression& ife = std::get<IfExpression>(exp.data);
+        size_t res = count_lets(*ife.condition) +
+                     count_lets(ife.consequence.stmts);
+        if (ife.alternative.has_value()) {
+            res += count_lets(ife.alternative->stmts);
+        }
+        return res;
+    }
+    case Expression::Type::Call: {
+        const CallExpression& call = std::get<CallExpression>(exp.data);
+        size_t res = count_lets(*call.function);
+        for (auto& arg : call.arguments) {
+            res += count_lets(arg);
+        }
+        return res;
+    }
+    default:
+        break;
+    }
+    return 0;
+}
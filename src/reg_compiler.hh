@@ -0,0 +1,75 @@
+#pragma once
+
+#include "ast.hh"
+#include "object.hh"
+#include "reg_code.hh"
+#include "symbol_table.hh"
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#define REG_MAX_REGISTERS UINT16_MAX
+
+struct RegBytecode {
+    Instructions instructions;
+    size_t num_registers; /* used by the top level code */
+    std::vector<Object> constants;
+    /* names of the global slots, used to report unbound globals */
+    std::vector<std::string> global_names;
+    /* names of the locals, used the same way */
+    std::vector<std::string> local_names;
+};
+
+/* compiles a program to register code. functions become CompiledFunctions
+ * in the constants, with num_locals holding the registers a call needs */
+class RegCompiler {
+  public:
+    RegCompiler();
+    void compile(const Program& program);
+    RegBytecode bytecode();
+    std::vector<std::string>& get_errors();
+
+  private:
+    struct CompilationScope {
+        Instructions instructions;
+        size_t next; /* the lowest free register */
+        size_t max;  /* one past the highest register used */
+        size_t first_temp; /* registers below this are locals */
+        /* the lets of the function kept in cells */
+        std::unordered_set<SymbolId> captured;
+        /* which locals are certain to be bound at the code being compiled */
+        std::vector<bool> bound;
+    };
+    std::vector<Object> constants;
+    std::vector<std::string> global_names;
+    std::vector<std::string> local_names;
+    std::unordered_map<SymbolId, size_t> local_name_index;
+    std::shared_ptr<SymbolTable> symbols;
+    std::vector<CompilationScope> scopes;
+    std::vector<std::string> errors;
+    void compile_statements(const std::vector<Statement>& stmts);
+    void compile_statement(const Statement& stmt);
+    void compile_block(const BlockStatement& block, uint16_t dst);
+    void compile_expression(const Expression& exp, uint16_t dst);
+    uint16_t compile_operand(const Expression& exp);
+    void compile_infix(const InfixExpression& infix, uint16_t dst);
+    void compile_if(const IfExpression& ife, uint16_t dst);
+    void compile_function(const FunctionLiteral& fn, const SymbolId* name,
+                          uint16_t dst);
+    void compile_call(const CallExpression& call, uint16_t dst);
+    void compile_identifier(const Identifier& ident, uint16_t dst);
+    void load_symbol(Symbol sym, uint16_t dst);
+    uint16_t global_index(Symbol sym);
+    uint16_t local_name(SymbolId name);
+    void check_bound(Symbol sym, SymbolId name);
+    void define_global(SymbolId name);
+    size_t add_constant(Object obj);
+    size_t emit(RegOp op, uint16_t a = 0, uint16_t b = 0, uint16_t c = 0);
+    size_t emit_wide(RegOp op, uint16_t a, uint32_t bc);
+    void patch_target(size_t pos, size_t target);
+    uint16_t alloc_register();
+    void enter_scope(size_t num_locals);
+    CompilationScope leave_scope();
+};
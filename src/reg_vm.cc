@@ -0,0 +1,311 @@
+#include "reg_vm.hh"
+#include "util.hh"
+#include <algorithm>
+
+static const Object null_obj(Object::Type::Null, std::monostate());
+static const Object true_obj(Object::Type::Bool, true);
+static const Object false_obj(Object::Type::Bool, false);
+
+static inline void set_int(Object& dst, int64_t value);
+static inline void set_bool(Object& dst, bool value);
+static inline void int_infix(RegOp op, int64_t left, int64_t right,
+                             Object& dst);
+static Object generic_infix(RegOp op, Object& left, Object& right);
+static bool is_truthy(const Object& obj);
+
+RegVM::RegVM(RegBytecode bytecode)
+    : instructions(std::move(bytecode.instructions)),
+      num_registers(bytecode.num_registers),
+      constants(std::move(bytecode.constants)),
+      globals(std::vector<Object>(bytecode.global_names.size())),
+      global_names(std::move(bytecode.global_names)),
+      local_names(std::move(bytecode.local_names)),
+      registers(std::vector<Object>(REG_VM_REGISTERS)) {
+    frames.reserve(REG_VM_MAX_FRAMES);
+}
+
+Object RegVM::run() {
+    if (num_registers > REG_VM_REGISTERS) {
+        return Object(Object::Type::Error, "stack overflow");
+    }
+    frames.clear();
+    frames.push_back(RegFrame{nullptr, instructions.data(), 0, 0});
+    RegFrame* frame = &frames.back();
+    Object* regs = registers.data();
+    while (true) {
+        RegInstruction ins = reg_fetch(frame->code, frame->pc++);
+        switch (ins.op) {
+        case RegOp::Move:
+            regs[ins.a] = regs[ins.b];
+            break;
+        case RegOp::LoadInt:
+            set_int(regs[ins.a], (int32_t)ins.bc());
+            break;
+        case RegOp::LoadConst:
+            regs[ins.a] = constants[ins.bc()];
+            break;
+        case RegOp::LoadTrue:
+            set_bool(regs[ins.a], true);
+            break;
+        case RegOp::LoadFalse:
+            set_bool(regs[ins.a], false);
+            break;
+        case RegOp::LoadNull:
+            regs[ins.a] = null_obj;
+            break;
+        case RegOp::Clear:
+            std::fill(regs + ins.a, regs + ins.a + ins.b, null_obj);
+            break;
+        case RegOp::GetGlobal:
+            if (globals[ins.b].type == Object::Type::Null) {
+                return Object(Object::Type::Error,
+                              "identifier not found: " + global_names[ins.b]);
+            }
+            regs[ins.a] = globals[ins.b];
+            break;
+        case RegOp::SetGlobal:
+            globals[ins.b] = regs[ins.a];
+            break;
+        case RegOp::GetFree:
+            regs[ins.a] = frame->cl->free[ins.b];
+            break;
+        case RegOp::Check:
+            if (regs[ins.a].type == Object::Type::Null) {
+                return Object(Object::Type::Error,
+                              "identifier not found: " + local_names[ins.c]);
+            }
+            break;
+        case RegOp::GetCell:
+        case RegOp::GetFreeCell: {
+            const Object& cell = ins.op == RegOp::GetCell
+                                     ? regs[ins.b]
+                                     : frame->cl->free[ins.b];
+            if (std::get<std::shared_ptr<Object>>(cell.value)->type ==
+                Object::Type::Null) {
+                return Object(Object::Type::Error,
+                              "identifier not found: " + local_names[ins.c]);
+            }
+            regs[ins.a] = *std::get<std::shared_ptr<Object>>(cell.value);
+        } break;
+        case RegOp::SetCell:
+            *std::get<std::shared_ptr<Object>>(regs[ins.a].value) = regs[ins.b];
+            break;
+        case RegOp::MakeCell:
+            regs[ins.a] =
+                Object(Object::Type::Cell,
+                       std::make_shared<Object>(std::move(regs[ins.a])));
+            break;
+        case RegOp::CurrentClosure:
+            regs[ins.a] = regs[-1];
+            break;
+        case RegOp::Closure: {
+            auto fn = std::get<std::shared_ptr<const CompiledFunction>>(
+                constants[ins.b].value);
+            std::vector<Object> free(regs + ins.a, regs + ins.a + ins.c);
+            regs[ins.a] = Object(Object::Type::Closure,
+                                 std::make_shared<Closure>(std::move(fn),
+                                                           std::move(free)));
+        } break;
+        case RegOp::Call: {
+            Object& callee = regs[ins.a];
+            if (callee.type != Object::Type::Closure) {
+                return Object(Object::Type::Error,
+                              string_format("not a function: %s",
+                                            callee.type_to_string()));
+            }
+            const Closure* cl =
+                std::get<std::shared_ptr<Closure>>(callee.value).get();
+            if (ins.b != cl->fn->num_params) {
+                return Object(Object::Type::Error,
+                              string_format("wrong number of arguments: "
+                                            "want=%zu, got=%zu",
+                                            cl->fn->num_params,
+                                            (size_t)ins.b));
+            }
+            size_t base = frame->base + ins.a + 1;
+            if (frames.size() >= REG_VM_MAX_FRAMES ||
+                base + cl->fn->num_locals > REG_VM_REGISTERS) {
+                return Object(Object::Type::Error, "stack overflow");
+            }
+            frames.push_back(
+                RegFrame{cl, cl->fn->instructions.data(), 0, base});
+            frame = &frames.back();
+            regs = registers.data() + base;
+        } break;
+        case RegOp::Return: {
+            if (frames.size() == 1) {
+                /* return at the top level ends the program */
+                Object res = std::move(regs[ins.a]);
+                frames.pop_back();
+                return res;
+            }
+            /* the result replaces the callee in the caller's register */
+            regs[-1] = regs[ins.a];
+            frames.pop_back();
+            frame = &frames.back();
+            regs = registers.data() + frame->base;
+        } break;
+        case RegOp::Jump:
+            frame->pc = ins.bc();
+            break;
+        case RegOp::JumpFalsy:
+            if (!is_truthy(regs[ins.a])) {
+                frame->pc = ins.bc();
+            }
+            break;
+        case RegOp::Neg: {
+            Object& right = regs[ins.b];
+            if (right.type != Object::Type::Int) {
+                return Object(Object::Type::Error,
+                              string_format("unknown operator: -%s",
+                                            right.type_to_string()));
+            }
+            set_int(regs[ins.a], -*std::get_if<int64_t>(&right.value));
+        } break;
+        case RegOp::Not: {
+            Object& right = regs[ins.b];
+            switch (right.type) {
+            case Object::Type::Null:
+                set_bool(regs[ins.a], true);
+                break;
+            case Object::Type::Bool:
+                set_bool(regs[ins.a], !*std::get_if<bool>(&right.value));
+                break;
+            default:
+                set_bool(regs[ins.a], false);
+                break;
+            }
+        } break;
+        case RegOp::AddInt:
+        case RegOp::SubInt:
+        case RegOp::MulInt:
+        case RegOp::DivInt:
+        case RegOp::LtInt:
+        case RegOp::GtInt:
+        case RegOp::EqInt:
+        case RegOp::NotEqInt: {
+            Object& left = regs[ins.b];
+            Object& right = regs[ins.c];
+            if (left.type == Object::Type::Int &&
+                right.type == Object::Type::Int) {
+                int_infix(ins.op, *std::get_if<int64_t>(&left.value),
+                          *std::get_if<int64_t>(&right.value), regs[ins.a]);
+                break;
+            }
+            Object res = generic_infix(ins.op, left, right);
+            if (res.type == Object::Type::Error) {
+                return res;
+            }
+            regs[ins.a] = std::move(res);
+        } break;
+        case RegOp::AddIntImm:
+        case RegOp::SubIntImm:
+        case RegOp::MulIntImm:
+        case RegOp::DivIntImm:
+        case RegOp::LtIntImm:
+        case RegOp::GtIntImm:
+        case RegOp::EqIntImm:
+        case RegOp::NotEqIntImm: {
+            RegOp op = (RegOp)((uint8_t)ins.op - (uint8_t)RegOp::AddIntImm +
+                               (uint8_t)RegOp::AddInt);
+            Object& left = regs[ins.b];
+            if (left.type == Object::Type::Int) {
+                int_infix(op, *std::get_if<int64_t>(&left.value),
+                          (int16_t)ins.c, regs[ins.a]);
+                break;
+            }
+            Object right(Object::Type::Int, (int64_t)(int16_t)ins.c);
+            Object res = generic_infix(op, left, right);
+            if (res.type == Object::Type::Error) {
+                return res;
+            }
+            regs[ins.a] = std::move(res);
+        } break;
+        }
+    }
+}
+
+/* overwrites an Int or Bool in place rather than building a new Object */
+static inline void set_int(Object& dst, int64_t value) {
+    if (dst.type == Object::Type::Int) {
+        *std::get_if<int64_t>(&dst.value) = value;
+        return;
+    }
+    dst = Object(Object::Type::Int, value);
+}
+
+static inline void set_bool(Object& dst, bool value) {
+    if (dst.type == Object::Type::Bool) {
+        *std::get_if<bool>(&dst.value) = value;
+        return;
+    }
+    dst = Object(Object::Type::Bool, value);
+}
+
+static inline void int_infix(RegOp op, int64_t left, int64_t right,
+                             Object& dst) {
+    switch (op) {
+    case RegOp::AddInt:
+        set_int(dst, left + right);
+        break;
+    case RegOp::SubInt:
+        set_int(dst, left - right);
+        break;
+    case RegOp::MulInt:
+        set_int(dst, left * right);
+        break;
+    case RegOp::DivInt:
+        set_int(dst, left / right);
+        break;
+    case RegOp::LtInt:
+        set_bool(dst, left < right);
+        break;
+    case RegOp::GtInt:
+        set_bool(dst, left > right);
+        break;
+    case RegOp::EqInt:
+        set_bool(dst, left == right);
+        break;
+    case RegOp::NotEqInt:
+        set_bool(dst, left != right);
+        break;
+    default:
+        break;
+    }
+}
+
+/* the rules eval_infix applies to operands that are not both integers */
+static Object generic_infix(RegOp op, Object& left, Object& right) {
+    InfixExpression::Operator oper =
+        (InfixExpression::Operator)((uint8_t)op - (uint8_t)RegOp::AddInt);
+    if (left.type != right.type) {
+        return Object(
+            Object::Type::Error,
+            string_format("type mismatch: %s %s %s", left.type_to_string(),
+                          infix_oper_to_string(oper), right.type_to_string()));
+    }
+    if (op == RegOp::EqInt) {
+        return left == right ? true_obj : false_obj;
+    }
+    if (op == RegOp::NotEqInt) {
+        return left != right ? true_obj : false_obj;
+    }
+    return Object(
+        Object::Type::Error,
+        string_format("unknown operator: %s %s %s", left.type_to_string(),
+                      infix_oper_to_string(oper), right.type_to_string()));
+}
+
+static bool is_truthy(const Object& obj) {
+    switch (obj.type) {
+    case Object::Type::Null:
+        return false;
+    case Object::Type::Int:
+        return true;
+    case Object::Type::Bool:
+        return std::get<bool>(obj.value);
+    default:
+        break;
+    }
+    return false;
+}
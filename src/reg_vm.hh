@@ -0,0 +1,39 @@
+#pragma once
+
+#include "object.hh"
+#include "reg_code.hh"
+#include "reg_compiler.hh"
+#include <string>
+#include <vector>
+
+/* like the stack vm, calls nest at most REG_VM_MAX_FRAMES deep and share
+ * REG_VM_REGISTERS registers, past which a call is a stack overflow */
+#define REG_VM_REGISTERS 16384
+#define REG_VM_MAX_FRAMES 1024
+
+/* a call's window of registers. cl is the closure being run, which stays
+ * alive in the caller's register just below base. the top level has none */
+struct RegFrame {
+    const Closure* cl;
+    const uint8_t* code;
+    size_t pc;
+    size_t base;
+};
+
+class RegVM {
+  public:
+    RegVM(RegBytecode bytecode);
+    /* runs the program, returning either the value of its last expression
+     * statement or the Error that stopped it */
+    Object run();
+
+  private:
+    Instructions instructions;
+    size_t num_registers;
+    std::vector<Object> constants;
+    std::vector<Object> globals;
+    std::vector<std::string> global_names;
+    std::vector<std::string> local_names;
+    std::vector<Object> registers;
+    std::vector<RegFrame> frames;
+};
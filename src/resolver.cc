@@ -0,0 +1,432 @@
+#include "resolver.hh"
+#include "parser.hh"
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+class Resolver {
+  public:
+    Resolver(Environment& env);
+    void resolve_program(Program& program);
+    void resolve_lazy(FunctionLiteral& fn);
+
+  private:
+    Environment& env;
+    std::vector<std::unordered_map<SymbolId, size_t>> locals;
+    FunctionLiteral* loading; /* the lazy function being resolved now */
+    std::unordered_map<SymbolId, size_t>& scope(size_t depth);
+    size_t declare(SymbolId name);
+    void declare_lets(std::vector<Statement>& stmts,
+                      const std::unordered_set<SymbolId>* only);
+    void resolve_statements(std::vector<Statement>& stmts);
+    void resolve_statement(Statement& stmt);
+    void resolve_expression(Expression& exp);
+    void resolve_function(FunctionLiteral& fn);
+    void resolve_identifier(Identifier& ident);
+};
+
+static void closure_names(const std::vector<Statement>& stmts, bool nested,
+                          std::unordered_set<SymbolId>& names);
+static void early_lets(const std::vector<Statement>& stmts,
+                       const std::unordered_set<SymbolId>* only,
+                       std::vector<SymbolId>& names);
+static void mark_tail_calls(std::vector<Statement>& stmts, bool last);
+
+void resolve(Program& program, Environment& env) {
+    Resolver r(env);
+    r.resolve_program(program);
+}
+
+Resolver::Resolver(Environment& env) : env(env), loading(nullptr) {}
+
+void Resolver::resolve_program(Program& program) {
+    declare_lets(program.statements, nullptr);
+    resolve_statements(program.statements);
+    env.slots.resize(env.names.size());
+}
+
+void Resolver::resolve_lazy(FunctionLiteral& fn) {
+    locals = std::move(fn.lazy->scopes);
+    loading = &fn;
+    resolve_function(fn);
+}
+
+static std::mutex resolve_mu;
+
+const std::vector<std::string>& resolve_body(const FunctionLiteral& fn,
+                                             Environment& globals) {
+    LazyBody* body = fn.lazy;
+    if (body->resolved.load(std::memory_order_acquire)) {
+        return body->errors;
+    }
+    const std::vector<std::string>& errors = Parser::load_body(fn);
+    std::lock_guard<std::mutex> lock(resolve_mu);
+    if (!body->resolved.load(std::memory_order_relaxed)) {
+        if (errors.empty()) {
+            Resolver r(globals);
+            r.resolve_lazy(const_cast<FunctionLiteral&>(fn));
+        }
+        body->resolved.store(true, std::memory_order_release);
+    }
+    return errors;
+}
+
+std::unordered_map<SymbolId, size_t>& Resolver::scope(size_t depth) {
+    if (depth == locals.size()) {
+        return env.names;
+    }
+    return locals[locals.size() - 1 - depth];
+}
+
+size_t Resolver::declare(SymbolId name) {
+    std::unordered_map<SymbolId, size_t>& names = scope(0);
+    auto it = names.find(name);
+    if (it != names.end()) {
+        return it->second;
+    }
+    size_t slot = names.size();
+    names[name] = slot;
+    return slot;
+}
+
+/* a function may use any binding of its enclosing scope, including ones made
+ * after it is defined, so the lets of a scope get their slots before anything
+ * in the scope is resolved. only gives the names to declare this way, or null
+ * for all of them; any other let is declared once its value is resolved, so
+ * names used before it still find the outer binding. if blocks do not
+ * introduce a scope of their own */
+void Resolver::declare_lets(std::vector<Statement>& stmts,
+                            const std::unordered_set<SymbolId>* only) {
+    std::vector<SymbolId> names;
+    early_lets(stmts, only, names);
+    for (SymbolId name : names) {
+        declare(name);
+    }
+}
+
+/* appends the lets declare_lets gives slots to names, in order */
+static void early_lets(const std::vector<Statement>& stmts,
+                       const std::unordered_set<SymbolId>* only,
+                       std::vector<SymbolId>& names) {
+    for (auto& stmt : stmts) {
+        const Expression* exp = nullptr;
+        switch (stmt.type) {
+        case Statement::Type::Let: {
+            const LetStatement& let = std::get<LetStatement>(stmt.data);
+            if (only == nullptr || only->count(let.name.symbol) != 0) {
+                names.push_back(let.name.symbol);
+            }
+            exp = &let.value;
+        } break;
+        case Statement::Type::Ret:
+            exp = &std::get<ReturnStatement>(stmt.data).value;
+            break;
+        case Statement::Type::Expression:
+            exp = &std::get<ExpressionStatement>(stmt.data).exp;
+            break;
+        default:
+            break;
+        }
+        if (exp != nullptr && exp->type == Expression::Type::If) {
+            const IfExpression& ife = std::get<IfExpression>(exp->data);
+            early_lets(ife.consequence.stmts, only, names);
+            if (ife.alternative.has_value()) {
+                early_lets(ife.alternative->stmts, only, names);
+            }
+        }
+    }
+}
+
+void Resolver::resolve_statements(std::vector<Statement>& stmts) {
+    for (auto& stmt : stmts) {
+        resolve_statement(stmt);
+    }
+}
+
+void Resolver::resolve_statement(Statement& stmt) {
+    switch (stmt.type) {
+    case Statement::Type::Let: {
+        LetStatement& let = std::get<LetStatement>(stmt.data);
+        resolve_expression(let.value);
+        let.name.depth = 0;
+        let.name.slot = declare(let.name.symbol);
+    } break;
+    case Statement::Type::Ret:
+        resolve_expression(std::get<ReturnStatement>(stmt.data).value);
+        break;
+    case Statement::Type::Expression:
+        resolve_expression(std::get<ExpressionStatement>(stmt.data).exp);
+        break;
+    default:
+        break;
+    }
+}
+
+void Resolver::resolve_expression(Expression& exp) {
+    switch (exp.type) {
+    case Expression::Type::Identifier:
+        resolve_identifier(std::get<Identifier>(exp.data));
+        break;
+    case Expression::Type::Prefix:
+        resolve_expression(*std::get<PrefixExpression>(exp.data).right);
+        break;
+    case Expression::Type::Infix: {
+        InfixExpression& infix = std::get<InfixExpression>(exp.data);
+        resolve_expression(*infix.left);
+        resolve_expression(*infix.right);
+    } break;
+    case Expression::Type::If: {
+        IfExpression& ife = std::get<IfExpression>(exp.data);
+        resolve_expression(*ife.condition);
+        resolve_statements(ife.consequence.stmts);
+        if (ife.alternative.has_value()) {
+            resolve_statements(ife.alternative->stmts);
+        }
+    } break;
+    case Expression::Type::Function:
+        resolve_function(*std::get<FunctionLiteral*>(exp.data));
+        break;
+    case Expression::Type::Call: {
+        CallExpression& call = std::get<CallExpression>(exp.data);
+        resolve_expression(*call.function);
+        for (auto& arg : call.arguments) {
+            resolve_expression(arg);
+        }
+    } break;
+    default:
+        break;
+    }
+}
+
+void Resolver::resolve_function(FunctionLiteral& fn) {
+    if (fn.lazy != nullptr && &fn != loading &&
+        !fn.lazy->resolved.load(std::memory_order_acquire)) {
+        /* the body is resolved when it is first called, against the scopes
+         * around it now */
+        fn.lazy->scopes = locals;
+        return;
+    }
+    locals.push_back(std::unordered_map<SymbolId, size_t>());
+    for (auto& param : fn.params) {
+        param.depth = 0;
+        param.slot = declare(param.symbol);
+    }
+    std::unordered_set<SymbolId> used;
+    closure_names(fn.body.stmts, false, used);
+    declare_lets(fn.body.stmts, &used);
+    resolve_statements(fn.body.stmts);
+    mark_tail_calls(fn.body.stmts, true);
+    fn.num_slots = scope(0).size();
+    locals.pop_back();
+}
+
+static void closure_names(const Expression& exp, bool nested,
+                          std::unordered_set<SymbolId>& names) {
+    switch (exp.type) {
+    case Expression::Type::Identifier:
+        if (nested) {
+            names.insert(std::get<Identifier>(exp.data).symbol);
+        }
+        break;
+    case Expression::Type::Prefix:
+        closure_names(*std::get<PrefixExpression>(exp.data).right, nested,
+                      names);
+        break;
+    case Expression::Type::Infix: {
+        const InfixExpression& infix = std::get<InfixExpression>(exp.data);
+        closure_names(*infix.left, nested, names);
+        closure_names(*infix.right, nested, names);
+    } break;
+    case Expression::Type::If: {
+        const IfExpression& ife = std::get<IfExpression>(exp.data);
+        closure_names(*ife.condition, nested, names);
+        closure_names(ife.consequence.stmts, nested, names);
+        if (ife.alternative.has_value()) {
+            closure_names(ife.alternative->stmts, nested, names);
+        }
+    } break;
+    case Expression::Type::Function: {
+        const FunctionLiteral& fn = *std::get<FunctionLiteral*>(exp.data);
+        if (fn.body_parsed()) {
+            closure_names(fn.body.stmts, true, names);
+            break;
+        }
+        /* an unparsed body is only tokens, any identifier of which may name
+         * a binding of ours */
+        const TokenBuffer& tokens = *fn.lazy->tokens;
+        size_t i;
+        for (i = fn.lazy->begin; i < fn.lazy->end; ++i) {
+            Token tok = tokens.get(i);
+            if (tok.type == Token::Type::Ident) {
+                names.insert(intern(tok.get_literal(tokens.source)));
+            }
+        }
+    } break;
+    case Expression::Type::Call: {
+        const CallExpression& call = std::get<CallExpression>(exp.data);
+        closure_names(*call.function, nested, names);
+        for (auto& arg : call.arguments) {
+            closure_names(arg, nested, names);
+        }
+    } break;
+    default:
+        break;
+    }
+}
+
+static void let_names(const std::vector<Statement>& stmts,
+                      std::unordered_set<SymbolId>& names);
+
+/* collects the names bound by the lets in exp, leaving out those of the
+ * function literals in it, which bind in scopes of their own */
+static void let_names(const Expression& exp,
+                      std::unordered_set<SymbolId>& names) {
+    switch (exp.type) {
+    case Expression::Type::Prefix:
+        let_names(*std::get<PrefixExpression>(exp.data).right, names);
+        break;
+    case Expression::Type::Infix: {
+        const InfixExpression& infix = std::get<InfixExpression>(exp.data);
+        let_names(*infix.left, names);
+        let_names(*infix.right, names);
+    } break;
+    case Expression::Type::If: {
+        const IfExpression& ife = std::get<IfExpression>(exp.data);
+        let_names(*ife.condition, names);
+        let_names(ife.consequence.stmts, names);
+        if (ife.alternative.has_value()) {
+            let_names(ife.alternative->stmts, names);
+        }
+    } break;
+    case Expression::Type::Call: {
+        const CallExpression& call = std::get<CallExpression>(exp.data);
+        let_names(*call.function, names);
+        for (auto& arg : call.arguments) {
+            let_names(arg, names);
+        }
+    } break;
+    default:
+        break;
+    }
+}
+
+static void let_names(const std::vector<Statement>& stmts,
+                      std::unordered_set<SymbolId>& names) {
+    for (auto& stmt : stmts) {
+        switch (stmt.type) {
+        case Statement::Type::Let: {
+            const LetStatement& let = std::get<LetStatement>(stmt.data);
+            names.insert(let.name.symbol);
+            let_names(let.value, names);
+        } break;
+        case Statement::Type::Ret:
+            let_names(std::get<ReturnStatement>(stmt.data).value, names);
+            break;
+        case Statement::Type::Expression:
+            let_names(std::get<ExpressionStatement>(stmt.data).exp, names);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+LetBindings let_bindings(const FunctionLiteral& fn) {
+    LetBindings bindings;
+    std::unordered_set<SymbolId> used, bound;
+    closure_names(fn.body.stmts, false, used);
+    early_lets(fn.body.stmts, &used, bindings.early);
+    let_names(fn.body.stmts, bound);
+    for (SymbolId name : bound) {
+        if (used.count(name) != 0) {
+            bindings.captured.insert(name);
+        }
+    }
+    return bindings;
+}
+
+/* collects the names used by the function literals in stmts, which may
+ * refer to a let of the enclosing function made after them. nested says
+ * whether stmts are themselves in such a literal */
+static void closure_names(const std::vector<Statement>& stmts, bool nested,
+                          std::unordered_set<SymbolId>& names) {
+    for (auto& stmt : stmts) {
+        switch (stmt.type) {
+        case Statement::Type::Let:
+            closure_names(std::get<LetStatement>(stmt.data).value, nested,
+                          names);
+            break;
+        case Statement::Type::Ret:
+            closure_names(std::get<ReturnStatement>(stmt.data).value, nested,
+                          names);
+            break;
+        case Statement::Type::Expression:
+            closure_names(std::get<ExpressionStatement>(stmt.data).exp, nested,
+                          names);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+static void mark_tail_call(Expression& exp) {
+    switch (exp.type) {
+    case Expression::Type::Call:
+        std::get<CallExpression>(exp.data).tail = true;
+        break;
+    case Expression::Type::If: {
+        IfExpression& ife = std::get<IfExpression>(exp.data);
+        mark_tail_calls(ife.consequence.stmts, true);
+        if (ife.alternative.has_value()) {
+            mark_tail_calls(ife.alternative->stmts, true);
+        }
+    } break;
+    default:
+        break;
+    }
+}
+
+/* a call is in tail position when it is the value of a return, or of the
+ * last statement of the body. the blocks of an if statement in the body are
+ * looked into as well, since a return in them returns from the function.
+ * last says whether the value of stmts is that of the function */
+static void mark_tail_calls(std::vector<Statement>& stmts, bool last) {
+    size_t i, len = stmts.size();
+    for (i = 0; i < len; ++i) {
+        Statement& stmt = stmts[i];
+        if (stmt.type == Statement::Type::Ret) {
+            mark_tail_call(std::get<ReturnStatement>(stmt.data).value);
+            continue;
+        }
+        if (stmt.type != Statement::Type::Expression) {
+            continue;
+        }
+        Expression& exp = std::get<ExpressionStatement>(stmt.data).exp;
+        if (last && i == len - 1) {
+            mark_tail_call(exp);
+        } else if (exp.type == Expression::Type::If) {
+            IfExpression& ife = std::get<IfExpression>(exp.data);
+            mark_tail_calls(ife.consequence.stmts, false);
+            if (ife.alternative.has_value()) {
+                mark_tail_calls(ife.alternative->stmts, false);
+            }
+        }
+    }
+}
+
+void Resolver::resolve_identifier(Identifier& ident) {
+    size_t depth;
+    for (depth = 0; depth <= locals.size(); ++depth) {
+        std::unordered_map<SymbolId, size_t>& names = scope(depth);
+        auto it = names.find(ident.symbol);
+        if (it != names.end()) {
+            ident.depth = depth;
+            ident.slot = it->second;
+            return;
+        }
+    }
+    ident.depth = -1;
+    ident.slot = -1;
+}
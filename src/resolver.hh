@@ -0,0 +1,34 @@
+#pragma once
+
+#include "ast.hh"
+#include "object.hh"
+#include <unordered_set>
+#include <vector>
+
+/* annotates every Identifier in program with the (depth, slot) address of
+ * its binding. names bound at the top level are given slots in env, so a
+ * program can be resolved against an environment used by earlier programs */
+void resolve(Program& program, Environment& env);
+
+/* parses and resolves the body of a lazily parsed function the first time it
+ * is called. globals is the outermost environment the function runs in.
+ * returns the errors found parsing the body. safe to call from many
+ * threads */
+const std::vector<std::string>& resolve_body(const FunctionLiteral& fn,
+                                             Environment& globals);
+
+/* how the lets of a function body are bound, for the vms to bind them the
+ * way the evaluator does */
+struct LetBindings {
+    /* the lets bound before any of the body runs, in the order the evaluator
+     * gives them slots: those a function literal in the body may use, since
+     * it may be called before the let runs */
+    std::vector<SymbolId> early;
+    /* the names bound by a let of the body and used by a function literal in
+     * it. a closure may be made before such a let runs, so the binding is
+     * shared with closures rather than copied into them */
+    std::unordered_set<SymbolId> captured;
+};
+
+/* the bindings of the lets of fn, whose body must be parsed */
+LetBindings let_bindings(const FunctionLiteral& fn);
@@ -0,0 +1,219 @@
+#include "scan.hh"
+#include <atomic>
+#include <cstdint>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+static inline bool is_space(char ch) {
+    return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r';
+}
+
+static inline bool is_letter(char ch) {
+    return (uint8_t)((ch | 0x20) - 'a') < 26 || ch == '_';
+}
+
+static inline bool is_digit(char ch) { return (uint8_t)(ch - '0') < 10; }
+
+static size_t spaces_scalar(const char* s, size_t pos, size_t len) {
+    while (pos < len && is_space(s[pos])) {
+        pos++;
+    }
+    return pos;
+}
+
+static size_t letters_scalar(const char* s, size_t pos, size_t len) {
+    while (pos < len && is_letter(s[pos])) {
+        pos++;
+    }
+    return pos;
+}
+
+static size_t digits_scalar(const char* s, size_t pos, size_t len) {
+    while (pos < len && is_digit(s[pos])) {
+        pos++;
+    }
+    return pos;
+}
+
+#ifdef SCAN_X86
+
+/* sse2 only has signed byte compares, so a range check shifts the range
+ * down to start at -128 and compares against its end */
+static inline __m128i sse2_in_range(__m128i v, char lo, char n) {
+    __m128i shifted = _mm_add_epi8(v, _mm_set1_epi8((char)(0x80 - lo)));
+    return _mm_cmplt_epi8(shifted, _mm_set1_epi8((char)(0x80 + n)));
+}
+
+static inline __m128i sse2_spaces(__m128i v) {
+    __m128i sp = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+    __m128i tab = _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'));
+    __m128i nl = _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'));
+    __m128i cr = _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'));
+    return _mm_or_si128(_mm_or_si128(sp, tab), _mm_or_si128(nl, cr));
+}
+
+static inline __m128i sse2_letters(__m128i v) {
+    __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    __m128i alpha = sse2_in_range(lower, 'a', 26);
+    return _mm_or_si128(alpha, _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+}
+
+static inline __m128i sse2_digits(__m128i v) {
+    return sse2_in_range(v, '0', 10);
+}
+
+static inline uint32_t sse2_misses(__m128i match) {
+    return ~(uint32_t)_mm_movemask_epi8(match) & 0xffff;
+}
+
+#define SSE2_SCANNER(name, classify, scalar)                                   \
+    static size_t name(const char* s, size_t pos, size_t len) {                \
+        while (pos + 16 <= len) {                                              \
+            __m128i v = _mm_loadu_si128((const __m128i*)(s + pos));            \
+            uint32_t misses = sse2_misses(classify(v));                        \
+            if (misses != 0) {                                                 \
+                return pos + __builtin_ctz(misses);                            \
+            }                                                                  \
+            pos += 16;                                                         \
+        }                                                                      \
+        return scalar(s, pos, len);                                            \
+    }
+
+SSE2_SCANNER(spaces_sse2, sse2_spaces, spaces_scalar)
+SSE2_SCANNER(letters_sse2, sse2_letters, letters_scalar)
+SSE2_SCANNER(digits_sse2, sse2_digits, digits_scalar)
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static inline __m256i avx2_in_range(__m256i v, char lo, char n) {
+    __m256i shifted = _mm256_add_epi8(v, _mm256_set1_epi8((char)(0x80 - lo)));
+    return _mm256_cmpgt_epi8(_mm256_set1_epi8((char)(0x80 + n)), shifted);
+}
+
+AVX2 static inline __m256i avx2_spaces(__m256i v) {
+    __m256i sp = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '));
+    __m256i tab = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'));
+    __m256i nl = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'));
+    __m256i cr = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r'));
+    return _mm256_or_si256(_mm256_or_si256(sp, tab), _mm256_or_si256(nl, cr));
+}
+
+AVX2 static inline __m256i avx2_letters(__m256i v) {
+    __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+    __m256i alpha = avx2_in_range(lower, 'a', 26);
+    return _mm256_or_si256(alpha, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')));
+}
+
+AVX2 static inline __m256i avx2_digits(__m256i v) {
+    return avx2_in_range(v, '0', 10);
+}
+
+AVX2 static inline uint32_t avx2_misses(__m256i match) {
+    return ~(uint32_t)_mm256_movemask_epi8(match);
+}
+
+#define AVX2_SCANNER(name, classify, tail)                                     \
+    AVX2 static size_t name(const char* s, size_t pos, size_t len) {           \
+        while (pos + 32 <= len) {                                              \
+            __m256i v = _mm256_loadu_si256((const __m256i*)(s + pos));         \
+            uint32_t misses = avx2_misses(classify(v));                        \
+            if (misses != 0) {                                                 \
+                return pos + __builtin_ctz(misses);                            \
+            }                                                                  \
+            pos += 32;                                                         \
+        }                                                                      \
+        return tail(s, pos, len);                                              \
+    }
+
+AVX2_SCANNER(spaces_avx2, avx2_spaces, spaces_sse2)
+AVX2_SCANNER(letters_avx2, avx2_letters, letters_sse2)
+AVX2_SCANNER(digits_avx2, avx2_digits, digits_sse2)
+
+#endif
+
+struct Scanners {
+    ScanImpl impl;
+    size_t (*spaces)(const char*, size_t, size_t);
+    size_t (*letters)(const char*, size_t, size_t);
+    size_t (*digits)(const char*, size_t, size_t);
+};
+
+static const Scanners scalar_scanners = {ScanImpl::Scalar, spaces_scalar,
+                                         letters_scalar, digits_scalar};
+#ifdef SCAN_X86
+static const Scanners sse2_scanners = {ScanImpl::Sse2, spaces_sse2,
+                                       letters_sse2, digits_sse2};
+static const Scanners avx2_scanners = {ScanImpl::Avx2, spaces_avx2,
+                                       letters_avx2, digits_avx2};
+#endif
+
+static bool cpu_supports(ScanImpl impl) {
+    switch (impl) {
+    case ScanImpl::Scalar:
+        return true;
+#ifdef SCAN_X86
+    case ScanImpl::Sse2:
+        /* part of the x86-64 baseline */
+        return true;
+    case ScanImpl::Avx2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+static const Scanners* scanners_for(ScanImpl impl) {
+    switch (impl) {
+#ifdef SCAN_X86
+    case ScanImpl::Sse2:
+        return &sse2_scanners;
+    case ScanImpl::Avx2:
+        return &avx2_scanners;
+#endif
+    default:
+        return &scalar_scanners;
+    }
+}
+
+static const Scanners* best_scanners() {
+    if (cpu_supports(ScanImpl::Avx2)) {
+        return scanners_for(ScanImpl::Avx2);
+    }
+    if (cpu_supports(ScanImpl::Sse2)) {
+        return scanners_for(ScanImpl::Sse2);
+    }
+    return &scalar_scanners;
+}
+
+/* scan_use may run while other threads lex; each scanner reads active once,
+ * and every Scanners it can point to is static, so relaxed order is enough */
+static std::atomic<const Scanners*> active{best_scanners()};
+
+size_t scan_spaces(const char* s, size_t pos, size_t len) {
+    return active.load(std::memory_order_relaxed)->spaces(s, pos, len);
+}
+
+size_t scan_letters(const char* s, size_t pos, size_t len) {
+    return active.load(std::memory_order_relaxed)->letters(s, pos, len);
+}
+
+size_t scan_digits(const char* s, size_t pos, size_t len) {
+    return active.load(std::memory_order_relaxed)->digits(s, pos, len);
+}
+
+ScanImpl scan_impl() {
+    return active.load(std::memory_order_relaxed)->impl;
+}
+
+bool scan_use(ScanImpl impl) {
+    if (!cpu_supports(impl)) {
+        return false;
+    }
+    active.store(scanners_for(impl), std::memory_order_relaxed);
+    return true;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+
+/* each scanner returns the index of the first byte of s at or after pos that
+ * is not in its class, or len if the run reaches the end. spaces are ' ',
+ * '\t', '\n' and '\r', letters are a-z, A-Z and '_', digits are 0-9.
+ *
+ * on x86-64 the runs are classified 16 or 32 bytes at a time with SSE2 or
+ * AVX2, picked at startup from what the cpu supports. elsewhere, and for the
+ * last bytes of the input, they go one byte at a time */
+size_t scan_spaces(const char* s, size_t pos, size_t len);
+size_t scan_letters(const char* s, size_t pos, size_t len);
+size_t scan_digits(const char* s, size_t pos, size_t len);
+
+enum class ScanImpl {
+    Scalar,
+    Sse2,
+    Avx2,
+};
+
+ScanImpl scan_impl();
+/* switches every scanner to impl, returns false and changes nothing if the
+ * cpu cannot run it */
+bool scan_use(ScanImpl impl);
@@ -0,0 +1,104 @@
+#include "source.hh"
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+Source::Source() : map(nullptr), map_len(0), modified(0) {}
+
+Source::Source(std::string text)
+    : owned(std::move(text)), map(nullptr), map_len(0), modified(0) {}
+
+Source::~Source() {
+    if (map != nullptr) {
+        munmap(map, map_len);
+    }
+}
+
+/* reads what is left of fd into an owned string, closing fd */
+static std::unique_ptr<Source> read_file(int fd, const std::string& path,
+                                         std::string& err) {
+    std::string text;
+    char buf[65536];
+    for (;;) {
+        ssize_t n = read(fd, buf, sizeof buf);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            err = path + ": " + std::strerror(errno);
+            close(fd);
+            return nullptr;
+        }
+        if (n == 0) {
+            break;
+        }
+        text.append(buf, n);
+        if ((uint64_t)text.size() > UINT32_MAX) {
+            err = path + ": file too large";
+            close(fd);
+            return nullptr;
+        }
+    }
+    close(fd);
+    return std::make_unique<Source>(std::move(text));
+}
+
+std::unique_ptr<Source> Source::map_file(const std::string& path,
+                                         std::string& err) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        err = path + ": " + std::strerror(errno);
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        err = path + ": " + std::strerror(errno);
+        close(fd);
+        return nullptr;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        /* pipes and devices cannot be mapped, and report no size */
+        return read_file(fd, path, err);
+    }
+    /* token offsets are 32 bits */
+    if ((uint64_t)st.st_size > UINT32_MAX) {
+        err = path + ": file too large";
+        close(fd);
+        return nullptr;
+    }
+    std::unique_ptr<Source> src(new Source());
+    src->modified =
+        (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    if (st.st_size == 0) {
+        /* an empty file cannot be mapped, and has nothing to map */
+        close(fd);
+        return src;
+    }
+    void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    int map_errno = errno;
+    close(fd);
+    if (map == MAP_FAILED) {
+        err = path + ": " + std::strerror(map_errno);
+        return nullptr;
+    }
+    /* the lexer reads front to back once */
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    src->map = map;
+    src->map_len = st.st_size;
+    return src;
+}
+
+std::string_view Source::text() const {
+    if (map != nullptr) {
+        return std::string_view((const char*)map, map_len);
+    }
+    return owned;
+}
+
+bool Source::is_mapped() const { return map != nullptr; }
+
+int64_t Source::mtime() const { return modified; }
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+/* the text of a program. it either owns a string or is a read only mapping
+ * of a file, so a script on disk is lexed in place without being copied.
+ * tokens point into the text, so a source must outlive the tokens lexed
+ * from it, but not the Program parsed from them */
+class Source {
+  public:
+    Source(std::string text);
+    ~Source();
+    Source(const Source&) = delete;
+    Source& operator=(const Source&) = delete;
+
+    /* maps the file at path, or returns nullptr and sets err. anything but
+     * a regular file, such as a pipe, is read into an owned string */
+    static std::unique_ptr<Source> map_file(const std::string& path,
+                                            std::string& err);
+    std::string_view text() const;
+    bool is_mapped() const;
+    /* when the file the text was read from was last modified, in
+     * nanoseconds since the epoch, or 0 if it is not from a regular file */
+    int64_t mtime() const;
+
+  private:
+    Source();
+    std::string owned;
+    void* map;
+    size_t map_len;
+    int64_t modified;
+};
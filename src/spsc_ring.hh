@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+/* a lock free ring of N slots shared by exactly one producer thread and one
+ * consumer thread. slots are filled and drained in place: the producer
+ * writes into back() then calls push(), the consumer reads front() then
+ * calls pop(). back() is null while the ring is full and front() is null
+ * while it is empty */
+template <typename T, size_t N> class SpscRing {
+    static_assert(N != 0 && (N & (N - 1)) == 0, "N must be a power of 2");
+
+  public:
+    SpscRing() : slots(N), head(0), tail(0) {}
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    T* back() {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == N) {
+            return nullptr;
+        }
+        return &slots[t & (N - 1)];
+    }
+
+    void push() {
+        tail.store(tail.load(std::memory_order_relaxed) + 1,
+                   std::memory_order_release);
+    }
+
+    T* front() {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        return &slots[h & (N - 1)];
+    }
+
+    void pop() {
+        head.store(head.load(std::memory_order_relaxed) + 1,
+                   std::memory_order_release);
+    }
+
+  private:
+    std::vector<T> slots;
+    /* each index is written by one side only; keep them on their own cache
+     * lines so the two threads do not fight over one */
+    alignas(64) std::atomic<size_t> head; /* next slot to read */
+    alignas(64) std::atomic<size_t> tail; /* next slot to write */
+};
@@ -0,0 +1,90 @@
+#include "symbol_table.hh"
+#include <algorithm>
+
+SymbolTable::SymbolTable() : outer(nullptr), definitions(0) {}
+
+SymbolTable::SymbolTable(std::shared_ptr<SymbolTable> outer)
+    : outer(std::move(outer)), definitions(0) {}
+
+Symbol SymbolTable::define(SymbolId name, bool cell) {
+    Symbol sym;
+    sym.scope = outer ? Symbol::Scope::Local : Symbol::Scope::Global;
+    sym.cell = cell;
+    auto it = store.find(name);
+    if (it != store.end() && it->second.scope == sym.scope) {
+        /* rebinding a name reuses its slot */
+        return it->second;
+    }
+    auto slot = reserved.find(name);
+    sym.index = slot != reserved.end() ? slot->second : definitions++;
+    store[name] = sym;
+    return sym;
+}
+
+Symbol SymbolTable::define_function_name(SymbolId name) {
+    Symbol sym = {Symbol::Scope::Function, 0, false};
+    store[name] = sym;
+    return sym;
+}
+
+size_t SymbolTable::reserve(SymbolId name) {
+    auto it = store.find(name);
+    if (it != store.end() && it->second.scope == Symbol::Scope::Local) {
+        return it->second.index;
+    }
+    auto slot = reserved.find(name);
+    if (slot != reserved.end()) {
+        return slot->second;
+    }
+    reserved[name] = definitions;
+    return definitions++;
+}
+
+std::vector<size_t>
+SymbolTable::reserve_cells(const std::unordered_set<SymbolId>& names) {
+    std::vector<SymbolId> sorted(names.begin(), names.end());
+    std::sort(sorted.begin(), sorted.end());
+    std::vector<size_t> slots;
+    for (SymbolId name : sorted) {
+        slots.push_back(reserve(name));
+    }
+    return slots;
+}
+
+std::optional<Symbol> SymbolTable::resolve(SymbolId name) {
+    auto it = store.find(name);
+    if (it != store.end()) {
+        return it->second;
+    }
+    if (!outer) {
+        return {};
+    }
+    std::optional<Symbol> sym = outer->resolve(name);
+    if (!sym.has_value()) {
+        return sym;
+    }
+    if (sym->scope == Symbol::Scope::Global) {
+        return sym;
+    }
+    return define_free(name, *sym);
+}
+
+bool SymbolTable::binds(SymbolId name) {
+    if (store.count(name) != 0) {
+        return true;
+    }
+    return outer && outer->binds(name);
+}
+
+size_t SymbolTable::num_definitions() { return definitions; }
+
+std::shared_ptr<SymbolTable> SymbolTable::get_outer() { return outer; }
+
+std::vector<Symbol>& SymbolTable::get_free_symbols() { return free_symbols; }
+
+Symbol SymbolTable::define_free(SymbolId name, Symbol original) {
+    Symbol sym = {Symbol::Scope::Free, free_symbols.size(), original.cell};
+    free_symbols.push_back(original);
+    store[name] = sym;
+    return sym;
+}
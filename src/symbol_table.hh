@@ -0,0 +1,52 @@
+#pragma once
+
+#include "intern.hh"
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+struct Symbol {
+    enum class Scope {
+        Global,
+        Local,
+        Free,
+        Function,
+    } scope;
+    size_t index;
+    /* whether the binding is kept in a cell shared with the closures that
+     * capture it, as it may be bound after they are made */
+    bool cell;
+};
+
+class SymbolTable {
+  public:
+    SymbolTable();
+    SymbolTable(std::shared_ptr<SymbolTable> outer);
+    Symbol define(SymbolId name, bool cell = false);
+    Symbol define_function_name(SymbolId name);
+    /* the slot name is bound to here, or that a later define will bind it
+     * to, so the slot can be set up before name is bound */
+    size_t reserve(SymbolId name);
+    /* the slots of names, reserving those not bound yet. they are in the
+     * order of the names, so code made from them does not depend on how a
+     * set hashes */
+    std::vector<size_t>
+    reserve_cells(const std::unordered_set<SymbolId>& names);
+    std::optional<Symbol> resolve(SymbolId name);
+    /* whether name resolves here or in an outer table. unlike resolve,
+     * never defines a free symbol */
+    bool binds(SymbolId name);
+    size_t num_definitions();
+    std::shared_ptr<SymbolTable> get_outer();
+    std::vector<Symbol>& get_free_symbols();
+
+  private:
+    std::shared_ptr<SymbolTable> outer;
+    std::unordered_map<SymbolId, Symbol> store;
+    std::unordered_map<SymbolId, size_t> reserved;
+    std::vector<Symbol> free_symbols;
+    size_t definitions;
+    Symbol define_free(SymbolId name, Symbol original);
+};
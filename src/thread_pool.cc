@@ -0,0 +1,54 @@
+#include "thread_pool.hh"
+
+ThreadPool::ThreadPool(size_t num_threads) : stopping(false) {
+    if (num_threads == 0) {
+        num_threads = std::thread::hardware_concurrency();
+    }
+    if (num_threads == 0) {
+        num_threads = 1;
+    }
+    workers.reserve(num_threads);
+    for (size_t i = 0; i < num_threads; ++i) {
+        workers.emplace_back([this] { work(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mu);
+        stopping = true;
+    }
+    cv.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+std::future<void> ThreadPool::submit(std::function<void()> job) {
+    std::packaged_task<void()> task(std::move(job));
+    std::future<void> res = task.get_future();
+    {
+        std::lock_guard<std::mutex> lock(mu);
+        jobs.push_back(std::move(task));
+    }
+    cv.notify_one();
+    return res;
+}
+
+size_t ThreadPool::size() const { return workers.size(); }
+
+void ThreadPool::work() {
+    while (true) {
+        std::packaged_task<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mu);
+            cv.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (jobs.empty()) {
+                return;
+            }
+            task = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        task();
+    }
+}
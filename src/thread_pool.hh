@@ -0,0 +1,31 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* a fixed set of worker threads running jobs in the order they were
+ * submitted. destroying the pool finishes the queued jobs first */
+class ThreadPool {
+  public:
+    /* 0 threads means one per hardware thread */
+    ThreadPool(size_t num_threads = 0);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    std::future<void> submit(std::function<void()> job);
+    size_t size() const;
+
+  private:
+    std::vector<std::thread> workers;
+    std::deque<std::packaged_task<void()>> jobs;
+    std::mutex mu;
+    std::condition_variable cv;
+    bool stopping;
+    void work();
+};
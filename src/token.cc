@@ -6,93 +6,99 @@ struct KeyWordMapItem {
     Token::Type type;
 };
 
-const KeyWordMapItem key_words[] = {
-    {"fn", Token::Type::Function},   {"if", Token::Type::If},
-    {"let", Token::Type::Let},       {"else", Token::Type::Else},
-    {"true", Token::Type::True},     {"false", Token::Type::False},
-    {"return", Token::Type::Return},
+/* keywords indexed by keyword_hash, which has no collisions between them */
+static const KeyWordMapItem key_words[16] = {
+    {"if", Token::Type::If},         {"false", Token::Type::False},
+    {"return", Token::Type::Return}, {nullptr, Token::Type::Ident},
+    {"true", Token::Type::True},     {nullptr, Token::Type::Ident},
+    {"else", Token::Type::Else},     {nullptr, Token::Type::Ident},
+    {nullptr, Token::Type::Ident},   {nullptr, Token::Type::Ident},
+    {nullptr, Token::Type::Ident},   {"let", Token::Type::Let},
+    {nullptr, Token::Type::Ident},   {nullptr, Token::Type::Ident},
+    {"fn", Token::Type::Function},   {nullptr, Token::Type::Ident},
 };
 
-size_t key_words_len = sizeof key_words / sizeof key_words[0];
+static inline size_t keyword_hash(std::string_view ident) {
+    return (((uint8_t)ident[0] << 1) ^ ((uint8_t)ident.back() << 3) ^
+            ident.size()) &
+           15;
+}
 
-Token::Type lookup_ident(const std::string& ident) {
-    size_t i;
-    for (i = 0; i < key_words_len; ++i) {
-        KeyWordMapItem item = key_words[i];
-        if (item.literal == ident) {
-            return item.type;
-        }
+Token::Type lookup_ident(std::string_view ident) {
+    if (ident.size() < 2 || ident.size() > 6) {
+        return Token::Type::Ident;
+    }
+    const KeyWordMapItem& item = key_words[keyword_hash(ident)];
+    if (item.literal != nullptr && ident == item.literal) {
+        return item.type;
     }
     return Token::Type::Ident;
 }
 
-const char* Token::get_literal() {
+std::string_view Token::get_literal(std::string_view source) const {
+    return source.substr(offset, length);
+}
+
+const char* token_type_literal(Token::Type type) {
     switch (type) {
-    case Type::Illegal:
-        return "Illegal";
-    case Type::Eof:
+    case Token::Type::Illegal:
+    case Token::Type::Eof:
+    case Token::Type::Ident:
+    case Token::Type::Int:
         return "";
-    case Type::Assign:
+    case Token::Type::Assign:
         return "=";
-    case Type::Plus:
+    case Token::Type::Plus:
         return "+";
-    case Type::LParen:
+    case Token::Type::LParen:
         return "(";
-    case Type::RParen:
+    case Token::Type::RParen:
         return ")";
-    case Type::LSquirly:
+    case Token::Type::LSquirly:
         return "{";
-    case Type::RSquirly:
+    case Token::Type::RSquirly:
         return "}";
-    case Type::Function:
+    case Token::Type::Function:
         return "fn";
-    case Type::Let:
+    case Token::Type::Let:
         return "let";
-    case Type::Comma:
+    case Token::Type::Comma:
         return ",";
-    case Type::Semicolon:
+    case Token::Type::Semicolon:
         return ";";
-    case Type::Bang:
+    case Token::Type::Bang:
         return "!";
-    case Type::Minus:
+    case Token::Type::Minus:
         return "-";
-    case Type::Slash:
+    case Token::Type::Slash:
         return "/";
-    case Type::Asterisk:
+    case Token::Type::Asterisk:
         return "*";
-    case Type::Lt:
+    case Token::Type::Lt:
         return "<";
-    case Type::Gt:
+    case Token::Type::Gt:
         return ">";
-    case Type::Eq:
+    case Token::Type::Eq:
         return "==";
-    case Type::NotEq:
+    case Token::Type::NotEq:
         return "!=";
-    case Type::If:
+    case Token::Type::If:
         return "if";
-    case Type::Else:
+    case Token::Type::Else:
         return "else";
-    case Type::Return:
+    case Token::Type::Return:
         return "return";
-    case Type::True:
+    case Token::Type::True:
         return "true";
-    case Type::False:
+    case Token::Type::False:
         return "false";
-    case Type::Ident: {
-        auto lit = std::get<std::shared_ptr<std::string>>(literal);
-        return lit->c_str();
-    }
-    case Type::Int: {
-        auto lit = std::get<std::shared_ptr<std::string>>(literal);
-        return lit->c_str();
-    }
     }
 
     unreachable;
     return "";
 }
 
-const char* Token::token_type_string() {
+const char* Token::token_type_string() const {
     switch (type) {
     case Type::Illegal:
         return "Illegal";
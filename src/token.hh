@@ -1,11 +1,12 @@
 #pragma once
 
-#include <memory>
-#include <string>
-#include <variant>
+#include <cstdint>
+#include <string_view>
 
+/* a token is its type and the span of source text it was read from, plus the
+ * decoded value of an integer. it does not own any text */
 struct Token {
-    enum class Type {
+    enum class Type : uint8_t {
         Illegal,
         Eof,
         Ident,
@@ -34,10 +35,15 @@ struct Token {
         True,
         False,
     } type;
-    std::variant<std::monostate, std::shared_ptr<std::string>> literal;
-    const char* get_literal();
-    const char* token_type_string();
+    uint32_t offset;
+    uint32_t length;
+    int64_t value; /* Int tokens only */
+    std::string_view get_literal(std::string_view source) const;
+    const char* token_type_string() const;
 };
 
-Token::Type lookup_ident(const std::string& ident);
+Token::Type lookup_ident(std::string_view ident);
 const char* token_type_to_string(Token::Type type);
+/* the fixed spelling of a keyword or operator, "" for identifiers, integers,
+ * Illegal and Eof */
+const char* token_type_literal(Token::Type type);
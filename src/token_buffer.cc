@@ -0,0 +1,50 @@
+#include "token_buffer.hh"
+#include "lexer.hh"
+
+TokenBuffer::TokenBuffer(std::string_view source) : source(source) {
+    /* a rough guess of one token per 4 bytes saves most regrowth */
+    size_t guess = source.size() / 4 + 1;
+    types.reserve(guess);
+    offsets.reserve(guess);
+    lengths.reserve(guess);
+    values.reserve(guess);
+    Lexer l(source, 0, source.size());
+    Token tok;
+    do {
+        tok = l.next_token();
+        push(tok);
+    } while (tok.type != Token::Type::Eof);
+}
+
+TokenBuffer::TokenBuffer(std::string_view source,
+                         const std::vector<Token>& tokens)
+    : source(source) {
+    types.reserve(tokens.size());
+    offsets.reserve(tokens.size());
+    lengths.reserve(tokens.size());
+    values.reserve(tokens.size());
+    for (auto& tok : tokens) {
+        push(tok);
+    }
+}
+
+size_t TokenBuffer::size() const { return types.size(); }
+
+Token TokenBuffer::get(size_t i) const {
+    if (i >= types.size()) {
+        i = types.size() - 1;
+    }
+    Token tok;
+    tok.type = types[i];
+    tok.offset = offsets[i];
+    tok.length = lengths[i];
+    tok.value = values[i];
+    return tok;
+}
+
+void TokenBuffer::push(const Token& tok) {
+    types.push_back(tok.type);
+    offsets.push_back(tok.offset);
+    lengths.push_back(tok.length);
+    values.push_back(tok.type == Token::Type::Int ? tok.value : 0);
+}
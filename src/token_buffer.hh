@@ -0,0 +1,28 @@
+#pragma once
+
+#include "token.hh"
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+/* every token of a source, lexed up front and stored as a struct of arrays.
+ * token i is types[i], offsets[i], lengths[i] and values[i], and the last
+ * token is always Eof. the source must outlive the buffer */
+struct TokenBuffer {
+    std::string_view source;
+    std::vector<Token::Type> types;
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> lengths;
+    std::vector<int64_t> values; /* decoded value of Int tokens, else 0 */
+
+    /* lexes all of source */
+    TokenBuffer(std::string_view source);
+    /* takes tokens already lexed from source, such as those returned by
+     * tokenize_parallel. they must end with Eof */
+    TokenBuffer(std::string_view source, const std::vector<Token>& tokens);
+
+    size_t size() const;
+    /* token i, or the final Eof for any i past the end */
+    Token get(size_t i) const;
+    void push(const Token& tok);
+};
@@ -0,0 +1,63 @@
+#include "token_pipe.hh"
+#include "lexer.hh"
+
+TokenPipe::TokenPipe(std::string_view source)
+    : input(source), stopping(false), batch(nullptr), pos(0), done(false),
+      eof{} {
+    producer = std::thread([this] { produce(); });
+}
+
+TokenPipe::~TokenPipe() {
+    /* the parser may stop reading before Eof, leaving the producer waiting
+     * on a full ring */
+    stopping.store(true, std::memory_order_relaxed);
+    producer.join();
+}
+
+void TokenPipe::produce() {
+    Lexer l(input, 0, input.size());
+    bool at_eof = false;
+    while (!at_eof) {
+        Batch* out;
+        while ((out = ring.back()) == nullptr) {
+            if (stopping.load(std::memory_order_relaxed)) {
+                return;
+            }
+            std::this_thread::yield();
+        }
+        uint32_t n = 0;
+        while (n < TOKEN_PIPE_BATCH) {
+            Token tok = l.next_token();
+            out->tokens[n++] = tok;
+            if (tok.type == Token::Type::Eof) {
+                at_eof = true;
+                break;
+            }
+        }
+        out->size = n;
+        ring.push();
+    }
+}
+
+Token TokenPipe::next_token() {
+    if (done) {
+        return eof;
+    }
+    if (batch == nullptr || pos == batch->size) {
+        if (batch != nullptr) {
+            ring.pop();
+        }
+        while ((batch = ring.front()) == nullptr) {
+            std::this_thread::yield();
+        }
+        pos = 0;
+    }
+    Token tok = batch->tokens[pos++];
+    if (tok.type == Token::Type::Eof) {
+        done = true;
+        eof = tok;
+    }
+    return tok;
+}
+
+std::string_view TokenPipe::source() const { return input; }
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "spsc_ring.hh"
+#include "token.hh"
+#include <atomic>
+#include <cstdint>
+#include <string_view>
+#include <thread>
+
+#define TOKEN_PIPE_BATCH 512
+#define TOKEN_PIPE_DEPTH 64
+
+/* a lexer running on its own thread. tokens are lexed in batches of
+ * TOKEN_PIPE_BATCH into a ring of TOKEN_PIPE_DEPTH batches and handed out
+ * by next_token, so a parser reading from the pipe overlaps with the lexing
+ * of what comes after. once Eof is reached next_token keeps returning it.
+ * the source must outlive the pipe */
+class TokenPipe {
+  public:
+    TokenPipe(std::string_view source);
+    ~TokenPipe();
+    TokenPipe(const TokenPipe&) = delete;
+    TokenPipe& operator=(const TokenPipe&) = delete;
+
+    Token next_token();
+    std::string_view source() const;
+
+  private:
+    struct Batch {
+        Token tokens[TOKEN_PIPE_BATCH];
+        uint32_t size;
+    };
+    std::string_view input;
+    SpscRing<Batch, TOKEN_PIPE_DEPTH> ring;
+    std::atomic<bool> stopping;
+    std::thread producer;
+    /* consumer side */
+    Batch* batch;
+    uint32_t pos;
+    bool done;
+    Token eof;
+    void produce();
+};
@@ -0,0 +1,104 @@
+#include "tokenize.hh"
+#include "lexer.hh"
+#include <algorithm>
+#include <future>
+
+struct Chunk {
+    size_t begin;
+    size_t end;
+    std::vector<Token> tokens; /* without the chunk's Eof */
+    bool stopped; /* hit a nul byte, which ends the input */
+};
+
+static void lex_chunk(std::string_view input, Chunk& chunk) {
+    Lexer l(input, chunk.begin, chunk.end);
+    /* a rough guess of one token per 4 bytes saves most regrowth */
+    chunk.tokens.reserve((chunk.end - chunk.begin) / 4);
+    while (true) {
+        Token tok = l.next_token();
+        if (tok.type == Token::Type::Eof) {
+            chunk.stopped = l.position() < chunk.end;
+            return;
+        }
+        chunk.tokens.push_back(tok);
+    }
+}
+
+static inline bool is_space(char ch) {
+    return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r';
+}
+
+std::vector<Token> tokenize(std::string_view input) {
+    std::vector<Token> tokens;
+    tokens.reserve(input.size() / 4);
+    Lexer l(input, 0, input.size());
+    do {
+        tokens.push_back(l.next_token());
+    } while (tokens.back().type != Token::Type::Eof);
+    return tokens;
+}
+
+std::vector<Token> tokenize_parallel(std::string_view input, ThreadPool& pool,
+                                     size_t min_chunk) {
+    size_t len = input.size();
+    size_t chunk_size = len / pool.size();
+    if (chunk_size < min_chunk) {
+        chunk_size = min_chunk;
+    }
+    if (chunk_size >= len) {
+        return tokenize(input);
+    }
+
+    std::vector<Chunk> chunks;
+    size_t begin = 0;
+    while (begin < len) {
+        size_t end = begin + chunk_size < len ? begin + chunk_size : len;
+        while (end < len && !is_space(input[end])) {
+            end++;
+        }
+        chunks.push_back(Chunk{begin, end, {}, false});
+        begin = end;
+    }
+
+    std::vector<std::future<void>> done;
+    done.reserve(chunks.size());
+    for (auto& chunk : chunks) {
+        done.push_back(
+            pool.submit([input, &chunk] { lex_chunk(input, chunk); }));
+    }
+    for (auto& d : done) {
+        d.get();
+    }
+
+    /* a nul byte ends the input, so nothing after a stopped chunk is used */
+    std::vector<size_t> starts(chunks.size());
+    size_t total = 0, used = chunks.size();
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        starts[i] = total;
+        total += chunks[i].tokens.size();
+        if (chunks[i].stopped) {
+            used = i + 1;
+            break;
+        }
+    }
+
+    /* each chunk is copied into its place in the result on the pool too */
+    std::vector<Token> tokens(total + 1);
+    done.clear();
+    for (size_t i = 0; i < used; ++i) {
+        Chunk* chunk = &chunks[i];
+        Token* dst = tokens.data() + starts[i];
+        done.push_back(pool.submit([chunk, dst] {
+            std::copy(chunk->tokens.begin(), chunk->tokens.end(), dst);
+        }));
+    }
+    for (auto& d : done) {
+        d.get();
+    }
+    Token& eof = tokens.back();
+    eof.type = Token::Type::Eof;
+    eof.offset = len;
+    eof.length = 0;
+    eof.value = 0;
+    return tokens;
+}
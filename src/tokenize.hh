@@ -0,0 +1,18 @@
+#pragma once
+
+#include "thread_pool.hh"
+#include "token.hh"
+#include <string_view>
+#include <vector>
+
+#define TOKENIZE_MIN_CHUNK (256 * 1024)
+
+/* every token of input, ending with Eof */
+std::vector<Token> tokenize(std::string_view input);
+
+/* the same tokens as tokenize, lexed in chunks on pool. no token contains
+ * whitespace, so the input is cut at whitespace into chunks of at least
+ * min_chunk bytes, each chunk is lexed on its own and the results are
+ * joined in order */
+std::vector<Token> tokenize_parallel(std::string_view input, ThreadPool& pool,
+                                     size_t min_chunk = TOKENIZE_MIN_CHUNK);
@@ -1,6 +1,4 @@
-#include <memory>
-#include <string>
-#include <stdexcept>
+#include "util.hh"
 
 bool is_letter(char ch) {
     return ('a' <= ch && ch <= 'z') || ('A' <= ch && ch <= 'Z') || (ch == '_');
@@ -8,12 +6,11 @@ bool is_letter(char ch) {
 
 bool is_digit(char ch) { return '0' <= ch && ch <= '9'; }
 
-template<typename ... Args>
-std::string string_format( const std::string& format, Args ... args ) {
-    int size_s = std::snprintf( nullptr, 0, format.c_str(), args ... ) + 1; // Extra space for '\0'
-    if( size_s <= 0 ){ throw std::runtime_error( "Error during formatting." ); }
-    auto size = static_cast<size_t>( size_s );
-    std::unique_ptr<char[]> buf( new char[ size ] );
-    std::snprintf( buf.get(), size, format.c_str(), args ... );
-    return std::string( buf.get(), buf.get() + size - 1 ); // We don't want the '\0' inside
+bool stack_exhausted() {
+    static thread_local char* base = nullptr;
+    char* frame = (char*)__builtin_frame_address(0);
+    if (base == nullptr) {
+        base = frame;
+    }
+    return base - frame > INTERP_STACK_BYTES;
 }
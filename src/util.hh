@@ -1,5 +1,6 @@
 #pragma once
 #include <assert.h>
+#include <cstdio>
 #include <memory>
 #include <string>
 #include <stdexcept>
@@ -9,7 +10,27 @@
         assert(0);                                                             \
     } while (0)
 
+/* bytes of native stack the tree walking interpreters let a thread use */
+#define INTERP_STACK_BYTES (4 * 1024 * 1024)
+
 bool is_letter(char ch);
 bool is_digit(char ch);
-template<typename ... Args>
-std::string string_format( const std::string& format, Args ... args );
+
+/* whether the running thread is more than INTERP_STACK_BYTES of stack below
+ * where it first called this. the interpreters check it on every call, so
+ * deep recursion stops with a stack overflow error rather than a crash */
+bool stack_exhausted();
+
+template <typename... Args>
+std::string string_format(const std::string& format, Args... args) {
+    int size_s = std::snprintf(nullptr, 0, format.c_str(), args...) +
+                 1; // Extra space for '\0'
+    if (size_s <= 0) {
+        throw std::runtime_error("Error during formatting.");
+    }
+    auto size = static_cast<size_t>(size_s);
+    std::unique_ptr<char[]> buf(new char[size]);
+    std::snprintf(buf.get(), size, format.c_str(), args...);
+    return std::string(buf.get(),
+                       buf.get() + size - 1); // We don't want the '\0' inside
+}
@@ -0,0 +1,355 @@
+#include "vm.hh"
+#include "util.hh"
+#include <algorithm>
+
+static const Object null_obj(Object::Type::Null, std::monostate());
+static const Object true_obj(Object::Type::Bool, true);
+static const Object false_obj(Object::Type::Bool, false);
+
+static inline Object native_bool_to_bool_obj(bool input);
+static bool is_truthy(Object& obj);
+static const char* opcode_oper_string(Opcode op);
+
+Frame::Frame(std::shared_ptr<Closure> cl, size_t base_pointer)
+    : cl(std::move(cl)), ip(0), base_pointer(base_pointer) {}
+
+VM::VM(Bytecode bytecode)
+    : constants(std::move(bytecode.constants)),
+      globals(std::vector<Object>(bytecode.global_names.size())),
+      global_names(std::move(bytecode.global_names)),
+      local_names(std::move(bytecode.local_names)),
+      stack(std::vector<Object>(VM_STACK_SIZE)), sp(0) {
+    auto main_fn = std::make_shared<const CompiledFunction>(
+        std::move(bytecode.instructions), 0, 0);
+    frames.reserve(VM_MAX_FRAMES);
+    frames.push_back(
+        Frame(std::make_shared<Closure>(main_fn, std::vector<Object>()), 0));
+}
+
+Object VM::run() {
+    while (true) {
+        Frame& frame = frames.back();
+        const Instructions& ins = frame.cl->fn->instructions;
+        if (frame.ip >= ins.size()) {
+            break;
+        }
+        const uint8_t* ip = &ins[frame.ip];
+        Opcode op = (Opcode)*ip;
+        switch (op) {
+        case Opcode::Constant:
+            frame.ip += 3;
+            push(constants[read_uint16(ip + 1)]);
+            break;
+        case Opcode::Add:
+        case Opcode::Sub:
+        case Opcode::Mul:
+        case Opcode::Div:
+        case Opcode::Equal:
+        case Opcode::NotEqual:
+        case Opcode::LessThan:
+        case Opcode::GreaterThan: {
+            frame.ip += 1;
+            Object& left = stack[sp - 2];
+            Object& right = stack[sp - 1];
+            Object res = execute_binary(op, left, right);
+            if (res.type == Object::Type::Error) {
+                return res;
+            }
+            sp--;
+            stack[sp - 1] = std::move(res);
+        } break;
+        case Opcode::True:
+            frame.ip += 1;
+            push(true_obj);
+            break;
+        case Opcode::False:
+            frame.ip += 1;
+            push(false_obj);
+            break;
+        case Opcode::Null:
+            frame.ip += 1;
+            push(null_obj);
+            break;
+        case Opcode::Minus:
+        case Opcode::Bang: {
+            frame.ip += 1;
+            Object res = execute_prefix(op, stack[sp - 1]);
+            if (res.type == Object::Type::Error) {
+                return res;
+            }
+            stack[sp - 1] = std::move(res);
+        } break;
+        case Opcode::JumpNotTruthy: {
+            Object cond = pop();
+            if (is_truthy(cond)) {
+                frame.ip += 3;
+            } else {
+                frame.ip = read_uint16(ip + 1);
+            }
+        } break;
+        case Opcode::Jump:
+            frame.ip = read_uint16(ip + 1);
+            break;
+        case Opcode::GetGlobal: {
+            uint16_t idx = read_uint16(ip + 1);
+            frame.ip += 3;
+            if (globals[idx].type == Object::Type::Null) {
+                return Object(Object::Type::Error,
+                              "identifier not found: " + global_names[idx]);
+            }
+            push(globals[idx]);
+        } break;
+        case Opcode::SetGlobal:
+            frame.ip += 3;
+            globals[read_uint16(ip + 1)] = pop();
+            break;
+        case Opcode::GetLocal: {
+            frame.ip += 4;
+            const Object& local =
+                stack[frame.base_pointer + read_uint8(ip + 1)];
+            if (local.type == Object::Type::Null) {
+                return Object(Object::Type::Error,
+                              "identifier not found: " +
+                                  local_names[read_uint16(ip + 2)]);
+            }
+            push(local);
+        } break;
+        case Opcode::SetLocal:
+            frame.ip += 2;
+            stack[frame.base_pointer + read_uint8(ip + 1)] = pop();
+            break;
+        case Opcode::CaptureLocal:
+            frame.ip += 2;
+            push(stack[frame.base_pointer + read_uint8(ip + 1)]);
+            break;
+        case Opcode::GetFree:
+            frame.ip += 2;
+            push(frame.cl->free[read_uint8(ip + 1)]);
+            break;
+        case Opcode::GetCell:
+        case Opcode::GetFreeCell: {
+            frame.ip += 4;
+            size_t idx = read_uint8(ip + 1);
+            const Object& cell = op == Opcode::GetCell
+                                     ? stack[frame.base_pointer + idx]
+                                     : frame.cl->free[idx];
+            if (std::get<std::shared_ptr<Object>>(cell.value)->type ==
+                Object::Type::Null) {
+                return Object(Object::Type::Error,
+                              "identifier not found: " +
+                                  local_names[read_uint16(ip + 2)]);
+            }
+            push(*std::get<std::shared_ptr<Object>>(cell.value));
+        } break;
+        case Opcode::SetCell: {
+            frame.ip += 2;
+            Object& local = stack[frame.base_pointer + read_uint8(ip + 1)];
+            *std::get<std::shared_ptr<Object>>(local.value) = pop();
+        } break;
+        case Opcode::MakeCell: {
+            frame.ip += 2;
+            Object& local = stack[frame.base_pointer + read_uint8(ip + 1)];
+            local = Object(Object::Type::Cell,
+                           std::make_shared<Object>(std::move(local)));
+        } break;
+        case Opcode::CurrentClosure:
+            frame.ip += 1;
+            push(Object(Object::Type::Closure, frame.cl));
+            break;
+        case Opcode::Closure:
+            frame.ip += 4;
+            push_closure(read_uint16(ip + 1), read_uint8(ip + 3));
+            break;
+        case Opcode::Call: {
+            frame.ip += 2;
+            Object res = call_closure(read_uint8(ip + 1));
+            if (res.type == Object::Type::Error) {
+                return res;
+            }
+        } break;
+        case Opcode::ReturnValue:
+        case Opcode::Return: {
+            Object ret = op == Opcode::ReturnValue ? pop() : null_obj;
+            if (frames.size() == 1) {
+                /* return at the top level ends the program */
+                return ret;
+            }
+            sp = frame.base_pointer - 1;
+            frames.pop_back();
+            push(std::move(ret));
+        } break;
+        case Opcode::Pop:
+            frame.ip += 1;
+            last_popped = pop();
+            break;
+        }
+    }
+    return last_popped;
+}
+
+void VM::push(Object obj) {
+    reserve(sp + 1);
+    stack[sp++] = std::move(obj);
+}
+
+/* grows the stack to hold at least size slots. frames are what bounds
+ * recursion, so the stack never runs out first */
+void VM::reserve(size_t size) {
+    if (size > stack.size()) {
+        stack.resize(std::max(size, stack.size() * 2));
+    }
+}
+
+Object VM::pop() { return std::move(stack[--sp]); }
+
+Object VM::execute_binary(Opcode op, Object& left, Object& right) {
+    if (left.type != right.type) {
+        return Object(Object::Type::Error,
+                      string_format("type mismatch: %s %s %s",
+                                    left.type_to_string(),
+                                    opcode_oper_string(op),
+                                    right.type_to_string()));
+    }
+    if (left.type == Object::Type::Int) {
+        int64_t lval = std::get<int64_t>(left.value);
+        int64_t rval = std::get<int64_t>(right.value);
+        switch (op) {
+        case Opcode::Add:
+            return Object(Object::Type::Int, lval + rval);
+        case Opcode::Sub:
+            return Object(Object::Type::Int, lval - rval);
+        case Opcode::Mul:
+            return Object(Object::Type::Int, lval * rval);
+        case Opcode::Div:
+            return Object(Object::Type::Int, lval / rval);
+        case Opcode::LessThan:
+            return native_bool_to_bool_obj(lval < rval);
+        case Opcode::GreaterThan:
+            return native_bool_to_bool_obj(lval > rval);
+        case Opcode::Equal:
+            return native_bool_to_bool_obj(lval == rval);
+        case Opcode::NotEqual:
+            return native_bool_to_bool_obj(lval != rval);
+        default:
+            break;
+        }
+    }
+    if (op == Opcode::Equal) {
+        return native_bool_to_bool_obj(left == right);
+    }
+    if (op == Opcode::NotEqual) {
+        return native_bool_to_bool_obj(left != right);
+    }
+    return Object(Object::Type::Error,
+                  string_format("unknown operator: %s %s %s",
+                                left.type_to_string(), opcode_oper_string(op),
+                                right.type_to_string()));
+}
+
+Object VM::execute_prefix(Opcode op, Object& right) {
+    if (op == Opcode::Minus) {
+        if (right.type != Object::Type::Int) {
+            return Object(Object::Type::Error,
+                          string_format("unknown operator: -%s",
+                                        right.type_to_string()));
+        }
+        return Object(Object::Type::Int, -std::get<int64_t>(right.value));
+    }
+    switch (right.type) {
+    case Object::Type::Null:
+        return true_obj;
+    case Object::Type::Bool:
+        return native_bool_to_bool_obj(!std::get<bool>(right.value));
+    default:
+        break;
+    }
+    return false_obj;
+}
+
+Object VM::call_closure(size_t num_args) {
+    Object& callee = stack[sp - 1 - num_args];
+    if (callee.type != Object::Type::Closure) {
+        return Object(Object::Type::Error,
+                      string_format("not a function: %s",
+                                    callee.type_to_string()));
+    }
+    std::shared_ptr<Closure> cl =
+        std::get<std::shared_ptr<Closure>>(callee.value);
+    if (num_args != cl->fn->num_params) {
+        return Object(Object::Type::Error,
+                      string_format("wrong number of arguments: want=%zu, "
+                                    "got=%zu",
+                                    cl->fn->num_params, num_args));
+    }
+    if (frames.size() >= VM_MAX_FRAMES) {
+        return Object(Object::Type::Error, "stack overflow");
+    }
+    size_t base_pointer = sp - num_args;
+    sp = base_pointer + cl->fn->num_locals;
+    reserve(sp);
+    /* a let's slot holds nothing until the let runs, not what an earlier
+     * call left there */
+    std::fill(stack.begin() + (base_pointer + num_args), stack.begin() + sp,
+              null_obj);
+    frames.push_back(Frame(std::move(cl), base_pointer));
+    return null_obj;
+}
+
+void VM::push_closure(size_t const_index, size_t num_free) {
+    Object& constant = constants[const_index];
+    auto fn = std::get<std::shared_ptr<const CompiledFunction>>(constant.value);
+    std::vector<Object> free(stack.begin() + (sp - num_free),
+                             stack.begin() + sp);
+    sp -= num_free;
+    auto cl = std::make_shared<Closure>(std::move(fn), std::move(free));
+    push(Object(Object::Type::Closure, std::move(cl)));
+}
+
+static inline Object native_bool_to_bool_obj(bool input) {
+    if (input) {
+        return true_obj;
+    }
+    return false_obj;
+}
+
+static bool is_truthy(Object& obj) {
+    switch (obj.type) {
+    case Object::Type::Null:
+        return false;
+    case Object::Type::Int:
+        return true;
+    case Object::Type::Bool:
+        return std::get<bool>(obj.value);
+    default:
+        break;
+    }
+    return false;
+}
+
+static const char* opcode_oper_string(Opcode op) {
+    switch (op) {
+    case Opcode::Add:
+        return "+";
+    case Opcode::Sub:
+    case Opcode::Minus:
+        return "-";
+    case Opcode::Mul:
+        return "*";
+    case Opcode::Div:
+        return "/";
+    case Opcode::LessThan:
+        return "<";
+    case Opcode::GreaterThan:
+        return ">";
+    case Opcode::Equal:
+        return "==";
+    case Opcode::NotEqual:
+        return "!=";
+    case Opcode::Bang:
+        return "!";
+    default:
+        break;
+    }
+    unreachable;
+    return "";
+}
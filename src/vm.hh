@@ -0,0 +1,48 @@
+#pragma once
+
+#include "code.hh"
+#include "compiler.hh"
+#include "object.hh"
+#include <memory>
+#include <string>
+#include <vector>
+
+/* calls nest at most VM_MAX_FRAMES deep. their locals and temporaries share
+ * a stack of VM_STACK_SIZE slots to begin with, which grows as deeper calls
+ * need it. eval is only bounded by INTERP_STACK_BYTES of native stack, and
+ * the functions the jit compiles by the thread's whole stack, so they recurse
+ * deeper, but all stop with the same "stack overflow" error */
+#define VM_STACK_SIZE 2048
+#define VM_MAX_FRAMES 1024
+
+struct Frame {
+    std::shared_ptr<Closure> cl;
+    size_t ip;
+    size_t base_pointer;
+    Frame(std::shared_ptr<Closure> cl, size_t base_pointer);
+};
+
+class VM {
+  public:
+    VM(Bytecode bytecode);
+    /* runs the program, returning either the value of its last expression
+     * statement or the Error that stopped it */
+    Object run();
+
+  private:
+    std::vector<Object> constants;
+    std::vector<Object> globals;
+    std::vector<std::string> global_names;
+    std::vector<std::string> local_names;
+    std::vector<Object> stack;
+    size_t sp;
+    std::vector<Frame> frames;
+    Object last_popped;
+    void push(Object obj);
+    void reserve(size_t size);
+    Object pop();
+    Object execute_binary(Opcode op, Object& left, Object& right);
+    Object execute_prefix(Opcode op, Object& right);
+    Object call_closure(size_t num_args);
+    void push_closure(size_t const_index, size_t num_free);
+};
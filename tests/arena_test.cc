@@ -0,0 +1,71 @@
+#include "../src/arena.hh"
+#include "../src/lexer.hh"
+#include "../src/parser.hh"
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <vector>
+
+struct Tracked {
+    std::vector<int>& destroyed;
+    int id;
+    Tracked(std::vector<int>& destroyed, int id)
+        : destroyed(destroyed), id(id) {}
+    ~Tracked() { destroyed.push_back(id); }
+};
+
+TEST(Arena, DestroysNewestFirst) {
+    std::vector<int> destroyed;
+    Arena arena;
+    int i;
+    for (i = 0; i < 3; ++i) {
+        Tracked* t = arena.make<Tracked>(destroyed, i);
+        EXPECT_EQ(t->id, i);
+    }
+    EXPECT_EQ(destroyed.size(), 0);
+    arena.reset();
+    std::vector<int> exp = {2, 1, 0};
+    EXPECT_EQ(destroyed, exp);
+    EXPECT_EQ(arena.bytes_allocated(), 0);
+}
+
+TEST(Arena, Adopt) {
+    std::vector<int> destroyed;
+    std::shared_ptr<Arena> arena = std::make_shared<Arena>();
+    {
+        std::shared_ptr<Arena> other = std::make_shared<Arena>();
+        other->make<Tracked>(destroyed, 1);
+        arena->adopt(other);
+        arena->adopt(arena);
+    }
+    EXPECT_EQ(destroyed.size(), 0);
+    arena->make<Tracked>(destroyed, 0);
+    arena->reset();
+    std::vector<int> exp = {0, 1};
+    EXPECT_EQ(destroyed, exp);
+}
+
+TEST(Arena, Alignment) {
+    Arena arena;
+    int i;
+    for (i = 0; i < 1000; ++i) {
+        arena.make<char>('a');
+        int64_t* n = arena.make<int64_t>(i);
+        EXPECT_EQ((uintptr_t)n % alignof(int64_t), 0);
+        EXPECT_EQ(*n, i);
+    }
+    void* big = arena.allocate(ARENA_MAX_BLOCK_SIZE * 2, 16);
+    EXPECT_EQ((uintptr_t)big % 16, 0);
+}
+
+TEST(Arena, OwnsProgramNodes) {
+    std::string input = "let add = fn(x, y) { x + y }; add(1 * 2, -3);";
+    Lexer l(input);
+    Parser p(l);
+    Program program = p.parse();
+    EXPECT_GT(program.arena->bytes_allocated(), 0);
+    std::string before = program.string();
+    Arena* arena = program.arena.get();
+    Program moved = std::move(program);
+    EXPECT_EQ(moved.arena.get(), arena);
+    EXPECT_EQ(moved.string(), before);
+}
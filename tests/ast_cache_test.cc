@@ -0,0 +1,200 @@
+#include "../src/ast_cache.hh"
+#include "../src/eval.hh"
+#include "../src/lexer.hh"
+#include "../src/parser.hh"
+#include "../src/resolver.hh"
+#include <cstdint>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <string>
+#include <unistd.h>
+
+static const char* inputs[] = {
+    "let x = 5; let y = true; return x;",
+    "-a * b + !c == d / (e - f) < g",
+    "if (x < y) { x } else { let z = y; z }",
+    "let add = fn(a, b) { a + b }; add(1, add(2, 3)) + fn() { 7 }()",
+    "fn(x) { if (x > 1) { return x; } 0 }(12345678901)",
+    "",
+};
+
+static SourceStamp stamp_of(const std::string& input) {
+    return source_stamp(Source(input));
+}
+
+static std::string encode(const std::string& input) {
+    Lexer l(input);
+    Parser p(l);
+    FlatAst ast = p.parse_flat();
+    EXPECT_EQ(p.get_errors().size(), 0);
+    return encode_ast(ast, stamp_of(input));
+}
+
+static uint32_t header_field(const std::string& data, size_t offset) {
+    uint32_t res;
+    std::memcpy(&res, data.data() + offset, sizeof(res));
+    return res;
+}
+
+/* the offset of node's lhs in an encoded cache */
+static size_t lhs_offset(const std::string& data, uint32_t node) {
+    return 64 + (size_t)header_field(data, 48) * 8 + (size_t)node * 4;
+}
+
+TEST(AstCache, RoundTrip) {
+    for (std::string input : inputs) {
+        Lexer l(input);
+        Parser p(l);
+        Program parsed = p.parse();
+        std::string data = encode(input);
+        Program loaded;
+        std::string err;
+        ASSERT_TRUE(decode_ast(data, stamp_of(input), loaded, err)) << err;
+        EXPECT_EQ(loaded.string(), parsed.string()) << input;
+        SourceStamp saved = ast_cache_stamp(data);
+        EXPECT_EQ(saved.hash, source_hash(input));
+        EXPECT_EQ(saved.size, input.size());
+    }
+}
+
+TEST(AstCache, Rejects) {
+    std::string input = inputs[3];
+    std::string data = encode(input);
+    SourceStamp hash = stamp_of(input);
+    Program program;
+    std::string err;
+
+    /* a source differing in any part of its stamp */
+    for (auto other : {SourceStamp{hash.hash + 1, hash.size, hash.mtime},
+                       SourceStamp{hash.hash, hash.size + 1, hash.mtime},
+                       SourceStamp{hash.hash, hash.size, hash.mtime + 1}}) {
+        EXPECT_FALSE(decode_ast(data, other, program, err));
+        EXPECT_EQ(err, "ast cache: stale");
+    }
+    for (size_t len : {(size_t)0, (size_t)10, (size_t)64, data.size() - 1}) {
+        EXPECT_FALSE(decode_ast(data.substr(0, len), hash, program, err));
+    }
+    EXPECT_FALSE(decode_ast(data + "x", hash, program, err));
+
+    std::string bad = data;
+    bad[0] = 'X';
+    EXPECT_FALSE(decode_ast(bad, hash, program, err));
+    EXPECT_EQ(ast_cache_stamp(bad).hash, 0);
+    bad = data;
+    bad[8] = AST_CACHE_VERSION + 1;
+    EXPECT_FALSE(decode_ast(bad, hash, program, err));
+
+    /* the first infix is a + b; point its left at itself, then at a node
+     * already used elsewhere */
+    uint32_t nodes = header_field(data, 40), infix = 0;
+    while (infix < nodes && data[data.size() - header_field(data, 56) -
+                                 nodes * 2 + infix] !=
+                                (char)FlatAst::Kind::Infix) {
+        infix++;
+    }
+    ASSERT_LT(infix, nodes);
+    bad = data;
+    std::memcpy(&bad[lhs_offset(bad, infix)], &infix, sizeof(infix));
+    EXPECT_FALSE(decode_ast(bad, hash, program, err));
+    uint32_t right;
+    std::memcpy(&right, &data[lhs_offset(data, infix) + nodes * 4],
+                sizeof(right));
+    bad = data;
+    std::memcpy(&bad[lhs_offset(bad, infix)], &right, sizeof(right));
+    EXPECT_FALSE(decode_ast(bad, hash, program, err));
+    EXPECT_EQ(program.statements.size(), 0);
+}
+
+/* a damaged cache is turned away or decodes to some program, but is never
+ * read out of bounds */
+TEST(AstCache, Damaged) {
+    std::string input = inputs[3];
+    std::string data = encode(input);
+    SourceStamp hash = stamp_of(input);
+    uint32_t seed = 1;
+    for (int i = 0; i < 2000; ++i) {
+        std::string bad = data;
+        for (int j = 0; j < 4; ++j) {
+            seed = seed * 1103515245 + 12345;
+            size_t at = 64 + (seed >> 8) % (bad.size() - 64);
+            bad[at] ^= (char)(1 << (seed % 8));
+        }
+        Program program;
+        std::string err;
+        if (decode_ast(bad, hash, program, err)) {
+            program.string();
+        }
+    }
+}
+
+TEST(AstCache, Deep) {
+    std::string input;
+    for (int i = 0; i < 1000; ++i) {
+        input.append("if (x) { ");
+    }
+    input.append("x");
+    for (int i = 0; i < 1000; ++i) {
+        input.append(" }");
+    }
+    Lexer l(input);
+    Parser p(l);
+    Program parsed = p.parse();
+    Program loaded;
+    std::string err;
+    ASSERT_TRUE(decode_ast(encode(input), stamp_of(input), loaded, err))
+        << err;
+    EXPECT_EQ(loaded.string(), parsed.string());
+}
+
+/* a chain of operators is as tall as it is long. one the parser takes
+ * loads, and a cache of a taller one is refused like the source would be */
+TEST(AstCache, LongChain) {
+    std::string input = "1";
+    for (int i = 1; i < PARSER_MAX_DEPTH; ++i) {
+        input.append(" + 1");
+    }
+    Program loaded;
+    std::string err;
+    ASSERT_TRUE(decode_ast(encode(input), stamp_of(input), loaded, err))
+        << err;
+    std::shared_ptr<Environment> env = std::make_shared<Environment>();
+    resolve(loaded, *env);
+    Object res = eval(loaded, env);
+    EXPECT_EQ(res.type, Object::Type::Int);
+    EXPECT_EQ(std::get<int64_t>(res.value), PARSER_MAX_DEPTH);
+
+    input.append(" + 1");
+    Lexer l(input);
+    Parser p(l);
+    p.set_max_depth(SIZE_MAX);
+    FlatAst ast = p.parse_flat();
+    EXPECT_EQ(p.get_errors().size(), 0);
+    std::string data = encode_ast(ast, stamp_of(input));
+    EXPECT_FALSE(decode_ast(data, stamp_of(input), loaded, err));
+    EXPECT_EQ(err, "ast cache: nested deeper than " +
+                       std::to_string(PARSER_MAX_DEPTH));
+}
+
+TEST(AstCache, File) {
+    std::string input = "let f = fn(n) { if (n < 2) { n } else { "
+                        "f(n - 1) + f(n - 2) } }; f(15)";
+    SourceStamp hash = stamp_of(input);
+    char dir[] = "/tmp/monkey_cache_XXXXXX";
+    ASSERT_NE(mkdtemp(dir), nullptr);
+    std::string path = ast_cache_path(dir, hash.hash);
+    std::string err;
+    Program program;
+    EXPECT_FALSE(load_ast_cache(path, hash, program, err));
+    ASSERT_TRUE(write_ast_cache(path, encode(input), err)) << err;
+    ASSERT_TRUE(load_ast_cache(path, hash, program, err)) << err;
+    hash.mtime++;
+    EXPECT_FALSE(load_ast_cache(path, hash, program, err));
+
+    std::shared_ptr<Environment> env = std::make_shared<Environment>();
+    resolve(program, *env);
+    Object res = eval(program, env);
+    EXPECT_EQ(res.type, Object::Type::Int);
+    EXPECT_EQ(std::get<int64_t>(res.value), 610);
+    unlink(path.c_str());
+    rmdir(dir);
+}
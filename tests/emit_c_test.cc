@@ -0,0 +1,214 @@
+#include "../src/emit_c.hh"
+#include "../src/eval.hh"
+#include "../src/lexer.hh"
+#include "../src/object.hh"
+#include "../src/parser.hh"
+#include "../src/resolver.hh"
+#include "../src/token_buffer.hh"
+#include <cstdio>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define arr_size(arr) sizeof arr / sizeof arr[0]
+
+/* the inputs of eval_test, plus cases for what only a binary can show */
+static const char* corpus[] = {
+    "5",
+    "10",
+    "-5",
+    "-10",
+    "5 + 5 + 5 + 5 - 10",
+    "2 * 2 * 2 * 2 * 2",
+    "-50 + 100 + -50",
+    "5 * 2 + 10",
+    "5 + 2 * 10",
+    "20 + 2 * -10",
+    "50 / 2 * 2 + 10",
+    "2 * (5 + 10)",
+    "3 * 3 * 3 + 10",
+    "3 * (3 * 3) + 10",
+    "(5 + 10 * 2 + 15 / 3) * 2 + -10",
+    "5000000000 - 40000 * 2",
+    "let f = fn(x) { let y = x * 3; y - 1 }; f(f(2)) + f(1)",
+    "true",
+    "false",
+    "1 < 2",
+    "1 > 2",
+    "1 < 1",
+    "1 > 1",
+    "1 == 1",
+    "1 != 1",
+    "1 == 2",
+    "1 != 2",
+    "true == true",
+    "false == false",
+    "true == false",
+    "true != false",
+    "false != true",
+    "(1 < 2) == true",
+    "(1 < 2) == false",
+    "(1 > 2) == true",
+    "(1 > 2) == false",
+    "!true",
+    "!false",
+    "!5",
+    "!!true",
+    "!!false",
+    "!!5",
+    "if (true) { 10 }",
+    "if (false) { 10 }",
+    "if (1) { 10 }",
+    "if (1 < 2) { 10 }",
+    "if (1 > 2) { 10 }",
+    "if (1 > 2) { 10 } else { 20 }",
+    "if (1 < 2) { 10 } else { 20 }",
+    "return 10;",
+    "return 10; 9;",
+    "return 2 * 5; 9;",
+    "9; return 2 * 5; 9;",
+    "if (10 > 1) { if (10 > 1) { return 10; } return 1; }",
+    "5 + true;",
+    "5 + true; 5;",
+    "-true",
+    "true + false;",
+    "5; true + false; 5",
+    "if (10 > 1) { true + false; }",
+    "if (10 > 1) { if (10 > 1) { return true + false; } return 1; }",
+    "foobar",
+    "let a = 5; a;",
+    "let a = 5 * 5; a;",
+    "let a = 5; let b = a; b;",
+    "let a = 5; let b = a; let c = a + b + 5; c;",
+    "let a = 5; let a = a + 1; a;",
+    "fn(x) { x + 2; };",
+    "let identity = fn(x) { x; }; identity(5);",
+    "let identity = fn(x) { return x; }; identity(5);",
+    "let double = fn(x) { x * 2; }; double(5);",
+    "let add = fn(x, y) { x + y; }; add(5, 5);",
+    "let add = fn(x, y) { x + y; }; add(5 + 5, add(5, 5));",
+    "fn(x) { x; }(5)",
+    "let newAdder = fn(x) { fn(y) { x + y }; }; let addTwo = newAdder(2);"
+    "addTwo(2);",
+    "let fib = fn(n) { if (n < 2) { return n; } fib(n - 1) + fib(n - 2) };"
+    "fib(15);",
+    "let wrapper = fn() { let countDown = fn(x) { if (x == 0) { 0 } else {"
+    " countDown(x - 1) } }; countDown(10); }; wrapper();",
+    "let a = fn() { b() }; let b = fn() { 7 }; a();",
+    "let a = 1;",
+    "5(1)",
+    "let f = fn(x) { x }; f(1, 2) + f(3)",
+    "let f = fn(x, y) { y }; f(1)",
+    "let f = fn(x) { x }; f == f",
+    "if (false) { 1 } == if (false) { 2 }",
+    "let f = fn(a) { fn(b) { fn(c) { a * 100 + b * 10 + c } } }; f(1)(2)(3)",
+    "let f = fn() { let x = 1; let g = fn() { x }; let x = 2; g() }; f()",
+    "let f = fn(n) { if (n > 0) { return n; }; -1 }; f(3) * 10 + f(0)",
+    "let loop = fn(n, acc) { if (n == 0) { acc } else {"
+    " loop(n - 1, acc + 1) } }; loop(1000000, 0)",
+    "let f = fn(n) { if (n == 0) { return 0; }; return f(n - 1); }; f(100000)",
+    "let f = fn(n, acc) { let g = fn() { acc + n }; if (n == 0) { g() } else {"
+    " f(n - 1, g()) } }; f(100000, 0)",
+    "let f = fn(n) { if (n == 0) { 0 } else { f(n - 1, 0) } }; f(3)",
+    "let f = fn(n) { 1 + f(n + 1) }; f(0)",
+    "let f = fn(n) { let g = fn() { n }; g() + f(n + 1) }; f(0)",
+};
+
+/* what `monkey SCRIPT` prints for a program evaluating to res */
+static std::string expected_output(Object& res) {
+    if (res.type == Object::Type::Null) {
+        return "";
+    }
+    return res.inspect() + "\n";
+}
+
+/* runs cmd, returning its output and exit status */
+static bool run(const std::string& cmd, std::string& out, int& status) {
+    FILE* f = popen((cmd + " 2>&1").c_str(), "r");
+    if (f == nullptr) {
+        return false;
+    }
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof buf, f)) > 0) {
+        out.append(buf, n);
+    }
+    status = pclose(f);
+    return status != -1;
+}
+
+class EmitC : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        std::string out;
+        int status;
+        if (!run("cc --version", out, status) || status != 0) {
+            GTEST_SKIP() << "no C compiler";
+        }
+        ASSERT_NE(mkdtemp(dir), nullptr);
+    }
+    void TearDown() override {
+        unlink(c_path().c_str());
+        unlink(bin_path().c_str());
+        rmdir(dir);
+    }
+    std::string c_path() { return std::string(dir) + "/program.c"; }
+    std::string bin_path() { return std::string(dir) + "/program"; }
+    /* emits program, builds it and checks the binary's output against
+     * what eval gives for exp */
+    void check(Program& program, const std::string& input, Object& exp) {
+        std::string c, err, out;
+        int status;
+        ASSERT_TRUE(emit_c(program, c, err)) << err;
+        std::ofstream(c_path()) << c;
+        /* the values of statements are often left unused */
+        std::string cc = "cc -std=c99 -Wall -Wno-unused -Werror -o ";
+        ASSERT_TRUE(run(cc + bin_path() + " " + c_path(), out, status));
+        ASSERT_EQ(status, 0) << input << "\n" << out;
+        out.clear();
+        ASSERT_TRUE(run(bin_path(), out, status));
+        EXPECT_EQ(out, expected_output(exp)) << input;
+        int code = exp.type == Object::Type::Error ? 1 : 0;
+        EXPECT_TRUE(WIFEXITED(status)) << input;
+        EXPECT_EQ(WEXITSTATUS(status), code) << input;
+    }
+    char dir[32] = "/tmp/monkey_emit_c_XXXXXX";
+};
+
+TEST_F(EmitC, MatchesEval) {
+    size_t i, len = arr_size(corpus);
+    for (i = 0; i < len; ++i) {
+        std::string input = corpus[i];
+        Lexer el(input);
+        Parser ep(el);
+        Program evaluated = ep.parse();
+        ASSERT_EQ(ep.get_errors().size(), 0) << input;
+        std::shared_ptr<Environment> env = std::make_shared<Environment>();
+        resolve(evaluated, *env);
+        Object exp = eval(evaluated, env);
+
+        Lexer cl(input);
+        Parser cp(cl);
+        Program compiled = cp.parse();
+        check(compiled, input, exp);
+    }
+}
+
+TEST_F(EmitC, LazyBodies) {
+    std::string input = "let f = fn(n) { if (n < 1) { 0 } else { n + f(n - 1)"
+                        " } }; let g = fn() { fn(x) { x * 2 } }; g()(f(10))";
+    Lexer l(input);
+    Parser p(l);
+    Program program = p.parse();
+    std::shared_ptr<Environment> env = std::make_shared<Environment>();
+    resolve(program, *env);
+    Object exp = eval(program, env);
+    ASSERT_EQ(exp.inspect(), "110");
+
+    TokenBuffer tokens(input);
+    Parser lp(tokens);
+    lp.set_lazy(true);
+    Program lazy = lp.parse();
+    check(lazy, input, exp);
+}
@@ -0,0 +1,39 @@
+#include "../bench/alloc_count.hh"
+#include "../src/eval.hh"
+#include "../src/lexer.hh"
+#include "../src/object.hh"
+#include "../src/parser.hh"
+#include "../src/resolver.hh"
+#include <gtest/gtest.h>
+
+#define arr_size(arr) sizeof arr / sizeof arr[0]
+
+struct AllocTest {
+    std::string input;
+    int64_t exp;
+};
+
+TEST(EvalAlloc, IntegerExpressions) {
+    AllocTest tests[] = {
+        {"(5 + 10 * 2 + 15 / 3) * 2 + -10", 50},
+        {"if ((1 < 2) == true) { 3 * (4 - 1) } else { 0 }", 9},
+        {"let a = 2; let b = 3; (a + b) * -a - (b / a)", -11},
+    };
+    size_t i, len = arr_size(tests);
+    for (i = 0; i < len; ++i) {
+        AllocTest test = tests[i];
+        Lexer l(test.input);
+        Parser p(l);
+        Program program = p.parse();
+        auto env = std::make_shared<Environment>();
+        resolve(program, *env);
+        Object res = eval(program, env);
+
+        size_t before = alloc_count;
+        res = eval(program, env);
+        size_t allocs = alloc_count - before;
+        EXPECT_EQ(allocs, 0);
+        EXPECT_EQ(res.type, Object::Type::Int);
+        EXPECT_EQ(std::get<int64_t>(res.value), test.exp);
+    }
+}
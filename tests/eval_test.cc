@@ -1,9 +1,17 @@
 #include "../src/ast.hh"
+#include "../src/closure_eval.hh"
+#include "../src/compiler.hh"
 #include "../src/eval.hh"
 #include "../src/lexer.hh"
 #include "../src/object.hh"
+#include "../src/parse_parallel.hh"
 #include "../src/parser.hh"
+#include "../src/reg_vm.hh"
+#include "../src/resolver.hh"
+#include "../src/token_buffer.hh"
+#include "../src/vm.hh"
 #include <gtest/gtest.h>
+#include <thread>
 
 #define arr_size(arr) sizeof arr / sizeof arr[0]
 
@@ -45,16 +53,104 @@ struct ErrorTest {
     const char* exp;
 };
 
-static Object test_eval(const std::string& input) {
-    Lexer l(input);
-    Parser p(l);
-    Program program = p.parse();
+static Object eval_program(Program& program) {
     std::shared_ptr<Environment> env =
         std::make_shared<Environment>(Environment());
+    resolve(program, *env);
     Object evaluated = eval(program, env);
     return evaluated;
 }
 
+static Object run_closures(Program& program) {
+    std::shared_ptr<Environment> env = std::make_shared<Environment>();
+    resolve(program, *env);
+    return eval(compile_closures(program), env);
+}
+
+static Object run_program(Program& program) {
+    Compiler c;
+    c.compile(program);
+    if (c.get_errors().size() > 0) {
+        return Object(Object::Type::Error, c.get_errors()[0]);
+    }
+    VM vm(c.bytecode());
+    return vm.run();
+}
+
+static Object run_registers(Program& program) {
+    RegCompiler c;
+    c.compile(program);
+    if (c.get_errors().size() > 0) {
+        return Object(Object::Type::Error, c.get_errors()[0]);
+    }
+    RegVM vm(c.bytecode());
+    return vm.run();
+}
+
+static Object test_eval(const std::string& input) {
+    Lexer l(input);
+    Parser p(l);
+    Program program = p.parse();
+    return eval_program(program);
+}
+
+static Object test_closures(const std::string& input) {
+    Lexer l(input);
+    Parser p(l);
+    Program program = p.parse();
+    return run_closures(program);
+}
+
+static Object test_vm(const std::string& input) {
+    Lexer l(input);
+    Parser p(l);
+    Program program = p.parse();
+    return run_program(program);
+}
+
+static Object test_registers(const std::string& input) {
+    Lexer l(input);
+    Parser p(l);
+    Program program = p.parse();
+    return run_registers(program);
+}
+
+/* function bodies are parsed when first called or compiled */
+static std::vector<Object> test_lazy(const std::string& input) {
+    std::vector<Object> res;
+    TokenBuffer tokens(input);
+    Parser ep(tokens);
+    ep.set_lazy(true);
+    Program evaluated = ep.parse();
+    res.push_back(eval_program(evaluated));
+    Parser cp(tokens);
+    cp.set_lazy(true);
+    Program closures = cp.parse();
+    res.push_back(run_closures(closures));
+    Parser vp(tokens);
+    vp.set_lazy(true);
+    Program compiled = vp.parse();
+    res.push_back(run_program(compiled));
+    Parser rp(tokens);
+    rp.set_lazy(true);
+    Program registers = rp.parse();
+    res.push_back(run_registers(registers));
+    return res;
+}
+
+/* runs input through every backend so each case checks them all */
+static std::vector<Object> test_run(const std::string& input) {
+    std::vector<Object> res;
+    res.push_back(test_eval(input));
+    res.push_back(test_closures(input));
+    res.push_back(test_vm(input));
+    res.push_back(test_registers(input));
+    for (auto& obj : test_lazy(input)) {
+        res.push_back(std::move(obj));
+    }
+    return res;
+}
+
 TEST(Eval, Integers) {
     IntTest tests[] = {
         {"5", 5},
@@ -72,12 +168,15 @@ TEST(Eval, Integers) {
         {"3 * 3 * 3 + 10", 37},
         {"3 * (3 * 3) + 10", 37},
         {"(5 + 10 * 2 + 15 / 3) * 2 + -10", 50},
+        {"5000000000 - 40000 * 2", 4999920000},
+        {"let f = fn(x) { let y = x * 3; y - 1 }; f(f(2)) + f(1)", 16},
     };
     size_t i, len = arr_size(tests);
     for (i = 0; i < len; ++i) {
         IntTest test = tests[i];
-        Object evaluated = test_eval(test.input);
-        test_int(evaluated, test.exp);
+        for (auto& evaluated : test_run(test.input)) {
+            test_int(evaluated, test.exp);
+        }
     }
 }
 
@@ -106,8 +205,9 @@ TEST(Eval, Booleans) {
     size_t i, len = arr_size(tests);
     for (i = 0; i < len; ++i) {
         BoolTest test = tests[i];
-        Object evaluated = test_eval(test.input);
-        test_bool(evaluated, test.exp);
+        for (auto& evaluated : test_run(test.input)) {
+            test_bool(evaluated, test.exp);
+        }
     }
 }
 
@@ -119,8 +219,9 @@ TEST(Eval, Bang) {
     size_t i, len = arr_size(tests);
     for (i = 0; i < len; ++i) {
         BoolTest test = tests[i];
-        Object evaluated = test_eval(test.input);
-        test_bool(evaluated, test.exp);
+        for (auto& evaluated : test_run(test.input)) {
+            test_bool(evaluated, test.exp);
+        }
     }
 }
 
@@ -137,11 +238,12 @@ TEST(Eval, IfElse) {
     size_t i, len = arr_size(tests);
     for (i = 0; i < len; ++i) {
         IfElseTest test = tests[i];
-        Object evaluated = test_eval(test.input);
-        if (test.has_exp) {
-            test_int(evaluated, test.exp);
-        } else {
-            test_null(evaluated);
+        for (auto& evaluated : test_run(test.input)) {
+            if (test.has_exp) {
+                test_int(evaluated, test.exp);
+            } else {
+                test_null(evaluated);
+            }
         }
     }
 }
@@ -163,8 +265,9 @@ TEST(Eval, Return) {
     size_t i, len = arr_size(tests);
     for (i = 0; i < len; ++i) {
         IntTest test = tests[i];
-        Object evaluated = test_eval(test.input);
-        test_int(evaluated, test.exp);
+        for (auto& evaluated : test_run(test.input)) {
+            test_int(evaluated, test.exp);
+        }
     }
 }
 
@@ -185,15 +288,87 @@ TEST(Eval, Errors) {
             }",
          "unknown operator: BOOLEAN + BOOLEAN"},
         {"foobar", "identifier not found: foobar"},
+        {"let f = fn(x) { if (x > 0) { let y = x; } y }; f(0)",
+         "identifier not found: y"},
+        {"let f = fn(x) { if (x > 0) { let y = x; } 1 + y }; f(1); f(0)",
+         "identifier not found: y"},
+        {"fn() { let g = fn() { x }; let y = g(); let x = 1; y }()",
+         "identifier not found: x"},
+        {"fn(x) { x }(1, 2)", "wrong number of arguments: want=1, got=2"},
+        {"let f = fn(x, y) { y }; f(1)",
+         "wrong number of arguments: want=2, got=1"},
+        {"let f = fn(n) { if (n == 0) { 0 } else { f(n - 1, 0) } }; f(2)",
+         "wrong number of arguments: want=1, got=2"},
+        /* every backend stops unbounded recursion that is not in tail
+         * position with the same error, though not at the same depth: the
+         * vms allow VM_MAX_FRAMES calls, eval INTERP_STACK_BYTES of native
+         * stack, and code the jit compiled nearly all of the thread's */
+        {"let f = fn(n) { 1 + f(n + 1) }; f(0)", "stack overflow"},
+        {"let f = fn(n) { let g = fn() { n }; g() + f(n + 1) }; f(0)",
+         "stack overflow"},
     };
 
     size_t i, len = arr_size(tests);
+    for (i = 0; i < len; ++i) {
+        ErrorTest test = tests[i];
+        for (auto& evaluated : test_run(test.input)) {
+            EXPECT_EQ(evaluated.type, Object::Type::Error);
+            EXPECT_STREQ(std::get<std::string>(evaluated.value).c_str(),
+                         test.exp);
+        }
+    }
+}
+
+/* a distinct identifier for each i, since identifiers have no digits */
+static std::string name_of(const char* prefix, size_t i) {
+    std::string res = prefix;
+    do {
+        res += (char)('a' + i % 26);
+        i /= 26;
+    } while (i > 0);
+    return res;
+}
+
+/* programs whose locals, globals, constants or arguments do not fit the
+ * operands of the vms. eval runs them, the vms refuse to compile them rather
+ * than truncate the operands */
+TEST(Eval, VmOperandLimits) {
+    std::string locals = "let f = fn() {", globals, constants, params, args;
+    size_t i;
+    for (i = 0; i < 300; ++i) {
+        locals += " let " + name_of("v", i) + " = " + std::to_string(i) + ";";
+        params += (i == 0 ? "" : ", ") + name_of("p", i);
+        args += i == 0 ? "0" : ", 0";
+    }
+    locals += " " + name_of("v", 0) + " + " + name_of("v", 256) + " }; f()";
+    args = "fn(" + params + ") { 1 }(" + args + ")";
+    for (i = 0; i < 70001; ++i) {
+        globals += "let " + name_of("g", i) + " = true; ";
+        constants += std::to_string(i) + "; ";
+    }
+    globals += name_of("g", 65536);
+    ErrorTest tests[] = {
+        {locals, "too many locals"},
+        {globals, "too many globals"},
+        {constants, "too many constants"},
+        {args, "too many arguments"},
+    };
+    size_t len = arr_size(tests);
     for (i = 0; i < len; ++i) {
         ErrorTest test = tests[i];
         Object evaluated = test_eval(test.input);
-        EXPECT_EQ(evaluated.type, Object::Type::Error);
-        EXPECT_STREQ(std::get<std::string>(evaluated.value).c_str(), test.exp);
+        EXPECT_NE(evaluated.type, Object::Type::Error)
+            << test.exp << ": " << evaluated.inspect();
+        Object compiled = test_vm(test.input);
+        EXPECT_EQ(compiled.type, Object::Type::Error);
+        EXPECT_STREQ(std::get<std::string>(compiled.value).c_str(),
+                     test.exp);
     }
+    /* the register vm addresses globals with 16 bits as well */
+    Object registers = test_registers(globals);
+    EXPECT_EQ(registers.type, Object::Type::Error);
+    EXPECT_STREQ(std::get<std::string>(registers.value).c_str(),
+                 "too many globals");
 }
 
 TEST(Eval, Let) {
@@ -202,12 +377,28 @@ TEST(Eval, Let) {
         {"let a = 5 * 5; a;", 25},
         {"let a = 5; let b = a; b;", 5},
         {"let a = 5; let b = a; let c = a + b + 5; c;", 15},
+        {"let a = 5; let a = a + 1; a;", 6},
+        /* a local's value sees the binding it shadows */
+        {"let x = 5; let f = fn() { let x = x + 1; x }; f();", 6},
+        {"let x = 5; let f = fn() { let y = x; let x = 2; y * 10 + x }; f()",
+         52},
+        {"let f = fn(x) { let x = x * 2; let g = fn() { x }; g() }; f(3)", 6},
+        /* the left operand is read before the right one rebinds it */
+        {"let f = fn(x) { x + if (true) { let x = 5; x } }; f(1)", 6},
+        {"fn(a) { a * if (a > 0) { let a = 3; a } else { 0 } }(2)", 6},
+        /* a let in an if block binds for the rest of the function */
+        {"let f = fn(x) { if (x > 0) { let y = x; } y }; f(4)", 4},
     };
     size_t i, len = arr_size(tests);
     for (i = 0; i < len; ++i) {
         IntTest test = tests[i];
-        Object evaluated = test_eval(test.input);
-        test_int(evaluated, test.exp);
+        for (auto& evaluated : test_run(test.input)) {
+            test_int(evaluated, test.exp);
+        }
+    }
+    /* a let has no value, even after an expression that has one */
+    for (auto& evaluated : test_run("5; let a = 1;")) {
+        test_null(evaluated);
     }
 }
 
@@ -216,9 +407,9 @@ TEST(Eval, Function) {
     Object evaluated = test_eval(input);
     EXPECT_EQ(evaluated.type, Object::Type::Function);
     auto fn = std::get<Function>(evaluated.value);
-    EXPECT_EQ(fn.parameters.size(), 1);
-    EXPECT_STREQ(fn.parameters[0].string().c_str(), "x");
-    EXPECT_STREQ(fn.body.string().c_str(), "(x + 2)");
+    EXPECT_EQ(fn.parameters().size(), 1);
+    EXPECT_STREQ(fn.parameters()[0].string().c_str(), "x");
+    EXPECT_STREQ(fn.body().string().c_str(), "(x + 2)");
 }
 
 TEST(Eval, FunctionApplication) {
@@ -233,18 +424,246 @@ TEST(Eval, FunctionApplication) {
     size_t i, len = arr_size(tests);
     for (i = 0; i < len; ++i) {
         IntTest test = tests[i];
-        Object evaluated = test_eval(test.input);
-        test_int(evaluated, test.exp);
+        for (auto& evaluated : test_run(test.input)) {
+            test_int(evaluated, test.exp);
+        }
     }
 }
 
 TEST(Eval, Closures) {
+    IntTest tests[] = {
+        {"let newAdder = fn(x) {\
+              fn(y) { x + y };\
+          };\
+          let addTwo = newAdder(2);\
+          addTwo(2);",
+         4},
+        /* a closure sees the lets of its function made after it */
+        {"let f = fn() { let x = 1; let g = fn() { x }; let x = 2; g() }; f()",
+         2},
+        {"let f = fn(x) { let g = fn() { x }; let x = x + 1; g() }; f(1)", 2},
+        {"let f = fn(c) {\
+              1 + if (c) { let x = 3; let g = fn() { x }; let x = 4; g() }\
+          };\
+          f(true)",
+         5},
+    };
+    size_t i, len = arr_size(tests);
+    for (i = 0; i < len; ++i) {
+        IntTest test = tests[i];
+        for (auto& evaluated : test_run(test.input)) {
+            test_int(evaluated, test.exp);
+        }
+    }
+}
+
+TEST(Eval, RecursiveFunctions) {
+    IntTest tests[] = {
+        {"let fib = fn(n) { if (n < 2) { return n; } fib(n - 1) + fib(n - 2) };\
+          fib(15);",
+         610},
+        {"let wrapper = fn() {\
+              let countDown = fn(x) { if (x == 0) { 0 } else { countDown(x - 1) } };\
+              countDown(10);\
+          };\
+          wrapper();",
+         0},
+        {"let a = fn() { b() }; let b = fn() { 7 }; a();", 7},
+        {"let f = fn(n) {\
+              let even = fn(n) { if (n == 0) { 1 } else { odd(n - 1) } };\
+              let odd = fn(n) { if (n == 0) { 0 } else { even(n - 1) } };\
+              even(n)\
+          };\
+          f(10) + f(7)",
+         1},
+        /* recursion the vms' frame limits allow is not cut short by the
+         * room its locals and temporaries take */
+        {"let f = fn(n) { if (n == 0) { 0 } else { 1 + f(n - 1) } }; f(700)",
+         700},
+        {"let f = fn(n) { let a = n; let b = a; let c = b;"
+         " if (c == 0) { 0 } else { a + b - c - n + 1 + f(n - 1) } };"
+         " f(1000)",
+         1000},
+    };
+    size_t i, len = arr_size(tests);
+    for (i = 0; i < len; ++i) {
+        IntTest test = tests[i];
+        for (auto& evaluated : test_run(test.input)) {
+            test_int(evaluated, test.exp);
+        }
+    }
+}
+
+/* only eval runs calls in tail position in constant stack, so these are too
+ * deep for the other backends. each reads a global, which keeps the jit
+ * from compiling it */
+TEST(Eval, TailCalls) {
+    ErrorTest tests[] = {
+        {"let count = fn(n, acc) { if (n == 0) { acc } else {"
+         " count(n - 1, acc + step) } }; let step = 2; count(300000, 0)",
+         "600000"},
+        {"let count = fn(n) { if (n > 0) { return count(n - step); } n };"
+         "let step = 1; count(300000)",
+         "0"},
+        {"let even = fn(n) { if (n == 0) { true } else { odd(n - 1) } };"
+         "let odd = fn(n) { if (n == 0) { false } else { even(n - 1) } };"
+         "even(300001)",
+         "false"},
+        /* each frame is captured, so none can be reused */
+        {"let f = fn(n, g) { if (n == 0) { g() } else {"
+         " f(n - 1, fn() { n + step }) } }; let step = 0;"
+         "f(10000, fn() { 0 })",
+         "1"},
+        /* a reused frame starts out empty */
+        {"let f = fn(n) { if (n == step) { x } else { let x = 1; f(n - 1) } };"
+         "let step = 0; f(3)",
+         "Error: identifier not found: x"},
+    };
+    size_t i, len = arr_size(tests);
+    for (i = 0; i < len; ++i) {
+        ErrorTest test = tests[i];
+        Object evaluated = test_eval(test.input);
+        EXPECT_EQ(evaluated.inspect(), test.exp) << test.input;
+    }
+}
+
+TEST(Eval, SameProgramRepeatedly) {
     std::string input = "\
-    let newAdder = fn(x) {\
-        fn(y) { x + y };\
-    };\
+    let newAdder = fn(x) { fn(y) { x + y } };\
+    let fib = fn(n) { if (n < 2) { return n; } fib(n - 1) + fib(n - 2) };\
     let addTwo = newAdder(2);\
-    addTwo(2);";
-    Object evaluated = test_eval(input);
-    test_int(evaluated, 4);
+    addTwo(fib(10));";
+    Lexer l(input);
+    Parser p(l);
+    Program program = p.parse();
+    auto env = std::make_shared<Environment>();
+    resolve(program, *env);
+    std::string before = program.string();
+    int i;
+    for (i = 0; i < 100; ++i) {
+        Object evaluated = eval(program, env);
+        test_int(evaluated, 57);
+    }
+    EXPECT_EQ(program.string(), before);
+}
+
+TEST(Eval, SameProgramConcurrently) {
+    std::string input = "\
+    let newAdder = fn(x) { fn(y) { x + y } };\
+    let fib = fn(n) { if (n < 2) { return n; } fib(n - 1) + fib(n - 2) };\
+    newAdder(fib(12))(3);";
+    Lexer l(input);
+    Parser p(l);
+    Program program = p.parse();
+    Environment resolved;
+    resolve(program, resolved);
+
+    std::vector<std::thread> threads;
+    std::vector<Object> results(8);
+    size_t i;
+    for (i = 0; i < results.size(); ++i) {
+        threads.emplace_back([&program, &resolved, &results, i]() {
+            auto env = std::make_shared<Environment>(resolved);
+            int j;
+            for (j = 0; j < 20; ++j) {
+                results[i] = eval(program, env);
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    for (auto& res : results) {
+        test_int(res, 147);
+    }
+}
+
+TEST(Eval, ParsedInParallel) {
+    /* each function calls one defined in an earlier chunk */
+    std::string input = "let ga = fn(x) { x };";
+    size_t i;
+    for (i = 1; i < 50; ++i) {
+        input.append("let " + name_of("g", i) + " = fn(x) { " +
+                     name_of("g", i - 1) + "(x) + 1 };");
+    }
+    input.append(name_of("g", 49) + "(1);");
+    TokenBuffer tokens(input);
+    ThreadPool pool(4);
+    std::vector<std::string> errors;
+    Program program = parse_parallel(tokens, pool, errors, 1);
+    EXPECT_TRUE(errors.empty());
+    auto env = std::make_shared<Environment>();
+    resolve(program, *env);
+    Object evaluated = eval(program, env);
+    test_int(evaluated, 50);
+}
+
+TEST(Eval, LazyBodies) {
+    std::string input = "\
+    let unused = fn(x) { x + };\
+    let twice = fn(f, x) { f(f(x)) };\
+    let inc = fn(x) { let one = 1; x + one };\
+    twice(inc, 5);";
+    TokenBuffer tokens(input);
+    Parser p(tokens);
+    p.set_lazy(true);
+    Program program = p.parse();
+    EXPECT_EQ(p.get_errors().size(), 0);
+    auto env = std::make_shared<Environment>();
+    resolve(program, *env);
+    test_int(eval(program, env), 7);
+    /* only the bodies that ran were parsed */
+    size_t parsed = 0;
+    for (auto& stmt : program.statements) {
+        if (stmt.type != Statement::Type::Let) {
+            continue;
+        }
+        const LetStatement& let = std::get<LetStatement>(stmt.data);
+        parsed += std::get<FunctionLiteral*>(let.value.data)->body_parsed();
+    }
+    EXPECT_EQ(parsed, 2);
+
+    /* errors in a body show up when it is called */
+    std::string call = "unused(1);";
+    Lexer l(call);
+    Parser cp(l);
+    Program next = cp.parse();
+    resolve(next, *env);
+    Object err = eval(next, env);
+    EXPECT_EQ(err.type, Object::Type::Error);
+    EXPECT_EQ(std::get<std::string>(err.value),
+              "no prefix parse function for RSquirly found");
+}
+
+TEST(Eval, LazyBodiesConcurrently) {
+    std::string input = "\
+    let newAdder = fn(x) { fn(y) { x + y } };\
+    let fib = fn(n) { if (n < 2) { return n; } fib(n - 1) + fib(n - 2) };\
+    newAdder(fib(12))(3);";
+    TokenBuffer tokens(input);
+    Parser p(tokens);
+    p.set_lazy(true);
+    Program program = p.parse();
+    Environment resolved;
+    resolve(program, resolved);
+
+    std::vector<std::thread> threads;
+    std::vector<Object> results(8);
+    size_t i;
+    for (i = 0; i < results.size(); ++i) {
+        threads.emplace_back([&program, &resolved, &results, i]() {
+            auto env = std::make_shared<Environment>(resolved);
+            if (i % 2 == 0) {
+                results[i] = eval(program, env);
+            } else {
+                results[i] = eval(compile_closures(program), env);
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    for (auto& res : results) {
+        test_int(res, 147);
+    }
 }
@@ -0,0 +1,59 @@
+#include "../src/intern.hh"
+#include "../src/lexer.hh"
+#include "../src/parser.hh"
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST(Intern, SameNameSameId) {
+    SymbolId a = intern("intern_a");
+    SymbolId b = intern("intern_b");
+    std::string a2 = "intern_";
+    a2.push_back('a');
+    EXPECT_NE(a, b);
+    EXPECT_EQ(intern(a2), a);
+    EXPECT_EQ(symbol_name(a), "intern_a");
+    EXPECT_EQ(symbol_name(b), "intern_b");
+}
+
+TEST(Intern, Identifiers) {
+    std::string input = "let x = fn(y) { x + y }; x(y);";
+    Lexer l(input);
+    Parser p(l);
+    Program program = p.parse();
+    auto& let = std::get<LetStatement>(program.statements[0].data);
+    auto& call = std::get<CallExpression>(
+        std::get<ExpressionStatement>(program.statements[1].data).exp.data);
+    auto& fn = *std::get<FunctionLiteral*>(let.value.data);
+    EXPECT_EQ(std::get<Identifier>(call.function->data).symbol,
+              let.name.symbol);
+    EXPECT_EQ(std::get<Identifier>(call.arguments[0].data).symbol,
+              fn.params[0].symbol);
+    EXPECT_EQ(let.name.symbol, intern("x"));
+    EXPECT_EQ(let.name.value, "x");
+}
+
+TEST(Intern, Concurrent) {
+    const int num_threads = 8;
+    const int num_names = 1000;
+    std::vector<std::vector<SymbolId>> ids(num_threads);
+    std::vector<std::thread> threads;
+    int i, j;
+    for (i = 0; i < num_threads; ++i) {
+        threads.emplace_back([&ids, i] {
+            for (int n = 0; n < num_names; ++n) {
+                ids[i].push_back(intern("concurrent_" + std::to_string(n)));
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    for (i = 1; i < num_threads; ++i) {
+        EXPECT_EQ(ids[i], ids[0]);
+    }
+    for (j = 0; j < num_names; ++j) {
+        EXPECT_EQ(symbol_name(ids[0][j]), "concurrent_" + std::to_string(j));
+    }
+}
@@ -0,0 +1,121 @@
+#include "../src/ast.hh"
+#include "../src/eval.hh"
+#include "../src/jit.hh"
+#include "../src/lexer.hh"
+#include "../src/object.hh"
+#include "../src/parser.hh"
+#include "../src/resolver.hh"
+#include <gtest/gtest.h>
+
+#define arr_size(arr) sizeof arr / sizeof arr[0]
+
+struct JitTest {
+    std::string input;
+    const char* exp;
+    bool compiled;
+};
+
+/* parses, resolves and evaluates input, reporting whether the function
+ * bound by its first statement was compiled */
+static Object run(const std::string& input, bool& compiled) {
+    Lexer l(input);
+    Parser p(l);
+    Program program = p.parse();
+    EXPECT_EQ(p.get_errors().size(), 0);
+    auto env = std::make_shared<Environment>();
+    resolve(program, *env);
+    Object res = eval(program, env);
+    const LetStatement& let =
+        std::get<LetStatement>(program.statements[0].data);
+    compiled = jit_compiled(*std::get<FunctionLiteral*>(let.value.data));
+    return res;
+}
+
+TEST(Jit, MatchesInterpreter) {
+    if (!jit_enabled()) {
+        GTEST_SKIP() << "no jit on this platform";
+    }
+    JitTest tests[] = {
+        {"let fib = fn(n) { if (n < 2) { return n; } fib(n - 1) + fib(n - 2) };"
+         "fib(20)",
+         "6765", true},
+        {"let sum = fn(n, acc) { if (n == 0) { acc } else {"
+         " sum(n - 1, acc + n * 3 / 2 - -n) } }; sum(200, 0)",
+         "50200", true},
+        {"let even = fn(n) { if (n == 0) { true } else { !even(n - 1) } };"
+         "even(101)",
+         "false", true},
+        {"let f = fn(a, b) { let c = a * b; let d = c - 5000000000;"
+         " if (a > 0) { f(a - 1, b) + (d != c) } else { d } }; f(100, 3)",
+         "type mismatch: INTEGER + BOOLEAN", false},
+        {"let f = fn(n) { if (!(n < 1)) { f(n - 1) + 1 } else { 0 } };"
+         "f(80)",
+         "80", true},
+        /* a call in tail position loops rather than recursing */
+        {"let count = fn(n, acc) { if (n == 0) { acc } else {"
+         " count(n - 1, acc + 2) } }; count(300000, 0)",
+         "600000", true},
+        /* a free variable keeps the function in the interpreter */
+        {"let f = fn(n) { if (n < 1) { k } else { f(n - 1) + k } }; let k = 2;"
+         "f(60)",
+         "122", false},
+        /* an integer condition is always truthy */
+        {"let f = fn(n) { if (n) { n } else { 0 } }; f(1) + f(2) + f(0) + "
+         "f(3) + f(4) + f(5) + f(6) + f(7) + f(8) + f(9) + f(10) + f(11) + "
+         "f(12) + f(13) + f(14) + f(15) + f(16) + f(17) + f(18) + f(19) + "
+         "f(20) + f(21) + f(22) + f(23) + f(24) + f(25) + f(26) + f(27) + "
+         "f(28) + f(29) + f(30) + f(31) + f(32) + f(33) + f(34) + f(35) + "
+         "f(36) + f(37) + f(38) + f(39) + f(40) + f(41) + f(42) + f(43) + "
+         "f(44) + f(45) + f(46) + f(47) + f(48) + f(49) + f(50) + f(51)",
+         "1326", true},
+    };
+    size_t i, len = arr_size(tests);
+    for (i = 0; i < len; ++i) {
+        JitTest test = tests[i];
+        bool compiled;
+        jit_enable(false);
+        Object interpreted = run(test.input, compiled);
+        EXPECT_FALSE(compiled);
+        jit_enable(true);
+        Object res = run(test.input, compiled);
+        EXPECT_EQ(compiled, test.compiled) << test.input;
+        std::string exp = test.exp;
+        if (res.type == Object::Type::Error) {
+            exp = "Error: " + exp;
+        }
+        EXPECT_EQ(res.inspect(), exp) << test.input;
+        EXPECT_EQ(interpreted.inspect(), exp) << test.input;
+    }
+}
+
+TEST(Jit, Guards) {
+    if (!jit_enabled()) {
+        GTEST_SKIP() << "no jit on this platform";
+    }
+    JitTest tests[] = {
+        /* an argument that is not an integer */
+        {"let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + fib(n - 2) }"
+         " }; fib(15); fib(true)",
+         "type mismatch: BOOLEAN < INTEGER", true},
+        /* the name the body calls itself by bound to another function */
+        {"let f = fn(n) { if (n == 0) { 0 } else { n + f(n - 1) } }; f(60);"
+         "let g = f; let f = fn(n) { 7 }; g(60)",
+         "67", true},
+        /* recursion too deep for the stack stops rather than crashing */
+        {"let f = fn(n) { if (n == 0) { 0 } else { 1 + f(n - 1) } };"
+         "f(1000000000)",
+         "stack overflow", true},
+    };
+    size_t i, len = arr_size(tests);
+    for (i = 0; i < len; ++i) {
+        JitTest test = tests[i];
+        bool compiled;
+        Object res = run(test.input, compiled);
+        EXPECT_EQ(compiled, test.compiled) << test.input;
+        std::string exp = test.exp;
+        if (res.type == Object::Type::Error) {
+            exp = "Error: " + exp;
+        }
+        EXPECT_EQ(res.inspect(), exp) << test.input;
+    }
+}
@@ -0,0 +1,18 @@
+#include "../bench/alloc_count.hh"
+#include "../src/lexer.hh"
+#include <gtest/gtest.h>
+
+TEST(LexerAlloc, NoAllocations) {
+    std::string input = "let add = fn(first, second) { first + second };\n"
+                        "let result = add(123456789, -987654321);\n"
+                        "if (result != 10) { return true; } else { !false }";
+    Lexer l(input);
+    size_t allocs = alloc_count;
+    size_t tokens = 0;
+    while (l.next_token().type != Token::Type::Eof) {
+        tokens++;
+    }
+    EXPECT_EQ(alloc_count - allocs, 0);
+    EXPECT_EQ(tokens, 42);
+    EXPECT_LE(sizeof(Token), 24);
+}
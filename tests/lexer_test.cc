@@ -69,6 +69,68 @@ if (5 < 10) {\n\
         Token tok = l.next_token();
         TokenTest test = tests[i];
         EXPECT_EQ(tok.type, test.type);
-        EXPECT_STREQ(tok.get_literal(), test.literal);
+        EXPECT_EQ(tok.get_literal(input), test.literal);
+    }
+}
+
+TEST(Lexer, Keywords) {
+    std::string input = "fn if let else true false return "
+                        "fnn iff lett elsee truee falsee returnn "
+                        "f i le els tru fals retur Fn IF _let";
+    Token::Type exp[] = {
+        Token::Type::Function, Token::Type::If,    Token::Type::Let,
+        Token::Type::Else,     Token::Type::True,  Token::Type::False,
+        Token::Type::Return,
+    };
+    Lexer l(input);
+    for (auto type : exp) {
+        EXPECT_EQ(l.next_token().type, type);
+    }
+    Token tok;
+    while ((tok = l.next_token()).type != Token::Type::Eof) {
+        EXPECT_EQ(tok.type, Token::Type::Ident) << tok.get_literal(input);
+    }
+}
+
+TEST(Lexer, Integers) {
+    struct {
+        const char* input;
+        int64_t value;
+    } tests[] = {
+        {"0", 0},
+        {"7", 7},
+        {"00042", 42},
+        {"1234567890", 1234567890},
+        {"9223372036854775807", 9223372036854775807},
+    };
+    for (auto& test : tests) {
+        std::string input(test.input);
+        Lexer l(input);
+        Token tok = l.next_token();
+        EXPECT_EQ(tok.type, Token::Type::Int);
+        EXPECT_EQ(tok.value, test.value);
+        EXPECT_EQ(tok.get_literal(input), test.input);
+        EXPECT_EQ(l.next_token().type, Token::Type::Eof);
+    }
+}
+
+TEST(Lexer, Spans) {
+    std::string input = "  x1 @==\t!=!\n";
+    struct {
+        Token::Type type;
+        uint32_t offset;
+        uint32_t length;
+    } tests[] = {
+        {Token::Type::Ident, 2, 1},   {Token::Type::Int, 3, 1},
+        {Token::Type::Illegal, 5, 1}, {Token::Type::Eq, 6, 2},
+        {Token::Type::NotEq, 9, 2},   {Token::Type::Bang, 11, 1},
+        {Token::Type::Eof, 13, 0},
+    };
+    Lexer l(input);
+    for (auto& test : tests) {
+        Token tok = l.next_token();
+        EXPECT_EQ(tok.type, test.type);
+        EXPECT_EQ(tok.offset, test.offset);
+        EXPECT_EQ(tok.length, test.length);
     }
 }
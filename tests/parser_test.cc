@@ -1,6 +1,9 @@
 #include "../src/ast.hh"
 #include "../src/lexer.hh"
+#include "../src/parse_parallel.hh"
 #include "../src/parser.hh"
+#include "../src/token_buffer.hh"
+#include "../src/token_pipe.hh"
 #include <gtest/gtest.h>
 #include <iostream>
 
@@ -20,40 +23,40 @@
 #define test_let_statement(stmt, name)                                         \
     do {                                                                       \
         EXPECT_EQ(stmt.type, Statement::Type::Let);                            \
-        auto let_stmt = std::get<LetStatement>(stmt.data);                     \
-        EXPECT_STREQ(let_stmt.token_literal(), "let");                         \
-        EXPECT_STREQ(let_stmt.name.token_literal(), name);                     \
-        EXPECT_STREQ(let_stmt.name.value->c_str(), name);                      \
+        auto& let_stmt = std::get<LetStatement>(stmt.data);                    \
+        EXPECT_EQ(let_stmt.token_literal(), "let");                            \
+        EXPECT_EQ(let_stmt.name.token_literal(), name);                        \
+        EXPECT_EQ(let_stmt.name.value, name);                                  \
     } while (0)
 
 #define test_ident(ident, name)                                                \
     do {                                                                       \
-        EXPECT_STREQ(ident.value->c_str(), name);                              \
-        EXPECT_STREQ(ident.token_literal(), name);                             \
+        EXPECT_EQ(ident.value, name);                                          \
+        EXPECT_EQ(ident.token_literal(), name);                                \
     } while (0)
 
 #define test_identifier(e, name)                                               \
     do {                                                                       \
         EXPECT_EQ(e.type, Expression::Type::Identifier);                       \
-        auto ident = std::get<Identifier>(e.data);                             \
-        EXPECT_STREQ(ident.value->c_str(), name);                              \
-        EXPECT_STREQ(ident.token_literal(), name);                             \
+        auto& ident = std::get<Identifier>(e.data);                            \
+        EXPECT_EQ(ident.value, name);                                          \
+        EXPECT_EQ(ident.token_literal(), name);                                \
     } while (0)
 
 #define test_integer_literal(e, val, lit)                                      \
     do {                                                                       \
         EXPECT_EQ(e.type, Expression::Type::Integer);                          \
-        auto il = std::get<IntegerLiteral>(e.data);                            \
+        auto& il = std::get<IntegerLiteral>(e.data);                           \
         EXPECT_EQ(il.value, val);                                              \
-        EXPECT_STREQ(il.token_literal(), lit);                                 \
+        EXPECT_EQ(il.token_literal(), lit);                                    \
     } while (0);
 
 #define test_boolean_literal(e, val, lit)                                      \
     do {                                                                       \
         EXPECT_EQ(e.type, Expression::Type::Boolean);                          \
-        auto il = std::get<BooleanLiteral>(e.data);                            \
+        auto& il = std::get<BooleanLiteral>(e.data);                           \
         EXPECT_EQ(il.value, val);                                              \
-        EXPECT_STREQ(il.token_literal(), lit);                                 \
+        EXPECT_EQ(il.token_literal(), lit);                                    \
     } while (0);
 
 #define test_literal(type, e, val, lit)                                        \
@@ -110,10 +113,10 @@ struct FunctionParamsTest {
 };
 
 TEST(Parser, LetStatement) {
-    std::string input = "\
-let x = 5;\n\
-let y = 10;\n\
-let foobar = true;\n\
+    std::string input = "                                                      \
+let x = 5;\n                                                                   \
+let y = 10;\n                                                                  \
+let foobar = true;\n                                                           \
 ";
 
     LetTest tests[] = {
@@ -129,20 +132,20 @@ let foobar = true;\n\
     EXPECT_EQ(program.statements.size(), 3);
 
     for (i = 0; i < len; ++i) {
-        Statement stmt = program.statements[i];
+        Statement& stmt = program.statements[i];
         const char* name = tests[i].exp_name;
         test_let_statement(stmt, name);
-        auto let = std::get<LetStatement>(stmt.data);
+        auto& let = std::get<LetStatement>(stmt.data);
         test_literal(tests[i].type, let.value, tests[i].value,
                      tests[i].exp_lit);
     }
 }
 
 TEST(Parser, ReturnStatement) {
-    std::string input = "\
-return 5;\n\
-return 10;\n\
-return 993322;\n\
+    std::string input = "                                                      \
+return 5;\n                                                                    \
+return 10;\n                                                                   \
+return 993322;\n                                                               \
 ";
     Lexer l(input);
     Parser p(l);
@@ -152,7 +155,7 @@ return 993322;\n\
 
     for (auto& stmt : program.statements) {
         EXPECT_EQ(stmt.type, Statement::Type::Ret);
-        EXPECT_STREQ(stmt.token_literal(), "return");
+        EXPECT_EQ(stmt.token_literal(), "return");
     }
 }
 
@@ -163,13 +166,13 @@ TEST(Parser, Identifier) {
     Program program = p.parse();
     check_errors(p);
     EXPECT_EQ(program.statements.size(), 1);
-    Statement stmt = program.statements[0];
+    Statement& stmt = program.statements[0];
     EXPECT_EQ(stmt.type, Statement::Type::Expression);
-    auto e = std::get<ExpressionStatement>(stmt.data).exp;
+    auto& e = std::get<ExpressionStatement>(stmt.data).exp;
     EXPECT_EQ(e.type, Expression::Type::Identifier);
-    auto i = std::get<Identifier>(e.data);
-    EXPECT_STREQ(i.value->c_str(), "foobar");
-    EXPECT_STREQ(i.token_literal(), "foobar");
+    auto& i = std::get<Identifier>(e.data);
+    EXPECT_EQ(i.value, "foobar");
+    EXPECT_EQ(i.token_literal(), "foobar");
 }
 
 TEST(Parser, Integer) {
@@ -179,13 +182,13 @@ TEST(Parser, Integer) {
     Program program = p.parse();
     check_errors(p);
     EXPECT_EQ(program.statements.size(), 1);
-    Statement stmt = program.statements[0];
+    Statement& stmt = program.statements[0];
     EXPECT_EQ(stmt.type, Statement::Type::Expression);
-    auto e = std::get<ExpressionStatement>(stmt.data).exp;
+    auto& e = std::get<ExpressionStatement>(stmt.data).exp;
     EXPECT_EQ(e.type, Expression::Type::Integer);
-    auto i = std::get<IntegerLiteral>(e.data);
+    auto& i = std::get<IntegerLiteral>(e.data);
     EXPECT_EQ(i.value, 5);
-    EXPECT_STREQ(i.token_literal(), "5");
+    EXPECT_EQ(i.token_literal(), "5");
 }
 
 TEST(Parser, Boolean) {
@@ -195,13 +198,13 @@ TEST(Parser, Boolean) {
     Program program = p.parse();
     check_errors(p);
     EXPECT_EQ(program.statements.size(), 1);
-    Statement stmt = program.statements[0];
+    Statement& stmt = program.statements[0];
     EXPECT_EQ(stmt.type, Statement::Type::Expression);
-    auto e = std::get<ExpressionStatement>(stmt.data).exp;
+    auto& e = std::get<ExpressionStatement>(stmt.data).exp;
     EXPECT_EQ(e.type, Expression::Type::Boolean);
-    auto i = std::get<BooleanLiteral>(e.data);
+    auto& i = std::get<BooleanLiteral>(e.data);
     EXPECT_EQ(i.value, true);
-    EXPECT_STREQ(i.token_literal(), "true");
+    EXPECT_EQ(i.token_literal(), "true");
 }
 
 TEST(Parser, PrefixExpression) {
@@ -222,11 +225,11 @@ TEST(Parser, PrefixExpression) {
         Program program = p.parse();
         check_errors(p);
         EXPECT_EQ(program.statements.size(), 1);
-        Statement stmt = program.statements[0];
+        Statement& stmt = program.statements[0];
         EXPECT_EQ(stmt.type, Statement::Type::Expression);
-        auto e = std::get<ExpressionStatement>(stmt.data).exp;
+        auto& e = std::get<ExpressionStatement>(stmt.data).exp;
         EXPECT_EQ(e.type, Expression::Type::Prefix);
-        auto pe = std::get<PrefixExpression>(e.data);
+        auto& pe = std::get<PrefixExpression>(e.data);
         EXPECT_EQ(pe.oper, test.oper);
         test_literal(test.type, (*(pe.right)), test.value, test.lit);
     }
@@ -264,11 +267,11 @@ TEST(Parser, InfixExpression) {
         Parser p(l);
         Program program = p.parse();
         check_errors(p);
-        auto stmt = program.statements[0];
+        auto& stmt = program.statements[0];
         EXPECT_EQ(stmt.type, Statement::Type::Expression);
-        auto e = std::get<ExpressionStatement>(stmt.data).exp;
+        auto& e = std::get<ExpressionStatement>(stmt.data).exp;
         EXPECT_EQ(e.type, Expression::Type::Infix);
-        auto ie = std::get<InfixExpression>(e.data);
+        auto& ie = std::get<InfixExpression>(e.data);
         EXPECT_EQ(ie.oper, test.oper);
         test_literal(test.type, (*ie.left), test.lval, test.lval_lit);
         test_literal(test.type, (*ie.right), test.rval, test.rval_lit);
@@ -327,20 +330,20 @@ TEST(Parser, IfExpression) {
     Program program = p.parse();
     check_errors(p);
     EXPECT_EQ(program.statements.size(), 1);
-    auto stmt = program.statements[0];
+    auto& stmt = program.statements[0];
     EXPECT_EQ(stmt.type, Statement::Type::Expression);
-    auto e = std::get<ExpressionStatement>(stmt.data).exp;
+    auto& e = std::get<ExpressionStatement>(stmt.data).exp;
     EXPECT_EQ(e.type, Expression::Type::If);
-    auto ife = std::get<IfExpression>(e.data);
+    auto& ife = std::get<IfExpression>(e.data);
     EXPECT_EQ(ife.condition->type, Expression::Type::Infix);
-    auto infix = std::get<InfixExpression>(ife.condition->data);
+    auto& infix = std::get<InfixExpression>(ife.condition->data);
     test_identifier((*infix.left), "x");
     test_identifier((*infix.right), "y");
 
     EXPECT_EQ(ife.consequence.stmts.size(), 1);
-    auto conseq_stmt = ife.consequence.stmts[0];
+    auto& conseq_stmt = ife.consequence.stmts[0];
     EXPECT_EQ(conseq_stmt.type, Statement::Type::Expression);
-    auto conseq_exp = std::get<ExpressionStatement>(conseq_stmt.data).exp;
+    auto& conseq_exp = std::get<ExpressionStatement>(conseq_stmt.data).exp;
     test_identifier(conseq_exp, "x");
     EXPECT_EQ(ife.alternative.has_value(), false);
 }
@@ -352,27 +355,27 @@ TEST(Parser, IfElseExpression) {
     Program program = p.parse();
     check_errors(p);
     EXPECT_EQ(program.statements.size(), 1);
-    auto stmt = program.statements[0];
+    auto& stmt = program.statements[0];
     EXPECT_EQ(stmt.type, Statement::Type::Expression);
-    auto e = std::get<ExpressionStatement>(stmt.data).exp;
+    auto& e = std::get<ExpressionStatement>(stmt.data).exp;
     EXPECT_EQ(e.type, Expression::Type::If);
-    auto ife = std::get<IfExpression>(e.data);
+    auto& ife = std::get<IfExpression>(e.data);
     EXPECT_EQ(ife.condition->type, Expression::Type::Infix);
-    auto infix = std::get<InfixExpression>(ife.condition->data);
+    auto& infix = std::get<InfixExpression>(ife.condition->data);
     test_identifier((*infix.left), "x");
     test_identifier((*infix.right), "y");
 
     EXPECT_EQ(ife.consequence.stmts.size(), 1);
-    auto conseq_stmt = ife.consequence.stmts[0];
+    auto& conseq_stmt = ife.consequence.stmts[0];
     EXPECT_EQ(conseq_stmt.type, Statement::Type::Expression);
-    auto conseq_exp = std::get<ExpressionStatement>(conseq_stmt.data).exp;
+    auto& conseq_exp = std::get<ExpressionStatement>(conseq_stmt.data).exp;
     test_identifier(conseq_exp, "x");
 
     EXPECT_EQ(ife.alternative.has_value(), true);
     EXPECT_EQ(ife.alternative->stmts.size(), 1);
-    auto alt_stmt = ife.alternative->stmts[0];
+    auto& alt_stmt = ife.alternative->stmts[0];
     EXPECT_EQ(alt_stmt.type, Statement::Type::Expression);
-    auto alt_exp = std::get<ExpressionStatement>(alt_stmt.data).exp;
+    auto& alt_exp = std::get<ExpressionStatement>(alt_stmt.data).exp;
     test_identifier(alt_exp, "y");
 }
 
@@ -383,11 +386,11 @@ TEST(Parser, Functions) {
     Program program = p.parse();
     check_errors(p);
     EXPECT_EQ(program.statements.size(), 1);
-    auto stmt = program.statements[0];
+    auto& stmt = program.statements[0];
     EXPECT_EQ(stmt.type, Statement::Type::Expression);
-    auto e = std::get<ExpressionStatement>(stmt.data).exp;
+    auto& e = std::get<ExpressionStatement>(stmt.data).exp;
     EXPECT_EQ(e.type, Expression::Type::Function);
-    auto fn = std::get<FunctionLiteral>(e.data);
+    auto& fn = *std::get<FunctionLiteral*>(e.data);
     EXPECT_EQ(fn.params.size(), 2);
     test_ident(fn.params[0], "x");
     test_ident(fn.params[1], "y");
@@ -409,15 +412,15 @@ TEST(Parser, FunctionParams) {
         size_t j;
         check_errors(p);
         EXPECT_EQ(program.statements.size(), 1);
-        auto stmt = program.statements[0];
+        auto& stmt = program.statements[0];
         EXPECT_EQ(stmt.type, Statement::Type::Expression);
-        auto e = std::get<ExpressionStatement>(stmt.data).exp;
+        auto& e = std::get<ExpressionStatement>(stmt.data).exp;
         EXPECT_EQ(e.type, Expression::Type::Function);
-        auto fn = std::get<FunctionLiteral>(e.data);
+        auto& fn = *std::get<FunctionLiteral*>(e.data);
         EXPECT_EQ(fn.params.size(), test.exp_len);
         for (j = 0; j < test.exp_len; ++j) {
             const char* exp = test.exps[j];
-            auto param = fn.params[j];
+            auto& param = fn.params[j];
             test_ident(param, exp);
         }
     }
@@ -430,11 +433,211 @@ TEST(Parser, Call) {
     Program program = p.parse();
     check_errors(p);
     EXPECT_EQ(program.statements.size(), 1);
-    auto stmt = program.statements[0];
+    auto& stmt = program.statements[0];
     EXPECT_EQ(stmt.type, Statement::Type::Expression);
-    auto exp = std::get<ExpressionStatement>(stmt.data).exp;
+    auto& exp = std::get<ExpressionStatement>(stmt.data).exp;
     EXPECT_EQ(exp.type, Expression::Type::Call);
-    auto call = std::get<CallExpression>(exp.data);
+    auto& call = std::get<CallExpression>(exp.data);
     test_identifier((*call.function), "add");
     EXPECT_EQ(call.arguments.size(), 3);
 }
+
+TEST(Parser, FlatMatchesTree) {
+    const char* tests[] = {
+        "let x = 5; let y = true; let foobar = y;",
+        "return 5; return add(1, 2);",
+        "-a * b + !c / d",
+        "a + add(b * c) + d",
+        "add(a, b, 1, 2 * 3, 4 + 5, add(6, 7 * 8))",
+        "if (x < y) { x }",
+        "if (x < y) { let z = x; z } else { return y; }",
+        "let add = fn(x, y) { x + y; }; add(1, 2)(3)",
+        "fn() {}",
+        "let f = fn(n) { if (n == 0) { 1 } else { n * f(n - 1) } }; f(5);",
+        "let x 5; let = 10; let 838383;",
+        "(1 + 2; if (x { 1 }",
+    };
+
+    for (auto input : tests) {
+        std::string s(input);
+        Lexer tl(s);
+        Parser tp(tl);
+        Program program = tp.parse();
+        Lexer fl(s);
+        Parser fp(fl);
+        FlatAst ast = fp.parse_flat();
+        EXPECT_EQ(ast.string(), program.string()) << input;
+        EXPECT_EQ(fp.get_errors(), tp.get_errors()) << input;
+    }
+}
+
+TEST(Parser, TokenSources) {
+    const char* tests[] = {
+        "let x = 5; let y = true; let foobar = y;",
+        "-a * b + !c / d",
+        "let f = fn(n) { if (n == 0) { 1 } else { n * f(n - 1) } }; f(5);",
+        "let x 5; let = 10; let 838383;",
+        "(1 + 2; if (x { 1 }",
+        "",
+    };
+
+    for (auto input : tests) {
+        std::string s(input);
+        Lexer l(s);
+        Parser lp(l);
+        Program program = lp.parse();
+        TokenBuffer tokens(s);
+        Parser bp(tokens);
+        EXPECT_EQ(bp.parse().string(), program.string()) << input;
+        EXPECT_EQ(bp.get_errors(), lp.get_errors()) << input;
+        Parser fp(tokens);
+        EXPECT_EQ(fp.parse_flat().string(), program.string()) << input;
+        TokenPipe pipe(s);
+        Parser pp(pipe);
+        EXPECT_EQ(pp.parse().string(), program.string()) << input;
+        EXPECT_EQ(pp.get_errors(), lp.get_errors()) << input;
+    }
+}
+
+TEST(Parser, ParallelMatchesSerial) {
+    std::string generated;
+    int i;
+    for (i = 0; i < 300; ++i) {
+        std::string n = std::to_string(i);
+        generated.append("let f = fn(a) { if (a) { a; b; } }; f(" + n +
+                         ");\n");
+    }
+    const std::string tests[] = {
+        generated,
+        "let x = 5; let y = true; let foobar = y;",
+        "let x = 5 let y = 6; x y; (1 + 2) * 3;",
+        "let x 5; let = 10; let 838383;",
+        "(1 + 2; if (x { 1 }; let y = 1;",
+        "if (a) { - }; let y = 1; }; let z = 2;",
+        ";;",
+        "",
+    };
+    ThreadPool pool(4);
+    for (auto& input : tests) {
+        TokenBuffer tokens(input);
+        Parser sp(tokens);
+        std::string exp = sp.parse().string();
+        for (size_t min_chunk : {1, 3, 64, PARSE_MIN_CHUNK}) {
+            std::vector<std::string> errors;
+            Program program = parse_parallel(tokens, pool, errors, min_chunk);
+            EXPECT_EQ(program.string(), exp) << input;
+            EXPECT_EQ(errors, sp.get_errors()) << input;
+        }
+    }
+}
+
+TEST(Parser, DeepNesting) {
+    std::string parens = std::string(100000, '(') + "1" +
+                         std::string(100000, ')') + "; let x = 1;";
+    std::string ifs;
+    for (int i = 0; i < 100000; ++i) {
+        ifs.append("if (x) { ");
+    }
+    /* operators chain without nesting frames, but make as tall a tree */
+    std::string chain = "1";
+    for (int i = 0; i < 100000; ++i) {
+        chain.append(" + 1");
+    }
+    /* and a group's height carries into the chain it starts */
+    std::string groups = "1";
+    for (int i = 0; i < 10; ++i) {
+        groups = "(" + groups + ")";
+        for (int j = 0; j < 500; ++j) {
+            groups.append(" + 1");
+        }
+    }
+
+    for (auto& input : {parens, ifs, chain, groups}) {
+        Lexer tl(input);
+        Parser tp(tl);
+        Program program = tp.parse();
+        std::vector<std::string> exp = {"expression nested deeper than " +
+                                        std::to_string(PARSER_MAX_DEPTH)};
+        EXPECT_EQ(tp.get_errors(), exp);
+        EXPECT_EQ(program.statements.size(), 0);
+        Lexer fl(input);
+        Parser fp(fl);
+        FlatAst ast = fp.parse_flat();
+        EXPECT_EQ(fp.get_errors(), exp);
+    }
+
+    /* the tree parser's depth is only bounded by memory */
+    Lexer l(parens);
+    Parser p(l);
+    p.set_max_depth(SIZE_MAX);
+    Program program = p.parse();
+    check_errors(p);
+    EXPECT_EQ(program.string(), "1let x = 1;");
+}
+
+TEST(Parser, Lazy) {
+    std::string input = "let f = fn(x, y) { let g = fn() { x }; g() + y };"
+                        "f(1, 2); fn() { if (a) { b } }(); fn() { x";
+    TokenBuffer tokens(input);
+    Parser lp(tokens);
+    lp.set_lazy(true);
+    Program program = lp.parse();
+    Lexer l(input);
+    Parser ep(l);
+    Program eager = ep.parse();
+    /* the unclosed body is parsed up front, so its errors are too */
+    EXPECT_EQ(lp.get_errors(), ep.get_errors());
+
+    LetStatement& let = std::get<LetStatement>(program.statements[0].data);
+    FunctionLiteral* f = std::get<FunctionLiteral*>(let.value.data);
+    ASSERT_NE(f->lazy, nullptr);
+    EXPECT_FALSE(f->body_parsed());
+    EXPECT_EQ(f->body.stmts.size(), 0);
+    EXPECT_EQ(f->string(), "fn(x, y) { let g = fn() { x }; g() + y }");
+
+    EXPECT_EQ(Parser::load_body(*f).size(), 0);
+    ASSERT_EQ(f->body.stmts.size(), 2);
+    LetStatement& inner = std::get<LetStatement>(f->body.stmts[0].data);
+    FunctionLiteral* g = std::get<FunctionLiteral*>(inner.value.data);
+    EXPECT_FALSE(g->body_parsed());
+    Parser::load_body(*g);
+    ExpressionStatement& call =
+        std::get<ExpressionStatement>(program.statements[2].data);
+    Expression* callee = std::get<CallExpression>(call.exp.data).function;
+    Parser::load_body(*std::get<FunctionLiteral*>(callee->data));
+    EXPECT_EQ(program.string(), eager.string());
+}
+
+TEST(Parser, FlatLayout) {
+    std::string input = "let a = fn(x, y) { x + y }; a(1, a);";
+    Lexer l(input);
+    Parser p(l);
+    FlatAst ast = p.parse_flat();
+    check_errors(p);
+    EXPECT_EQ(ast.statements.size(), 2);
+    std::vector<std::string> names = {"a", "x", "y"};
+    EXPECT_EQ(ast.names, names);
+    std::vector<int64_t> integers = {1};
+    EXPECT_EQ(ast.integers, integers);
+
+    NodeIndex let = ast.statements[0];
+    EXPECT_EQ(ast.kinds[let], FlatAst::Kind::Let);
+    EXPECT_EQ(ast.names[ast.lhs[let]], "a");
+    NodeIndex fn = ast.rhs[let];
+    EXPECT_EQ(ast.kinds[fn], FlatAst::Kind::Function);
+    EXPECT_EQ(ast.list_size(ast.lhs[fn]), 2);
+    NodeIndex body = ast.rhs[fn];
+    EXPECT_EQ(ast.kinds[body], FlatAst::Kind::Block);
+    EXPECT_EQ(ast.list_size(ast.lhs[body]), 1);
+    NodeIndex infix = ast.lhs[ast.list_items(ast.lhs[body])[0]];
+    EXPECT_EQ(ast.kinds[infix], FlatAst::Kind::Infix);
+    EXPECT_EQ((InfixExpression::Operator)ast.opers[infix],
+              InfixExpression::Operator::Plus);
+
+    NodeIndex call = ast.lhs[ast.statements[1]];
+    EXPECT_EQ(ast.kinds[call], FlatAst::Kind::Call);
+    EXPECT_EQ(ast.list_size(ast.rhs[call]), 2);
+    /* children are made before their parents */
+    EXPECT_LT(ast.lhs[call], call);
+    EXPECT_EQ(ast.lhs[ast.lhs[call]], ast.lhs[let]);
+}
@@ -0,0 +1,167 @@
+#include "../src/ast.hh"
+#include "../src/lexer.hh"
+#include "../src/object.hh"
+#include "../src/parser.hh"
+#include "../src/resolver.hh"
+#include <gtest/gtest.h>
+
+#define test_address(ident, exp_depth, exp_slot)                               \
+    do {                                                                       \
+        EXPECT_EQ(ident.depth, exp_depth);                                     \
+        EXPECT_EQ(ident.slot, exp_slot);                                       \
+    } while (0)
+
+TEST(Resolver, Globals) {
+    std::string input = "let a = 1; let b = 2; let a = b; c;";
+    Lexer l(input);
+    Parser p(l);
+    Program program = p.parse();
+    Environment env;
+    resolve(program, env);
+    EXPECT_EQ(env.slots.size(), 2);
+
+    auto& first = std::get<LetStatement>(program.statements[0].data);
+    test_address(first.name, 0, 0);
+    auto& second = std::get<LetStatement>(program.statements[1].data);
+    test_address(second.name, 0, 1);
+    auto& third = std::get<LetStatement>(program.statements[2].data);
+    test_address(third.name, 0, 0);
+    test_address(std::get<Identifier>(third.value.data), 0, 1);
+    auto& unbound = std::get<ExpressionStatement>(program.statements[3].data);
+    test_address(std::get<Identifier>(unbound.exp.data), -1, -1);
+}
+
+TEST(Resolver, Functions) {
+    std::string input = "\
+let g = 1;\
+let f = fn(x, y) {\
+    let z = x;\
+    fn(w) { w + z + g + later };\
+};\
+let later = 2;";
+    Lexer l(input);
+    Parser p(l);
+    Program program = p.parse();
+    Environment env;
+    resolve(program, env);
+    EXPECT_EQ(env.slots.size(), 3);
+
+    auto& let_f = std::get<LetStatement>(program.statements[1].data);
+    auto& outer = *std::get<FunctionLiteral*>(let_f.value.data);
+    EXPECT_EQ(outer.num_slots, 3);
+    test_address(outer.params[0], 0, 0);
+    test_address(outer.params[1], 0, 1);
+
+    auto& inner_stmt =
+        std::get<ExpressionStatement>(outer.body.stmts[1].data);
+    auto& inner =
+        *std::get<FunctionLiteral*>(inner_stmt.exp.data);
+    EXPECT_EQ(inner.num_slots, 1);
+    auto& body = std::get<ExpressionStatement>(inner.body.stmts[0].data);
+
+    /* ((w + z) + g) + later */
+    auto& sum = std::get<InfixExpression>(body.exp.data);
+    test_address(std::get<Identifier>(sum.right->data), 2, 2);
+    auto& sum2 = std::get<InfixExpression>(sum.left->data);
+    test_address(std::get<Identifier>(sum2.right->data), 2, 0);
+    auto& sum3 = std::get<InfixExpression>(sum2.left->data);
+    test_address(std::get<Identifier>(sum3.left->data), 0, 0);
+    test_address(std::get<Identifier>(sum3.right->data), 1, 2);
+}
+
+TEST(Resolver, Shadowing) {
+    std::string input = "\
+let x = 5;\
+let f = fn() {\
+    let y = x;\
+    let x = x + 1;\
+    let g = fn() { later };\
+    let later = x;\
+};";
+    Lexer l(input);
+    Parser p(l);
+    Program program = p.parse();
+    Environment env;
+    resolve(program, env);
+
+    auto& let_f = std::get<LetStatement>(program.statements[1].data);
+    auto& f = *std::get<FunctionLiteral*>(let_f.value.data);
+    EXPECT_EQ(f.num_slots, 4);
+    /* later is used by g before its let, so it is declared first */
+    auto& let_y = std::get<LetStatement>(f.body.stmts[0].data);
+    test_address(let_y.name, 0, 1);
+    test_address(std::get<Identifier>(let_y.value.data), 1, 0);
+    auto& let_x = std::get<LetStatement>(f.body.stmts[1].data);
+    test_address(let_x.name, 0, 2);
+    auto& sum = std::get<InfixExpression>(let_x.value.data);
+    test_address(std::get<Identifier>(sum.left->data), 1, 0);
+    auto& let_g = std::get<LetStatement>(f.body.stmts[2].data);
+    auto& g = *std::get<FunctionLiteral*>(let_g.value.data);
+    auto& body = std::get<ExpressionStatement>(g.body.stmts[0].data);
+    test_address(std::get<Identifier>(body.exp.data), 1, 0);
+    auto& let_later = std::get<LetStatement>(f.body.stmts[3].data);
+    test_address(let_later.name, 0, 0);
+    test_address(std::get<Identifier>(let_later.value.data), 0, 2);
+}
+
+static void tail_flags(const std::vector<Statement>& stmts,
+                       std::vector<bool>& flags);
+
+/* the tail flag of every call under exp, in source order */
+static void tail_flags(const Expression& exp, std::vector<bool>& flags) {
+    switch (exp.type) {
+    case Expression::Type::Infix: {
+        auto& infix = std::get<InfixExpression>(exp.data);
+        tail_flags(*infix.left, flags);
+        tail_flags(*infix.right, flags);
+    } break;
+    case Expression::Type::If: {
+        auto& ife = std::get<IfExpression>(exp.data);
+        tail_flags(ife.consequence.stmts, flags);
+        if (ife.alternative.has_value()) {
+            tail_flags(ife.alternative->stmts, flags);
+        }
+    } break;
+    case Expression::Type::Function:
+        tail_flags(std::get<FunctionLiteral*>(exp.data)->body.stmts, flags);
+        break;
+    case Expression::Type::Call:
+        flags.push_back(std::get<CallExpression>(exp.data).tail);
+        break;
+    default:
+        break;
+    }
+}
+
+static void tail_flags(const std::vector<Statement>& stmts,
+                       std::vector<bool>& flags) {
+    for (auto& stmt : stmts) {
+        if (stmt.type == Statement::Type::Let) {
+            tail_flags(std::get<LetStatement>(stmt.data).value, flags);
+        } else if (stmt.type == Statement::Type::Ret) {
+            tail_flags(std::get<ReturnStatement>(stmt.data).value, flags);
+        } else if (stmt.type == Statement::Type::Expression) {
+            tail_flags(std::get<ExpressionStatement>(stmt.data).exp, flags);
+        }
+    }
+}
+
+TEST(Resolver, TailCalls) {
+    std::string input = "\
+f(1);\
+let f = fn(n) {\
+    if (n) { return f(n); };\
+    let a = f(n);\
+    if (n) { f(n) } else { n + f(n) }\
+};";
+    Lexer l(input);
+    Parser p(l);
+    Program program = p.parse();
+    Environment env;
+    resolve(program, env);
+
+    std::vector<bool> flags;
+    tail_flags(program.statements, flags);
+    std::vector<bool> exp = {false, true, false, true, false};
+    EXPECT_EQ(flags, exp);
+}
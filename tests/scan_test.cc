@@ -0,0 +1,83 @@
+#include "../src/lexer.hh"
+#include "../src/scan.hh"
+#include <cstdlib>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+static const ScanImpl impls[] = {ScanImpl::Scalar, ScanImpl::Sse2,
+                                  ScanImpl::Avx2};
+
+/* runs of every class and length, broken by bytes on both sides of each
+ * class's range */
+static std::string make_input() {
+    const char* alphabet[] = {" \t\r\n", "abcxyzABCXYZ_", "0123456789",
+                              "@[`{/:\x7f\x80\xff+=;"};
+    std::string out;
+    std::srand(42);
+    for (int i = 0; i < 4000; ++i) {
+        const char* set = alphabet[std::rand() % 4];
+        int run = std::rand() % 70;
+        int set_len = std::strlen(set);
+        for (int j = 0; j < run; ++j) {
+            out.push_back(set[std::rand() % set_len]);
+        }
+    }
+    return out;
+}
+
+TEST(Scan, ImplementationsAgree) {
+    std::string input = make_input();
+    const char* s = input.data();
+    size_t len = input.size();
+    ScanImpl saved = scan_impl();
+    std::vector<size_t> exp[3];
+    ASSERT_TRUE(scan_use(ScanImpl::Scalar));
+    for (size_t pos = 0; pos < len; ++pos) {
+        exp[0].push_back(scan_spaces(s, pos, len));
+        exp[1].push_back(scan_letters(s, pos, len));
+        exp[2].push_back(scan_digits(s, pos, len));
+    }
+    for (auto impl : impls) {
+        if (!scan_use(impl)) {
+            continue;
+        }
+        for (size_t pos = 0; pos < len; ++pos) {
+            ASSERT_EQ(scan_spaces(s, pos, len), exp[0][pos]) << pos;
+            ASSERT_EQ(scan_letters(s, pos, len), exp[1][pos]) << pos;
+            ASSERT_EQ(scan_digits(s, pos, len), exp[2][pos]) << pos;
+        }
+    }
+    scan_use(saved);
+}
+
+TEST(Scan, LexerAgrees) {
+    std::string input;
+    for (int i = 0; i < 200; ++i) {
+        input.append(std::string(i % 40, ' '));
+        input.append("let a_rather_long_identifier_for_the_vector_path" +
+                     std::to_string(i) + " = 1234567890123456789012 + x;\n");
+    }
+    ScanImpl saved = scan_impl();
+    ASSERT_TRUE(scan_use(ScanImpl::Scalar));
+    std::vector<Token> exp;
+    Lexer l(input);
+    do {
+        exp.push_back(l.next_token());
+    } while (exp.back().type != Token::Type::Eof);
+    for (auto impl : impls) {
+        if (!scan_use(impl)) {
+            continue;
+        }
+        Lexer l(input);
+        for (auto& tok : exp) {
+            Token got = l.next_token();
+            EXPECT_EQ(got.type, tok.type);
+            EXPECT_EQ(got.offset, tok.offset);
+            EXPECT_EQ(got.length, tok.length);
+            EXPECT_EQ(got.value, tok.value);
+        }
+    }
+    scan_use(saved);
+}
@@ -0,0 +1,89 @@
+#include "../src/lexer.hh"
+#include "../src/parser.hh"
+#include "../src/source.hh"
+#include <cstdio>
+#include <gtest/gtest.h>
+#include <string>
+#include <unistd.h>
+
+static std::string write_temp(const std::string& text) {
+    char path[] = "/tmp/monkey_source_XXXXXX";
+    int fd = mkstemp(path);
+    EXPECT_GE(fd, 0);
+    EXPECT_EQ(write(fd, text.data(), text.size()), (ssize_t)text.size());
+    close(fd);
+    return path;
+}
+
+TEST(Source, MappedFileLexesLikeString) {
+    std::string text = "let add = fn(x, y) { x + y };\nadd(1, 22);\n";
+    std::string path = write_temp(text);
+    std::string err;
+    auto mapped = Source::map_file(path, err);
+    ASSERT_NE(mapped, nullptr) << err;
+    EXPECT_TRUE(mapped->is_mapped());
+    EXPECT_EQ(mapped->text(), text);
+
+    Source owned(text);
+    EXPECT_FALSE(owned.is_mapped());
+    Lexer ml(*mapped);
+    Lexer ol(owned);
+    Token mt, ot;
+    do {
+        mt = ml.next_token();
+        ot = ol.next_token();
+        EXPECT_EQ(mt.type, ot.type);
+        EXPECT_EQ(mt.get_literal(mapped->text()), ot.get_literal(text));
+        /* tokens point into the mapping itself */
+        EXPECT_EQ(mt.get_literal(mapped->text()).data(),
+                  mapped->text().data() + mt.offset);
+    } while (mt.type != Token::Type::Eof);
+    std::remove(path.c_str());
+}
+
+TEST(Source, ProgramOutlivesMapping) {
+    std::string path = write_temp("let name = fn(value) { value * 3 };");
+    std::string err;
+    Program program;
+    {
+        auto src = Source::map_file(path, err);
+        ASSERT_NE(src, nullptr) << err;
+        Lexer l(*src);
+        Parser p(l);
+        program = p.parse();
+    }
+    std::remove(path.c_str());
+    EXPECT_EQ(program.string(), "let name = fn(value) (value * 3);");
+}
+
+TEST(Source, EmptyFile) {
+    std::string path = write_temp("");
+    std::string err;
+    auto src = Source::map_file(path, err);
+    ASSERT_NE(src, nullptr) << err;
+    EXPECT_EQ(src->text().size(), 0);
+    Lexer l(*src);
+    EXPECT_EQ(l.next_token().type, Token::Type::Eof);
+    std::remove(path.c_str());
+}
+
+TEST(Source, MissingFile) {
+    std::string err;
+    auto src = Source::map_file("/nonexistent/monkey/script", err);
+    EXPECT_EQ(src, nullptr);
+    EXPECT_EQ(err, "/nonexistent/monkey/script: No such file or directory");
+}
+
+TEST(Source, Pipe) {
+    int fds[2];
+    ASSERT_EQ(pipe(fds), 0);
+    std::string text = "5 + 5";
+    ASSERT_EQ(write(fds[1], text.data(), text.size()), (ssize_t)text.size());
+    close(fds[1]);
+    std::string err;
+    auto src = Source::map_file("/dev/fd/" + std::to_string(fds[0]), err);
+    close(fds[0]);
+    ASSERT_NE(src, nullptr) << err;
+    EXPECT_FALSE(src->is_mapped());
+    EXPECT_EQ(src->text(), text);
+}
@@ -0,0 +1,149 @@
+#include "../src/spsc_ring.hh"
+#include "../src/thread_pool.hh"
+#include "../src/token_buffer.hh"
+#include "../src/token_pipe.hh"
+#include "../src/tokenize.hh"
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define expect_same_tokens(got, exp)                                           \
+    do {                                                                       \
+        ASSERT_EQ(got.size(), exp.size());                                     \
+        for (size_t i = 0; i < exp.size(); ++i) {                              \
+            EXPECT_EQ(got[i].type, exp[i].type) << i;                          \
+            EXPECT_EQ(got[i].offset, exp[i].offset) << i;                      \
+            EXPECT_EQ(got[i].length, exp[i].length) << i;                      \
+            EXPECT_EQ(got[i].value, exp[i].value) << i;                        \
+        }                                                                      \
+    } while (0)
+
+static std::string make_source(size_t statements) {
+    std::string out;
+    for (size_t i = 0; i < statements; ++i) {
+        std::string n = std::to_string(i);
+        out.append("let f" + n + " = fn(a, b) { if (a == b) { a != " + n +
+                   " } else {\n\t!f" + n + "(b,-a) } };");
+        out.append(i % 3 == 0 ? "\n" : "  ");
+    }
+    return out;
+}
+
+TEST(Tokenize, MatchesSequential) {
+    std::string input = make_source(2000);
+    std::vector<Token> exp = tokenize(input);
+    size_t threads[] = {1, 2, 3, 8};
+    size_t chunks[] = {1, 7, 64, 4096, TOKENIZE_MIN_CHUNK};
+    for (auto n : threads) {
+        ThreadPool pool(n);
+        for (auto min_chunk : chunks) {
+            std::vector<Token> got = tokenize_parallel(input, pool, min_chunk);
+            expect_same_tokens(got, exp);
+        }
+    }
+}
+
+TEST(Tokenize, EdgeCases) {
+    std::string nul("let a = 1;\nlet b = 2;\0 let c = 3;\n", 33);
+    const std::string inputs[] = {
+        "",
+        "   \n\t  ",
+        "nowhitespaceatallinthisinput;let=1;fn(){}",
+        "x1==y2!=z3",
+        nul,
+    };
+    ThreadPool pool(4);
+    for (auto& input : inputs) {
+        std::vector<Token> exp = tokenize(input);
+        std::vector<Token> got = tokenize_parallel(input, pool, 1);
+        expect_same_tokens(got, exp);
+    }
+}
+
+TEST(TokenBuffer, MatchesTokenize) {
+    std::string input = make_source(200);
+    std::vector<Token> exp = tokenize(input);
+    ThreadPool pool(2);
+    TokenBuffer lexed(input);
+    TokenBuffer joined(input, tokenize_parallel(input, pool, 64));
+    for (auto buf : {&lexed, &joined}) {
+        std::vector<Token> got;
+        for (size_t i = 0; i < buf->size(); ++i) {
+            got.push_back(buf->get(i));
+        }
+        expect_same_tokens(got, exp);
+        /* reading past the end keeps giving the Eof */
+        EXPECT_EQ(buf->get(buf->size() + 5).type, Token::Type::Eof);
+    }
+}
+
+TEST(TokenBuffer, Empty) {
+    TokenBuffer buf("");
+    EXPECT_EQ(buf.size(), 1);
+    EXPECT_EQ(buf.get(0).type, Token::Type::Eof);
+    EXPECT_EQ(buf.get(1).type, Token::Type::Eof);
+}
+
+TEST(SpscRing, KeepsOrder) {
+    SpscRing<int, 4> ring;
+    const int count = 100000;
+    std::thread producer([&ring] {
+        for (int i = 0; i < count; ++i) {
+            int* slot;
+            while ((slot = ring.back()) == nullptr) {
+                std::this_thread::yield();
+            }
+            *slot = i;
+            ring.push();
+        }
+    });
+    for (int i = 0; i < count; ++i) {
+        int* slot;
+        while ((slot = ring.front()) == nullptr) {
+            std::this_thread::yield();
+        }
+        ASSERT_EQ(*slot, i);
+        ring.pop();
+    }
+    EXPECT_EQ(ring.front(), nullptr);
+    producer.join();
+}
+
+TEST(TokenPipe, MatchesTokenize) {
+    /* enough tokens to wrap the ring several times */
+    std::string nul("let a = 1;\0 let b = 2;", 22);
+    const std::string inputs[] = {"", "x", nul, make_source(5000)};
+    for (auto& input : inputs) {
+        std::vector<Token> exp = tokenize(input);
+        TokenPipe pipe(input);
+        std::vector<Token> got;
+        do {
+            got.push_back(pipe.next_token());
+        } while (got.back().type != Token::Type::Eof);
+        expect_same_tokens(got, exp);
+        EXPECT_EQ(pipe.next_token().type, Token::Type::Eof);
+    }
+}
+
+TEST(TokenPipe, StopsEarly) {
+    std::string input = make_source(5000);
+    TokenPipe pipe(input);
+    EXPECT_EQ(pipe.next_token().type, Token::Type::Let);
+    /* destroying the pipe must not wait for the whole input to be read */
+}
+
+TEST(ThreadPool, RunsEveryJob) {
+    std::vector<int> out(100);
+    std::vector<std::future<void>> done;
+    {
+        ThreadPool pool(4);
+        EXPECT_EQ(pool.size(), 4);
+        for (int i = 0; i < 100; ++i) {
+            done.push_back(pool.submit([&out, i] { out[i] = i * i; }));
+        }
+    }
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_EQ(out[i], i * i);
+    }
+}